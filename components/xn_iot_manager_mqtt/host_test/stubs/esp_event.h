@@ -0,0 +1,12 @@
+/*
+ * 主机测试桩：esp_event.h
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef const char *esp_event_base_t;
+
+#define ESP_EVENT_ANY_ID -1
+
+typedef void (*esp_event_handler_t)(void *arg, esp_event_base_t base, int32_t id, void *data);
@@ -0,0 +1,16 @@
+/*
+ * 主机测试桩：esp_log.h（默认只输出 E，HOST_TEST_VERBOSE=1 时全部输出；
+ *             测试可置 host_log_quiet 屏蔽预期中的错误日志）
+ */
+#pragma once
+
+#include <stdio.h>
+
+extern int host_log_verbose;
+extern int host_log_quiet;
+
+#define ESP_LOGE(tag, fmt, ...) do { if (!host_log_quiet || host_log_verbose) fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGW(tag, fmt, ...) do { if (host_log_verbose) fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, fmt, ...) do { if (host_log_verbose) fprintf(stderr, "I %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGD(tag, fmt, ...) do { if (host_log_verbose) fprintf(stderr, "D %s: " fmt "\n", tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGV(tag, fmt, ...) do { (void)(tag); } while (0)
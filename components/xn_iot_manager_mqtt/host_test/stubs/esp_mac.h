@@ -0,0 +1,12 @@
+/*
+ * 主机测试桩：esp_mac.h（返回固定 MAC）
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define ESP_MAC_WIFI_STA 0
+
+esp_err_t esp_read_mac(uint8_t *mac, int type);
@@ -0,0 +1,8 @@
+/*
+ * 主机测试桩：esp_random.h（可复现的伪随机数，种子由 host_random_seed 设置）
+ */
+#pragma once
+
+#include <stdint.h>
+
+uint32_t esp_random(void);
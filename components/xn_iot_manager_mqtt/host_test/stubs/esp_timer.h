@@ -0,0 +1,8 @@
+/*
+ * 主机测试桩：esp_timer.h（时间由测试用 host_clock_advance_us 推进）
+ */
+#pragma once
+
+#include <stdint.h>
+
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,34 @@
+/*
+ * 主机测试桩：freertos/FreeRTOS.h（单线程，1 tick = 1 ms，时间取自虚拟时钟）
+ *
+ * 被测代码在主机上只有一个线程，临界区因此为空操作。
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+
+#define pdPASS               1
+#define pdFAIL               0
+#define pdTRUE               1
+#define pdFALSE              0
+#define portMAX_DELAY        0xFFFFFFFFu
+#define portTICK_PERIOD_MS   1
+#define configTICK_RATE_HZ   1000
+#define configMAX_PRIORITIES 25
+#define tskIDLE_PRIORITY     0
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+#define pdTICKS_TO_MS(t)     ((uint32_t)(t))
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+#define portMUX_INITIALIZE(mux)      ((void)(mux))
+#define portENTER_CRITICAL(mux)      ((void)(mux))
+#define portEXIT_CRITICAL(mux)       ((void)(mux))
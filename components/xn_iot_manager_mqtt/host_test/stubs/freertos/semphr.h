@@ -0,0 +1,15 @@
+/*
+ * 主机测试桩：freertos/semphr.h（计数信号量 / 互斥量，计数可由 host_sem_count 读取）
+ */
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef struct host_sem *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t sem);
+void              vSemaphoreDelete(SemaphoreHandle_t sem);
@@ -0,0 +1,21 @@
+/*
+ * 主机测试桩：freertos/task.h
+ *
+ * xTaskCreate 只登记不运行（被测模块的常驻任务在主机上不执行），
+ * 需要阻塞的调用通过 host_rtos_set_wait_hook 交给测试推进虚拟时钟。
+ */
+#pragma once
+
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t   xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                         UBaseType_t prio, TaskHandle_t *out);
+void         vTaskDelete(TaskHandle_t task);
+void         vTaskDelay(TickType_t ticks);
+TickType_t   xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+uint32_t     ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
@@ -0,0 +1,229 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-20 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-20 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\stubs\host_mgr_deps.c
+ * @Description: 主机测试桩：web_mqtt_manager 依赖的模块（MQTT 客户端、服务器列表、注册、心跳、RPC、事件循环）
+ *
+ * 直接包含 web_mqtt_manager.c 的测试只验证管理器自身的逻辑（路由、退避等），
+ * 下层模块在这里以“总是成功、不产生事件”的方式替代。
+ */
+
+#include <string.h>
+
+#include "mqtt_broker_module.h"
+#include "mqtt_heartbeat_module.h"
+#include "mqtt_module.h"
+#include "mqtt_reg_module.h"
+#include "mqtt_rpc_module.h"
+#include "xn_loop.h"
+
+#include "host_stubs.h"
+
+/* -------------------- mqtt_module（默认实例） -------------------- */
+
+static int s_msg_id = 0;                           ///< 假订阅报文 ID
+
+esp_err_t mqtt_module_init(const mqtt_module_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_start(void)
+{
+    return ESP_OK;
+}
+
+bool mqtt_module_session_present(void)
+{
+    return false;
+}
+
+esp_err_t mqtt_module_stop(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_set_uri(const char *uri)
+{
+    (void)uri;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_subscribe_multiple(const mqtt_module_topic_t *topics, int num, int *msg_id)
+{
+    (void)topics;
+    (void)num;
+    if (msg_id != NULL) {
+        *msg_id = ++s_msg_id;
+    }
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_unsubscribe(const char *topic)
+{
+    (void)topic;
+    return ESP_OK;
+}
+
+bool mqtt_module_rx_get_props(mqtt_module_msg_props_t *out)
+{
+    (void)out;
+    return false;                                  ///< 测试消息均为 MQTT 3.1.1
+}
+
+bool mqtt_module_rx_detach(const uint8_t *payload)
+{
+    (void)payload;
+    return false;                                  ///< 不在 message_cb 内，无可接管的缓冲区
+}
+
+void mqtt_module_rx_release(const uint8_t *payload)
+{
+    (void)payload;
+}
+
+/* -------------------- 服务器列表：单台服务器 -------------------- */
+
+esp_err_t mqtt_broker_init(const mqtt_broker_config_t *config)
+{
+    (void)config;
+    return ESP_OK;
+}
+
+int mqtt_broker_num(void)
+{
+    return 1;
+}
+
+int mqtt_broker_current(void)
+{
+    return 0;
+}
+
+const char *mqtt_broker_uri(int idx)
+{
+    (void)idx;
+    return "mqtt://127.0.0.1:1883";
+}
+
+int mqtt_broker_select(bool *failover)
+{
+    if (failover != NULL) {
+        *failover = false;
+    }
+    return 0;
+}
+
+void mqtt_broker_set_current(int idx)
+{
+    (void)idx;
+}
+
+void mqtt_broker_on_attempt(int idx)
+{
+    (void)idx;
+}
+
+void mqtt_broker_on_connected(int idx, uint32_t connack_ms)
+{
+    (void)idx;
+    (void)connack_ms;
+}
+
+void mqtt_broker_on_failed(int idx, bool raced)
+{
+    (void)idx;
+    (void)raced;
+}
+
+int mqtt_broker_probe(int exclude)
+{
+    (void)exclude;
+    return -1;
+}
+
+esp_err_t mqtt_broker_get_stats(mqtt_broker_stats_t *out, int max, int *num)
+{
+    (void)out;
+    (void)max;
+    if (num != NULL) {
+        *num = 0;
+    }
+    return ESP_OK;
+}
+
+/* -------------------- 注册 / 心跳 / RPC -------------------- */
+
+esp_err_t mqtt_reg_module_init(const web_mqtt_manager_config_t *mgr_cfg, mqtt_reg_notify_cb_t notify)
+{
+    (void)mgr_cfg;
+    (void)notify;
+    return ESP_OK;
+}
+
+bool mqtt_reg_module_is_registered(void)
+{
+    return true;
+}
+
+void mqtt_reg_module_on_connected(void)
+{
+}
+
+void mqtt_reg_module_on_disconnected(void)
+{
+}
+
+void mqtt_reg_module_on_subscribed(void)
+{
+}
+
+int mqtt_reg_module_step(void)
+{
+    return -1;
+}
+
+esp_err_t mqtt_heartbeat_module_init(const web_mqtt_manager_config_t *mgr_cfg)
+{
+    (void)mgr_cfg;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_rpc_module_init(const web_mqtt_manager_config_t *mgr_cfg)
+{
+    (void)mgr_cfg;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_rpc_register_method(const char *name, mqtt_rpc_method_cb_t cb)
+{
+    (void)name;
+    (void)cb;
+    return ESP_OK;
+}
+
+/* -------------------- 事件循环：定时器只登记不运行 -------------------- */
+
+esp_err_t xn_loop_timer_create(const char *name, xn_loop_cb_t cb, void *arg, xn_loop_timer_t **out)
+{
+    (void)name;
+    (void)cb;
+    (void)arg;
+    *out = NULL;                                   ///< xn_loop_timer_wake(NULL) 为空操作
+    return ESP_OK;
+}
+
+esp_err_t xn_loop_timer_start(xn_loop_timer_t *timer, uint32_t delay_ms)
+{
+    (void)timer;
+    (void)delay_ms;
+    return ESP_OK;
+}
+
+void xn_loop_timer_wake(xn_loop_timer_t *timer)
+{
+    (void)timer;
+}
@@ -0,0 +1,247 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-20 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-20 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\stubs\host_mqtt_client.c
+ * @Description: 主机测试桩：假 esp-mqtt 客户端
+ *
+ * 与 esp-mqtt 一样，QoS>=1 消息连同 Topic 拷贝进堆上的 outbox，收到确认或被删除时才释放；
+ * 确认由测试通过 host_mqtt_complete 按任意顺序注入，事件直接在测试线程中回调。
+ */
+
+#include <string.h>
+
+#include "mqtt_client.h"
+
+#include "host_stubs.h"
+
+#define HOST_MQTT_MSG_OVERHEAD 64                  ///< 按 esp-mqtt outbox 项头部与报文头估算
+
+/**
+ * @brief outbox 中等待确认的一条消息
+ */
+typedef struct host_mqtt_msg {
+    struct host_mqtt_msg *next;   ///< 按发送顺序链接
+    int                   msg_id; ///< 报文 ID
+    size_t                bytes;  ///< 占用的堆字节数
+    char                  data[]; ///< Topic + 负载拷贝
+} host_mqtt_msg_t;
+
+/**
+ * @brief 假客户端
+ */
+struct esp_mqtt_client {
+    esp_event_handler_t handler;   ///< 注册的事件回调
+    void               *arg;       ///< 回调参数
+    bool                started;   ///< 是否已启动
+    uint16_t            next_id;   ///< 下一个报文 ID（1 ~ 65535 回绕）
+    int                 fail_next; ///< 接下来若干次发布返回失败
+    host_mqtt_msg_t    *head;      ///< 最早发出的未确认消息
+    host_mqtt_outbox_t  outbox;    ///< outbox 统计
+};
+
+static esp_mqtt_client_handle_t s_last = NULL;     ///< 最近创建的客户端
+
+esp_mqtt_client_handle_t host_mqtt_last_client(void)
+{
+    return s_last;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    (void)config;
+    esp_mqtt_client_handle_t c = (esp_mqtt_client_handle_t)calloc(1, sizeof(struct esp_mqtt_client));
+    if (c != NULL) {
+        c->next_id = 1;
+        s_last     = c;
+    }
+    return c;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *arg)
+{
+    (void)event;
+    client->handler = handler;
+    client->arg     = arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client, const char *uri)
+{
+    (void)client;
+    (void)uri;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    client->started = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (!client->started) {
+        return ESP_FAIL;
+    }
+    client->started = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    while (client->head != NULL) {
+        host_mqtt_msg_t *m = client->head;
+        client->head = m->next;
+        free(m);
+    }
+    if (s_last == client) {
+        s_last = NULL;
+    }
+    free(client);
+    return ESP_OK;
+}
+
+static int host_mqtt_next_id(esp_mqtt_client_handle_t client)
+{
+    int id = client->next_id;
+    client->next_id = (uint16_t)((client->next_id == UINT16_MAX) ? 1 : client->next_id + 1);
+    return id;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    (void)topic;
+    (void)qos;
+    return host_mqtt_next_id(client);
+}
+
+int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client, const esp_mqtt_topic_t *list, int num)
+{
+    (void)list;
+    (void)num;
+    return host_mqtt_next_id(client);
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic)
+{
+    (void)topic;
+    return host_mqtt_next_id(client);
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain, bool store)
+{
+    (void)retain;
+
+    if (client->fail_next > 0) {
+        client->fail_next--;
+        return -1;
+    }
+    if (len <= 0 && data != NULL) {
+        len = (int)strlen(data);
+    }
+    if (qos == 0 && !store) {
+        return 0;                                  ///< QoS 0 直接写入连接，不进 outbox
+    }
+
+    size_t           topic_len = strlen(topic);
+    size_t           bytes     = sizeof(host_mqtt_msg_t) + topic_len + (size_t)len + HOST_MQTT_MSG_OVERHEAD;
+    host_mqtt_msg_t *m         = (host_mqtt_msg_t *)malloc(bytes);
+    if (m == NULL) {
+        return -1;
+    }
+    memcpy(m->data, topic, topic_len);
+    if (len > 0) {
+        memcpy(m->data + topic_len, data, (size_t)len);
+    }
+    m->next   = NULL;
+    m->msg_id = (qos > 0) ? host_mqtt_next_id(client) : 0;
+    m->bytes  = bytes;
+
+    host_mqtt_msg_t **tail = &client->head;
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = m;
+
+    client->outbox.bytes += bytes;
+    client->outbox.num++;
+    if (client->outbox.bytes > client->outbox.bytes_peak) {
+        client->outbox.bytes_peak = client->outbox.bytes;
+    }
+    if (client->outbox.num > client->outbox.num_peak) {
+        client->outbox.num_peak = client->outbox.num;
+    }
+    return m->msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    return esp_mqtt_client_enqueue(client, topic, data, len, qos, retain, false);
+}
+
+void host_mqtt_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id)
+{
+    esp_mqtt_event_t e = {
+        .event_id = id,
+        .client   = client,
+        .msg_id   = msg_id,
+    };
+    if (client->handler != NULL) {
+        client->handler(client->arg, "MQTT_EVENTS", id, &e);
+    }
+}
+
+int host_mqtt_pending(esp_mqtt_client_handle_t client)
+{
+    return (int)client->outbox.num;
+}
+
+int host_mqtt_peek(esp_mqtt_client_handle_t client, int nth)
+{
+    host_mqtt_msg_t *m = client->head;
+    for (int i = 0; i < nth && m != NULL; ++i) {
+        m = m->next;
+    }
+    return (m != NULL) ? m->msg_id : -1;
+}
+
+int host_mqtt_complete(esp_mqtt_client_handle_t client, int nth, bool deleted)
+{
+    host_mqtt_msg_t **p = &client->head;
+    for (int i = 0; i < nth && *p != NULL; ++i) {
+        p = &(*p)->next;
+    }
+    if (*p == NULL) {
+        return -1;
+    }
+
+    host_mqtt_msg_t *m = *p;
+    *p = m->next;
+    client->outbox.bytes -= m->bytes;
+    client->outbox.num--;
+
+    int id = m->msg_id;
+    free(m);
+    host_mqtt_event(client, deleted ? MQTT_EVENT_DELETED : MQTT_EVENT_PUBLISHED, id);
+    return id;
+}
+
+void host_mqtt_fail_next(esp_mqtt_client_handle_t client, int n)
+{
+    client->fail_next = n;
+}
+
+void host_mqtt_set_next_id(esp_mqtt_client_handle_t client, uint16_t id)
+{
+    client->next_id = (id != 0) ? id : 1;
+}
+
+void host_mqtt_get_outbox(esp_mqtt_client_handle_t client, host_mqtt_outbox_t *out)
+{
+    *out = client->outbox;
+}
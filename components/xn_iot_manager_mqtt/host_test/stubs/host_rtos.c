@@ -0,0 +1,209 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-20 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-20 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\stubs\host_rtos.c
+ * @Description: 主机测试桩：FreeRTOS 任务与信号量（单线程、虚拟时钟）
+ *
+ * 主机上只有测试线程：创建的任务只登记不运行，信号量只是计数。
+ * 调用方需要阻塞等待时交给等待钩子推进虚拟时钟，钩子可以借机模拟其他任务
+ * （例如 esp-mqtt 任务收到 PUBACK），返回后再检查一次条件。
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_mac.h"
+#include "esp_timer.h"
+
+#include "host_stubs.h"
+
+/**
+ * @brief 计数信号量（互斥量按初值为 1 的二值信号量处理）
+ */
+struct host_sem {
+    UBaseType_t max;   ///< 计数上限
+    UBaseType_t count; ///< 当前计数
+};
+
+/**
+ * @brief 登记的任务
+ */
+typedef struct {
+    TaskFunction_t fn;     ///< 任务函数（不执行）
+    void          *arg;    ///< 任务参数
+    uint32_t       notify; ///< 通知计数
+} host_task_t;
+
+static host_task_t       s_main_task;              ///< 测试线程本身
+static host_wait_hook_t  s_wait_hook = NULL;       ///< 阻塞等待钩子
+static uint32_t          s_task_created = 0;       ///< 累计创建的任务数
+
+void host_rtos_set_wait_hook(host_wait_hook_t hook)
+{
+    s_wait_hook = hook;
+}
+
+uint32_t host_rtos_task_created(void)
+{
+    return s_task_created;
+}
+
+/**
+ * @brief 等待 ms 毫秒内条件成立：每次交给钩子推进一段时间后重新检查
+ *
+ * @return 条件是否在超时前成立
+ */
+static bool host_rtos_wait(uint32_t ms, bool (*ready)(void *), void *arg)
+{
+    while (!ready(arg)) {
+        if (ms == 0) {
+            return false;
+        }
+        uint32_t step = (s_wait_hook != NULL) ? s_wait_hook(ms) : 0;
+        if (step == 0) {                           ///< 钩子没有推进时钟：剩余时间整段流逝
+            host_clock_advance_us((int64_t)ms * 1000);
+            step = ms;
+        } else if (step > ms) {
+            step = ms;
+        }
+        ms -= step;
+    }
+    return true;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+static bool host_rtos_never(void *arg)
+{
+    (void)arg;
+    return false;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    (void)host_rtos_wait(ticks, host_rtos_never, NULL);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t prio, TaskHandle_t *out)
+{
+    (void)name;
+    (void)stack;
+    (void)prio;
+
+    host_task_t *t = (host_task_t *)calloc(1, sizeof(host_task_t));
+    if (t == NULL) {
+        return pdFAIL;
+    }
+    t->fn  = fn;
+    t->arg = arg;
+    s_task_created++;
+    if (out != NULL) {
+        *out = t;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task != NULL && task != &s_main_task) {
+        free(task);
+    }
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return &s_main_task;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    if (task != NULL) {
+        ((host_task_t *)task)->notify++;
+    }
+    return pdPASS;
+}
+
+static bool host_rtos_notified(void *arg)
+{
+    return ((host_task_t *)arg)->notify > 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait)
+{
+    if (!host_rtos_wait(wait, host_rtos_notified, &s_main_task)) {
+        return 0;
+    }
+    uint32_t n = s_main_task.notify;
+    s_main_task.notify = clear ? 0 : n - 1;
+    return n;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t s = (SemaphoreHandle_t)calloc(1, sizeof(struct host_sem));
+    if (s != NULL) {
+        s->max   = max;
+        s->count = initial;
+    }
+    return s;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+static bool host_rtos_sem_ready(void *arg)
+{
+    return ((SemaphoreHandle_t)arg)->count > 0;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    if (!host_rtos_wait(wait, host_rtos_sem_ready, sem)) {
+        return pdFALSE;
+    }
+    sem->count--;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    if (sem->count >= sem->max) {
+        return pdFALSE;
+    }
+    sem->count++;
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    free(sem);
+}
+
+int host_sem_count(SemaphoreHandle_t sem)
+{
+    return (sem != NULL) ? (int)sem->count : -1;
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, int type)
+{
+    static const uint8_t s_mac[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+    (void)type;
+    memcpy(mac, s_mac, sizeof(s_mac));
+    return ESP_OK;
+}
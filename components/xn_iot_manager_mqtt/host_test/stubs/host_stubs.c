@@ -0,0 +1,193 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-18 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-18 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\stubs\host_stubs.c
+ * @Description: 主机测试桩实现
+ *
+ * RAM 分区按 NOR Flash 语义工作：写入只能把 1 变为 0，擦除按 4KB 扇区恢复为 0xFF，
+ * 因此被测模块依赖“只清位推进状态”的写法在这里同样成立，并统计写入字节与擦除次数。
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+
+#include "host_stubs.h"
+
+#define HOST_SECTOR_SIZE 4096
+
+int host_log_verbose = 0;                          ///< 由环境变量 HOST_TEST_VERBOSE 打开
+int host_log_quiet   = 0;                          ///< 测试注入故障期间屏蔽错误日志
+
+static int64_t            s_now_us = 0;             ///< 虚拟时钟
+static uint32_t           s_epoch  = 0;             ///< 虚拟时钟起点对应的 UNIX 时间，0 表示未同步
+static uint32_t           s_rand   = 1;             ///< 伪随机状态
+static esp_partition_t    s_part;                   ///< 唯一的 RAM 分区
+static uint8_t           *s_flash  = NULL;          ///< 分区内容
+static uint32_t          *s_sector_erases = NULL;   ///< 各扇区擦除次数
+static host_flash_stats_t s_flash_stats;            ///< Flash 操作统计
+
+__attribute__((constructor)) static void host_stubs_setup(void)
+{
+    const char *v = getenv("HOST_TEST_VERBOSE");
+    host_log_verbose = (v != NULL && v[0] == '1');
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", (unsigned)code);
+    return buf;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_now_us;
+}
+
+void host_clock_advance_us(int64_t us)
+{
+    s_now_us += us;
+}
+
+void host_epoch_set(uint32_t epoch)
+{
+    s_epoch = epoch;
+}
+
+time_t time(time_t *out)
+{
+    /* 覆盖 libc 的 time()，让依赖系统时间的逻辑也跟随虚拟时钟 */
+    time_t t = (s_epoch == 0) ? (time_t)(s_now_us / 1000000) : (time_t)s_epoch + (time_t)(s_now_us / 1000000);
+    if (out != NULL) {
+        *out = t;
+    }
+    return t;
+}
+
+void host_random_seed(uint32_t seed)
+{
+    s_rand = (seed != 0) ? seed : 1;
+}
+
+uint32_t esp_random(void)
+{
+    /* xorshift32：足够均匀，且同一种子结果可复现 */
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+uint64_t host_wall_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; ++i) {
+        crc ^= buf[i];
+        for (int b = 0; b < 8; ++b) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+void host_partition_create(const char *label, uint32_t size)
+{
+    free(s_flash);
+    free(s_sector_erases);
+    memset(&s_part, 0, sizeof(s_part));
+    s_part.type       = ESP_PARTITION_TYPE_DATA;
+    s_part.subtype    = 0x40;
+    s_part.size       = size;
+    s_part.erase_size = HOST_SECTOR_SIZE;
+    strncpy(s_part.label, label, sizeof(s_part.label) - 1);
+
+    s_flash         = malloc(size);
+    s_sector_erases = calloc(size / HOST_SECTOR_SIZE, sizeof(uint32_t));
+    HOST_CHECK(s_flash != NULL && s_sector_erases != NULL);
+    memset(s_flash, 0xFF, size);
+    memset(&s_flash_stats, 0, sizeof(s_flash_stats));
+}
+
+void host_partition_get_stats(host_flash_stats_t *out)
+{
+    *out = s_flash_stats;
+    out->erase_min = UINT32_MAX;
+    out->erase_max = 0;
+    for (uint32_t i = 0; i < s_part.size / HOST_SECTOR_SIZE; ++i) {
+        if (s_sector_erases[i] < out->erase_min) {
+            out->erase_min = s_sector_erases[i];
+        }
+        if (s_sector_erases[i] > out->erase_max) {
+            out->erase_max = s_sector_erases[i];
+        }
+    }
+}
+
+void host_partition_reset_stats(void)
+{
+    memset(&s_flash_stats, 0, sizeof(s_flash_stats));
+    memset(s_sector_erases, 0, (s_part.size / HOST_SECTOR_SIZE) * sizeof(uint32_t));
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t    type,
+                                                esp_partition_subtype_t subtype,
+                                                const char             *label)
+{
+    (void)subtype;
+    if (s_flash == NULL || type != s_part.type || label == NULL || strcmp(label, s_part.label) != 0) {
+        return NULL;
+    }
+    return &s_part;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t size)
+{
+    if (part != &s_part || offset + size > s_part.size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(dst, s_flash + offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src, size_t size)
+{
+    if (part != &s_part || offset + size > s_part.size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const uint8_t *p = (const uint8_t *)src;
+    for (size_t i = 0; i < size; ++i) {
+        s_flash[offset + i] &= p[i];               ///< NOR Flash 只能把 1 写成 0
+    }
+    s_flash_stats.bytes_written += size;
+    s_flash_stats.writes++;
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t size)
+{
+    if (part != &s_part || offset % HOST_SECTOR_SIZE != 0 || size % HOST_SECTOR_SIZE != 0 ||
+        offset + size > s_part.size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(s_flash + offset, 0xFF, size);
+    for (size_t s = offset / HOST_SECTOR_SIZE; s < (offset + size) / HOST_SECTOR_SIZE; ++s) {
+        s_sector_erases[s]++;
+        s_flash_stats.erases++;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,164 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-18 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-18 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\stubs\host_stubs.h
+ * @Description: 主机测试桩的控制接口（虚拟时钟、RAM 分区、FreeRTOS、假 MQTT 客户端、断言）
+ */
+
+#ifndef HOST_STUBS_H
+#define HOST_STUBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "mqtt_client.h"
+
+/**
+ * @brief 断言失败时打印位置并以非 0 退出，make test 据此判定失败
+ */
+#define HOST_CHECK(cond)                                                        \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            exit(1);                                                            \
+        }                                                                       \
+    } while (0)
+
+/**
+ * @brief RAM 分区的 Flash 操作统计
+ */
+typedef struct {
+    uint64_t bytes_written; ///< esp_partition_write 写入的字节数（含状态字）
+    uint32_t writes;        ///< 写操作次数
+    uint32_t erases;        ///< 擦除的扇区数
+    uint32_t erase_min;     ///< 单个扇区最少擦除次数
+    uint32_t erase_max;     ///< 单个扇区最多擦除次数
+} host_flash_stats_t;
+
+/**
+ * @brief 创建（或重建为全 0xFF 的）RAM 分区，供 esp_partition_find_first 按标签查找
+ */
+void host_partition_create(const char *label, uint32_t size);
+
+/**
+ * @brief 读取 RAM 分区的 Flash 操作统计
+ */
+void host_partition_get_stats(host_flash_stats_t *out);
+
+/**
+ * @brief 清零 RAM 分区的 Flash 操作统计（内容保留）
+ */
+void host_partition_reset_stats(void);
+
+/**
+ * @brief 推进虚拟时钟（esp_timer_get_time 与 xTaskGetTickCount 共用）
+ */
+void host_clock_advance_us(int64_t us);
+
+/**
+ * @brief 设置虚拟时钟起点对应的 UNIX 时间（time() 随虚拟时钟前进），0 表示系统时间未同步
+ */
+void host_epoch_set(uint32_t epoch);
+
+/**
+ * @brief 设置 esp_random 的种子
+ */
+void host_random_seed(uint32_t seed);
+
+/**
+ * @brief 主机单调时钟（ns），用于测量被测代码本身的耗时
+ */
+uint64_t host_wall_ns(void);
+
+/* -------------------------------------------------------------------------- */
+/*                        FreeRTOS（stubs/host_rtos.c）                         */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 阻塞等待钩子
+ *
+ * 信号量 / 通知 / vTaskDelay 需要等待时调用，钩子可模拟其他任务（如投递 PUBACK），
+ * 并自行推进虚拟时钟（不超过 max_ms）。
+ *
+ * @return 已推进的毫秒数；0 表示无事可做，剩余等待时间整段流逝
+ */
+typedef uint32_t (*host_wait_hook_t)(uint32_t max_ms);
+
+/**
+ * @brief 设置阻塞等待钩子，NULL 表示等待只推进虚拟时钟
+ */
+void host_rtos_set_wait_hook(host_wait_hook_t hook);
+
+/**
+ * @brief 累计调用 xTaskCreate 的次数（任务只登记不运行）
+ */
+uint32_t host_rtos_task_created(void);
+
+/**
+ * @brief 信号量当前计数
+ */
+int host_sem_count(SemaphoreHandle_t sem);
+
+/* -------------------------------------------------------------------------- */
+/*                     假 esp-mqtt 客户端（stubs/host_mqtt_client.c）           */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 假客户端 outbox 的堆占用统计
+ */
+typedef struct {
+    size_t   bytes;      ///< 当前占用字节数
+    size_t   bytes_peak; ///< 占用字节数峰值
+    uint32_t num;        ///< 当前未确认消息数
+    uint32_t num_peak;   ///< 未确认消息数峰值
+} host_mqtt_outbox_t;
+
+/**
+ * @brief 最近一次 esp_mqtt_client_init 创建的客户端
+ */
+esp_mqtt_client_handle_t host_mqtt_last_client(void);
+
+/**
+ * @brief 向客户端注册的回调投递一个只带 msg_id 的事件（CONNECTED / DISCONNECTED 等）
+ */
+void host_mqtt_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id);
+
+/**
+ * @brief outbox 中未确认的消息数
+ */
+int host_mqtt_pending(esp_mqtt_client_handle_t client);
+
+/**
+ * @brief outbox 中第 nth 条（0 为最早发出的）消息的 msg_id，不存在时返回 -1
+ */
+int host_mqtt_peek(esp_mqtt_client_handle_t client, int nth);
+
+/**
+ * @brief 结束 outbox 中第 nth 条（0 为最早发出的）消息并投递 PUBLISHED 或 DELETED 事件
+ *
+ * @return 该消息的 msg_id；不存在时返回 -1
+ */
+int host_mqtt_complete(esp_mqtt_client_handle_t client, int nth, bool deleted);
+
+/**
+ * @brief 让接下来 n 次发布返回 -1（模拟 outbox 满或连接断开）
+ */
+void host_mqtt_fail_next(esp_mqtt_client_handle_t client, int n);
+
+/**
+ * @brief 设置下一个分配的报文 ID（用于构造 ID 回绕）
+ */
+void host_mqtt_set_next_id(esp_mqtt_client_handle_t client, uint16_t id);
+
+/**
+ * @brief 读取 outbox 堆占用统计
+ */
+void host_mqtt_get_outbox(esp_mqtt_client_handle_t client, host_mqtt_outbox_t *out);
+
+#endif /* HOST_STUBS_H */
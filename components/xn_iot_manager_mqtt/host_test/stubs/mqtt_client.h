@@ -0,0 +1,105 @@
+/*
+ * 主机测试桩：mqtt_client.h（esp-mqtt 的最小子集）
+ *
+ * 假客户端把 QoS>=1 消息按 esp-mqtt 的方式拷贝进堆上的 outbox，直到测试调用
+ * host_mqtt_complete 模拟 PUBACK 或超时删除，据此统计 outbox 的堆占用。
+ */
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+    MQTT_USER_EVENT,
+} esp_mqtt_event_id_t;
+
+typedef enum {
+    MQTT_PROTOCOL_UNDEFINED = 0,
+    MQTT_PROTOCOL_V_3_1,
+    MQTT_PROTOCOL_V_3_1_1,
+    MQTT_PROTOCOL_V_5,
+} esp_mqtt_protocol_ver_t;
+
+typedef enum {
+    MQTT_CONNECTION_ACCEPTED = 0,
+    MQTT_CONNECTION_REFUSE_PROTOCOL,
+} esp_mqtt_connect_return_code_t;
+
+typedef struct {
+    int                            error_type;
+    esp_mqtt_connect_return_code_t connect_return_code;
+} esp_mqtt_error_codes_t;
+
+typedef struct topic_t {
+    const char *filter;
+    int         qos;
+} esp_mqtt_topic_t;
+
+typedef struct esp_mqtt_event_t {
+    esp_mqtt_event_id_t      event_id;
+    esp_mqtt_client_handle_t client;
+    char                    *data;
+    int                      data_len;
+    int                      total_data_len;
+    int                      current_data_offset;
+    char                    *topic;
+    int                      topic_len;
+    int                      msg_id;
+    int                      session_present;
+    esp_mqtt_error_codes_t  *error_handle;
+    bool                     retain;
+    int                      qos;
+    bool                     dup;
+    esp_mqtt_protocol_ver_t  protocol_ver;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+
+typedef struct {
+    struct { struct { const char *uri; } address; } broker;
+    struct {
+        const char *username;
+        const char *client_id;
+        struct { const char *password; } authentication;
+    } credentials;
+    struct {
+        int                     keepalive;
+        bool                    disable_clean_session;
+        esp_mqtt_protocol_ver_t protocol_ver;
+    } session;
+    struct {
+        int  reconnect_timeout_ms;
+        int  timeout_ms;
+        bool disable_auto_reconnect;
+    } network;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *arg);
+esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client, const char *uri);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+int esp_mqtt_client_subscribe_multiple(esp_mqtt_client_handle_t client, const esp_mqtt_topic_t *list, int num);
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain, bool store);
@@ -0,0 +1,183 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-20 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-20 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\test_backoff.c
+ * @Description: 重连退避主机仿真：5000 台设备在服务器重启后的重连时间分布与服务器建连速率
+ *
+ * 模型（时间粒度 100 ms）：
+ *  - t = 0 服务器重启，全部设备同时断开，服务器 10 s 后恢复；
+ *  - 服务器每 100 ms 最多完成 50 次握手（500 次/s），其余尝试等到 network_timeout（4 s）才失败，
+ *    服务器未恢复时连接立即被拒绝（100 ms）；
+ *  - 每台设备按 web_mqtt_manager_backoff_ms(attempt++) 调度下一次尝试，与固件状态机一致。
+ *
+ * 对比默认配置（指数退避 + 全抖动）与 reconnect_max_ms = 0（固定 1 s 间隔，全体同步重试）。
+ */
+
+#include <string.h>
+
+#include "host_stubs.h"
+
+#include "../src/web_mqtt_manager.c"               ///< 直接包含以便调用 web_mqtt_manager_backoff_ms
+
+#define SIM_CLIENT_NUM     5000                    ///< 设备数
+#define SIM_SLOT_MS        100                     ///< 仿真时间粒度
+#define SIM_SLOT_NUM       (3600 * 1000 / SIM_SLOT_MS) ///< 仿真时长 1 小时
+#define SIM_DOWN_MS        10000                   ///< 服务器重启耗时
+#define SIM_ACCEPT_PER_SEC 500                     ///< 服务器每秒可完成的握手数
+#define SIM_ACCEPT_PER_SLOT (SIM_ACCEPT_PER_SEC * SIM_SLOT_MS / 1000)
+#define SIM_TIMEOUT_MS     4000                    ///< 握手超时（broker_latency_budget_ms + broker_probe_timeout_ms）
+#define SIM_REFUSED_MS     100                     ///< 服务器未恢复时连接被拒绝的耗时
+
+/**
+ * @brief 一次仿真的结果
+ */
+typedef struct {
+    uint32_t connected;        ///< 最终连上的设备数
+    uint32_t attempts;         ///< 总尝试次数
+    uint32_t peak_attempts;    ///< 服务器恢复后 1 s 内尝试数峰值
+    uint32_t pct_ms[4];        ///< 重连耗时 p50 / p90 / p99 / max
+} sim_result_t;
+
+static int      s_slot_head[SIM_SLOT_NUM];         ///< 各时间槽待尝试设备链表头
+static int      s_next[SIM_CLIENT_NUM];            ///< 链表后继
+static uint32_t s_attempt[SIM_CLIENT_NUM];         ///< 各设备连续失败次数
+static uint32_t s_done_ms[SIM_CLIENT_NUM];         ///< 各设备连上的时刻
+static uint32_t s_per_sec[SIM_SLOT_NUM * SIM_SLOT_MS / 1000]; ///< 每秒尝试数
+
+static void sim_schedule(int c, uint32_t now_ms, uint32_t after_ms)
+{
+    uint32_t slot = (now_ms + after_ms + SIM_SLOT_MS - 1) / SIM_SLOT_MS;
+    if (slot >= SIM_SLOT_NUM) {
+        return;                                    ///< 超出仿真时长，视为未连上
+    }
+    s_next[c]         = s_slot_head[slot];
+    s_slot_head[slot] = c;
+}
+
+/**
+ * @brief 与固件一样：断开后按当前失败次数退避，再递增失败次数
+ */
+static void sim_retry(int c, uint32_t now_ms)
+{
+    uint32_t delay = web_mqtt_manager_backoff_ms(s_attempt[c]);
+    s_attempt[c]++;
+    sim_schedule(c, now_ms, delay);
+}
+
+static int sim_cmp_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void sim_run(int reconnect_max_ms, sim_result_t *out)
+{
+    s_mgr_cfg                  = WEB_MQTT_MANAGER_DEFAULT_CONFIG();
+    s_mgr_cfg.reconnect_max_ms = reconnect_max_ms;
+
+    memset(out, 0, sizeof(*out));
+    memset(s_per_sec, 0, sizeof(s_per_sec));
+    for (int i = 0; i < SIM_SLOT_NUM; ++i) {
+        s_slot_head[i] = -1;
+    }
+    for (int c = 0; c < SIM_CLIENT_NUM; ++c) {
+        s_attempt[c] = 0;
+        s_done_ms[c] = UINT32_MAX;
+        sim_retry(c, 0);
+    }
+
+    for (uint32_t slot = 0; slot < SIM_SLOT_NUM; ++slot) {
+        uint32_t now      = slot * SIM_SLOT_MS;
+        uint32_t accepted = 0;
+        int      c        = s_slot_head[slot];
+        s_slot_head[slot] = -1;
+
+        while (c >= 0) {
+            int next = s_next[c];
+            out->attempts++;
+            s_per_sec[now / 1000]++;
+            if (now < SIM_DOWN_MS) {
+                sim_retry(c, now + SIM_REFUSED_MS);
+            } else if (accepted < SIM_ACCEPT_PER_SLOT) {
+                accepted++;
+                s_done_ms[c] = now;
+                out->connected++;
+            } else {
+                sim_retry(c, now + SIM_TIMEOUT_MS);
+            }
+            c = next;
+        }
+    }
+
+    for (uint32_t s = SIM_DOWN_MS / 1000; s < SIM_SLOT_NUM * SIM_SLOT_MS / 1000; ++s) {
+        if (s_per_sec[s] > out->peak_attempts) {
+            out->peak_attempts = s_per_sec[s];
+        }
+    }
+
+    qsort(s_done_ms, SIM_CLIENT_NUM, sizeof(s_done_ms[0]), sim_cmp_u32);
+    const int pct[3] = { 50, 90, 99 };
+    for (int i = 0; i < 3; ++i) {
+        out->pct_ms[i] = s_done_ms[(SIM_CLIENT_NUM * pct[i] + 99) / 100 - 1];
+    }
+    out->pct_ms[3] = s_done_ms[SIM_CLIENT_NUM - 1];
+}
+
+static void sim_print(const char *name, const sim_result_t *r)
+{
+    printf("  %-22s connected %u/%u, attempts %6u, peak %5u attempts/s (capacity %d/s), "
+           "reconnect p50 %5.1f s, p90 %5.1f s, p99 %6.1f s, max %6.1f s\n",
+           name, (unsigned)r->connected, SIM_CLIENT_NUM, (unsigned)r->attempts,
+           (unsigned)r->peak_attempts, SIM_ACCEPT_PER_SEC,
+           r->pct_ms[0] / 1000.0, r->pct_ms[1] / 1000.0, r->pct_ms[2] / 1000.0, r->pct_ms[3] / 1000.0);
+}
+
+/**
+ * @brief 退避窗口本身：按次数翻倍、不超过上限、固定间隔模式不抖动
+ */
+static void test_backoff_window(void)
+{
+    s_mgr_cfg = WEB_MQTT_MANAGER_DEFAULT_CONFIG();
+    for (uint32_t attempt = 0; attempt < 40; ++attempt) {
+        uint32_t window = (attempt < 17) ? (1000u << attempt) : UINT32_MAX;
+        if (window > 120000) {
+            window = 120000;
+        }
+        uint32_t max = 0;
+        for (int i = 0; i < 2000; ++i) {
+            uint32_t d = web_mqtt_manager_backoff_ms(attempt);
+            HOST_CHECK(d <= window);
+            max = (d > max) ? d : max;
+        }
+        HOST_CHECK(max >= window * 9 / 10);        ///< 抖动覆盖整个窗口
+    }
+
+    s_mgr_cfg.reconnect_max_ms = 0;
+    HOST_CHECK(web_mqtt_manager_backoff_ms(0) == 1000 && web_mqtt_manager_backoff_ms(30) == 1000);
+}
+
+int main(void)
+{
+    host_random_seed(8);
+    test_backoff_window();
+
+    printf("broker restart with %d clients (down %d s, accepts %d/s, handshake timeout %d s):\n",
+           SIM_CLIENT_NUM, SIM_DOWN_MS / 1000, SIM_ACCEPT_PER_SEC, SIM_TIMEOUT_MS / 1000);
+
+    sim_result_t jitter, lockstep;
+    sim_run(120000, &jitter);
+    sim_print("backoff + full jitter", &jitter);
+    sim_run(0, &lockstep);
+    sim_print("fixed 1 s (lockstep)", &lockstep);
+
+    HOST_CHECK(jitter.connected == SIM_CLIENT_NUM);
+    HOST_CHECK(jitter.peak_attempts * 2 < lockstep.peak_attempts);
+    HOST_CHECK(jitter.attempts * 2 < lockstep.attempts);
+    HOST_CHECK(jitter.pct_ms[2] < lockstep.pct_ms[2]);
+
+    printf("test_backoff: OK\n");
+    return 0;
+}
@@ -0,0 +1,215 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-22 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-22 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\test_lzf.c
+ * @Description: 负载压缩与服务器 PHP 编解码（xn_mqtt_server/lib/XnLzf.php）的互通测试
+ *
+ *  - 固定向量：设备端对一段 JSON 的压缩帧必须与 s_frame_dev 逐字节一致，
+ *    且能被 test_php_unpack（逐行对照 xn_lzf_unpack 移植）还原；
+ *  - 反方向：s_frame_php 是 xn_lzf_pack 对同一 JSON 的输出，设备端 mqtt_lzf_unpack 必须能还原；
+ *  - 随机负载：压缩后经 test_php_unpack 还原，截断的帧两边都必须拒绝。
+ *
+ * 修改任一端的编解码时需同步更新两个向量（或说明格式变化）。
+ */
+
+#include <string.h>
+
+#include "host_stubs.h"
+
+#include "../src/mqtt_lzf_module.c"                ///< 直接包含被测模块
+
+#define TEST_RANDOM_NUM 2000                       ///< 随机负载条数
+#define TEST_RANDOM_MAX 1500                       ///< 随机负载最大长度
+
+/* 包含字面量满段（32 字节）、短回引与带长度扩展字节的长回引 */
+static const char s_plain[] =
+    "{\"wifi\":{\"ssid\":\"xn-lab\",\"rssi\":-61,\"channel\":6},"
+    "\"apps\":[{\"name\":\"wifi_config\",\"state\":\"ready\"},"
+    "{\"name\":\"ota_update\",\"state\":\"ready\"},"
+    "{\"name\":\"wifi_config\",\"state\":\"ready\"}],"
+    "\"pad\":\"0123456789abcdefghijklmnopqrstuvwxyzABCDEF\"}";
+
+/* mqtt_lzf_pack(s_plain) 的输出 */
+static const uint8_t s_frame_dev[] = {
+    0x00, 0xe1, 0x1a, 0x7b, 0x22, 0x77, 0x69, 0x66, 0x69, 0x22, 0x3a, 0x7b,
+    0x22, 0x73, 0x73, 0x69, 0x64, 0x22, 0x3a, 0x22, 0x78, 0x6e, 0x2d, 0x6c,
+    0x61, 0x62, 0x22, 0x2c, 0x22, 0x72, 0x20, 0x10, 0x1f, 0x22, 0x3a, 0x2d,
+    0x36, 0x31, 0x2c, 0x22, 0x63, 0x68, 0x61, 0x6e, 0x6e, 0x65, 0x6c, 0x22,
+    0x3a, 0x36, 0x7d, 0x2c, 0x22, 0x61, 0x70, 0x70, 0x73, 0x22, 0x3a, 0x5b,
+    0x7b, 0x22, 0x6e, 0x61, 0x6d, 0x02, 0x65, 0x22, 0x3a, 0x60, 0x3f, 0x06,
+    0x5f, 0x63, 0x6f, 0x6e, 0x66, 0x69, 0x67, 0x20, 0x35, 0x03, 0x73, 0x74,
+    0x61, 0x74, 0x40, 0x15, 0x07, 0x72, 0x65, 0x61, 0x64, 0x79, 0x22, 0x7d,
+    0x2c, 0xe0, 0x00, 0x26, 0x06, 0x6f, 0x74, 0x61, 0x5f, 0x75, 0x70, 0x64,
+    0x40, 0x1d, 0xe0, 0x12, 0x25, 0xe0, 0x14, 0x4c, 0x04, 0x5d, 0x2c, 0x22,
+    0x70, 0x61, 0x40, 0xa3, 0x1f, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75,
+    0x76, 0x0b, 0x77, 0x78, 0x79, 0x7a, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46,
+    0x22, 0x7d,
+};
+
+/* xn_lzf_pack(s_plain) 的输出：PHP 端按 3 字节精确查表，与设备端的哈希查表结果不同 */
+static const uint8_t s_frame_php[] = {
+    0x00, 0xe1, 0x1a, 0x7b, 0x22, 0x77, 0x69, 0x66, 0x69, 0x22, 0x3a, 0x7b,
+    0x22, 0x73, 0x73, 0x69, 0x64, 0x22, 0x3a, 0x22, 0x78, 0x6e, 0x2d, 0x6c,
+    0x61, 0x62, 0x22, 0x2c, 0x22, 0x72, 0x20, 0x10, 0x1f, 0x22, 0x3a, 0x2d,
+    0x36, 0x31, 0x2c, 0x22, 0x63, 0x68, 0x61, 0x6e, 0x6e, 0x65, 0x6c, 0x22,
+    0x3a, 0x36, 0x7d, 0x2c, 0x22, 0x61, 0x70, 0x70, 0x73, 0x22, 0x3a, 0x5b,
+    0x7b, 0x22, 0x6e, 0x61, 0x6d, 0x00, 0x65, 0x20, 0x30, 0x40, 0x3f, 0x06,
+    0x5f, 0x63, 0x6f, 0x6e, 0x66, 0x69, 0x67, 0x20, 0x35, 0x03, 0x73, 0x74,
+    0x61, 0x74, 0x40, 0x15, 0x07, 0x72, 0x65, 0x61, 0x64, 0x79, 0x22, 0x7d,
+    0x2c, 0xe0, 0x00, 0x26, 0x06, 0x6f, 0x74, 0x61, 0x5f, 0x75, 0x70, 0x64,
+    0x40, 0x1d, 0xe0, 0x12, 0x25, 0xe0, 0x14, 0x4c, 0x04, 0x5d, 0x2c, 0x22,
+    0x70, 0x61, 0x40, 0xa3, 0x1f, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36,
+    0x37, 0x38, 0x39, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72, 0x73, 0x74, 0x75,
+    0x76, 0x0b, 0x77, 0x78, 0x79, 0x7a, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46,
+    0x22, 0x7d,
+};
+
+static uint32_t s_rand = 1;                        ///< 随机负载生成器状态
+
+static uint32_t test_rand(void)
+{
+    s_rand = s_rand * 1103515245u + 12345u;
+    return s_rand >> 8;
+}
+
+/**
+ * @brief xn_lzf_unpack 的 C 版本，逐行对照 XnLzf.php，帧损坏时返回 -1
+ */
+static int test_php_unpack(const uint8_t *frame, int in_len, uint8_t *out, int out_cap)
+{
+    if (in_len <= 2) {
+        return -1;
+    }
+
+    int out_len = (frame[0] << 8) | frame[1];
+    if (out_len <= 0 || out_len > out_cap) {
+        return -1;
+    }
+
+    int n  = 0;                                    ///< PHP 中的 strlen($out)
+    int ip = 2;
+    while (ip < in_len) {
+        int ctrl = frame[ip++];
+
+        if (ctrl < 32) {                           ///< 字面量：其后 ctrl+1 字节原样拷贝
+            int run = ctrl + 1;
+            if (ip + run > in_len || n + run > out_len) {
+                return -1;
+            }
+            memcpy(out + n, frame + ip, (size_t)run);
+            n  += run;
+            ip += run;
+            continue;
+        }
+
+        int len = ctrl >> 5;                       ///< 回引：从已输出数据往回拷贝
+        if (len == 7) {
+            if (ip >= in_len) {
+                return -1;
+            }
+            len += frame[ip++];
+        }
+        if (ip >= in_len) {
+            return -1;
+        }
+        int ref = n - ((ctrl & 0x1f) << 8) - frame[ip++] - 1;
+        len += 2;
+        if (ref < 0 || n + len > out_len) {
+            return -1;
+        }
+        for (int i = 0; i < len; i++) {            ///< 可能与输出重叠，逐字节拷贝
+            out[n] = out[ref + i];
+            n++;
+        }
+    }
+
+    return (n == out_len) ? n : -1;
+}
+
+/**
+ * @brief 固定向量：设备端输出逐字节固定，两个方向都能还原
+ */
+static void test_vectors(void)
+{
+    int      plain_len = (int)strlen(s_plain);
+    uint8_t  frame[sizeof(s_plain)];
+    uint8_t  out[sizeof(s_plain)];
+    uint16_t htab[MQTT_LZF_HTAB_NUM];
+
+    int n = mqtt_lzf_pack((const uint8_t *)s_plain, plain_len, frame, sizeof(frame), htab);
+    HOST_CHECK(n == (int)sizeof(s_frame_dev));
+    HOST_CHECK(memcmp(frame, s_frame_dev, sizeof(s_frame_dev)) == 0);
+
+    HOST_CHECK(test_php_unpack(s_frame_dev, (int)sizeof(s_frame_dev), out, sizeof(out)) == plain_len);
+    HOST_CHECK(memcmp(out, s_plain, (size_t)plain_len) == 0);
+
+    memset(out, 0, sizeof(out));
+    HOST_CHECK(mqtt_lzf_unpack(s_frame_php, (int)sizeof(s_frame_php), out, sizeof(out)) == plain_len);
+    HOST_CHECK(memcmp(out, s_plain, (size_t)plain_len) == 0);
+
+    printf("vector: %d -> %d bytes (device), %d bytes (php)\n",
+           plain_len, n, (int)sizeof(s_frame_php));
+}
+
+/**
+ * @brief 随机负载：由少量键名与数字拼成的类 JSON 文本，设备端压缩后按 PHP 规则还原
+ */
+static void test_random(void)
+{
+    static const char *const words[] = {
+        "{\"id\":", ",\"rssi\":", ",\"state\":\"ready\"", ",\"heap\":", "}", "[", "]", ",",
+    };
+    static uint8_t  plain[TEST_RANDOM_MAX];
+    static uint8_t  frame[TEST_RANDOM_MAX];
+    static uint8_t  out[TEST_RANDOM_MAX];
+    static uint16_t htab[MQTT_LZF_HTAB_NUM];
+
+    int packed = 0;
+    for (int r = 0; r < TEST_RANDOM_NUM; ++r) {
+        int len = 0;
+        int max = 1 + (int)(test_rand() % TEST_RANDOM_MAX);
+        while (len < max) {
+            uint32_t v = test_rand();
+            if (v % 3 == 0) {
+                plain[len++] = (uint8_t)('0' + v % 10);
+                continue;
+            }
+            const char *w = words[v % (sizeof(words) / sizeof(words[0]))];
+            for (; *w != '\0' && len < max; ++w) {
+                plain[len++] = (uint8_t)*w;
+            }
+        }
+
+        int n = mqtt_lzf_pack(plain, len, frame, sizeof(frame), htab);
+        if (n == 0) {
+            continue;                              ///< 压缩无收益，原样发送
+        }
+        packed++;
+
+        HOST_CHECK(test_php_unpack(frame, n, out, sizeof(out)) == len);
+        HOST_CHECK(memcmp(out, plain, (size_t)len) == 0);
+
+        int cut = 3 + (int)(test_rand() % (uint32_t)(n - 2)); ///< 截断到 [3, n)
+        if (cut < n) {
+            HOST_CHECK(test_php_unpack(frame, cut, out, sizeof(out)) < 0);
+            HOST_CHECK(mqtt_lzf_unpack(frame, cut, out, sizeof(out)) < 0);
+        }
+    }
+
+    HOST_CHECK(packed > TEST_RANDOM_NUM / 2);
+    printf("random: %d/%d payloads packed and decoded by the php rules\n", packed, TEST_RANDOM_NUM);
+}
+
+int main(void)
+{
+    test_vectors();
+    test_random();
+
+    printf("test_lzf: OK\n");
+    return 0;
+}
@@ -0,0 +1,296 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-20 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-20 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\test_router.c
+ * @Description: 下行路由主机测试：路由正确性 + 与旧 snprintf 循环的 ns/消息对比
+ *
+ * 正确性：
+ *  - 本设备 / 广播 / 其他设备 / 前缀部分匹配 / base 之外的 Topic 各自命中（或不命中）正确的模块；
+ *  - '+' 模板走通配链表，同一消息对同一模块只分发一次；注销后不再分发；
+ *  - 目标段、命令段下标与 for_device 按模块前缀层级计算。
+ *
+ * 性能：8 / 32 / 128 个模块时，分别用旧实现（每条消息为每个模块 snprintf "%s/%s" 再 memcmp，
+ * 回调内再 snprintf 一次自己的前缀）与预编译路由分发同一批消息，两者命中数必须一致。
+ */
+
+#include <string.h>
+
+#include "esp_random.h"
+
+#include "host_stubs.h"
+
+#include "../src/web_mqtt_manager.c"               ///< 直接包含以便设置 base_topic / client_id 等内部状态
+
+#define TEST_BASE        "xn/esp"                  ///< base_topic
+#define TEST_CLIENT_ID   "ESP32_0001"              ///< 本设备 client_id
+#define TEST_APP_MAX     128                       ///< 基准测试最大模块数
+#define TEST_MSG_NUM     200000                    ///< 每轮分发的消息数
+#define TEST_TOPIC_NUM   256                       ///< 轮流使用的 Topic 数
+
+static uint32_t s_hits[TEST_APP_MAX + 1];          ///< 各模块命中数，最后一项为通配模块
+static char     s_names[TEST_APP_MAX][8];          ///< 模块前缀 "appNNN"
+static int      s_last_cmd_index = -1;             ///< 最近一次回调看到的命令段下标
+static bool     s_last_for_device = false;         ///< 最近一次回调看到的 for_device
+
+/**
+ * @brief 预编译路由的模块回调：前缀层级已切分好，直接取模块编号
+ */
+static esp_err_t test_route_cb(const web_mqtt_topic_t *t, const uint8_t *payload, int payload_len)
+{
+    (void)payload;
+    (void)payload_len;
+
+    const char *seg = t->seg[t->base_segs];
+    int         idx = (seg[3] - '0') * 100 + (seg[4] - '0') * 10 + (seg[5] - '0');
+    s_hits[idx]++;
+    s_last_cmd_index  = t->cmd_index;
+    s_last_for_device = t->for_device;
+    return ESP_OK;
+}
+
+/**
+ * @brief 通配模块回调（订阅 {base}/+/{client_id}/#）
+ */
+static esp_err_t test_monitor_cb(const web_mqtt_topic_t *t, const uint8_t *payload, int payload_len)
+{
+    (void)t;
+    (void)payload;
+    (void)payload_len;
+    s_hits[TEST_APP_MAX]++;
+    return ESP_OK;
+}
+
+static void test_register(int idx)
+{
+    snprintf(s_names[idx], sizeof(s_names[idx]), "app%03d", idx);
+    web_mqtt_app_config_t cfg = {
+        .topic_suffix = s_names[idx],
+        .route_cb     = test_route_cb,
+        .dispatch     = WEB_MQTT_APP_DISPATCH_INLINE,
+    };
+    HOST_CHECK(web_mqtt_manager_register_app_ex(&cfg) == ESP_OK);
+}
+
+static void test_deliver(const char *topic)
+{
+    web_mqtt_manager_on_mqtt_message(topic, (int)strlen(topic), (const uint8_t *)"1", 1);
+}
+
+static uint32_t test_total_hits(void)
+{
+    uint32_t n = 0;
+    for (int i = 0; i <= TEST_APP_MAX; ++i) {
+        n += s_hits[i];
+    }
+    return n;
+}
+
+/* -------------------- 旧实现：逐模块 snprintf + memcmp -------------------- */
+
+/**
+ * @brief 旧版模块表项
+ */
+typedef struct {
+    const char *suffix; ///< 模块前缀
+    int         idx;    ///< 模块编号（代替旧回调内部的状态）
+} test_legacy_app_t;
+
+static test_legacy_app_t s_legacy[TEST_APP_MAX];
+static int               s_legacy_num = 0;
+
+/**
+ * @brief 旧版模块回调：再拼一次自己的前缀 "%s/<suffix>/"，确认是发给本设备的指令
+ */
+static esp_err_t test_legacy_cb(const test_legacy_app_t *app, const char *topic, int topic_len)
+{
+    char prefix[128];
+    int  n = snprintf(prefix, sizeof(prefix), "%s/%s/", s_mgr_cfg.base_topic, app->suffix);
+    if (n <= 0 || n >= (int)sizeof(prefix) || topic_len < n || memcmp(topic, prefix, (size_t)n) != 0) {
+        return ESP_FAIL;
+    }
+
+    const char *target = topic + n;
+    int         rest   = topic_len - n;
+    size_t      id_len = strlen(s_mgr_cfg.client_id);
+    if (((size_t)rest > id_len && memcmp(target, s_mgr_cfg.client_id, id_len) == 0 && target[id_len] == '/') ||
+        (rest > 9 && memcmp(target, "broadcast", 9) == 0 && target[9] == '/')) {
+        s_hits[app->idx]++;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 旧版分发循环（改动前 web_mqtt_manager_on_mqtt_message 的实现）
+ */
+static void test_legacy_dispatch(const char *topic, int topic_len)
+{
+    for (int i = 0; i < s_legacy_num; ++i) {
+        char prefix[128];
+        int  n = snprintf(prefix, sizeof(prefix), "%s/%s", s_mgr_cfg.base_topic, s_legacy[i].suffix);
+        if (n <= 0 || n >= (int)sizeof(prefix)) {
+            continue;
+        }
+        if (topic_len < n || memcmp(topic, prefix, (size_t)n) != 0) {
+            continue;
+        }
+        if (topic_len > n && topic[n] != '/') {
+            continue;
+        }
+        (void)test_legacy_cb(&s_legacy[i], topic, topic_len);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 路由正确性
+ */
+static void test_routing(void)
+{
+    for (int i = 0; i < 10; ++i) {
+        test_register(i);
+    }
+    memset(s_hits, 0, sizeof(s_hits));
+
+    test_deliver("xn/esp/app007/ESP32_0001/set");
+    HOST_CHECK(s_hits[7] == 1 && test_total_hits() == 1);
+    HOST_CHECK(s_last_for_device && s_last_cmd_index == 4);
+
+    test_deliver("xn/esp/app007/broadcast/set");
+    HOST_CHECK(s_hits[7] == 2 && test_total_hits() == 2);
+    HOST_CHECK(!s_last_for_device);
+
+    uint32_t unmatched = s_stats.rx_unmatched;
+    test_deliver("xn/esp/app007/ESP32_0002/set");  ///< 其他设备的指令
+    test_deliver("xn/esp/app00/ESP32_0001/set");   ///< 前缀只部分匹配
+    test_deliver("xn/esp/app007");                 ///< 只有模块前缀
+    test_deliver("other/app007/ESP32_0001/set");   ///< 不在 base_topic 下
+    test_deliver("xn/esp/a/b/c/d/e/f/g/h/i/j/k");  ///< 超出最大层级
+    HOST_CHECK(test_total_hits() == 2);
+    HOST_CHECK(s_stats.rx_unmatched == unmatched + 5);
+
+    /* '+' 模板：与普通模块同时命中，各分发一次 */
+    web_mqtt_app_config_t mon = {
+        .topic_suffix = "mon",
+        .route_cb     = test_monitor_cb,
+        .filters      = { "{base}/+/{client_id}/#", "{base}/+/{client_id}/set" },
+        .dispatch     = WEB_MQTT_APP_DISPATCH_INLINE,
+    };
+    HOST_CHECK(web_mqtt_manager_register_app_ex(&mon) == ESP_OK);
+    test_deliver("xn/esp/app003/ESP32_0001/set");
+    HOST_CHECK(s_hits[3] == 1 && s_hits[TEST_APP_MAX] == 1);
+    test_deliver("xn/esp/unknown/ESP32_0001/get");
+    HOST_CHECK(s_hits[TEST_APP_MAX] == 2 && test_total_hits() == 5);
+
+    /* 多层前缀：目标段与命令段下标随前缀层级后移 */
+    web_mqtt_app_config_t ota = {
+        .topic_suffix = "ota/+",
+        .route_cb     = test_monitor_cb,
+        .dispatch     = WEB_MQTT_APP_DISPATCH_INLINE,
+    };
+    HOST_CHECK(web_mqtt_manager_register_app_ex(&ota) == ESP_OK);
+    HOST_CHECK(web_mqtt_manager_unregister_app("mon") == ESP_OK);
+    s_hits[TEST_APP_MAX] = 0;
+    test_deliver("xn/esp/ota/fw/ESP32_0001/begin");
+    HOST_CHECK(s_hits[TEST_APP_MAX] == 1);
+
+    /* 注销后不再分发 */
+    HOST_CHECK(web_mqtt_manager_unregister_app("app007") == ESP_OK);
+    test_deliver("xn/esp/app007/ESP32_0001/set");
+    HOST_CHECK(s_hits[7] == 2);
+    HOST_CHECK(web_mqtt_manager_unregister_app("app007") == ESP_ERR_NOT_FOUND);
+
+    for (int i = 0; i < 10; ++i) {
+        (void)web_mqtt_manager_unregister_app(s_names[i]);
+    }
+    HOST_CHECK(web_mqtt_manager_unregister_app("ota/+") == ESP_OK);
+    HOST_CHECK(s_registry != NULL && s_registry->app_num == 0);
+    printf("routing checks: OK\n");
+}
+
+/**
+ * @brief 生成一批 Topic：约 3/4 发给本设备，其余为广播、其他设备与未注册模块
+ */
+static void test_make_topics(char topics[][64], int *lens, int app_num)
+{
+    for (int i = 0; i < TEST_TOPIC_NUM; ++i) {
+        int         app    = (int)(esp_random() % (uint32_t)app_num);
+        const char *target = TEST_CLIENT_ID;
+        switch (i % 8) {
+        case 5:  target = "broadcast";  break;
+        case 6:  target = "ESP32_0002"; break;
+        case 7:  app += TEST_APP_MAX;   break;      ///< 未注册的模块
+        default: break;
+        }
+        lens[i] = snprintf(topics[i], 64, TEST_BASE "/app%03d/%s/%s", app, target,
+                           (i & 1) ? "set" : "get_status");
+    }
+}
+
+/**
+ * @brief 对比 app_num 个模块时两种实现的 ns/消息
+ */
+static void test_bench(int app_num)
+{
+    static char topics[TEST_TOPIC_NUM][64];
+    static int  lens[TEST_TOPIC_NUM];
+    test_make_topics(topics, lens, app_num);
+
+    s_legacy_num = app_num;
+    for (int i = 0; i < app_num; ++i) {
+        test_register(i);
+        s_legacy[i].suffix = s_names[i];
+        s_legacy[i].idx    = i;
+    }
+
+    uint32_t legacy_hits[TEST_APP_MAX + 1];
+    memset(s_hits, 0, sizeof(s_hits));
+    uint64_t t0 = host_wall_ns();
+    for (int n = 0; n < TEST_MSG_NUM; ++n) {
+        int k = n % TEST_TOPIC_NUM;
+        test_legacy_dispatch(topics[k], lens[k]);
+    }
+    uint64_t legacy_ns = host_wall_ns() - t0;
+    memcpy(legacy_hits, s_hits, sizeof(s_hits));
+
+    memset(s_hits, 0, sizeof(s_hits));
+    t0 = host_wall_ns();
+    for (int n = 0; n < TEST_MSG_NUM; ++n) {
+        int k = n % TEST_TOPIC_NUM;
+        web_mqtt_manager_on_mqtt_message(topics[k], lens[k], (const uint8_t *)"1", 1);
+    }
+    uint64_t router_ns = host_wall_ns() - t0;
+
+    HOST_CHECK(memcmp(legacy_hits, s_hits, sizeof(s_hits)) == 0); ///< 两种实现命中完全一致
+    HOST_CHECK(test_total_hits() > 0);
+
+    double legacy = (double)legacy_ns / TEST_MSG_NUM;
+    double router = (double)router_ns / TEST_MSG_NUM;
+    printf("  %3d apps: snprintf loop %8.1f ns/msg, router %6.1f ns/msg (%.1fx)\n",
+           app_num, legacy, router, legacy / router);
+    HOST_CHECK(router < legacy);
+
+    for (int i = 0; i < app_num; ++i) {
+        HOST_CHECK(web_mqtt_manager_unregister_app(s_names[i]) == ESP_OK);
+    }
+}
+
+int main(void)
+{
+    s_mgr_cfg.base_topic = TEST_BASE;
+    s_mgr_cfg.client_id  = TEST_CLIENT_ID;
+    s_client_id_len      = strlen(TEST_CLIENT_ID);
+    host_random_seed(6);
+
+    test_routing();
+
+    printf("dispatch cost (%d messages, %d distinct topics):\n", TEST_MSG_NUM, TEST_TOPIC_NUM);
+    test_bench(8);
+    test_bench(32);
+    test_bench(128);
+
+    printf("test_router: OK\n");
+    return 0;
+}
@@ -0,0 +1,300 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-20 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-20 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\host_test\test_window.c
+ * @Description: 在途窗口主机测试：发布风暴下的堆底线 + 窗口令牌守恒
+ *
+ * 风暴：应用以 1000 条/s 同步发布 4 KB 的 QoS 1 消息，服务器每 5 ms 确认一条（200 条/s）。
+ * 假客户端与 esp-mqtt 一样把未确认消息连同 Topic 拷贝在堆上，
+ * 启用窗口时其占用不超过 inflight_max 条，关闭窗口时随积压线性增长。
+ *
+ * 守恒：随机交错发布、乱序确认、客户端删除、发送失败、msg_id 回绕复用与超时清理，
+ * 每一步之后都要求 “信号量空位 + 已登记未确认 == 窗口”，结束时窗口全部归还。
+ */
+
+#include <string.h>
+
+#include "esp_random.h"
+
+#include "host_stubs.h"
+
+#include "../src/mqtt_module.c"                    ///< 直接包含以便读取窗口信号量与跟踪表
+
+#define STORM_MSG_NUM        2000                  ///< 风暴消息数
+#define STORM_PAYLOAD_LEN    4096                  ///< 单条负载
+#define STORM_PUBLISH_MS     1                     ///< 应用发布间隔
+#define STORM_ACK_MS         5                     ///< 服务器确认间隔
+#define STORM_WINDOW         8                     ///< 风暴使用的窗口
+#define STORM_HEAP_FREE      (160 * 1024)          ///< 模拟风暴开始前的空闲堆
+#define STORM_HEAP_FLOOR     (64 * 1024)           ///< 必须守住的堆底线
+#define STORM_TOPIC          "xn/esp/log/ESP32_0001/upload"
+
+#define FUZZ_STEPS           200000                ///< 守恒测试随机步数
+#define FUZZ_WINDOW          16                    ///< 守恒测试窗口
+
+static esp_mqtt_client_handle_t s_client      = NULL; ///< 当前实例的假客户端
+static int64_t                  s_next_ack_ms = 0;    ///< 服务器下一次确认的时间
+static int                      s_edge_full   = 0;    ///< inflight_cb(full=true) 次数
+static int                      s_edge_drain  = 0;    ///< inflight_cb(full=false) 次数
+static bool                     s_is_full     = false; ///< 最近一次回调的水位
+
+static int64_t test_now_ms(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+/**
+ * @brief 服务器按固定速率确认到当前时刻为止应确认的消息
+ */
+static void test_broker_pump(void)
+{
+    while (s_next_ack_ms <= test_now_ms()) {
+        if (host_mqtt_complete(s_client, 0, false) < 0) {
+            s_next_ack_ms = test_now_ms() + STORM_ACK_MS; ///< 没有待确认消息，空闲期不累积额度
+            break;
+        }
+        s_next_ack_ms += STORM_ACK_MS;
+    }
+}
+
+/**
+ * @brief 发布方阻塞等待窗口时，时间推进到下一次确认
+ */
+static uint32_t test_storm_wait(uint32_t max_ms)
+{
+    int64_t step = s_next_ack_ms - test_now_ms();
+    if (step <= 0) {
+        step = 1;
+    }
+    if (step > (int64_t)max_ms) {
+        step = max_ms;
+    }
+    host_clock_advance_us(step * 1000);
+    test_broker_pump();
+    return (uint32_t)step;
+}
+
+/**
+ * @brief 窗口水位回调：满与回落必须交替出现
+ */
+static void test_inflight_cb(int inflight, bool full, void *user_ctx)
+{
+    HOST_CHECK(user_ctx == &s_edge_full);
+    HOST_CHECK(full != s_is_full);
+    s_is_full = full;
+    if (full) {
+        s_edge_full++;
+    } else {
+        s_edge_drain++;
+    }
+    (void)inflight;
+}
+
+static mqtt_module_handle_t test_create(int inflight_max, int wait_ms)
+{
+    mqtt_module_config_t cfg = MQTT_MODULE_DEFAULT_CONFIG();
+    cfg.broker_uri       = "mqtt://127.0.0.1:1883";
+    cfg.outbox_slot_num  = 0;                      ///< 同步发布路径，窗口直接作用于调用方
+    cfg.inflight_max     = inflight_max;
+    cfg.inflight_wait_ms = wait_ms;
+    cfg.inflight_cb_ex   = test_inflight_cb;
+    cfg.user_ctx         = &s_edge_full;
+
+    mqtt_module_handle_t m = NULL;
+    HOST_CHECK(mqtt_module_create(&cfg, &m) == ESP_OK);
+    s_client     = host_mqtt_last_client();
+    s_edge_full  = 0;
+    s_edge_drain = 0;
+    s_is_full    = false;
+    return m;
+}
+
+/**
+ * @brief 轨迹生命周期：实例引用期间拒绝销毁，实例销毁后才可释放
+ */
+static void test_trace_users(void)
+{
+    mqtt_trace_config_t tcfg = MQTT_TRACE_DEFAULT_CONFIG();
+    mqtt_trace_handle_t t    = NULL;
+    HOST_CHECK(mqtt_trace_create(&tcfg, &t) == ESP_OK);
+
+    mqtt_module_config_t cfg = MQTT_MODULE_DEFAULT_CONFIG();
+    cfg.broker_uri      = "mqtt://127.0.0.1:1883";
+    cfg.outbox_slot_num = 0;                       ///< 桩中的任务不运行，不创建 drain 任务
+    cfg.trace           = t;
+
+    mqtt_module_handle_t a = NULL;
+    mqtt_module_handle_t b = NULL;
+    HOST_CHECK(mqtt_module_create(&cfg, &a) == ESP_OK);
+    HOST_CHECK(mqtt_module_create(&cfg, &b) == ESP_OK);
+    HOST_CHECK(mqtt_trace_destroy(t) == ESP_ERR_INVALID_STATE);
+
+    mqtt_module_destroy(a);
+    HOST_CHECK(mqtt_trace_destroy(t) == ESP_ERR_INVALID_STATE);
+    mqtt_trace_inst_record(t, MQTT_TRACE_DIR_TX, "xn/esp/hb", -1, 24, 0, 0); ///< 轨迹仍可写入
+    mqtt_module_destroy(b);
+    HOST_CHECK(mqtt_trace_destroy(t) == ESP_OK);
+}
+
+/**
+ * @brief 检查窗口令牌守恒：空位 + 已登记未确认 == 窗口
+ */
+static void test_check_tokens(mqtt_module_handle_t m)
+{
+    HOST_CHECK(m->ack.freed == 0);
+    HOST_CHECK(host_sem_count(m->ack.window_sem) + m->ack.stats.unacked == m->ack.stats.window);
+}
+
+/**
+ * @brief 发布风暴：返回 esp-mqtt outbox 的堆占用峰值
+ */
+static size_t test_storm(int inflight_max)
+{
+    static uint8_t payload[STORM_PAYLOAD_LEN];
+    memset(payload, 'x', sizeof(payload));
+
+    mqtt_module_handle_t m = test_create(inflight_max, 1000);
+    s_next_ack_ms = test_now_ms() + STORM_ACK_MS;
+    host_rtos_set_wait_hook(test_storm_wait);
+
+    int64_t start_ms = test_now_ms();
+    int     ok       = 0;
+    for (int i = 0; i < STORM_MSG_NUM; ++i) {
+        if (mqtt_module_inst_publish(m, STORM_TOPIC, payload, sizeof(payload), 1, false) == ESP_OK) {
+            ok++;
+        }
+        host_clock_advance_us(STORM_PUBLISH_MS * 1000);
+        test_broker_pump();
+    }
+    int64_t elapsed_ms = test_now_ms() - start_ms;
+    while (host_mqtt_pending(s_client) > 0) {      ///< 风暴结束后服务器确认完剩余消息
+        (void)test_storm_wait(STORM_ACK_MS);
+    }
+
+    host_mqtt_outbox_t      outbox;
+    mqtt_module_ack_stats_t stats;
+    host_mqtt_get_outbox(s_client, &outbox);
+    HOST_CHECK(mqtt_module_inst_get_ack_stats(m, &stats, false) == ESP_OK);
+
+    printf("  window %2d: published %d/%d in %lld ms, outbox peak %u msgs / %zu B, "
+           "heap floor %ld B, window full %u, waits %u\n",
+           inflight_max, ok, STORM_MSG_NUM, (long long)elapsed_ms, (unsigned)outbox.num_peak, outbox.bytes_peak,
+           (long)STORM_HEAP_FREE - (long)outbox.bytes_peak, (unsigned)stats.window_full,
+           (unsigned)stats.window_wait);
+
+    HOST_CHECK(ok == STORM_MSG_NUM);               ///< 等待上限远大于确认间隔，不应超时
+    if (inflight_max > 0) {
+        HOST_CHECK(outbox.num_peak <= (size_t)inflight_max);
+        HOST_CHECK(stats.unacked_max <= (uint32_t)inflight_max);
+        HOST_CHECK(stats.acked == STORM_MSG_NUM && stats.unacked == 0);
+        HOST_CHECK(s_edge_full > 0 && s_edge_full == (int)stats.window_full);
+        HOST_CHECK(s_edge_drain == s_edge_full);   ///< 最后一次占满之后也已回落
+        test_check_tokens(m);
+        HOST_CHECK(host_sem_count(m->ack.window_sem) == inflight_max);
+    }
+
+    host_rtos_set_wait_hook(NULL);
+    mqtt_module_destroy(m);
+    return outbox.bytes_peak;
+}
+
+/**
+ * @brief 随机操作下的窗口令牌守恒
+ */
+static void test_conservation(void)
+{
+    mqtt_module_handle_t m = test_create(FUZZ_WINDOW, 0);
+    host_log_quiet = 1;                            ///< 注入的发送失败会逐条打印错误
+    uint32_t published = 0, timeouts = 0, failed = 0, acked = 0, deleted = 0, reused = 0, expired = 0;
+
+    for (int step = 0; step < FUZZ_STEPS; ++step) {
+        uint32_t r       = esp_random() % 100;
+        int      pending = host_mqtt_pending(s_client);
+
+        if (r < 40) {                              ///< QoS 1 发布，窗口满时立即返回 ESP_ERR_TIMEOUT
+            int       free_before = host_sem_count(m->ack.window_sem);
+            esp_err_t ret         = mqtt_module_inst_publish(m, "xn/esp/fuzz/a", "x", 1, 1, false);
+            if (ret == ESP_OK) {
+                published++;
+            } else {
+                HOST_CHECK(ret == ESP_ERR_TIMEOUT && free_before == 0);
+                timeouts++;
+            }
+        } else if (r < 44) {                       ///< 发送失败：预留的空位必须归还
+            if (host_sem_count(m->ack.window_sem) > 0) {
+                host_mqtt_fail_next(s_client, 1);
+                HOST_CHECK(mqtt_module_inst_publish(m, "xn/esp/fuzz/b", "x", 1, 1, false) == ESP_FAIL);
+                failed++;
+            }
+        } else if (r < 48) {                       ///< QoS 0 不占用窗口
+            HOST_CHECK(mqtt_module_inst_publish(m, "xn/esp/fuzz/c", "x", 1, 0, false) == ESP_OK);
+        } else if (r < 78) {                       ///< 乱序确认
+            if (pending > 0 && host_mqtt_complete(s_client, (int)(esp_random() % (uint32_t)pending), false) >= 0) {
+                acked++;
+            }
+        } else if (r < 84) {                       ///< 客户端超时删除
+            if (pending > 0 && host_mqtt_complete(s_client, (int)(esp_random() % (uint32_t)pending), true) >= 0) {
+                deleted++;
+            }
+        } else if (r < 88) {                       ///< 下一条消息复用一个仍在途的 msg_id
+            if (pending > 0) {
+                int id = host_mqtt_peek(s_client, (int)(esp_random() % (uint32_t)pending));
+                host_mqtt_set_next_id(s_client, (uint16_t)id);
+                reused++;
+            }
+        } else if (r < 90) {                       ///< 接近 65535，覆盖回绕
+            host_mqtt_set_next_id(s_client, (uint16_t)(UINT16_MAX - esp_random() % 4));
+        } else if (r < 91) {                       ///< 确认丢失：超时后由等待方清理
+            host_clock_advance_us((int64_t)(MQTT_ACK_EXPIRE_MS + 1) * 1000);
+            if (mqtt_module_inst_wait_inflight(m, 0) == ESP_OK) {
+                expired++;
+            }
+        } else {
+            host_clock_advance_us((int64_t)(esp_random() % 50) * 1000);
+        }
+
+        test_check_tokens(m);
+        HOST_CHECK(m->ack.stats.unacked <= FUZZ_WINDOW);
+    }
+
+    /* 服务器确认剩余消息，窗口应全部归还 */
+    while (host_mqtt_complete(s_client, 0, false) >= 0) {
+    }
+    mqtt_module_ack_stats_t stats;
+    HOST_CHECK(mqtt_module_inst_get_ack_stats(m, &stats, false) == ESP_OK);
+    test_check_tokens(m);
+    HOST_CHECK(stats.unacked == 0 && host_sem_count(m->ack.window_sem) == FUZZ_WINDOW);
+    HOST_CHECK(stats.tracked == stats.acked + stats.expired + stats.untracked);
+    HOST_CHECK(s_edge_full == (int)stats.window_full);
+
+    printf("  %d steps: published %u, timeouts %u, send failures %u, acks %u, deletes %u, "
+           "id reuse %u, expiry sweeps %u, expired %u, window full %u\n",
+           FUZZ_STEPS, (unsigned)published, (unsigned)timeouts, (unsigned)failed, (unsigned)acked,
+           (unsigned)deleted, (unsigned)reused, (unsigned)expired, (unsigned)stats.expired,
+           (unsigned)stats.window_full);
+    HOST_CHECK(timeouts > 0 && failed > 0 && stats.expired > 0);
+    host_log_quiet = 0;
+
+    mqtt_module_destroy(m);
+}
+
+int main(void)
+{
+    host_random_seed(16);
+
+    printf("publish storm (%d x %d B QoS 1, publish every %d ms, ack every %d ms, %d KB heap free):\n",
+           STORM_MSG_NUM, STORM_PAYLOAD_LEN, STORM_PUBLISH_MS, STORM_ACK_MS, STORM_HEAP_FREE / 1024);
+    size_t bounded   = test_storm(STORM_WINDOW);
+    size_t unbounded = test_storm(0);
+    HOST_CHECK(STORM_HEAP_FREE - (long)bounded >= STORM_HEAP_FLOOR);
+    HOST_CHECK(STORM_HEAP_FREE - (long)unbounded < STORM_HEAP_FLOOR); ///< 不限窗口时守不住底线
+
+    printf("window token conservation:\n");
+    test_conservation();
+    test_trace_users();
+
+    printf("test_window: OK\n");
+    return 0;
+}
@@ -15,7 +15,9 @@
 #ifndef MQTT_APP_MODULE_H
 #define MQTT_APP_MODULE_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "esp_err.h"
 #include "web_mqtt_manager.h"  ///< 复用管理器中的状态定义
@@ -33,13 +35,144 @@ typedef esp_err_t (*web_mqtt_app_msg_cb_t)(const char    *topic,
                                            const uint8_t *payload,
                                            int            payload_len);
 
+/**
+ * @brief 路由器可处理的 Topic 最大层级数，超出的消息视为不匹配
+ */
+#define WEB_MQTT_TOPIC_MAX_SEGS 12
+
+/**
+ * @brief 已按 '/' 切分好的下行 Topic
+ *
+ * 由管理器在分发前切分一次，回调无需再 snprintf 拼前缀或 memcmp 比较：
+ *  - seg[0 .. base_segs-1]                  : base_topic；
+ *  - seg[base_segs .. cmd_index-2]          : 模块前缀（topic_suffix）；
+ *  - seg[cmd_index-1]                       : 目标段（client_id / "broadcast" 等）；
+ *  - seg[cmd_index .. seg_num-1]            : 命令段（如 "set" / "get_status"）。
+ */
+typedef struct {
+    const char *topic;                          ///< 完整 Topic（不保证以 '\0' 结尾）
+    int         topic_len;                      ///< Topic 长度
+    int         seg_num;                        ///< 层级数
+    const char *seg[WEB_MQTT_TOPIC_MAX_SEGS];   ///< 各层级起始指针
+    uint8_t     seg_len[WEB_MQTT_TOPIC_MAX_SEGS]; ///< 各层级长度
+    int         base_segs;                      ///< base_topic 占用的层级数
+    int         cmd_index;                      ///< 第一个命令段下标，>= seg_num 表示没有命令段
+    bool        for_device;                     ///< 目标段是否等于本设备 client_id
+    const char    *response_topic;              ///< MQTT 5.0 Response Topic（以 '\0' 结尾），无则为 NULL
+    int            response_topic_len;          ///< Response Topic 长度
+    const uint8_t *correlation_data;            ///< MQTT 5.0 Correlation Data，无则为 NULL
+    int            correlation_data_len;        ///< Correlation Data 长度
+} web_mqtt_topic_t;
+
+/**
+ * @brief 应用模块消息回调（预切分 Topic 版本）
+ */
+typedef esp_err_t (*web_mqtt_app_route_cb_t)(const web_mqtt_topic_t *topic,
+                                             const uint8_t          *payload,
+                                             int                     payload_len);
+
+/**
+ * @brief 判断 Topic 的第 idx 层是否等于字符串 str
+ */
+static inline bool web_mqtt_topic_seg_is(const web_mqtt_topic_t *t, int idx, const char *str)
+{
+    if (t == NULL || idx < 0 || idx >= t->seg_num) {
+        return false;
+    }
+    size_t n = strlen(str);
+    return t->seg_len[idx] == n && memcmp(t->seg[idx], str, n) == 0;
+}
+
+/**
+ * @brief 单个应用模块最多声明的订阅模板数
+ */
+#define WEB_MQTT_APP_FILTER_MAX_NUM 4
+
+/**
+ * @brief 常用订阅模板
+ *
+ * 模板中可使用以下占位符，在订阅时由管理器展开：
+ *  - {base}      : 下行基础 Topic（配置中的 base_topic）；
+ *  - {suffix}    : 模块前缀（topic_suffix）；
+ *  - {client_id} : 本设备 client_id。
+ */
+#define WEB_MQTT_APP_FILTER_DEVICE    "{base}/{suffix}/{client_id}/#" ///< 仅本设备的指令
+#define WEB_MQTT_APP_FILTER_BROADCAST "{base}/{suffix}/broadcast/#"   ///< 面向全部设备的广播
+#define WEB_MQTT_APP_FILTER_ALL       "{base}/{suffix}/#"             ///< 模块前缀下全部消息（整个设备群的流量）
+
+/**
+ * @brief 应用模块默认分发队列长度
+ */
+#define WEB_MQTT_APP_QUEUE_DEFAULT_LEN 4
+
+/**
+ * @brief 应用模块消息的执行方式
+ *
+ * 除 INLINE 外，回调都在管理器的分发线程中执行，不会阻塞 esp-mqtt 任务
+ * （keepalive 与其他下行消息不受慢回调影响）；同一模块的消息按到达顺序串行执行。
+ */
+typedef enum {
+    WEB_MQTT_APP_DISPATCH_COPY = 0, ///< 拷贝 Topic 与负载后入队（默认）
+    WEB_MQTT_APP_DISPATCH_TRANSFER, ///< 分片重组得到的负载直接转移给队列免拷贝，其余消息仍拷贝
+    WEB_MQTT_APP_DISPATCH_INLINE,   ///< 在 esp-mqtt 任务中直接执行，仅适用于极轻量、不阻塞的回调
+} web_mqtt_app_dispatch_t;
+
+/**
+ * @brief 单个模块最多声明的限流规则数
+ */
+#define WEB_MQTT_APP_LIMIT_MAX_NUM 4
+
+/**
+ * @brief 按命令段的限流规则
+ *
+ * 在 esp-mqtt 任务中、入队之前生效，被限流的消息不分配内存、不占用队列：
+ *  - 令牌桶：每条消息消耗一个令牌，令牌按 rate_per_min 匀速补充，最多攒 burst 个；
+ *  - 合并：队列中已有同一 Topic 的未执行消息时，用新消息替换它，只执行最新的一条，
+ *    合并不消耗令牌。仅适用于结果只取决于最新状态的幂等命令（如 get_status）。
+ */
+typedef struct {
+    const char *cmd;          ///< 命令段（需为静态字符串），如 "set"；"*" 匹配其余全部命令，NULL 表示规则结束
+    uint16_t    rate_per_min; ///< 令牌补充速率（条/分钟），0 表示不限速
+    uint16_t    burst;        ///< 令牌桶容量（允许的突发条数），<=0 按 1 处理
+    bool        coalesce;     ///< 是否合并队列中同一 Topic 的未执行消息（INLINE 模块无效）
+} web_mqtt_app_limit_t;
+
+/**
+ * @brief 应用模块分发统计
+ */
+typedef struct {
+    uint32_t queued;         ///< 累计入队消息数（INLINE 模块为 0）
+    uint32_t handled;        ///< 累计执行回调次数
+    uint32_t dropped;        ///< 因队列满或内存不足被丢弃的消息数
+    uint32_t rate_limited;   ///< 因令牌桶耗尽被丢弃的消息数
+    uint32_t coalesced;      ///< 被同一 Topic 的新消息替换掉的未执行消息数
+    uint16_t depth;          ///< 当前队列深度
+    uint16_t high_water;     ///< 队列深度历史最大值
+    uint32_t wait_us_max;    ///< 入队到开始执行的最大等待时间（us）
+    uint32_t handler_us_avg; ///< 回调平均耗时（us）
+    uint32_t handler_us_max; ///< 回调最大耗时（us）
+} web_mqtt_app_stats_t;
+
+/**
+ * @brief 应用模块注册配置
+ */
+typedef struct {
+    const char            *topic_suffix; ///< 模块 Topic 前缀（不含 base_topic 和前导 '/'），如 "reg"；可含独占一层的 '+'，如 "ota/+"
+    web_mqtt_app_msg_cb_t  cb;           ///< 模块消息回调（完整 Topic 版本），与 route_cb 二选一
+    web_mqtt_app_route_cb_t route_cb;    ///< 模块消息回调（预切分 Topic 版本），优先于 cb
+    const char            *filters[WEB_MQTT_APP_FILTER_MAX_NUM]; ///< 订阅模板（需为静态字符串），全部为 NULL 时使用 DEVICE + BROADCAST
+    web_mqtt_app_dispatch_t dispatch;    ///< 消息执行方式，默认 COPY
+    uint8_t                priority;     ///< 分发优先级，数值越大越先被分发线程处理
+    int                    queue_len;    ///< 分发队列长度，<=0 使用 WEB_MQTT_APP_QUEUE_DEFAULT_LEN；队列满时丢弃新消息
+    web_mqtt_app_limit_t   limits[WEB_MQTT_APP_LIMIT_MAX_NUM]; ///< 按命令段的限流 / 合并规则，按顺序取第一条匹配的规则；全部为空表示不限制
+} web_mqtt_app_config_t;
+
 /**
  * @brief 在 Web MQTT 管理器中注册一个应用模块消息处理回调
  *
- * 管理器内部会维护一个简单的“路由表”，按如下规则匹配并分发消息：
- *  - 实际 Topic 形如： base_topic "/" topic_suffix "/..."；
- *  - 只要前缀 "base_topic/topic_suffix" 匹配，即调用对应回调；
- *  - 这样可以很方便地按模块前缀拆分：例如 "reg" / "hb" / "wifi_cfg" 等。
+ * 等价于使用默认订阅模板调用 web_mqtt_manager_register_app_ex：
+ *  - 只订阅 base_topic/topic_suffix/<client_id>/# 与 base_topic/topic_suffix/broadcast/#；
+ *  - 其他设备的指令不会再由服务器转发到本设备。
  *
  * @param topic_suffix 模块的 Topic 前缀（不含 base_topic 和前导 '/'），如 "reg"；
  * @param cb           模块的消息处理回调，不可为 NULL。
@@ -47,9 +180,48 @@ typedef esp_err_t (*web_mqtt_app_msg_cb_t)(const char    *topic,
  * @return
  *  - ESP_OK             : 注册成功
  *  - ESP_ERR_INVALID_ARG: 参数非法
- *  - ESP_ERR_NO_MEM    : 模块数量已达上限
+ *  - ESP_ERR_NO_MEM    : 内存不足
+ *
+ * @note 模块数量不设上限；同名模块重复注册视为替换，旧模块队列中未执行的消息被丢弃。
+ *       注册 / 注销会等待正在读取旧注册表的分发过程结束，因此不可在 INLINE 回调中调用。
  */
 esp_err_t web_mqtt_manager_register_app(const char *topic_suffix,
                                         web_mqtt_app_msg_cb_t cb);
 
+/**
+ * @brief 按自定义订阅模板注册应用模块
+ *
+ * 管理器只订阅展开后的模板，并且只把与这些过滤器匹配的消息分发给该模块；
+ * 不匹配任何模块的消息计入 web_mqtt_manager_stats_t::rx_unmatched。
+ *
+ * 注册时过滤器会被预编译进路由表（按模块前缀首段哈希分桶），
+ * 收到消息时只切分一次 Topic，分发耗时与 Topic 长度成正比，不做任何格式化。
+ *
+ * @return 同 web_mqtt_manager_register_app
+ */
+esp_err_t web_mqtt_manager_register_app_ex(const web_mqtt_app_config_t *config);
+
+/**
+ * @brief 注销应用模块
+ *
+ * 返回后不再有新消息分发给该模块；正在执行的回调允许执行完毕，
+ * 队列中尚未执行的消息被丢弃。模块独占的订阅过滤器会被退订。
+ *
+ * @return
+ *  - ESP_OK             : 成功
+ *  - ESP_ERR_INVALID_ARG: 参数非法
+ *  - ESP_ERR_NOT_FOUND  : 模块未注册
+ */
+esp_err_t web_mqtt_manager_unregister_app(const char *topic_suffix);
+
+/**
+ * @brief 获取指定应用模块的分发统计
+ *
+ * @return
+ *  - ESP_OK             : 成功
+ *  - ESP_ERR_INVALID_ARG: 参数非法
+ *  - ESP_ERR_NOT_FOUND  : 模块未注册
+ */
+esp_err_t web_mqtt_manager_get_app_stats(const char *topic_suffix, web_mqtt_app_stats_t *out);
+
 #endif /* MQTT_APP_MODULE_H */
@@ -0,0 +1,163 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-12 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-12 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\include\mqtt_broker_module.h
+ * @Description: MQTT 服务器列表与故障切换接口
+ *
+ * 设计要点：
+ *  - 按列表顺序与权重选择服务器，记录每台服务器的 CONNACK 延迟（滑动平均）；
+ *  - 当前服务器健康时始终沿用，连续失败达到阈值后进入冷却期，立即切换到下一台；
+ *  - 连接尝试超出延迟预算时，由管理状态机并行发起 TCP 探测，最先握手成功的服务器胜出；
+ *  - 全部服务器都处于冷却期时才回到 web_mqtt_manager 的指数退避。
+ */
+
+#ifndef MQTT_BROKER_MODULE_H
+#define MQTT_BROKER_MODULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief 服务器列表最大长度
+ */
+#define MQTT_BROKER_MAX 4
+
+/**
+ * @brief 服务器列表中的一项
+ */
+typedef struct {
+    const char *uri;    ///< 服务器 URI，如 "mqtt://192.168.1.10:1883"（需在运行期间保持有效）
+    int         weight; ///< 权重（1~100），延迟折算时除以权重，<=0 按 1 处理
+} mqtt_broker_t;
+
+/**
+ * @brief 服务器选择与探测配置
+ */
+typedef struct {
+    const mqtt_broker_t *list;              ///< 服务器列表，按优先级排列
+    int                  num;               ///< 列表长度（1~MQTT_BROKER_MAX）
+    int                  latency_budget_ms; ///< CONNACK 延迟预算（ms）：连接尝试超过该时长即并行探测其他服务器，
+                                            ///< 平均延迟超出预算的服务器排在未知服务器之后；<=0 表示不探测
+    int                  probe_timeout_ms;  ///< 单次并行 TCP 探测的最长等待（ms）
+    int                  fail_threshold;    ///< 连续失败达到该次数后进入冷却期，<=0 按 1 处理
+    int                  hold_down_ms;      ///< 冷却期时长（ms），期间不再选择该服务器
+} mqtt_broker_config_t;
+
+/**
+ * @brief 服务器选择默认配置（列表由调用方填写）
+ */
+#define MQTT_BROKER_DEFAULT_CONFIG()     \
+    (mqtt_broker_config_t){             \
+        .list              = NULL,      \
+        .num               = 0,         \
+        .latency_budget_ms = 3000,      \
+        .probe_timeout_ms  = 1000,      \
+        .fail_threshold    = 1,         \
+        .hold_down_ms      = 60000,     \
+    }
+
+/**
+ * @brief 单台服务器的统计信息
+ */
+typedef struct {
+    const char *uri;            ///< 服务器 URI
+    uint32_t    attempts;       ///< 发起的连接尝试次数
+    uint32_t    connects;       ///< 收到 CONNACK 的次数
+    uint32_t    failures;       ///< 连接失败次数（含超时与被探测结果抢先）
+    uint32_t    raced;          ///< 超出延迟预算后被其他服务器抢先而放弃的次数
+    uint32_t    connack_ms;     ///< 最近一次 CONNACK 延迟（ms）
+    uint32_t    connack_avg_ms; ///< CONNACK 延迟滑动平均（ms），0 表示尚无数据
+    uint32_t    probe_ms;       ///< 最近一次 TCP 探测握手耗时（ms），0 表示未探测或无响应
+    bool        healthy;        ///< 是否可选（不在冷却期）
+    bool        current;        ///< 是否为当前使用的服务器
+} mqtt_broker_stats_t;
+
+/**
+ * @brief 初始化服务器列表
+ *
+ * 只解析并保存列表，不进行任何网络操作；当前服务器为列表第一项。
+ *
+ * @return
+ *      - ESP_OK              : 初始化成功
+ *      - ESP_ERR_INVALID_ARG : 列表为空、过长或 URI 无法解析
+ */
+esp_err_t mqtt_broker_init(const mqtt_broker_config_t *config);
+
+/**
+ * @brief 服务器数量
+ */
+int mqtt_broker_num(void);
+
+/**
+ * @brief 当前服务器下标
+ */
+int mqtt_broker_current(void);
+
+/**
+ * @brief 获取指定服务器的 URI，下标非法时返回 NULL
+ */
+const char *mqtt_broker_uri(int idx);
+
+/**
+ * @brief 选择下一次连接尝试使用的服务器，并设为当前服务器
+ *
+ * 冷却期外的服务器中：平均延迟在预算内的按 延迟/权重 取最小，其次是尚无数据的（按列表顺序），
+ * 最后是平均延迟超出预算的；全部处于冷却期时选择最早结束冷却的一台。
+ *
+ * @param failover 输出：是否切换到了一台冷却期外的其他服务器（此时无需退避，可立即连接）
+ *
+ * @return 选中的服务器下标
+ */
+int mqtt_broker_select(bool *failover);
+
+/**
+ * @brief 直接指定当前服务器（探测胜出后改连该服务器）
+ */
+void mqtt_broker_set_current(int idx);
+
+/**
+ * @brief 记录一次连接尝试
+ */
+void mqtt_broker_on_attempt(int idx);
+
+/**
+ * @brief 记录一次成功连接（收到 CONNACK），清除连续失败计数
+ *
+ * @param connack_ms 从发起连接到收到 CONNACK 的耗时
+ */
+void mqtt_broker_on_connected(int idx, uint32_t connack_ms);
+
+/**
+ * @brief 记录一次连接失败，连续失败达到阈值时进入冷却期
+ *
+ * @param raced true 表示因超出延迟预算、被探测结果抢先而主动放弃
+ */
+void mqtt_broker_on_failed(int idx, bool raced);
+
+/**
+ * @brief 并行探测其他服务器（阻塞）
+ *
+ * 对冷却期外、除 exclude 之外的服务器同时发起非阻塞 TCP 连接，
+ * 返回最先完成握手的一台；域名解析在探测前逐台同步完成，不计入握手耗时。
+ * 总耗时为各台域名解析时间之和再加最长 probe_timeout_ms，不可在事件循环中调用。
+ *
+ * @param exclude 不参与探测的服务器下标（通常为当前正在连接的服务器）
+ *
+ * @return 胜出的服务器下标；无服务器响应时返回 -1
+ */
+int mqtt_broker_probe(int exclude);
+
+/**
+ * @brief 获取各服务器统计信息
+ *
+ * @param out 输出数组，至少 max 项
+ * @param max 数组容量
+ * @param num 输出：实际填写的项数，可为 NULL
+ */
+esp_err_t mqtt_broker_get_stats(mqtt_broker_stats_t *out, int max, int *num);
+
+#endif /* MQTT_BROKER_MODULE_H */
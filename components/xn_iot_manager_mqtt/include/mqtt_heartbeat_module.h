@@ -4,21 +4,51 @@
  * @LastEditors: xingnian && jixingnian@gmail.com
  * @LastEditTime: 2025-11-24 13:52:00
  * @FilePath: \xn_web_mqtt_manager\components\iot_manager_mqtt\include\mqtt_heartbeat_module.h
- * @Description: 心跳模块接口（根据注册状态定时上报心跳）
+ * @Description: 心跳模块接口（根据注册状态与链路空闲时长上报心跳）
  */
 
 #ifndef MQTT_HEARTBEAT_MODULE_H
 #define MQTT_HEARTBEAT_MODULE_H
 
+#include <stdint.h>
+
 #include "esp_err.h"
 #include "web_mqtt_manager.h"
 
+/**
+ * @brief 健康记录格式版本（记录首字节）
+ *
+ * 只在末尾追加字段时版本号不变，服务器按长度识别新增字段；字段含义或顺序变化时加一。
+ */
+#define MQTT_HB_HEALTH_VERSION 1
+
+/**
+ * @brief 心跳负载：定长二进制健康记录（小端，24 字节）
+ *
+ * 旧版本心跳负载为设备 ID 文本，首字节不会是 MQTT_HB_HEALTH_VERSION，服务器据此区分。
+ */
+typedef struct {
+    uint8_t  ver;                 ///< 格式版本（MQTT_HB_HEALTH_VERSION）
+    int8_t   rssi;                ///< 当前 AP 信号强度（dBm），0 表示未连接或无法获取
+    uint16_t connects;            ///< 累计连接尝试次数（含首次，65535 封顶）
+    uint32_t uptime_s;            ///< 运行时长（秒）
+    uint32_t heap_free;           ///< 当前空闲堆（字节）
+    uint32_t heap_min;            ///< 启动以来最小空闲堆（字节）
+    uint16_t outbox_depth;        ///< 出站队列当前深度
+    uint16_t outbox_high_water;   ///< 出站队列深度历史最大值
+    uint16_t rx_queue_depth;      ///< 下行分发队列当前深度之和
+    uint16_t rx_queue_high_water; ///< 下行分发队列深度历史最大值（各模块取最大）
+} mqtt_hb_health_t;
+
 /**
  * @brief 初始化心跳模块
  *
  * 由 Web MQTT 管理器在初始化阶段调用一次：
  *  - 保存 base_topic / client_id 等必要信息；
- *  - 创建内部心跳任务，按固定间隔检查注册状态并发送心跳。
+ *  - 在管理器中注册前缀 "hb"，接收服务器下发的心跳间隔（base_topic/hb/<id>/interval，负载为秒数）；
+ *  - 在共享事件循环（xn_loop）中创建心跳定时器，已注册且链路空闲满 heartbeat_interval_ms 时才发送心跳，
+ *    期间任何送达服务器的上行（见 mqtt_module_last_uplink_ms）都会推迟下一次心跳；
+ *  - 心跳负载为 mqtt_hb_health_t 健康记录，服务器解析后按设备保存最新值。
  */
 esp_err_t mqtt_heartbeat_module_init(const web_mqtt_manager_config_t *mgr_cfg);
 
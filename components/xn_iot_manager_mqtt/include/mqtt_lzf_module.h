@@ -0,0 +1,68 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-10 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-10 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\include\mqtt_lzf_module.h
+ * @Description: MQTT 负载压缩（LZF 格式）接口
+ *
+ * 设计要点：
+ *  - 压缩流与 liblzf 格式一致，服务器可直接使用 lzf_decompress 或纯 PHP 解码；
+ *  - 压缩帧 = 2 字节大端原始长度 + LZF 压缩流，解码前即可按原始长度分配缓冲区；
+ *  - 压缩后的消息在 Topic 末尾追加 "/z" 标记，上下行规则相同，3.1.1 / 5.0 通用；
+ *  - 不做动态内存分配，哈希表由调用方提供，可在任意任务中并发使用。
+ */
+
+#ifndef MQTT_LZF_MODULE_H
+#define MQTT_LZF_MODULE_H
+
+#include <stdint.h>
+
+/**
+ * @brief 压缩消息的 Topic 后缀
+ */
+#define MQTT_LZF_TOPIC_SUFFIX "/z"
+
+/**
+ * @brief 压缩帧头长度（大端原始长度）
+ */
+#define MQTT_LZF_HEADER_LEN 2
+
+/**
+ * @brief 可压缩的最大原始长度（受帧头限制）
+ */
+#define MQTT_LZF_MAX_LEN 0xFFFF
+
+/**
+ * @brief 压缩哈希表项数（uint16_t），调用方按此大小提供工作区
+ */
+#define MQTT_LZF_HTAB_NUM 1024
+
+/**
+ * @brief 压缩为一帧
+ *
+ * @param in      原始数据
+ * @param in_len  原始长度（不超过 MQTT_LZF_MAX_LEN）
+ * @param out     输出缓冲区
+ * @param out_cap 输出缓冲区容量
+ * @param htab    MQTT_LZF_HTAB_NUM 项的哈希表工作区（无需初始化）
+ *
+ * @return 帧长度；0 表示压缩后不小于原始长度或放不下，调用方应发送原始数据
+ */
+int mqtt_lzf_pack(const uint8_t *in, int in_len, uint8_t *out, int out_cap, uint16_t *htab);
+
+/**
+ * @brief 读取帧头中的原始长度
+ *
+ * @return 原始长度；-1 表示帧非法
+ */
+int mqtt_lzf_unpacked_len(const uint8_t *frame, int frame_len);
+
+/**
+ * @brief 解压一帧
+ *
+ * @return 原始长度；-1 表示帧损坏或 out_cap 不足
+ */
+int mqtt_lzf_unpack(const uint8_t *frame, int frame_len, uint8_t *out, int out_cap);
+
+#endif /* MQTT_LZF_MODULE_H */
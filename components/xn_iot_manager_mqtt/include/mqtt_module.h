@@ -9,7 +9,9 @@
  * 设计要点：
  * - 只关心 MQTT 客户端本身，不直接耦合上层业务；
  * - 通过简单事件回调向上层报告连接状态变化；
- * - 由 web_mqtt_manager 在初始化时配置 broker_uri / 认证信息等。
+ * - 由 web_mqtt_manager 在初始化时配置 broker_uri / 认证信息等；
+ * - 每个实例（mqtt_module_handle_t）是一条独立的服务器会话，可同时连接局域网与云端服务器；
+ *   不带句柄的接口作用于 mqtt_module_init() 创建的默认实例。
  * 
  * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved. 
  */
@@ -21,11 +23,21 @@
 #include <stdint.h>
 
 #include "esp_err.h"  ///< ESP-IDF 通用错误码
+#include "mqtt_spool_module.h"
+#include "mqtt_trace_module.h"
 
 /* -------------------------------------------------------------------------- */
 /*                               事件与回调类型                                */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief MQTT 模块实例句柄
+ *
+ * 每个实例拥有独立的客户端、出站队列与 drain 任务、接收重组缓冲区和统计信息。
+ * 回调的 _ex 版本携带配置中的 user_ctx，多个实例可共用同一组回调并据此区分来源。
+ */
+typedef struct mqtt_module_s *mqtt_module_handle_t;
+
 /**
  * @brief MQTT 模块向上层上报的事件
  *
@@ -44,6 +56,14 @@ typedef enum {
  */
 typedef void (*mqtt_module_event_cb_t)(mqtt_module_event_t event);
 
+/**
+ * @brief 携带 user_ctx 的事件回调
+ *
+ * @param event    当前发生的 MQTT 事件
+ * @param user_ctx 配置中的 user_ctx
+ */
+typedef void (*mqtt_module_event_cb_ex_t)(mqtt_module_event_t event, void *user_ctx);
+
 /**
  * @brief MQTT 模块收到消息时的回调
  *
@@ -59,6 +79,255 @@ typedef void (*mqtt_module_message_cb_t)(const char  *topic,
                                          const uint8_t *payload,
                                          int          payload_len);
 
+/**
+ * @brief 携带 user_ctx 的消息回调，参数同 mqtt_module_message_cb_t
+ *
+ * @param user_ctx 配置中的 user_ctx
+ */
+typedef void (*mqtt_module_message_cb_ex_t)(const char    *topic,
+                                            int            topic_len,
+                                            const uint8_t *payload,
+                                            int            payload_len,
+                                            void          *user_ctx);
+
+/**
+ * @brief SUBACK 回调
+ *
+ * 在 esp-mqtt 任务中调用，回调内不可阻塞等待其他调用 MQTT 接口的任务。
+ *
+ * @param msg_id 对应 SUBSCRIBE 报文的 msg_id（由订阅接口返回）
+ * @param ok     报文内所有过滤器均被服务器接受时为 true
+ */
+typedef void (*mqtt_module_suback_cb_t)(int msg_id, bool ok);
+
+/**
+ * @brief 携带 user_ctx 的 SUBACK 回调，参数同 mqtt_module_suback_cb_t
+ *
+ * @param user_ctx 配置中的 user_ctx
+ */
+typedef void (*mqtt_module_suback_cb_ex_t)(int msg_id, bool ok, void *user_ctx);
+
+/**
+ * @brief 在途窗口水位回调
+ *
+ * 在途（已交给客户端、尚未确认）的 QoS>=1 消息数达到 inflight_max 时以 full=true 调用一次，
+ * 回落到 inflight_max 的一半及以下时以 full=false 调用一次。
+ * 可能在发布者任务或 esp-mqtt 任务中调用，回调内不可阻塞或调用发布接口。
+ *
+ * @param inflight 当前在途消息数
+ * @param full     true 表示窗口已满（高水位），false 表示已回落（低水位）
+ */
+typedef void (*mqtt_module_inflight_cb_t)(int inflight, bool full);
+
+/**
+ * @brief 携带 user_ctx 的在途窗口水位回调，参数同 mqtt_module_inflight_cb_t
+ *
+ * @param user_ctx 配置中的 user_ctx
+ */
+typedef void (*mqtt_module_inflight_cb_ex_t)(int inflight, bool full, void *user_ctx);
+
+/**
+ * @brief 单个 SUBSCRIBE 报文最多携带的过滤器数
+ */
+#define MQTT_MODULE_SUBSCRIBE_BATCH_MAX 8
+
+/**
+ * @brief 批量订阅中的一个过滤器
+ */
+typedef struct {
+    const char *filter; ///< 订阅过滤器
+    int         qos;    ///< 期望的 QoS 等级（0/1/2）
+} mqtt_module_topic_t;
+
+/**
+ * @brief 超大消息分片回调
+ *
+ * 负载超过 rx_max_msg_len（或没有空闲重组缓冲区）时，不再整条重组，
+ * 而是按到达顺序把各分片依次交给该回调；offset + len == total_len 表示最后一片。
+ *
+ * @param topic       消息 Topic（每个分片都会携带）
+ * @param topic_len   Topic 长度
+ * @param offset      本分片在整条负载中的偏移
+ * @param total_len   整条负载长度
+ * @param data        本分片数据
+ * @param len         本分片长度
+ */
+typedef void (*mqtt_module_fragment_cb_t)(const char    *topic,
+                                          int            topic_len,
+                                          int            offset,
+                                          int            total_len,
+                                          const uint8_t *data,
+                                          int            len);
+
+/**
+ * @brief 携带 user_ctx 的超大消息分片回调，参数同 mqtt_module_fragment_cb_t
+ *
+ * @param user_ctx 配置中的 user_ctx
+ */
+typedef void (*mqtt_module_fragment_cb_ex_t)(const char    *topic,
+                                             int            topic_len,
+                                             int            offset,
+                                             int            total_len,
+                                             const uint8_t *data,
+                                             int            len,
+                                             void          *user_ctx);
+
+/**
+ * @brief 接收重组统计信息
+ */
+typedef struct {
+    uint32_t whole;       ///< 单个 DATA 事件即完整的消息数
+    uint32_t reassembled; ///< 由多个分片重组得到的消息数
+    uint32_t streamed;    ///< 以分片流方式交付的超大消息数
+    uint32_t dropped;     ///< 因超限且无分片回调而丢弃的消息数
+    uint32_t no_buffer;   ///< 因重组缓冲区耗尽而改为分片流/丢弃的次数
+} mqtt_module_rx_stats_t;
+
+/**
+ * @brief MQTT 5.0 请求/响应属性
+ *
+ * 收到消息时由 mqtt_module_rx_get_props 读取；发布时传给 mqtt_module_publish_props。
+ * MQTT 3.1.1 连接下两项均为空。
+ */
+typedef struct {
+    const char    *response_topic;       ///< Response Topic（以 '\0' 结尾），NULL 表示无
+    int            response_topic_len;   ///< Response Topic 长度
+    const uint8_t *correlation_data;     ///< Correlation Data，NULL 表示无
+    int            correlation_data_len; ///< Correlation Data 长度
+} mqtt_module_msg_props_t;
+
+/**
+ * @brief 出站队列已满时的处理策略
+ */
+typedef enum {
+    MQTT_MODULE_OUTBOX_DROP_OLDEST = 0, ///< 丢弃队列中最旧的一条，为新消息腾出槽位
+    MQTT_MODULE_OUTBOX_DROP_NEWEST,     ///< 丢弃当前这条新消息，队列内容保持不变
+    MQTT_MODULE_OUTBOX_BLOCK,           ///< 阻塞等待空闲槽位，最长 outbox_block_ms
+} mqtt_module_outbox_policy_t;
+
+/**
+ * @brief 出站队列票据
+ *
+ * 每条成功入队的消息分配一个单调递增的票据（0 保留为无效），可用于查询该消息的去向。
+ */
+typedef uint32_t mqtt_module_ticket_t;
+
+/**
+ * @brief 票据对应消息的去向
+ */
+typedef enum {
+    MQTT_MODULE_TICKET_UNKNOWN = 0, ///< 未分配过的票据，或已太久远（只保留最近 2 * outbox_slot_num 条去向）
+    MQTT_MODULE_TICKET_PENDING,     ///< 仍在队列中，或正等待在途窗口
+    MQTT_MODULE_TICKET_SENT,        ///< 已提交到 esp-mqtt 客户端
+    MQTT_MODULE_TICKET_SPOOLED,     ///< 离线，已转存到 Flash 等待回放
+    MQTT_MODULE_TICKET_DROPPED,     ///< 队列满时被 DROP_OLDEST 策略挤出，未发送
+    MQTT_MODULE_TICKET_FAILED,      ///< 提交到客户端失败，或实例销毁时被放弃
+} mqtt_module_ticket_state_t;
+
+/**
+ * @brief 零拷贝发布租约
+ *
+ * 由 mqtt_module_publish_begin 填写，调用方直接把负载序列化到 buf 中，
+ * 随后调用 mqtt_module_publish_commit 提交或 mqtt_module_publish_abort 放弃。
+ */
+typedef struct {
+    mqtt_module_handle_t inst; ///< 槽位所属实例
+    char                *buf;  ///< 出站槽位中的可写负载区域
+    int                  cap;  ///< 可写容量（字节）
+    int                  slot; ///< 内部槽位下标，<0 表示租约无效
+} mqtt_module_publish_lease_t;
+
+/**
+ * @brief 出站队列统计信息
+ */
+typedef struct {
+    uint32_t enqueued;   ///< 累计成功入队条数
+    uint32_t dropped;    ///< 累计因队列满被丢弃的条数
+    uint32_t sent;       ///< 累计已提交到 esp-mqtt 客户端的条数
+    uint32_t failed;     ///< 累计提交到客户端失败的条数
+    uint32_t spooled;    ///< 累计因离线转存到 Flash 的条数
+    uint16_t depth;      ///< 当前排队条数
+    uint16_t high_water; ///< 历史最大排队条数
+    uint16_t capacity;   ///< 队列槽位总数
+} mqtt_module_outbox_stats_t;
+
+/**
+ * @brief 上行 Topic 别名统计信息（仅 MQTT 5.0）
+ */
+typedef struct {
+    uint32_t aliased;     ///< 只携带别名、省略 Topic 的发布数
+    uint32_t bound;       ///< 携带完整 Topic 建立别名映射的发布数
+    uint32_t evicted;     ///< 别名表满时按 LRU 替换的次数
+    uint32_t bytes_wire;  ///< 以上发布的 PUBLISH 报文实际字节数（固定头 + 可变头 + 负载）
+    uint32_t bytes_plain; ///< 同样这些发布不带别名时的报文字节数，与 bytes_wire 之差为实际节省量
+    uint16_t limit;       ///< 当前连接可用的别名数（受服务器 Topic Alias Maximum 限制）
+} mqtt_module_alias_stats_t;
+
+/**
+ * @brief 负载压缩统计信息
+ */
+typedef struct {
+    uint32_t compressed;     ///< 压缩后发布的上行消息数
+    uint32_t bytes_in;       ///< 被压缩消息的原始字节数
+    uint32_t bytes_out;      ///< 被压缩消息压缩后的字节数（含帧头）
+    uint32_t inflated;       ///< 解压成功的下行消息数
+    uint32_t inflate_failed; ///< 解压失败或无缓冲区而丢弃的下行消息数
+} mqtt_module_zip_stats_t;
+
+/**
+ * @brief 延迟直方图桶数
+ *
+ * 0~3 ms 每 1 ms 一个桶；之后每个 2 的幂区间再均分 4 个桶（相对误差 <= 25%），
+ * 最后一个桶同时容纳 >= 16384 ms 的样本。
+ */
+#define MQTT_MODULE_LAT_BUCKET_NUM 48
+
+/**
+ * @brief PUBACK 延迟统计的 Topic 类别数（下标 0 固定为 "other"）
+ */
+#define MQTT_MODULE_ACK_CLASS_NUM 8
+
+/**
+ * @brief Topic 类别名最大长度（含 '\0'）
+ */
+#define MQTT_MODULE_ACK_CLASS_NAME_MAX 16
+
+/**
+ * @brief 在途窗口上限（受确认跟踪表容量限制）
+ */
+#define MQTT_MODULE_INFLIGHT_MAX 48
+
+/**
+ * @brief 发布到确认（PUBACK / PUBCOMP）的延迟直方图
+ */
+typedef struct {
+    uint32_t count;                              ///< 样本数
+    uint32_t max_ms;                             ///< 最大延迟（ms）
+    uint64_t sum_ms;                             ///< 延迟总和（ms），用于求平均
+    uint32_t bucket[MQTT_MODULE_LAT_BUCKET_NUM]; ///< 各桶样本数
+} mqtt_module_lat_hist_t;
+
+/**
+ * @brief 发布确认跟踪统计信息
+ *
+ * 延迟从消息交给 esp-mqtt 客户端时开始计时（排队发送的消息包含客户端内部排队时间）。
+ */
+typedef struct {
+    uint32_t               tracked;     ///< 已登记等待确认的 QoS>=1 消息数
+    uint32_t               acked;       ///< 已收到确认的消息数
+    uint32_t               untracked;   ///< 跟踪表已满而未登记的消息数
+    uint32_t               expired;     ///< 超时仍未确认而被移出跟踪表的消息数
+    uint16_t               unacked;     ///< 当前未确认消息数
+    uint16_t               unacked_max; ///< 未确认消息数历史最大值
+    uint16_t               window;      ///< 在途窗口大小，0 表示不限制
+    uint32_t               window_full; ///< 在途窗口被占满的次数
+    uint32_t               window_wait; ///< 因窗口已满而等待的发布次数
+    mqtt_module_lat_hist_t qos[2];      ///< 按 QoS 统计：[0] QoS 1，[1] QoS 2
+    uint8_t                class_num;   ///< 已出现的 Topic 类别数（含 "other"）
+    char                   class_name[MQTT_MODULE_ACK_CLASS_NUM][MQTT_MODULE_ACK_CLASS_NAME_MAX]; ///< 类别名
+    mqtt_module_lat_hist_t cls[MQTT_MODULE_ACK_CLASS_NUM]; ///< 按 Topic 类别统计
+} mqtt_module_ack_stats_t;
+
 /* -------------------------------------------------------------------------- */
 /*                                   配置体                                    */
 /* -------------------------------------------------------------------------- */
@@ -74,8 +343,44 @@ typedef struct {
     const char           *username;      ///< 用户名，可为 NULL 表示匿名
     const char           *password;      ///< 密码，可为 NULL 表示无密码
     int                   keepalive_sec; ///< keepalive 保活时间（秒），<=0 使用内部默认
+    bool                  disable_auto_reconnect; ///< 关闭 esp-mqtt 内置的固定间隔重连，由上层调用 mqtt_module_reconnect 调度
+    int                   network_timeout_ms; ///< 网络操作超时（ms，含 TCP 建连与等待 CONNACK），<=0 使用 esp-mqtt 默认值
+    bool                  protocol_v5;   ///< 使用 MQTT 5.0（需开启 CONFIG_MQTT_PROTOCOL_5，否则忽略并使用 3.1.1）
+    bool                  persistent_session; ///< 持久会话：连接时不清除会话，服务器保留订阅并缓存离线期间的 QoS>=1 消息
+    uint32_t              session_expiry_sec; ///< 持久会话保留时间（秒），仅 MQTT 5.0 有效（3.1.1 由服务器决定）
+    int                   topic_alias_max; ///< 上行 Topic 别名表大小，仅 MQTT 5.0 下的 QoS 0 同步发布使用，<=0 表示关闭
+    int                   compress_min_len; ///< 上行负载达到该长度时尝试 LZF 压缩（Topic 追加 "/z"），<=0 表示不压缩
+    int                   compress_buf_size; ///< 同步发布（超出出站槽位的负载）的压缩输出缓冲区，创建实例时分配，压缩结果放不下时原样发送
+    int                   ack_class_level;  ///< 以第几级 Topic（从 0 起）作为 PUBACK 延迟统计类别，如 "xn/esp/hb" 的第 2 级为 "hb"
+    int                   inflight_max;     ///< QoS>=1 在途窗口（1 ~ MQTT_MODULE_INFLIGHT_MAX），<=0 表示不限制
+    int                   inflight_wait_ms; ///< 同步发布在窗口已满时的最长等待（ms），0 表示立即返回 ESP_ERR_TIMEOUT
+    mqtt_module_inflight_cb_t inflight_cb;  ///< 在途窗口水位回调，可为 NULL
     mqtt_module_event_cb_t  event_cb;    ///< 连接事件回调，可为 NULL 表示不关心
     mqtt_module_message_cb_t message_cb; ///< 消息回调，可为 NULL 表示不关心
+    mqtt_module_suback_cb_t suback_cb;   ///< SUBACK 回调，可为 NULL 表示不关心
+
+    /* 携带 user_ctx 的回调：非 NULL 时代替同名的普通回调 */
+    mqtt_module_inflight_cb_ex_t inflight_cb_ex; ///< 在途窗口水位回调
+    mqtt_module_event_cb_ex_t    event_cb_ex;    ///< 连接事件回调
+    mqtt_module_message_cb_ex_t  message_cb_ex;  ///< 消息回调
+    mqtt_module_suback_cb_ex_t   suback_cb_ex;   ///< SUBACK 回调
+    mqtt_module_fragment_cb_ex_t fragment_cb_ex; ///< 超大消息分片回调
+    void                        *user_ctx;       ///< 原样传给以上 _ex 回调的用户上下文
+    mqtt_trace_handle_t   trace;         ///< 消息轨迹，NULL 时默认实例使用默认轨迹、其他实例不记录
+
+    int                   outbox_slot_num;    ///< 出站队列槽位数，<=0 表示关闭队列（发布直接同步调用客户端）
+    int                   outbox_topic_max;   ///< 单槽位 Topic 最大长度（含 '\0'）
+    int                   outbox_payload_max; ///< 单槽位负载最大长度（字节），超出的消息走同步发布
+    mqtt_module_outbox_policy_t outbox_policy; ///< 队列满时的处理策略
+    int                   outbox_block_ms;    ///< MQTT_MODULE_OUTBOX_BLOCK 策略下的最长等待时间（ms）
+    const mqtt_spool_config_t *spool_cfg;     ///< 离线缓存配置，NULL 表示不启用（需同时启用出站队列）
+
+    mqtt_module_fragment_cb_t fragment_cb;    ///< 超大消息分片回调，与 fragment_cb_ex 均为 NULL 表示丢弃超大消息
+    int                   rx_small_buf_size;  ///< 小规格重组缓冲区大小（字节）
+    int                   rx_small_buf_num;   ///< 小规格重组缓冲区个数
+    int                   rx_large_buf_size;  ///< 大规格重组缓冲区大小（字节）
+    int                   rx_large_buf_num;   ///< 大规格重组缓冲区个数
+    int                   rx_max_msg_len;     ///< 可整条重组的最大负载（字节），不超过大规格缓冲区
 } mqtt_module_config_t;
 
 /* -------------------------------------------------------------------------- */
@@ -92,8 +397,40 @@ typedef struct {
         .username      = NULL,                      \
         .password      = NULL,                      \
         .keepalive_sec = 60,                        \
+        .disable_auto_reconnect = false,            \
+        .network_timeout_ms = 0,                    \
+        .protocol_v5   = false,                     \
+        .persistent_session = false,                \
+        .session_expiry_sec = 3600,                 \
+        .topic_alias_max    = 8,                    \
+        .compress_min_len   = 0,                    \
+        .compress_buf_size  = 4096,                 \
+        .ack_class_level    = 2,                    \
+        .inflight_max       = 16,                   \
+        .inflight_wait_ms   = 1000,                 \
+        .inflight_cb        = NULL,                 \
         .event_cb      = NULL,                      \
         .message_cb    = NULL,                      \
+        .suback_cb     = NULL,                      \
+        .inflight_cb_ex = NULL,                     \
+        .event_cb_ex    = NULL,                     \
+        .message_cb_ex  = NULL,                     \
+        .suback_cb_ex   = NULL,                     \
+        .fragment_cb_ex = NULL,                     \
+        .user_ctx       = NULL,                     \
+        .trace         = NULL,                      \
+        .outbox_slot_num    = 8,                    \
+        .outbox_topic_max   = 128,                  \
+        .outbox_payload_max = 512,                  \
+        .outbox_policy      = MQTT_MODULE_OUTBOX_DROP_OLDEST, \
+        .outbox_block_ms    = 100,                  \
+        .spool_cfg          = NULL,                 \
+        .fragment_cb        = NULL,                 \
+        .rx_small_buf_size  = 1024,                 \
+        .rx_small_buf_num   = 2,                    \
+        .rx_large_buf_size  = 4096,                 \
+        .rx_large_buf_num   = 1,                    \
+        .rx_max_msg_len     = 4096,                 \
     }
 
 /* -------------------------------------------------------------------------- */
@@ -105,7 +442,8 @@ typedef struct {
  *
  * - config 为 NULL 时使用 MQTT_MODULE_DEFAULT_CONFIG；
  * - 仅保存配置并创建 MQTT 客户端实例，不主动连接服务器；
- * - 可多次调用，只有第一次真正初始化。
+ * - 可多次调用，只有第一次真正初始化；
+ * - 创建的即默认实例，等价于 mqtt_module_create 并保存句柄供不带句柄的接口使用。
  *
  * @param config MQTT 模块配置指针
  *
@@ -129,9 +467,56 @@ esp_err_t mqtt_module_start(void);
  */
 esp_err_t mqtt_module_stop(void);
 
+/**
+ * @brief 最近一次 CONNACK 是否带 session present 标志
+ *
+ * 持久会话模式下为 true 表示服务器保留了上次的会话（包括订阅），无需重新订阅。
+ * 在 MQTT_MODULE_EVENT_CONNECTED 回调中即可读取。
+ */
+bool mqtt_module_session_present(void);
+
+/**
+ * @brief 最近一次确认送达服务器的上行时刻
+ *
+ * QoS 0 消息在连接中同步发出即计入，QoS>=1 消息在收到 PUBACK / PUBCOMP 时计入；
+ * 任何上行都能证明设备在线，心跳模块据此只在链路空闲时补发心跳。
+ *
+ * @return esp_timer 时间戳（ms，约 49 天回绕，按差值使用）；0 表示尚无上行
+ */
+uint32_t mqtt_module_last_uplink_ms(void);
+
+/**
+ * @brief 立即发起一次重新连接
+ *
+ * 先停止客户端（若在运行）再重新启动，用于上层自行调度重连时机
+ * （配合 disable_auto_reconnect）。不可在 MQTT 事件/消息回调中调用。
+ *
+ * @return
+ *      - ESP_OK               : 已提交连接请求
+ *      - ESP_ERR_INVALID_STATE: 客户端未初始化
+ *      - 其它                 : 底层启动失败
+ */
+esp_err_t mqtt_module_reconnect(void);
+
+/**
+ * @brief 切换服务器地址（停止客户端后替换 URI，下次 start / reconnect 时生效）
+ *
+ * 用于在多台服务器之间故障切换；uri 字符串需在运行期间保持有效。
+ *
+ * @return
+ *      - ESP_OK               : 已替换
+ *      - ESP_ERR_INVALID_ARG  : uri 为空
+ *      - ESP_ERR_INVALID_STATE: 客户端未初始化
+ */
+esp_err_t mqtt_module_set_uri(const char *uri);
+
 /**
  * @brief 发布一条 MQTT 消息
  *
+ * 启用出站队列时等价于 mqtt_module_publish_enqueue（忽略票据），调用方不会
+ * 阻塞在客户端的 socket 写入上；负载超过 outbox_payload_max 时退化为同步发布。
+ * 同步发布 QoS>=1 消息时若在途窗口已满，最多等待 inflight_wait_ms。
+ *
  * @param topic   目标 Topic 字符串
  * @param payload 负载数据指针
  * @param len     负载长度（字节）
@@ -139,9 +524,11 @@ esp_err_t mqtt_module_stop(void);
  * @param retain  是否保留消息
  *
  * @return
- *      - ESP_OK              : 已成功提交到客户端
+ *      - ESP_OK              : 已成功入队或提交到客户端
  *      - ESP_ERR_INVALID_ARG : 参数非法
  *      - ESP_ERR_INVALID_STATE : 客户端未初始化或未启动
+ *      - ESP_ERR_NO_MEM      : 队列已满且按策略丢弃了本条消息
+ *      - ESP_ERR_TIMEOUT     : BLOCK 策略下等待空闲槽位超时，或同步发布时在途窗口未腾出
  *      - ESP_FAIL            : 底层发送失败
  */
 esp_err_t mqtt_module_publish(const char *topic,
@@ -150,6 +537,158 @@ esp_err_t mqtt_module_publish(const char *topic,
                               int         qos,
                               bool        retain);
 
+/**
+ * @brief 携带 MQTT 5.0 请求/响应属性发布一条消息
+ *
+ * - 仅在 MQTT 5.0 连接下生效：属性设置与发布在同一把锁内完成，同步交给客户端，
+ *   不经过出站队列（属性是客户端级别的状态，需与 drain 任务互斥）；
+ * - props 为 NULL、两项属性均为空或使用 3.1.1 协议时，等价于 mqtt_module_publish。
+ *
+ * @return 与 mqtt_module_publish 相同
+ */
+esp_err_t mqtt_module_publish_props(const char                    *topic,
+                                    const void                    *payload,
+                                    int                            len,
+                                    int                            qos,
+                                    bool                           retain,
+                                    const mqtt_module_msg_props_t *props);
+
+/**
+ * @brief 等待在途窗口出现空位
+ *
+ * 供突发发布的调用方在入队前自行节流；未启用窗口时立即返回 ESP_OK。
+ * 返回 ESP_OK 只表示此刻有空位，并不为调用方预留。
+ *
+ * @param timeout_ms 最长等待时间（ms），0 表示只检查不等待
+ *
+ * @return
+ *      - ESP_OK               : 窗口有空位
+ *      - ESP_ERR_TIMEOUT      : 窗口仍满（timeout_ms 为 0 时即"会阻塞"）
+ *      - ESP_ERR_INVALID_STATE: 模块未初始化
+ */
+esp_err_t mqtt_module_wait_inflight(uint32_t timeout_ms);
+
+/**
+ * @brief 当前连接是否使用 MQTT 5.0
+ */
+bool mqtt_module_is_v5(void);
+
+/**
+ * @brief 将一条消息放入出站队列后立即返回
+ *
+ * - Topic 与负载会被拷贝到预分配槽位中，调用方缓冲区可立即复用；
+ * - 由内部 drain 任务按入队顺序通过 esp_mqtt_client_enqueue 交给客户端发送；
+ * - 调用方耗时与网络状况无关，仅为一次定长拷贝；
+ * - 在途窗口已满时 drain 任务暂停发送，消息留在队列中，队列满后按 outbox_policy 反压调用方。
+ *
+ * @param ticket 输出本条消息的票据，可为 NULL
+ *
+ * @return
+ *      - ESP_OK                : 已入队
+ *      - ESP_ERR_INVALID_ARG   : 参数非法
+ *      - ESP_ERR_INVALID_STATE : 模块未初始化或未启用出站队列
+ *      - ESP_ERR_INVALID_SIZE  : Topic 或负载超出槽位大小
+ *      - ESP_ERR_NO_MEM        : 队列已满且按策略丢弃了本条消息
+ *      - ESP_ERR_TIMEOUT       : BLOCK 策略下等待空闲槽位超时
+ */
+esp_err_t mqtt_module_publish_enqueue(const char           *topic,
+                                      const void           *payload,
+                                      int                   len,
+                                      int                   qos,
+                                      bool                  retain,
+                                      mqtt_module_ticket_t *ticket);
+
+/**
+ * @brief 租用一个出站槽位，供调用方直接序列化负载
+ *
+ * - Topic 在此时拷贝进槽位，负载由调用方写入 lease->buf；
+ * - 获取槽位时同样遵循 outbox_policy；
+ * - 成功后必须调用 commit 或 abort 之一归还槽位。
+ *
+ * @param topic   目标 Topic 字符串
+ * @param max_len 预计最大负载长度，超过槽位容量时返回 ESP_ERR_INVALID_SIZE
+ * @param lease   输出租约
+ *
+ * @return 与 mqtt_module_publish_enqueue 相同
+ */
+esp_err_t mqtt_module_publish_begin(const char                  *topic,
+                                    int                          max_len,
+                                    mqtt_module_publish_lease_t *lease);
+
+/**
+ * @brief 提交租约中已写好的负载，入队等待发送
+ *
+ * @param len    实际写入长度，不可超过 lease->cap
+ * @param ticket 输出本条消息的票据，可为 NULL
+ */
+esp_err_t mqtt_module_publish_commit(mqtt_module_publish_lease_t *lease,
+                                     int                          len,
+                                     int                          qos,
+                                     bool                         retain,
+                                     mqtt_module_ticket_t        *ticket);
+
+/**
+ * @brief 放弃租约并归还槽位
+ */
+void mqtt_module_publish_abort(mqtt_module_publish_lease_t *lease);
+
+/**
+ * @brief 查询某票据对应的消息是否已离开出站队列
+ *
+ * 离开队列包括：已提交到客户端、转存 Flash、提交失败或被 DROP_OLDEST 策略挤出；
+ * 需要区分发送与丢弃时使用 mqtt_module_outbox_ticket_state。
+ */
+bool mqtt_module_outbox_is_done(mqtt_module_ticket_t ticket);
+
+/**
+ * @brief 查询某票据对应消息的去向
+ *
+ * 按票据逐条判断，与其他消息的进度无关：被挤出的消息报告 DROPPED，
+ * 在它之前入队、仍在等待在途窗口的消息仍报告 PENDING。
+ */
+mqtt_module_ticket_state_t mqtt_module_outbox_ticket_state(mqtt_module_ticket_t ticket);
+
+/**
+ * @brief 获取出站队列统计信息
+ */
+esp_err_t mqtt_module_get_outbox_stats(mqtt_module_outbox_stats_t *out);
+
+/**
+ * @brief 获取上行 Topic 别名统计信息（MQTT 3.1.1 连接下各项均为 0）
+ */
+esp_err_t mqtt_module_get_alias_stats(mqtt_module_alias_stats_t *out);
+
+/**
+ * @brief 获取负载压缩统计信息
+ *
+ * 下行 Topic 以 "/z" 结尾的消息总会先解压（去掉后缀）再交给 message_cb，
+ * 解压结果占用一个重组缓冲区，超过 rx_max_msg_len 的消息被丢弃。
+ */
+esp_err_t mqtt_module_get_zip_stats(mqtt_module_zip_stats_t *out);
+
+/**
+ * @brief 获取发布确认跟踪统计信息
+ *
+ * @param out   输出，结构体较大（约 2KB），不宜放在小栈任务的栈上
+ * @param reset 读取后清零计数与直方图（unacked 与类别名保留），便于按周期上报区间统计
+ */
+esp_err_t mqtt_module_get_ack_stats(mqtt_module_ack_stats_t *out, bool reset);
+
+/**
+ * @brief 向直方图记录一个延迟样本（调用方负责互斥）
+ */
+void mqtt_module_lat_record(mqtt_module_lat_hist_t *hist, uint32_t ms);
+
+/**
+ * @brief 估算直方图的百分位延迟
+ *
+ * @param hist 直方图
+ * @param pct  百分位（1~100）
+ *
+ * @return 该百分位样本所在桶的上界（ms）；无样本时返回 0
+ */
+uint32_t mqtt_module_lat_percentile(const mqtt_module_lat_hist_t *hist, int pct);
+
 /**
  * @brief 订阅指定 Topic
  *
@@ -164,6 +703,24 @@ esp_err_t mqtt_module_publish(const char *topic,
  */
 esp_err_t mqtt_module_subscribe(const char *topic, int qos);
 
+/**
+ * @brief 用一个 SUBSCRIBE 报文订阅多个过滤器
+ *
+ * 服务器对整个报文只回复一个 SUBACK，连接后需订阅的过滤器较多时可减少往返次数。
+ * 报文大小受客户端发送缓冲区限制，单批最多 MQTT_MODULE_SUBSCRIBE_BATCH_MAX 个。
+ *
+ * @param topics 过滤器数组
+ * @param num    过滤器个数（1 ~ MQTT_MODULE_SUBSCRIBE_BATCH_MAX）
+ * @param msg_id 输出本报文的 msg_id（与 suback_cb 对应），可为 NULL
+ *
+ * @return
+ *      - ESP_OK               : 已成功提交订阅请求
+ *      - ESP_ERR_INVALID_ARG  : 参数非法
+ *      - ESP_ERR_INVALID_STATE: 客户端未初始化或未启动
+ *      - ESP_FAIL             : 底层返回订阅失败
+ */
+esp_err_t mqtt_module_subscribe_multiple(const mqtt_module_topic_t *topics, int num, int *msg_id);
+
 /**
  * @brief 取消订阅指定 Topic
  *
@@ -177,4 +734,229 @@ esp_err_t mqtt_module_subscribe(const char *topic, int qos);
  */
 esp_err_t mqtt_module_unsubscribe(const char *topic);
 
+/**
+ * @brief 获取接收重组统计信息
+ */
+esp_err_t mqtt_module_get_rx_stats(mqtt_module_rx_stats_t *out);
+
+/**
+ * @brief 在 message_cb 内读取当前消息携带的 MQTT 5.0 请求/响应属性
+ *
+ * 分片重组的消息同样有效（属性随第一片保存）。指针只在回调返回前有效。
+ *
+ * @return true 当前消息携带 Response Topic 或 Correlation Data；否则 false
+ */
+bool mqtt_module_rx_get_props(mqtt_module_msg_props_t *out);
+
+/**
+ * @brief 在 message_cb 内接管当前消息的重组缓冲区（所有权转移，免拷贝）
+ *
+ * 只对分片重组得到的消息有效：payload 指向模块内部 slab 缓冲区，接管后
+ * 回调返回时不再回收，调用方处理完毕后须调用 mqtt_module_rx_release() 归还。
+ * 未分片消息的负载属于 esp-mqtt，回调返回即失效，此时返回 false，调用方需自行拷贝。
+ *
+ * 注意：接管期间该缓冲区不可用于重组后续消息，应尽快归还。
+ *
+ * @param payload message_cb 收到的 payload 指针
+ *
+ * @return true 接管成功；false 不可接管
+ */
+bool mqtt_module_rx_detach(const uint8_t *payload);
+
+/**
+ * @brief 归还通过 mqtt_module_rx_detach() 接管的重组缓冲区（可在任意任务中调用）
+ */
+void mqtt_module_rx_release(const uint8_t *payload);
+
+/* -------------------------------------------------------------------------- */
+/*                                  多实例接口                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 创建一个 MQTT 模块实例（一条独立的服务器会话）
+ *
+ * - config 为 NULL 时使用 MQTT_MODULE_DEFAULT_CONFIG；
+ * - 与 mqtt_module_init 相同，只创建客户端与各项资源，不主动连接服务器；
+ * - 离线缓存分区全局唯一，只有第一个配置了 spool_cfg 的实例启用离线缓存。
+ *
+ * @param config MQTT 模块配置指针
+ * @param out    输出实例句柄
+ *
+ * @return
+ *      - ESP_OK              : 创建成功
+ *      - ESP_ERR_INVALID_ARG : out 为 NULL 或 broker_uri 为空
+ *      - ESP_ERR_NO_MEM 等   : 内部资源不足
+ */
+esp_err_t mqtt_module_create(const mqtt_module_config_t *config, mqtt_module_handle_t *out);
+
+/**
+ * @brief 销毁实例并释放其全部资源
+ *
+ * 销毁开始后新的发布与 publish_begin 返回 ESP_ERR_INVALID_STATE；
+ * 会等待进行中的发布调用返回（阻塞在队列或窗口上的发布者被唤醒并失败）、
+ * 未结束的租约被提交或放弃，再等待 drain 任务退出（最长约 1 s），队列中未发送的消息被丢弃。
+ * 销毁返回后句柄失效；销毁默认实例后可再次调用 mqtt_module_init。
+ */
+void mqtt_module_destroy(mqtt_module_handle_t inst);
+
+/**
+ * @brief 获取默认实例句柄，未初始化时返回 NULL
+ */
+mqtt_module_handle_t mqtt_module_get_default(void);
+
+/*
+ * 以下接口与同名的不带句柄接口行为一致，只是作用于指定实例；
+ * inst 为 NULL 时返回 ESP_ERR_INVALID_STATE / ESP_ERR_INVALID_ARG（或 false）。
+ */
+
+/**
+ * @brief 启动指定实例的客户端（见 mqtt_module_start）
+ */
+esp_err_t mqtt_module_inst_start(mqtt_module_handle_t inst);
+
+/**
+ * @brief 停止指定实例的客户端（见 mqtt_module_stop）
+ */
+esp_err_t mqtt_module_inst_stop(mqtt_module_handle_t inst);
+
+/**
+ * @brief 立即发起一次重连（见 mqtt_module_reconnect）
+ */
+esp_err_t mqtt_module_inst_reconnect(mqtt_module_handle_t inst);
+
+/**
+ * @brief 切换服务器 URI，会先停止客户端（见 mqtt_module_set_uri）
+ */
+esp_err_t mqtt_module_inst_set_uri(mqtt_module_handle_t inst, const char *uri);
+
+/**
+ * @brief 最近一次 CONNACK 是否携带 session present
+ */
+bool mqtt_module_inst_session_present(mqtt_module_handle_t inst);
+
+/**
+ * @brief 最近一次上行得到证实的时间（见 mqtt_module_last_uplink_ms）
+ */
+uint32_t mqtt_module_inst_last_uplink_ms(mqtt_module_handle_t inst);
+
+/**
+ * @brief 当前连接是否使用 MQTT 5.0
+ */
+bool mqtt_module_inst_is_v5(mqtt_module_handle_t inst);
+
+/**
+ * @brief 同步发布（见 mqtt_module_publish）
+ */
+esp_err_t mqtt_module_inst_publish(mqtt_module_handle_t inst,
+                                   const char          *topic,
+                                   const void          *payload,
+                                   int                  len,
+                                   int                  qos,
+                                   bool                 retain);
+
+/**
+ * @brief 携带 MQTT 5.0 属性的同步发布（见 mqtt_module_publish_props）
+ */
+esp_err_t mqtt_module_inst_publish_props(mqtt_module_handle_t           inst,
+                                         const char                    *topic,
+                                         const void                    *payload,
+                                         int                            len,
+                                         int                            qos,
+                                         bool                           retain,
+                                         const mqtt_module_msg_props_t *props);
+
+/**
+ * @brief 等待在途窗口出现空位（见 mqtt_module_wait_inflight）
+ */
+esp_err_t mqtt_module_inst_wait_inflight(mqtt_module_handle_t inst, uint32_t timeout_ms);
+
+/**
+ * @brief 放入出站队列异步发布（见 mqtt_module_publish_enqueue）
+ */
+esp_err_t mqtt_module_inst_publish_enqueue(mqtt_module_handle_t  inst,
+                                           const char           *topic,
+                                           const void           *payload,
+                                           int                   len,
+                                           int                   qos,
+                                           bool                  retain,
+                                           mqtt_module_ticket_t *ticket);
+
+/**
+ * @brief 在指定实例上租用出站槽位；租约记录所属实例，
+ *        提交 / 放弃仍使用 mqtt_module_publish_commit / mqtt_module_publish_abort
+ */
+esp_err_t mqtt_module_inst_publish_begin(mqtt_module_handle_t         inst,
+                                         const char                  *topic,
+                                         int                          max_len,
+                                         mqtt_module_publish_lease_t *lease);
+
+/**
+ * @brief 出站凭据对应的消息是否已处理完毕
+ */
+bool mqtt_module_inst_outbox_is_done(mqtt_module_handle_t inst, mqtt_module_ticket_t ticket);
+
+/**
+ * @brief 查询出站凭据的状态（见 mqtt_module_outbox_ticket_state）
+ */
+mqtt_module_ticket_state_t mqtt_module_inst_outbox_ticket_state(mqtt_module_handle_t inst,
+                                                                 mqtt_module_ticket_t ticket);
+
+/**
+ * @brief 订阅单个过滤器
+ */
+esp_err_t mqtt_module_inst_subscribe(mqtt_module_handle_t inst, const char *topic, int qos);
+
+/**
+ * @brief 在一个 SUBSCRIBE 报文中批量订阅（见 mqtt_module_subscribe_multiple）
+ */
+esp_err_t mqtt_module_inst_subscribe_multiple(mqtt_module_handle_t       inst,
+                                              const mqtt_module_topic_t *topics,
+                                              int                        num,
+                                              int                       *msg_id);
+
+/**
+ * @brief 取消订阅
+ */
+esp_err_t mqtt_module_inst_unsubscribe(mqtt_module_handle_t inst, const char *topic);
+
+/**
+ * @brief 读取出站队列统计
+ */
+esp_err_t mqtt_module_inst_get_outbox_stats(mqtt_module_handle_t inst, mqtt_module_outbox_stats_t *out);
+
+/**
+ * @brief 读取 Topic 别名统计
+ */
+esp_err_t mqtt_module_inst_get_alias_stats(mqtt_module_handle_t inst, mqtt_module_alias_stats_t *out);
+
+/**
+ * @brief 读取压缩统计
+ */
+esp_err_t mqtt_module_inst_get_zip_stats(mqtt_module_handle_t inst, mqtt_module_zip_stats_t *out);
+
+/**
+ * @brief 读取发布确认统计，reset 为 true 时读取后清零
+ */
+esp_err_t mqtt_module_inst_get_ack_stats(mqtt_module_handle_t inst, mqtt_module_ack_stats_t *out, bool reset);
+
+/**
+ * @brief 读取接收重组统计（加锁拷贝，可在任意任务中调用）
+ */
+esp_err_t mqtt_module_inst_get_rx_stats(mqtt_module_handle_t inst, mqtt_module_rx_stats_t *out);
+
+/**
+ * @brief 在 message_cb 内读取当前消息的 MQTT 5.0 属性
+ */
+bool mqtt_module_inst_rx_get_props(mqtt_module_handle_t inst, mqtt_module_msg_props_t *out);
+
+/**
+ * @brief 在 message_cb 内接管当前消息的重组缓冲区
+ */
+bool mqtt_module_inst_rx_detach(mqtt_module_handle_t inst, const uint8_t *payload);
+
+/**
+ * @brief 归还 mqtt_module_inst_rx_detach 接管的缓冲区
+ */
+void mqtt_module_inst_rx_release(mqtt_module_handle_t inst, const uint8_t *payload);
+
 #endif /* MQTT_MODULE_H */
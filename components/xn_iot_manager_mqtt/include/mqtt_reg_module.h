@@ -5,6 +5,9 @@
  * @LastEditTime: 2025-11-24 13:51:00
  * @FilePath: \xn_web_mqtt_manager\components\iot_manager_mqtt\include\mqtt_reg_module.h
  * @Description: 设备注册模块接口（查询是否注册 + 触发注册）
+ *
+ * 注册握手是一个小状态机：订阅完成后发送 reg/query，回复有截止时间，超时按指数退避重试，
+ * 并统计从连接建立到注册完成的耗时。管理器在注册完成后才进入 READY。
  */
 
 #ifndef MQTT_REG_MODULE_H
@@ -14,27 +17,99 @@
 #include <stdint.h>
 
 #include "esp_err.h"
+#include "mqtt_module.h"
 #include "web_mqtt_manager.h"
 
+/**
+ * @brief 注册握手状态
+ *
+ * IDLE → QUERYING → REGISTERED；连续 reg_retry_max 次未收到回复进入 FAILED，
+ * FAILED 下仍按最大退避间隔继续查询，收到回复即转为 REGISTERED。断开连接后回到 IDLE。
+ */
+typedef enum {
+    MQTT_REG_STATE_IDLE = 0,   ///< 未连接，或已连接但订阅尚未完成
+    MQTT_REG_STATE_QUERYING,   ///< 已发送 reg/query，等待回复或等待重试
+    MQTT_REG_STATE_REGISTERED, ///< 注册完成（收到回复或注册缓存有效）
+    MQTT_REG_STATE_FAILED,     ///< 重试次数用尽，按最大间隔继续查询
+} mqtt_reg_state_t;
+
+/**
+ * @brief 注册状态变化通知（在分发线程或管理状态机中调用，不得阻塞）
+ */
+typedef void (*mqtt_reg_notify_cb_t)(void);
+
+/**
+ * @brief 注册握手统计信息
+ */
+typedef struct {
+    mqtt_reg_state_t       state;      ///< 当前状态
+    uint32_t               queries;    ///< 累计发送 reg/query 次数（含重试）
+    uint32_t               timeouts;   ///< 回复超时次数
+    uint32_t               rejected;   ///< 服务器回复未注册的次数
+    uint32_t               failed;     ///< 进入 FAILED 的次数
+    uint32_t               cache_hits; ///< 凭注册缓存直接完成注册的连接次数
+    uint32_t               last_ms;    ///< 最近一次从连接建立到注册完成的耗时（ms）
+    mqtt_module_lat_hist_t latency;    ///< 连接建立到注册完成耗时的直方图（可用 mqtt_module_lat_percentile 取分位）
+} mqtt_reg_stats_t;
+
 /**
  * @brief 初始化设备注册模块
  *
  * 由 Web MQTT 管理器在初始化阶段调用一次：
  *  - 保存 base_topic / client_id 等必要信息；
+ *  - 启用 reg_cache 时读取 NVS 中的注册缓存；
  *  - 在管理器中注册消息回调（当前使用前缀 "reg"）。
+ *
+ * @param notify 注册完成或需要重新查询时调用，管理器借此唤醒管理状态机；可为 NULL
  */
-esp_err_t mqtt_reg_module_init(const web_mqtt_manager_config_t *mgr_cfg);
+esp_err_t mqtt_reg_module_init(const web_mqtt_manager_config_t *mgr_cfg, mqtt_reg_notify_cb_t notify);
 
 /**
- * @brief 在 MQTT 连接建立后触发一次“查询是否已注册”
+ * @brief MQTT 连接建立（收到 CONNACK）
  *
- * 由 Web MQTT 管理器在收到 MQTT_MODULE_EVENT_CONNECTED 时调用。
+ * 由 Web MQTT 管理器在收到 MQTT_MODULE_EVENT_CONNECTED 时调用，记录注册耗时的起点：
+ *  - 注册缓存有效时直接进入 REGISTERED，只上行 QoS0 的 reg/check（负载为令牌），服务器校验通过后不回复；
+ *  - 否则保持 IDLE，等待订阅完成后再查询（保证能收到 reg/<id>/resp）。
  */
 void mqtt_reg_module_on_connected(void);
 
+/**
+ * @brief 订阅全部完成（或持久会话已保留订阅），IDLE 时开始查询
+ *
+ * 只安排查询，reg/query 由管理状态机在下一次 mqtt_reg_module_step() 中发出。
+ */
+void mqtt_reg_module_on_subscribed(void);
+
+/**
+ * @brief MQTT 连接断开，回到 IDLE 并放弃未完成的查询
+ */
+void mqtt_reg_module_on_disconnected(void);
+
+/**
+ * @brief 推进注册状态机：到期时发送查询，回复超时后按退避安排重试
+ *
+ * 由管理状态机周期调用。
+ *
+ * @return 距下一个截止时刻的毫秒数；-1 表示没有待处理的截止时刻
+ */
+int mqtt_reg_module_step(void);
+
+/**
+ * @brief 当前注册状态
+ */
+mqtt_reg_state_t mqtt_reg_module_get_state(void);
+
 /**
  * @brief 设备是否已经完成注册
  */
 bool mqtt_reg_module_is_registered(void);
 
+/**
+ * @brief 获取注册握手统计信息
+ *
+ * @param out   输出，结构体约 240 字节
+ * @param reset 读取后清零计数与直方图（state 保留）
+ */
+esp_err_t mqtt_reg_module_get_stats(mqtt_reg_stats_t *out, bool reset);
+
 #endif /* MQTT_REG_MODULE_H */
@@ -0,0 +1,171 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-08 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-08 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\include\mqtt_rpc_module.h
+ * @Description: 基于 MQTT 的请求/响应（RPC）模块接口
+ *
+ * 设计要点：
+ *  - 每个调用分配一个关联 ID（correlation id），响应按 ID 匹配，不依赖到达顺序；
+ *  - 在途调用保存在固定大小的表中，可同时存在多个调用，每个调用有独立截止时间；
+ *  - MQTT 5.0 连接下同时携带 Response Topic / Correlation Data，3.1.1 下关联 ID 放在 Topic 末层；
+ *  - 服务器下发的请求按方法名分发给已注册的处理函数，同一设备可流水线下发多条请求。
+ *
+ * Topic 约定（<id> 为 client_id，<corr> 为 8 位十六进制关联 ID）：
+ *  - 设备调用服务器：上行 xn/esp/rpc/<id>/req/<method>/<corr>，
+ *    服务器回复 {base}/rpc/<id>/resp/<corr>（成功）或 {base}/rpc/<id>/err/<corr>（失败）；
+ *  - 服务器调用设备：下行 {base}/rpc/<id>/req/<method>/<corr>，
+ *    设备回复 xn/esp/rpc/<id>/resp/<corr> 或 xn/esp/rpc/<id>/err/<corr>；
+ *    请求带 Response Topic 时改为回复到该 Topic（失败回复到 <Response Topic>/err），
+ *    并原样带回 Correlation Data；
+ *  - MQTT 5.0 下设备调用携带 Response Topic {base}/rpc/<id>/resp 与 Correlation Data <corr>，
+ *    服务器可按同一规则回复，关联 ID 不必再放在 Topic 中。
+ */
+
+#ifndef MQTT_RPC_MODULE_H
+#define MQTT_RPC_MODULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "web_mqtt_manager.h"
+
+/**
+ * @brief 在途调用表容量上限（关联 ID 低 8 位为表下标）
+ */
+#define MQTT_RPC_INFLIGHT_MAX_NUM 256
+
+/**
+ * @brief 可注册的方法数量上限
+ */
+#define MQTT_RPC_METHOD_MAX_NUM 8
+
+/**
+ * @brief 方法名最大长度（不含 '\0'）
+ */
+#define MQTT_RPC_METHOD_NAME_MAX 31
+
+/**
+ * @brief 方法处理函数可写入的回复负载最大长度（字节）
+ */
+#define MQTT_RPC_REPLY_MAX_LEN 512
+
+/**
+ * @brief 调用结果回调
+ *
+ * - status 为 ESP_OK 时 data 为服务器回复的负载；
+ * - status 为 ESP_FAIL 时 data 为服务器回复的错误描述；
+ * - status 为 ESP_ERR_TIMEOUT 时 data 为 NULL。
+ *
+ * 响应在管理器分发线程中回调，超时在 esp_timer 任务中回调，均不可长时间阻塞。
+ * data 只在回调返回前有效。
+ */
+typedef void (*mqtt_rpc_result_cb_t)(uint32_t       call_id,
+                                     esp_err_t      status,
+                                     const uint8_t *data,
+                                     int            len,
+                                     void          *ctx);
+
+/**
+ * @brief 方法处理函数的回复缓冲区
+ */
+typedef struct {
+    uint8_t *buf; ///< 回复负载缓冲区
+    int      cap; ///< 缓冲区容量（MQTT_RPC_REPLY_MAX_LEN）
+    int      len; ///< 实际写入长度，初始为 0
+} mqtt_rpc_reply_t;
+
+/**
+ * @brief 服务器调用设备时的方法处理函数
+ *
+ * 在管理器分发线程中执行，同一设备的请求按到达顺序串行处理。
+ *
+ * @param params     请求参数（即请求负载）
+ * @param params_len 参数长度
+ * @param reply      回复缓冲区；返回 ESP_OK 时回复到 resp，否则回复到 err
+ *                   （reply->len 为 0 时以错误码名称作为错误描述）
+ */
+typedef esp_err_t (*mqtt_rpc_method_cb_t)(const uint8_t    *params,
+                                          int               params_len,
+                                          mqtt_rpc_reply_t *reply);
+
+/**
+ * @brief RPC 统计信息
+ */
+typedef struct {
+    uint32_t calls;          ///< 累计发起的调用数
+    uint32_t completed;      ///< 收到成功响应的调用数
+    uint32_t failed;         ///< 收到错误响应的调用数
+    uint32_t timeouts;       ///< 超时的调用数
+    uint32_t rejected;       ///< 因在途表已满被拒绝的调用数
+    uint32_t stale;          ///< 无法匹配在途调用的响应数（已超时 / 已取消 / 非法 ID）
+    uint32_t requests;       ///< 收到的服务器请求数
+    uint32_t request_errors; ///< 以 err 回复的服务器请求数
+    uint16_t inflight;       ///< 当前在途调用数
+    uint16_t high_water;     ///< 在途调用数历史最大值
+} mqtt_rpc_stats_t;
+
+/**
+ * @brief 初始化 RPC 模块
+ *
+ * 由 Web MQTT 管理器在初始化阶段调用一次（rpc_inflight_max <= 0 时跳过）：
+ *  - 按 rpc_inflight_max 预分配在途调用表；
+ *  - 在管理器中注册应用模块（前缀 "rpc"），分发队列长度与在途表容量一致。
+ */
+esp_err_t mqtt_rpc_module_init(const web_mqtt_manager_config_t *mgr_cfg);
+
+/**
+ * @brief 发起一次异步调用
+ *
+ * 调用登记进在途表后立即发布请求并返回，结果通过 cb 通知，且只通知一次。
+ *
+ * @param method     方法名（不可含 '/'、'+'、'#'）
+ * @param params     请求参数，可为 NULL
+ * @param params_len 参数长度
+ * @param timeout_ms 截止时间（ms），0 表示使用 rpc_timeout_ms
+ * @param cb         结果回调，可为 NULL（只发请求、不关心结果时仍会占用在途表直到响应或超时）
+ * @param ctx        透传给回调的用户参数
+ * @param call_id    输出本次调用 ID，可为 NULL
+ *
+ * @return
+ *      - ESP_OK               : 请求已发出
+ *      - ESP_ERR_INVALID_ARG  : 参数非法
+ *      - ESP_ERR_INVALID_STATE: 模块未初始化
+ *      - ESP_ERR_NO_MEM       : 在途表已满
+ *      - 其它                 : 发布失败（调用已撤销，不会再回调）
+ */
+esp_err_t mqtt_rpc_call(const char          *method,
+                        const void          *params,
+                        int                  params_len,
+                        uint32_t             timeout_ms,
+                        mqtt_rpc_result_cb_t cb,
+                        void                *ctx,
+                        uint32_t            *call_id);
+
+/**
+ * @brief 取消一次在途调用，之后到达的响应按 stale 丢弃，不再回调
+ *
+ * @return
+ *      - ESP_OK            : 已取消
+ *      - ESP_ERR_NOT_FOUND : 调用已完成、已超时或 ID 非法
+ */
+esp_err_t mqtt_rpc_cancel(uint32_t call_id);
+
+/**
+ * @brief 注册供服务器调用的方法，同名方法重复注册视为替换
+ *
+ * @return
+ *      - ESP_OK              : 注册成功
+ *      - ESP_ERR_INVALID_ARG : 参数非法或方法名过长
+ *      - ESP_ERR_NO_MEM      : 方法数量已达 MQTT_RPC_METHOD_MAX_NUM
+ */
+esp_err_t mqtt_rpc_register_method(const char *name, mqtt_rpc_method_cb_t cb);
+
+/**
+ * @brief 获取 RPC 统计信息
+ */
+esp_err_t mqtt_rpc_get_stats(mqtt_rpc_stats_t *out);
+
+#endif /* MQTT_RPC_MODULE_H */
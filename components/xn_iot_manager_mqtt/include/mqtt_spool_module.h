@@ -0,0 +1,145 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-02 10:20:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-02 10:20:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\include\mqtt_spool_module.h
+ * @Description: 离线上行消息 Flash 缓存（store-and-forward）接口
+ *
+ * 设计要点：
+ *  - 使用独立数据分区（默认标签 "mqtt_spool"），以扇区为单位循环追加写入；
+ *  - 记录消费后只清除状态位，不擦除扇区，擦除次数均匀分布在整个分区；
+ *  - 分区写满时擦除最旧扇区，其中尚未回放的记录计为丢弃；
+ *  - 由 mqtt_module 的出站 drain 任务单线程调用，模块内部不加锁。
+ */
+
+#ifndef MQTT_SPOOL_MODULE_H
+#define MQTT_SPOOL_MODULE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief 按 Topic 前缀配置的过期规则
+ */
+typedef struct {
+    const char *topic_prefix; ///< Topic 前缀，如 "xn/esp/hb"
+    uint32_t    ttl_sec;      ///< 过期时间（秒），0 表示永不过期
+} mqtt_spool_ttl_rule_t;
+
+/**
+ * @brief 离线缓存配置
+ */
+typedef struct {
+    const char                  *partition_label;     ///< 数据分区标签
+    int                          max_payload_len;     ///< 单条记录负载上限（字节）
+    int                          replay_rate_per_sec; ///< 重连后回放速率上限（条/秒），<=0 表示不限速；回放完之前新到的 QoS>=1 消息也经缓存发出，应高于持续上行速率
+    uint32_t                     default_ttl_sec;     ///< 未命中规则时的过期时间（秒），0 表示永不过期
+    const mqtt_spool_ttl_rule_t *ttl_rules;           ///< 过期规则数组，按顺序匹配，可为 NULL
+    int                          ttl_rule_num;        ///< 过期规则数量
+} mqtt_spool_config_t;
+
+/**
+ * @brief 离线缓存默认配置
+ */
+#define MQTT_SPOOL_DEFAULT_CONFIG()                  \
+    (mqtt_spool_config_t){                          \
+        .partition_label     = "mqtt_spool",        \
+        .max_payload_len     = 512,                 \
+        .replay_rate_per_sec = 20,                  \
+        .default_ttl_sec     = 24 * 3600,           \
+        .ttl_rules           = NULL,                \
+        .ttl_rule_num        = 0,                   \
+    }
+
+/**
+ * @brief 从缓存中取出的一条记录（指针指向模块内部缓冲区，下次调用前有效）
+ */
+typedef struct {
+    const char    *topic;       ///< 以 '\0' 结尾的 Topic
+    const uint8_t *payload;     ///< 负载
+    int            payload_len; ///< 负载长度
+    int            qos;         ///< 原始 QoS
+    bool           retain;      ///< 原始 retain 标志
+} mqtt_spool_record_t;
+
+/**
+ * @brief 离线缓存统计信息
+ */
+typedef struct {
+    uint32_t pending;       ///< 尚未回放的记录数
+    uint32_t appended;      ///< 累计写入记录数
+    uint32_t replayed;      ///< 累计回放记录数
+    uint32_t expired;       ///< 累计因过期被丢弃的记录数
+    uint32_t overwritten;   ///< 累计因分区写满被覆盖的记录数
+    uint32_t corrupted;     ///< 累计校验失败的记录数
+    uint32_t bytes_written; ///< 累计写入 Flash 的字节数（记录、消费标记与扇区头）
+    uint32_t sector_erases; ///< 累计擦除扇区次数
+} mqtt_spool_stats_t;
+
+/**
+ * @brief 初始化离线缓存
+ *
+ * 扫描分区恢复读写位置，掉电前未回放的记录在重启后依然有效。
+ *
+ * @return
+ *      - ESP_OK              : 初始化成功
+ *      - ESP_ERR_NOT_FOUND   : 未找到指定分区
+ *      - ESP_ERR_INVALID_SIZE: 分区不足两个扇区
+ *      - ESP_ERR_NO_MEM      : 内存不足
+ */
+esp_err_t mqtt_spool_init(const mqtt_spool_config_t *config);
+
+/**
+ * @brief 缓存是否可用（已成功初始化）
+ */
+bool mqtt_spool_is_ready(void);
+
+/**
+ * @brief 追加一条记录
+ *
+ * @return
+ *      - ESP_OK               : 写入成功
+ *      - ESP_ERR_INVALID_SIZE : Topic 或负载过长
+ *      - 其它                 : Flash 操作错误
+ */
+esp_err_t mqtt_spool_append(const char *topic,
+                            const void *payload,
+                            int         len,
+                            int         qos,
+                            bool        retain);
+
+/**
+ * @brief 是否还有待回放记录
+ */
+bool mqtt_spool_has_pending(void);
+
+/**
+ * @brief 读取最旧的一条未过期记录（不移除）
+ *
+ * 过期或校验失败的记录会在此过程中被直接标记为已消费。
+ *
+ * @return
+ *      - ESP_OK            : 成功，out 中为记录内容
+ *      - ESP_ERR_NOT_FOUND : 没有待回放记录
+ */
+esp_err_t mqtt_spool_peek(mqtt_spool_record_t *out);
+
+/**
+ * @brief 将最近一次 peek 得到的记录标记为已回放
+ */
+esp_err_t mqtt_spool_pop(void);
+
+/**
+ * @brief 回放速率对应的最小间隔（ms），未限速时返回 0
+ */
+uint32_t mqtt_spool_replay_interval_ms(void);
+
+/**
+ * @brief 获取统计信息
+ */
+esp_err_t mqtt_spool_get_stats(mqtt_spool_stats_t *out);
+
+#endif /* MQTT_SPOOL_MODULE_H */
@@ -0,0 +1,250 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-13 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-13 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\include\mqtt_trace_module.h
+ * @Description: MQTT 消息轨迹（二进制环形缓冲区）接口
+ *
+ * 设计要点：
+ *  - 热路径只写 16 字节定长记录（时间戳、Topic 哈希、长度、方向），不做格式化、不加锁；
+ *  - 写入方用原子自增抢占序号，每个槽位带序号校验，读取方可识别被覆盖或写到一半的记录；
+ *  - 运行期可在 关闭 / 采样 / 全量 之间切换，采样模式下每 N 条消息记录一条；
+ *  - 服务器通过 RPC 方法 "trace" 切换级别或分页读出记录，无需串口日志；
+ *  - 本模块不依赖 MQTT 客户端与管理器，收发路径可直接调用；
+ *  - 每个 MQTT 模块实例可持有各自的轨迹（mqtt_trace_create），不带句柄的接口作用于
+ *    mqtt_trace_init() 创建的默认轨迹。
+ *
+ * Topic 哈希为 FNV-1a（32 位，初值 2166136261，乘数 16777619），服务器对已知 Topic 做同样计算即可还原。
+ */
+
+#ifndef MQTT_TRACE_MODULE_H
+#define MQTT_TRACE_MODULE_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief 远程命令对应的 RPC 方法名
+ */
+#define MQTT_TRACE_RPC_METHOD "trace"
+
+/**
+ * @brief 轨迹句柄
+ */
+typedef struct mqtt_trace_s *mqtt_trace_handle_t;
+
+/**
+ * @brief 记录级别
+ */
+typedef enum {
+    MQTT_TRACE_OFF = 0, ///< 不记录
+    MQTT_TRACE_SAMPLED, ///< 每 sample 条消息记录一条
+    MQTT_TRACE_FULL,    ///< 记录每条消息
+} mqtt_trace_level_t;
+
+/**
+ * @brief 记录方向
+ */
+typedef enum {
+    MQTT_TRACE_DIR_NONE = 0, ///< 空记录（读取时已被覆盖或尚未写完）
+    MQTT_TRACE_DIR_RX,       ///< 收到的消息（len 为整条长度）
+    MQTT_TRACE_DIR_TX,       ///< 交给客户端的消息（len 为实际发送长度，压缩后为帧长）
+    MQTT_TRACE_DIR_ACK,      ///< 收到 PUBACK / PUBCOMP（topic_hash 为 0，len 为 0）
+} mqtt_trace_dir_t;
+
+/**
+ * @brief 一条轨迹记录（小端，即 RPC 回复中的格式）
+ */
+typedef struct {
+    uint32_t ts_ms;      ///< esp_timer 时间戳（ms，约 49 天回绕）
+    uint32_t topic_hash; ///< Topic 的 FNV-1a 哈希
+    uint32_t len;        ///< 负载长度（字节）
+    uint16_t msg_id;     ///< 报文 ID，QoS 0 为 0
+    uint8_t  dir;        ///< mqtt_trace_dir_t
+    uint8_t  qos;        ///< QoS 等级
+} mqtt_trace_record_t;
+
+/**
+ * @brief RPC "trace" 回复头（其后紧跟 count 条 mqtt_trace_record_t）
+ */
+typedef struct {
+    uint32_t first_seq; ///< 第一条记录的序号
+    uint32_t head;      ///< 下一条待写记录的序号
+    uint8_t  level;     ///< 当前级别（mqtt_trace_level_t）
+    uint8_t  count;     ///< 本次回复的记录条数
+    uint16_t sample;    ///< 当前采样间隔
+} mqtt_trace_dump_hdr_t;
+
+/**
+ * @brief 轨迹配置
+ */
+typedef struct {
+    int                capacity; ///< 记录条数，向上取整为 2 的幂；<=0 表示不启用
+    mqtt_trace_level_t level;    ///< 初始级别
+    int                sample;   ///< 采样间隔（每 N 条记录一条），<=0 按 1 处理
+} mqtt_trace_config_t;
+
+/**
+ * @brief 轨迹默认配置
+ */
+#define MQTT_TRACE_DEFAULT_CONFIG()          \
+    (mqtt_trace_config_t){                  \
+        .capacity = 256,                    \
+        .level    = MQTT_TRACE_SAMPLED,     \
+        .sample   = 16,                     \
+    }
+
+/**
+ * @brief 初始化默认轨迹（只分配一次，重复调用只更新级别）
+ *
+ * @return
+ *      - ESP_OK              : 初始化成功（capacity<=0 时不分配，记录为空操作）
+ *      - ESP_ERR_INVALID_ARG : 参数为 NULL
+ *      - ESP_ERR_NO_MEM      : 内存不足
+ */
+esp_err_t mqtt_trace_init(const mqtt_trace_config_t *config);
+
+/**
+ * @brief 获取默认轨迹句柄，未初始化时返回 NULL
+ */
+mqtt_trace_handle_t mqtt_trace_get_default(void);
+
+/**
+ * @brief 运行期切换默认轨迹的级别
+ *
+ * @param sample 采样间隔，<=0 表示保持不变
+ */
+void mqtt_trace_set_level(mqtt_trace_level_t level, int sample);
+
+/**
+ * @brief 获取默认轨迹的当前级别
+ *
+ * @param sample 输出当前采样间隔，可为 NULL
+ */
+mqtt_trace_level_t mqtt_trace_get_level(int *sample);
+
+/**
+ * @brief 向默认轨迹记录一条消息（可在任意任务中调用，不阻塞）
+ *
+ * @param topic     Topic，可为 NULL
+ * @param topic_len Topic 长度，<0 表示按 '\0' 结尾计算
+ */
+void mqtt_trace_record(mqtt_trace_dir_t dir, const char *topic, int topic_len,
+                       int len, int msg_id, int qos);
+
+/**
+ * @brief 按序号读出默认轨迹的记录
+ *
+ * 从 from_seq 开始按写入顺序读出，早于缓冲区最旧记录的部分自动跳过；
+ * 读取期间被覆盖或尚未写完的记录以 MQTT_TRACE_DIR_NONE 占位，保证序号连续。
+ *
+ * @param from_seq  起始序号，0 表示从最旧记录开始
+ * @param out       输出数组
+ * @param max       数组容量
+ * @param first_seq 输出第一条记录的序号，可为 NULL
+ *
+ * @return 读出的记录条数
+ */
+int mqtt_trace_read(uint32_t from_seq, mqtt_trace_record_t *out, int max, uint32_t *first_seq);
+
+/**
+ * @brief 默认轨迹下一条待写记录的序号
+ */
+uint32_t mqtt_trace_head(void);
+
+/**
+ * @brief 对默认轨迹执行一条远程命令（由管理器注册为 RPC 方法 "trace"）
+ *
+ * 命令为文本：
+ *  - "" 或 "<seq>"                 ：从最旧记录或指定序号开始读出，回复 mqtt_trace_dump_hdr_t + 记录；
+ *  - "off" / "full" / "sampled [N]"：切换级别，回复只含回复头（count 为 0）。
+ *
+ * @param cmd     命令文本（不要求 '\0' 结尾）
+ * @param cmd_len 命令长度
+ * @param out     回复缓冲区，至少容纳回复头
+ * @param cap     回复缓冲区容量，记录条数按容量截断
+ *
+ * @return 回复长度；-1 表示命令非法或缓冲区过小
+ */
+int mqtt_trace_command(const uint8_t *cmd, int cmd_len, uint8_t *out, int cap);
+
+/* -------------------------------------------------------------------------- */
+/*                                  多实例接口                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 创建一个独立的轨迹缓冲区
+ *
+ * @param config 轨迹配置，capacity<=0 时只创建句柄，记录为空操作
+ * @param out    输出句柄
+ *
+ * @return
+ *      - ESP_OK              : 创建成功
+ *      - ESP_ERR_INVALID_ARG : 参数为 NULL
+ *      - ESP_ERR_NO_MEM      : 内存不足
+ */
+esp_err_t mqtt_trace_create(const mqtt_trace_config_t *config, mqtt_trace_handle_t *out);
+
+/**
+ * @brief 销毁轨迹
+ *
+ * 引用该轨迹的 MQTT 模块实例销毁之前拒绝销毁；直接调用记录 / 读取接口的其他任务需由调用方自行停止。
+ *
+ * @return
+ *      - ESP_OK                : 销毁成功
+ *      - ESP_ERR_INVALID_ARG   : 句柄为 NULL
+ *      - ESP_ERR_INVALID_STATE : 仍有实例引用（mqtt_trace_retain 未配对 release），轨迹保持不变
+ */
+esp_err_t mqtt_trace_destroy(mqtt_trace_handle_t trace);
+
+/**
+ * @brief 登记一个写入方（mqtt_module_create 对 cfg.trace 调用），登记期间 mqtt_trace_destroy 拒绝销毁
+ */
+void mqtt_trace_retain(mqtt_trace_handle_t trace);
+
+/**
+ * @brief 注销 mqtt_trace_retain 登记的写入方（mqtt_module_destroy 在客户端与 drain 任务停止后调用）
+ */
+void mqtt_trace_release(mqtt_trace_handle_t trace);
+
+/*
+ * 以下接口与同名的不带句柄接口行为一致，只是作用于指定轨迹；
+ * trace 为 NULL 时记录为空操作，读取返回 0 条，命令返回 -1。
+ */
+
+/**
+ * @brief 切换指定轨迹的级别，sample<=0 表示保持采样间隔不变
+ */
+void mqtt_trace_inst_set_level(mqtt_trace_handle_t trace, mqtt_trace_level_t level, int sample);
+
+/**
+ * @brief 获取指定轨迹的级别与采样间隔（sample 可为 NULL）
+ */
+mqtt_trace_level_t mqtt_trace_inst_get_level(mqtt_trace_handle_t trace, int *sample);
+
+/**
+ * @brief 向指定轨迹记录一条消息（可在任意任务中调用，不阻塞）
+ */
+void mqtt_trace_inst_record(mqtt_trace_handle_t trace, mqtt_trace_dir_t dir, const char *topic,
+                            int topic_len, int len, int msg_id, int qos);
+
+/**
+ * @brief 按序号读出指定轨迹的记录
+ */
+int mqtt_trace_inst_read(mqtt_trace_handle_t trace, uint32_t from_seq, mqtt_trace_record_t *out,
+                         int max, uint32_t *first_seq);
+
+/**
+ * @brief 指定轨迹下一条待写记录的序号
+ */
+uint32_t mqtt_trace_inst_head(mqtt_trace_handle_t trace);
+
+/**
+ * @brief 对指定轨迹执行一条远程命令
+ */
+int mqtt_trace_inst_command(mqtt_trace_handle_t trace, const uint8_t *cmd, int cmd_len,
+                            uint8_t *out, int cap);
+
+#endif /* MQTT_TRACE_MODULE_H */
@@ -12,16 +12,20 @@
 #ifndef WEB_MQTT_MANAGER_H
 #define WEB_MQTT_MANAGER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "esp_err.h"           ///< ESP-IDF 通用错误码定义
+#include "mqtt_broker_module.h" ///< 服务器列表与故障切换
+#include "mqtt_trace_module.h"  ///< 消息轨迹环形缓冲区
 
 /**
- * @brief Web MQTT 管理器内部状态机单步运行周期（单位：ms）
+ * @brief Web MQTT 管理器状态机兜底唤醒周期（单位：ms）
  *
- * 管理任务会按该间隔周期性驱动内部状态机：
- * - 间隔过小：状态刷新更及时，但占用更多 CPU；
- * - 间隔过大：重连 / 心跳响应会变慢。
+ * 管理状态机作为 xn_loop 定时器运行，由 MQTT 事件（定时器唤醒）与重连定时驱动，正常情况下不依赖该周期；
+ * 该值仅作为等待上限，防止意外情况下状态机长期不运行。
  */
-#define WEB_MQTT_MANAGER_STEP_INTERVAL_MS 5000 ///< 默认状态机运行间隔（ms）
+#define WEB_MQTT_MANAGER_STEP_INTERVAL_MS 5000 ///< 默认兜底唤醒周期（ms）
 
 /**
  * @brief Web MQTT 管理器状态
@@ -31,8 +35,8 @@
 typedef enum {
     WEB_MQTT_STATE_DISCONNECTED = 0, ///< 已断开或尚未开始连接
     WEB_MQTT_STATE_CONNECTING,       ///< 正在与服务器建立连接
-    WEB_MQTT_STATE_CONNECTED,        ///< 已连接但尚未完成必要订阅
-    WEB_MQTT_STATE_READY,            ///< 已连接且完成必要订阅，可正常收发
+    WEB_MQTT_STATE_CONNECTED,        ///< 已连接但尚未完成必要订阅或设备注册（READY 后服务器报告未注册时也会退回此状态）
+    WEB_MQTT_STATE_READY,            ///< 已连接、全部订阅均收到 SUBACK 且设备已注册，可正常收发
     WEB_MQTT_STATE_ERROR,            ///< 出现错误，等待自动重连或人工干预
 } web_mqtt_state_t;
 
@@ -46,6 +50,14 @@ typedef enum {
  */
 typedef void (*web_mqtt_event_cb_t)(web_mqtt_state_t state);
 
+/**
+ * @brief QoS>=1 在途窗口水位回调（参数同 mqtt_module_inflight_cb_t）
+ *
+ * 窗口占满时 full=true、回落到一半及以下时 full=false 各调用一次，
+ * 可在发布者任务或 esp-mqtt 任务中调用，不可阻塞或在回调内发布。
+ */
+typedef void (*web_mqtt_inflight_cb_t)(int inflight, bool full);
+
 /**
  * @brief Web MQTT 默认认证信息
  *
@@ -64,20 +76,72 @@ typedef void (*web_mqtt_event_cb_t)(web_mqtt_state_t state);
 #define WEB_MQTT_UPLINK_BASE_TOPIC "xn/esp"
 #endif
 
+/**
+ * @brief Web MQTT 管理器收发统计
+ */
+typedef struct {
+    uint32_t rx_total;      ///< 收到的下行消息总数
+    uint32_t rx_dispatched; ///< 至少分发给一个应用模块的消息数
+    uint32_t rx_unmatched;  ///< 未匹配任何模块订阅过滤器而被丢弃的消息数
+    uint32_t rx_dropped;    ///< 因模块分发队列满或内存不足而丢弃的分发次数
+    uint32_t rx_limited;    ///< 因模块限流规则（令牌桶）而丢弃的分发次数
+    uint32_t rx_coalesced;  ///< 被同一 Topic 新消息合并替换的分发次数
+    uint16_t rx_queue_depth;      ///< 各模块分发队列当前深度之和（读取时统计）
+    uint16_t rx_queue_high_water; ///< 各模块分发队列深度历史最大值中的最大者（读取时统计）
+    uint32_t connect_attempts; ///< 累计发起的连接尝试次数
+    uint32_t last_backoff_ms;  ///< 最近一次调度的重连等待时间（ms）
+    uint32_t ready_ms;         ///< 最近一次从发起连接到 READY 的耗时（ms，含订阅与注册）
+    uint32_t subscribe_ms;     ///< 最近一次从连接建立到全部 SUBACK 到达的耗时（ms）
+    uint32_t register_ms;      ///< 最近一次从连接建立到注册完成并进入 READY 的耗时（ms），分布见 mqtt_reg_module_get_stats()
+    uint32_t subscribe_failed; ///< 订阅轮次失败（被拒绝 / 超时）次数
+    uint32_t session_resumed;  ///< 持久会话被服务器保留、跳过重新订阅的连接次数
+    uint32_t broker_switches;  ///< 切换到另一台服务器的次数（故障切换与探测抢先）
+} web_mqtt_manager_stats_t;
+
 /**
  * @brief Web MQTT 管理器配置
  *
  * 该结构体仅在初始化时读取一次，之后由管理器内部持有副本。
  */
 typedef struct {
-    const char          *broker_uri;            ///< MQTT 服务器 URI，如 "mqtt://192.168.1.10:1883"
+    const char          *broker_uri;            ///< MQTT 服务器 URI，如 "mqtt://192.168.1.10:1883"（未配置 brokers 时使用）
+    const mqtt_broker_t *brokers;               ///< 服务器列表（按优先级排列，可带权重），NULL 表示只使用 broker_uri
+    int                  broker_num;            ///< 服务器列表长度（1~MQTT_BROKER_MAX）
+    int                  broker_latency_budget_ms; ///< CONNACK 延迟预算（ms），连接尝试超出后并行探测其他服务器，<=0 表示不探测
+    int                  broker_probe_timeout_ms;  ///< 并行 TCP 探测最长等待（ms）
+    int                  broker_hold_down_ms;   ///< 连接失败的服务器冷却时长（ms），期间优先使用其他服务器
     const char          *client_id;             ///< MQTT 客户端 ID，NULL 表示使用芯片唯一 ID
     const char          *username;              ///< MQTT 用户名，可为 NULL 表示匿名
     const char          *password;              ///< MQTT 密码，可为 NULL 表示无密码
     const char          *base_topic;            ///< Web 管理相关的基础 Topic 前缀，如 "xn/web"
     int                  keepalive_sec;         ///< MQTT keepalive 保活时间（秒），<=0 使用组件默认值
-    int                  reconnect_interval_ms; ///< 连接失败后自动重连间隔；<0 表示关闭自动重连
-    int                  step_interval_ms;      ///< 状态机运行周期（ms），<=0 使用 WEB_MQTT_MANAGER_STEP_INTERVAL_MS
+    int                  reconnect_interval_ms; ///< 重连退避基准间隔（ms）；<0 表示关闭自动重连
+    int                  reconnect_max_ms;      ///< 重连退避上限（ms），<=0 表示不做指数退避（始终使用基准间隔）
+    int                  reconnect_stable_ms;   ///< 连接持续该时长（ms）后断开，退避从头计算
+    int                  connect_timeout_ms;    ///< 单次连接尝试超时（ms），超时视为失败并进入退避
+    int                  step_interval_ms;      ///< 状态机兜底唤醒周期（ms），<=0 使用 WEB_MQTT_MANAGER_STEP_INTERVAL_MS
+    bool                 offline_spool;         ///< 离线时将 QoS>=1 上行消息缓存到 "mqtt_spool" 分区，重连后回放
+    bool                 reg_cache;             ///< 把服务器签发的注册令牌缓存到 NVS，重启 / 重连时跳过 reg/query 往返（需已调用 nvs_flash_init）
+    int                  reg_timeout_ms;        ///< reg/query 回复截止时间（ms，<=0 按 5000 处理），超时后按指数退避重试（上限 reconnect_max_ms）
+    int                  reg_retry_max;         ///< 连续超时达到该次数后进入 FAILED（仍按最大间隔继续查询），<=0 表示不进入 FAILED
+    int                  dispatch_worker_num;   ///< 下行消息分发线程数，<=0 按 1 处理
+    int                  dispatch_stack_size;   ///< 分发线程栈大小（字节），需容纳各模块回调
+    int                  dispatch_task_prio;    ///< 分发线程优先级，建议低于 esp-mqtt 任务
+    bool                 persistent_session;    ///< 持久会话：服务器保留订阅并缓存离线期间的 QoS1 指令，重连时跳过重新订阅
+    uint32_t             session_expiry_sec;    ///< 持久会话保留时间（秒），仅 MQTT 5.0 有效
+    bool                 protocol_v5;           ///< 使用 MQTT 5.0（需开启 CONFIG_MQTT_PROTOCOL_5），RPC 借此携带 Response Topic / Correlation Data
+    int                  topic_alias_max;       ///< 上行 Topic 别名表大小（MQTT 5.0 下 QoS 0 同步发布省略重复的长 Topic），<=0 表示关闭
+    int                  compress_min_len;      ///< 上行负载达到该长度（字节）时 LZF 压缩并在 Topic 末尾追加 "/z"，<=0 表示不压缩（需服务器支持）
+    int                  heartbeat_interval_ms; ///< 心跳间隔（ms）：链路空闲满该时长才发送心跳，其他上行可替代心跳；服务器可在线调整
+    int                  ack_report_interval_ms; ///< PUBACK 延迟统计上报间隔（ms，随心跳检查），<=0 表示不上报
+    int                  inflight_max;          ///< QoS>=1 未确认消息上限（1~48），<=0 表示不限制
+    int                  inflight_wait_ms;      ///< 超大负载同步发布在窗口已满时的最长等待（ms）
+    web_mqtt_inflight_cb_t inflight_cb;         ///< 在途窗口水位回调，可为 NULL
+    int                  rpc_inflight_max;      ///< RPC 在途调用表容量（1~256），<=0 表示不启用 RPC 模块
+    int                  rpc_timeout_ms;        ///< RPC 调用默认截止时间（ms）
+    int                  trace_capacity;        ///< 消息轨迹记录条数（向上取整为 2 的幂），<=0 表示不记录；启用 RPC 时可由服务器调用 "trace" 读出
+    mqtt_trace_level_t   trace_level;           ///< 消息轨迹初始级别，运行期可通过 mqtt_trace_set_level() 或 "trace" 命令切换
+    int                  trace_sample;          ///< 采样级别下每 N 条消息记录一条
     web_mqtt_event_cb_t  event_cb;              ///< 状态及重要事件回调，可为 NULL 表示不关心
 } web_mqtt_manager_config_t;
 
@@ -96,13 +160,43 @@ typedef struct {
 #define WEB_MQTT_MANAGER_DEFAULT_CONFIG()                              \
     (web_mqtt_manager_config_t) {                                      \
         .broker_uri            = NULL,                                 \
+        .brokers               = NULL,                                 \
+        .broker_num            = 0,                                    \
+        .broker_latency_budget_ms = 3000,                              \
+        .broker_probe_timeout_ms  = 1000,                              \
+        .broker_hold_down_ms   = 60000,                                \
         .client_id             = NULL,                                 \
         .username              = WEB_MQTT_DEFAULT_USERNAME,            \
         .password              = WEB_MQTT_DEFAULT_PASSWORD,            \
         .base_topic            = NULL,                                 \
         .keepalive_sec         = 60,                                   \
-        .reconnect_interval_ms = 5000,                                 \
+        .reconnect_interval_ms = 1000,                                 \
+        .reconnect_max_ms      = 120000,                               \
+        .reconnect_stable_ms   = 60000,                                \
+        .connect_timeout_ms    = 30000,                                \
         .step_interval_ms      = WEB_MQTT_MANAGER_STEP_INTERVAL_MS,    \
+        .offline_spool         = true,                                 \
+        .reg_cache             = true,                                 \
+        .reg_timeout_ms        = 5000,                                 \
+        .reg_retry_max         = 5,                                    \
+        .dispatch_worker_num   = 1,                                    \
+        .dispatch_stack_size   = 4096,                                 \
+        .dispatch_task_prio    = 2,                                    \
+        .persistent_session    = false,                                \
+        .session_expiry_sec    = 3600,                                 \
+        .protocol_v5           = false,                                \
+        .topic_alias_max       = 8,                                    \
+        .compress_min_len      = 0,                                    \
+        .heartbeat_interval_ms = 30000,                                \
+        .ack_report_interval_ms = 300000,                              \
+        .inflight_max          = 16,                                   \
+        .inflight_wait_ms      = 1000,                                 \
+        .inflight_cb           = NULL,                                 \
+        .rpc_inflight_max      = 16,                                   \
+        .rpc_timeout_ms        = 5000,                                 \
+        .trace_capacity        = 256,                                  \
+        .trace_level           = MQTT_TRACE_SAMPLED,                   \
+        .trace_sample          = 16,                                   \
         .event_cb              = NULL,                                 \
     }
 
@@ -111,7 +205,7 @@ typedef struct {
  *
  * 功能概览：
  * - 初始化内部 MQTT 客户端及相关资源；
- * - 创建管理任务并启动内部状态机；
+ * - 在共享事件循环（xn_loop）中创建管理定时器并启动内部状态机；
  * - 根据配置自动尝试与服务器建立连接。
  *
  * @note 调用前应确保 WiFi / 以太网 已经就绪并具备网络连接。
@@ -133,4 +227,18 @@ const char *web_mqtt_manager_get_client_id(void);
  */
 const char *web_mqtt_manager_get_base_topic(void);
 
+/**
+ * @brief 获取管理器收发统计
+ */
+esp_err_t web_mqtt_manager_get_stats(web_mqtt_manager_stats_t *out);
+
+/**
+ * @brief 获取各服务器的连接统计（CONNACK 延迟、失败次数、探测结果等）
+ *
+ * @param out 输出数组，至少 max 项
+ * @param max 数组容量
+ * @param num 输出：实际填写的项数，可为 NULL
+ */
+esp_err_t web_mqtt_manager_get_broker_stats(mqtt_broker_stats_t *out, int max, int *num);
+
 #endif /* WEB_MQTT_MANAGER_H */
@@ -0,0 +1,486 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-12 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-12 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\src\mqtt_broker_module.c
+ * @Description: MQTT 服务器列表与故障切换实现
+ *
+ * 选择与统计在自旋锁内完成（由管理状态机更新，统计可在任意任务中读取）；
+ * 探测在管理器的临时任务中执行，网络操作在锁外完成，只有结果写回时加锁。
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#include "mqtt_broker_module.h"
+
+/* 日志 TAG */
+static const char *TAG = "mqtt_broker";            ///< 本模块日志 TAG
+
+#define MQTT_BROKER_HOST_MAX   64                  ///< 主机名最大长度（含 '\0'）
+#define MQTT_BROKER_AVG_SHIFT  2                   ///< 滑动平均中新样本权重为 1/4
+#define MQTT_BROKER_STICKY_PCT 150                 ///< 当前服务器折算延迟不超过最优者的 150% 时不切换
+
+/**
+ * @brief 单台服务器的内部状态
+ */
+typedef struct {
+    char                host[MQTT_BROKER_HOST_MAX]; ///< 解析出的主机名（探测用）
+    uint16_t            port;                       ///< 端口（未写明时按协议取默认值）
+    int                 weight;                     ///< 权重
+    int                 fail_run;                   ///< 连续失败次数
+    TickType_t          down_until;                 ///< 冷却结束时刻，0 表示不在冷却期
+    mqtt_broker_stats_t stats;                      ///< 统计信息
+} mqtt_broker_slot_t;
+
+static struct {
+    mqtt_broker_config_t cfg;                      ///< 配置副本
+    mqtt_broker_slot_t   slots[MQTT_BROKER_MAX];   ///< 各服务器状态
+    int                  num;                      ///< 服务器数量
+    int                  cur;                      ///< 当前服务器下标
+    portMUX_TYPE         lock;                     ///< 保护以上状态
+} s_broker = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/**
+ * @brief 内部辅助：从 URI 中解析主机名与端口
+ *
+ * 支持 scheme://[user[:pass]@]host[:port][/path]，IPv6 地址需写在方括号内。
+ */
+static bool mqtt_broker_parse_uri(const char *uri, char *host, size_t host_size, uint16_t *port)
+{
+    const char *p = strstr(uri, "://");
+    if (p == NULL) {
+        return false;
+    }
+
+    size_t scheme_len = (size_t)(p - uri);
+    *port = 1883;
+    if ((scheme_len == 5 && strncmp(uri, "mqtts", 5) == 0) ||
+        (scheme_len == 3 && strncmp(uri, "ssl", 3) == 0)) {
+        *port = 8883;
+    } else if (scheme_len == 3 && strncmp(uri, "wss", 3) == 0) {
+        *port = 443;
+    } else if (scheme_len == 2 && strncmp(uri, "ws", 2) == 0) {
+        *port = 80;
+    }
+
+    p += 3;
+    const char *end = p + strcspn(p, "/?#");
+    for (const char *q = p; q < end; ++q) {        ///< 跳过用户信息（取最后一个 '@'）
+        if (*q == '@') {
+            p = q + 1;
+        }
+    }
+
+    const char *hs    = p;
+    const char *he    = NULL;
+    const char *colon = NULL;
+    if (*p == '[') {
+        he = memchr(p, ']', (size_t)(end - p));
+        if (he == NULL) {
+            return false;
+        }
+        hs    = p + 1;
+        colon = (he + 1 < end && he[1] == ':') ? he + 1 : NULL;
+    } else {
+        colon = memchr(p, ':', (size_t)(end - p));
+        he    = (colon != NULL) ? colon : end;
+    }
+
+    size_t host_len = (size_t)(he - hs);
+    if (host_len == 0 || host_len >= host_size) {
+        return false;
+    }
+    memcpy(host, hs, host_len);
+    host[host_len] = '\0';
+
+    if (colon != NULL) {
+        char *num_end = NULL;
+        long  v       = strtol(colon + 1, &num_end, 10);
+        if (num_end != end || v <= 0 || v > 65535) {
+            return false;
+        }
+        *port = (uint16_t)v;
+    }
+    return true;
+}
+
+/**
+ * @brief 内部辅助：服务器是否处于冷却期（需持有锁）
+ */
+static bool mqtt_broker_held_locked(const mqtt_broker_slot_t *b, TickType_t now)
+{
+    return b->down_until != 0 &&
+           (TickType_t)(now - b->down_until) >= (portMAX_DELAY >> 1); ///< 尚未到达冷却结束时刻
+}
+
+/**
+ * @brief 内部辅助：服务器排序等级与折算延迟（需持有锁）
+ *
+ * @return 0 延迟在预算内；1 尚无数据；2 延迟超出预算
+ */
+static int mqtt_broker_rank_locked(const mqtt_broker_slot_t *b, uint32_t *score)
+{
+    uint32_t lat = b->stats.connack_avg_ms ? b->stats.connack_avg_ms : b->stats.probe_ms;
+
+    *score = lat / (uint32_t)b->weight;
+    if (lat == 0) {
+        return 1;
+    }
+    if (s_broker.cfg.latency_budget_ms > 0 && lat > (uint32_t)s_broker.cfg.latency_budget_ms) {
+        return 2;
+    }
+    return 0;
+}
+
+esp_err_t mqtt_broker_init(const mqtt_broker_config_t *config)
+{
+    if (config == NULL || config->list == NULL ||
+        config->num <= 0 || config->num > MQTT_BROKER_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_broker_slot_t slots[MQTT_BROKER_MAX];
+    memset(slots, 0, sizeof(slots));
+    for (int i = 0; i < config->num; ++i) {
+        const mqtt_broker_t *src = &config->list[i];
+        if (src->uri == NULL ||
+            !mqtt_broker_parse_uri(src->uri, slots[i].host, sizeof(slots[i].host), &slots[i].port)) {
+            ESP_LOGE(TAG, "invalid broker uri: %s", src->uri ? src->uri : "(null)");
+            return ESP_ERR_INVALID_ARG;
+        }
+        slots[i].weight    = (src->weight <= 0) ? 1 : (src->weight > 100 ? 100 : src->weight);
+        slots[i].stats.uri = src->uri;
+    }
+
+    portENTER_CRITICAL(&s_broker.lock);
+    s_broker.cfg = *config;
+    if (s_broker.cfg.fail_threshold <= 0) {
+        s_broker.cfg.fail_threshold = 1;
+    }
+    memcpy(s_broker.slots, slots, sizeof(slots));
+    s_broker.num = config->num;
+    s_broker.cur = 0;
+    portEXIT_CRITICAL(&s_broker.lock);
+
+    return ESP_OK;
+}
+
+int mqtt_broker_num(void)
+{
+    return s_broker.num;
+}
+
+int mqtt_broker_current(void)
+{
+    return s_broker.cur;
+}
+
+const char *mqtt_broker_uri(int idx)
+{
+    if (idx < 0 || idx >= s_broker.num) {
+        return NULL;
+    }
+    return s_broker.slots[idx].stats.uri;
+}
+
+int mqtt_broker_select(bool *failover)
+{
+    TickType_t now          = xTaskGetTickCount();
+    int        best         = -1;
+    int        best_rank    = 3;
+    uint32_t   best_score   = 0;
+    int        soonest      = -1;
+    TickType_t soonest_left = 0;
+
+    portENTER_CRITICAL(&s_broker.lock);
+    int prev = s_broker.cur;
+    for (int i = 0; i < s_broker.num; ++i) {
+        const mqtt_broker_slot_t *b = &s_broker.slots[i];
+        if (mqtt_broker_held_locked(b, now)) {
+            TickType_t left = b->down_until - now;
+            if (soonest < 0 || left < soonest_left) {
+                soonest      = i;
+                soonest_left = left;
+            }
+            continue;
+        }
+
+        uint32_t score = 0;
+        int      rank  = mqtt_broker_rank_locked(b, &score);
+        if (rank < best_rank || (rank == best_rank && rank != 1 && score < best_score)) {
+            best       = i;
+            best_rank  = rank;
+            best_score = score;
+        }
+    }
+
+    /* 当前服务器可用且与最优者相差不大时继续沿用，避免在相近的服务器之间来回切换 */
+    if (best >= 0 && best != prev && !mqtt_broker_held_locked(&s_broker.slots[prev], now)) {
+        uint32_t score = 0;
+        int      rank  = mqtt_broker_rank_locked(&s_broker.slots[prev], &score);
+        if (rank == 0 && best_rank == 0 &&
+            (uint64_t)score * 100 <= (uint64_t)best_score * MQTT_BROKER_STICKY_PCT) {
+            best = prev;
+        }
+    }
+
+    int next = (best >= 0) ? best : soonest;
+    s_broker.cur = next;
+    portEXIT_CRITICAL(&s_broker.lock);
+
+    if (failover != NULL) {
+        *failover = (best >= 0 && next != prev);
+    }
+    if (next != prev) {
+        ESP_LOGI(TAG, "switch broker %d -> %d (%s)", prev, next, s_broker.slots[next].stats.uri);
+    }
+    return next;
+}
+
+void mqtt_broker_set_current(int idx)
+{
+    if (idx < 0 || idx >= s_broker.num) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_broker.lock);
+    s_broker.cur = idx;
+    portEXIT_CRITICAL(&s_broker.lock);
+}
+
+void mqtt_broker_on_attempt(int idx)
+{
+    if (idx < 0 || idx >= s_broker.num) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_broker.lock);
+    s_broker.slots[idx].stats.attempts++;
+    portEXIT_CRITICAL(&s_broker.lock);
+}
+
+void mqtt_broker_on_connected(int idx, uint32_t connack_ms)
+{
+    if (idx < 0 || idx >= s_broker.num) {
+        return;
+    }
+    if (connack_ms == 0) {
+        connack_ms = 1;                            ///< 0 保留为“尚无数据”
+    }
+
+    portENTER_CRITICAL(&s_broker.lock);
+    mqtt_broker_slot_t *b = &s_broker.slots[idx];
+    b->stats.connects++;
+    b->stats.connack_ms = connack_ms;
+    if (b->stats.connack_avg_ms == 0) {
+        b->stats.connack_avg_ms = connack_ms;
+    } else {
+        int32_t diff = (int32_t)connack_ms - (int32_t)b->stats.connack_avg_ms;
+        b->stats.connack_avg_ms = (uint32_t)((int32_t)b->stats.connack_avg_ms + diff / (1 << MQTT_BROKER_AVG_SHIFT));
+        if (b->stats.connack_avg_ms == 0) {
+            b->stats.connack_avg_ms = 1;
+        }
+    }
+    b->fail_run   = 0;
+    b->down_until = 0;
+    portEXIT_CRITICAL(&s_broker.lock);
+}
+
+void mqtt_broker_on_failed(int idx, bool raced)
+{
+    if (idx < 0 || idx >= s_broker.num) {
+        return;
+    }
+
+    int  fail_run = 0;
+    bool held     = false;
+
+    portENTER_CRITICAL(&s_broker.lock);
+    mqtt_broker_slot_t *b = &s_broker.slots[idx];
+    b->stats.failures++;
+    if (raced) {
+        b->stats.raced++;
+    }
+    if (++b->fail_run >= s_broker.cfg.fail_threshold) {
+        b->down_until = xTaskGetTickCount() + pdMS_TO_TICKS(s_broker.cfg.hold_down_ms);
+        if (b->down_until == 0) {
+            b->down_until = 1;                     ///< 0 保留为“不在冷却期”
+        }
+        held = true;
+    }
+    fail_run = b->fail_run;
+    portEXIT_CRITICAL(&s_broker.lock);
+
+    if (held) {
+        ESP_LOGW(TAG, "broker %d hold down %d ms after %d failure(s)",
+                 idx, s_broker.cfg.hold_down_ms, fail_run);
+    }
+}
+
+/**
+ * @brief 内部辅助：解析地址并发起非阻塞 TCP 连接
+ *
+ * @return 套接字，失败返回 -1
+ */
+static int mqtt_broker_probe_open(const mqtt_broker_slot_t *b)
+{
+    struct addrinfo  hints = { 0 };
+    struct addrinfo *res   = NULL;
+    char             port[8];
+
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%u", (unsigned)b->port);
+    if (getaddrinfo(b->host, port, &hints, &res) != 0 || res == NULL) {
+        return -1;
+    }
+
+    int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd >= 0) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 ||
+            (connect(fd, res->ai_addr, res->ai_addrlen) != 0 && errno != EINPROGRESS)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+int mqtt_broker_probe(int exclude)
+{
+    int     fds[MQTT_BROKER_MAX];
+    int     idxs[MQTT_BROKER_MAX];
+    int64_t starts[MQTT_BROKER_MAX];
+    int     n      = 0;
+    int     winner = -1;
+
+    /* 候选集合在锁内确定；主机名与端口初始化后不再变化，可在锁外使用 */
+    TickType_t now = xTaskGetTickCount();
+    bool       candidate[MQTT_BROKER_MAX] = { 0 };
+    portENTER_CRITICAL(&s_broker.lock);
+    for (int i = 0; i < s_broker.num; ++i) {
+        candidate[i] = (i != exclude) && !mqtt_broker_held_locked(&s_broker.slots[i], now);
+    }
+    portEXIT_CRITICAL(&s_broker.lock);
+
+    for (int i = 0; i < s_broker.num; ++i) {
+        if (!candidate[i]) {
+            continue;
+        }
+        int fd = mqtt_broker_probe_open(&s_broker.slots[i]);
+        if (fd < 0) {
+            continue;
+        }
+        fds[n]    = fd;
+        idxs[n]   = i;
+        starts[n] = esp_timer_get_time();          ///< 每台单独计时，域名解析不计入
+        n++;
+    }
+
+    uint32_t result[MQTT_BROKER_MAX] = { 0 };      ///< 各候选的握手耗时，0 表示无响应
+    int64_t  deadline = esp_timer_get_time() + (int64_t)s_broker.cfg.probe_timeout_ms * 1000;
+    int      pending  = n;
+    while (pending > 0 && winner < 0) {
+        int64_t left = deadline - esp_timer_get_time();
+        if (left <= 0) {
+            break;
+        }
+
+        fd_set wset;
+        int    max_fd = -1;
+        FD_ZERO(&wset);
+        for (int k = 0; k < n; ++k) {
+            if (fds[k] >= 0) {
+                FD_SET(fds[k], &wset);
+                max_fd = (fds[k] > max_fd) ? fds[k] : max_fd;
+            }
+        }
+
+        struct timeval tv = {
+            .tv_sec  = (long)(left / 1000000),
+            .tv_usec = (long)(left % 1000000),
+        };
+        if (select(max_fd + 1, NULL, &wset, NULL, &tv) <= 0) {
+            break;                                 ///< 超时或出错
+        }
+
+        int64_t t = esp_timer_get_time();
+        for (int k = 0; k < n; ++k) {
+            if (fds[k] < 0 || !FD_ISSET(fds[k], &wset)) {
+                continue;
+            }
+            int       err = 0;
+            socklen_t len = sizeof(err);
+            if (getsockopt(fds[k], SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+                uint32_t ms = (uint32_t)((t - starts[k]) / 1000);
+                result[k] = ms ? ms : 1;
+                if (winner < 0 || result[k] < result[winner]) {
+                    winner = k;
+                }
+            }
+            close(fds[k]);
+            fds[k] = -1;
+            pending--;
+        }
+    }
+
+    for (int k = 0; k < n; ++k) {
+        if (fds[k] >= 0) {
+            close(fds[k]);
+        }
+    }
+
+    portENTER_CRITICAL(&s_broker.lock);
+    for (int k = 0; k < n; ++k) {
+        s_broker.slots[idxs[k]].stats.probe_ms = result[k];
+    }
+    portEXIT_CRITICAL(&s_broker.lock);
+
+    if (winner < 0) {
+        ESP_LOGW(TAG, "probe: no broker answered in %d ms", s_broker.cfg.probe_timeout_ms);
+        return -1;
+    }
+    ESP_LOGI(TAG, "probe: broker %d answered in %u ms", idxs[winner], (unsigned)result[winner]);
+    return idxs[winner];
+}
+
+esp_err_t mqtt_broker_get_stats(mqtt_broker_stats_t *out, int max, int *num)
+{
+    if (out == NULL || max <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    int        cnt = 0;
+
+    portENTER_CRITICAL(&s_broker.lock);
+    for (int i = 0; i < s_broker.num && cnt < max; ++i) {
+        out[cnt]         = s_broker.slots[i].stats;
+        out[cnt].healthy = !mqtt_broker_held_locked(&s_broker.slots[i], now);
+        out[cnt].current = (i == s_broker.cur);
+        cnt++;
+    }
+    portEXIT_CRITICAL(&s_broker.lock);
+
+    if (num != NULL) {
+        *num = cnt;
+    }
+    return ESP_OK;
+}
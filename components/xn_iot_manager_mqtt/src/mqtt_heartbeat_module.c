@@ -7,30 +7,45 @@
  * @Description: 心跳模块实现
  *
  * 功能概述：
- *  - 周期性检查设备是否已注册；
- *  - 若已注册，则按固定间隔向服务器发送心跳包；
- *  - 心跳 Topic 默认为 base_topic+"/hb"，负载使用设备 ID。
+ *  - 作为 xn_loop 定时器周期性检查设备是否已注册（与管理器、WiFi 管理共用一个任务）；
+ *  - 若已注册，只在链路空闲满一个心跳间隔（期间没有任何上行送达服务器）时才发送心跳包，
+ *    状态上报等其他上行已能证明在线，无需重复发送；
+ *  - 心跳间隔由 heartbeat_interval_ms 配置，服务器可向 base_topic/hb/<id>/interval 下发秒数在线调整（不保存）；
+ *  - 心跳 Topic 默认为 base_topic+"/hb"，负载为 24 字节健康记录（mqtt_hb_health_t：运行时长、堆、RSSI、
+ *    连接次数、出站与分发队列深度），设备 ID 由服务器从 MQTT client_id 取得；
+ *  - ack_report_interval_ms > 0 时，随心跳按该间隔上报一次 PUBACK 延迟统计（区间值，上报后清零）。
  */
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
 
 #include "mqtt_module.h"
+#include "mqtt_app_module.h"
 #include "mqtt_reg_module.h"
 #include "mqtt_heartbeat_module.h"
+#include "xn_loop.h"
 
 /* 日志 TAG */
 static const char *TAG = "mqtt_hb";               ///< 本模块日志 TAG
 
 static const web_mqtt_manager_config_t *s_mgr_cfg = NULL; ///< 管理器配置指针
-static TaskHandle_t                      s_hb_task = NULL; ///< 心跳任务句柄
+static xn_loop_timer_t                  *s_hb_timer = NULL; ///< 心跳定时器（运行在共享事件循环中）
+static TickType_t                        s_report_at = 0;  ///< 下次上报 PUBACK 统计的时刻
+static char                              s_topic[128];     ///< 心跳 Topic
+static uint32_t                          s_interval_ms = 0; ///< 当前心跳间隔（ms，可由服务器调整）
 
-#define MQTT_HEARTBEAT_INTERVAL_MS 30000           ///< 心跳间隔（ms），示例为 30 秒
+#define MQTT_HEARTBEAT_INTERVAL_MS     30000       ///< 未配置 heartbeat_interval_ms 时的心跳间隔（ms）
+#define MQTT_HEARTBEAT_INTERVAL_MIN_S  5           ///< 远程设置的最小间隔（秒）
+#define MQTT_HEARTBEAT_INTERVAL_MAX_S  86400       ///< 远程设置的最大间隔（秒）
 
 /**
  * @brief 获取设备唯一标识
@@ -45,39 +60,234 @@ static const char *mqtt_hb_get_device_id(void)
     return "unknown_device";                      ///< 占位设备 ID
 }
 
+_Static_assert(sizeof(mqtt_hb_health_t) == 24, "health record layout");
+
 /**
- * @brief 心跳任务主体
+ * @brief 内部辅助：采集一条健康记录
  */
-static void mqtt_hb_task(void *arg)
+static void mqtt_hb_fill_health(mqtt_hb_health_t *h)
 {
-    (void)arg;                                     ///< 未使用参数
+    web_mqtt_manager_stats_t   mgr = { 0 };
+    mqtt_module_outbox_stats_t ob  = { 0 };
+    wifi_ap_record_t           ap;
+
+    (void)web_mqtt_manager_get_stats(&mgr);
+    (void)mqtt_module_get_outbox_stats(&ob);
 
-    if (s_mgr_cfg == NULL || s_mgr_cfg->base_topic == NULL) { ///< 未正确初始化
-        vTaskDelete(NULL);                          ///< 删除任务
+    memset(h, 0, sizeof(*h));
+    h->ver                 = MQTT_HB_HEALTH_VERSION;
+    h->connects            = (uint16_t)(mgr.connect_attempts > UINT16_MAX ? UINT16_MAX : mgr.connect_attempts);
+    h->uptime_s            = (uint32_t)(esp_timer_get_time() / 1000000);
+    h->heap_free           = esp_get_free_heap_size();
+    h->heap_min            = esp_get_minimum_free_heap_size();
+    h->outbox_depth        = ob.depth;
+    h->outbox_high_water   = ob.high_water;
+    h->rx_queue_depth      = mgr.rx_queue_depth;
+    h->rx_queue_high_water = mgr.rx_queue_high_water;
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) { ///< 未连接 AP 时保持 0
+        h->rssi = ap.rssi;
     }
+}
 
-    char topic[128];                                ///< Topic 缓冲区
-    const char *device_id = mqtt_hb_get_device_id(); ///< 设备 ID 字符串
+/**
+ * @brief 内部辅助：追加一个延迟直方图摘要，如 "hb":{"n":3,"avg":12,"p50":11,...}
+ *
+ * 紧跟在 '{' 之后时不加逗号分隔。
+ */
+static int mqtt_hb_put_hist(char *buf, int off, int cap, const char *name,
+                            const mqtt_module_lat_hist_t *h)
+{
+    if (off >= cap) {
+        return off;
+    }
+    int n = snprintf(buf + off, (size_t)(cap - off),
+                     "%s\"%s\":{\"n\":%u,\"avg\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u}",
+                     (buf[off - 1] == '{') ? "" : ",", name,
+                     (unsigned)h->count, (unsigned)(h->sum_ms / h->count),
+                     (unsigned)mqtt_module_lat_percentile(h, 50),
+                     (unsigned)mqtt_module_lat_percentile(h, 90),
+                     (unsigned)mqtt_module_lat_percentile(h, 99),
+                     (unsigned)h->max_ms);
+    return (n > 0) ? off + n : off;
+}
 
-    /* 预构造心跳 Topic: base_topic + "/hb" */
-    snprintf(topic, sizeof(topic), "%s/hb", WEB_MQTT_UPLINK_BASE_TOPIC);
+/**
+ * @brief 内部辅助：提交 mqtt_hb_report_ack() 写好的一条统计，写入被截断时放弃
+ */
+static void mqtt_hb_report_commit(mqtt_module_publish_lease_t *lease, int len)
+{
+    if (len < lease->cap) {
+        (void)mqtt_module_publish_commit(lease, len, 0, false, NULL);
+    } else {
+        mqtt_module_publish_abort(lease);
+        ESP_LOGW(TAG, "puback report truncated");
+    }
+}
+
+/**
+ * @brief 内部辅助：上报一次 PUBACK 统计
+ *
+ * Topic 为 xn/esp/stats/<id>/puback，QoS 0 发布，不计入自身统计。
+ * 运行在共享事件循环中，统计直接写入出站槽位，不同步调用客户端：
+ * 第一条为计数与按 QoS 的分布，其后按类别分布拆成若干条 {"class":{...}}，每条不超过一个槽位。
+ */
+static void mqtt_hb_report_ack(const char *device_id)
+{
+    mqtt_module_ack_stats_t *st = malloc(sizeof(*st)); ///< 统计结构较大，不放在任务栈上
+    if (st == NULL || mqtt_module_get_ack_stats(st, true) != ESP_OK) {
+        free(st);
+        return;
+    }
 
-    for (;;) {                                     ///< 永久循环
-        vTaskDelay(pdMS_TO_TICKS(MQTT_HEARTBEAT_INTERVAL_MS)); ///< 按间隔休眠
+    char topic[128];
+    snprintf(topic, sizeof(topic), "%s/stats/%s/puback", WEB_MQTT_UPLINK_BASE_TOPIC, device_id);
 
-        if (!mqtt_reg_module_is_registered()) {    ///< 未注册则跳过本轮
-            continue;                               ///< 等待下一次
+    mqtt_module_publish_lease_t lease;
+    if (mqtt_module_publish_begin(topic, 0, &lease) == ESP_OK) {
+        int cap = lease.cap;
+        int off = snprintf(lease.buf, (size_t)cap,
+                           "{\"unacked\":%u,\"unacked_max\":%u,\"tracked\":%u,\"acked\":%u,"
+                           "\"expired\":%u,\"untracked\":%u,\"window\":%u,\"window_full\":%u,"
+                           "\"window_wait\":%u,\"qos\":{",
+                           st->unacked, st->unacked_max, (unsigned)st->tracked, (unsigned)st->acked,
+                           (unsigned)st->expired, (unsigned)st->untracked, st->window,
+                           (unsigned)st->window_full, (unsigned)st->window_wait);
+        for (int q = 0; q < 2; ++q) {
+            if (st->qos[q].count > 0) {
+                off = mqtt_hb_put_hist(lease.buf, off, cap, (q == 0) ? "1" : "2", &st->qos[q]);
+            }
         }
+        if (off < cap) {
+            off += snprintf(lease.buf + off, (size_t)(cap - off), "}}");
+        }
+        mqtt_hb_report_commit(&lease, off);
+    }
 
-        ESP_LOGI(TAG, "send heartbeat, id=%s, topic=%s", ///< 打印日志
-                 device_id, topic);                ///< 设备 ID 与 Topic
+    int c = 0;
+    while (c < st->class_num) {
+        if (st->cls[c].count == 0) {
+            c++;
+            continue;
+        }
+        if (mqtt_module_publish_begin(topic, 0, &lease) != ESP_OK) {
+            break;
+        }
 
-        (void)mqtt_module_publish(topic,           ///< 心跳 Topic
-                                   device_id,      ///< 负载为设备 ID
-                                   (int)strlen(device_id), ///< 负载长度
-                                   1,              ///< QoS 1 示例
-                                   false);         ///< 不保留
+        int cap = lease.cap;
+        int off = snprintf(lease.buf, (size_t)cap, "{\"class\":{");
+        int num = 0;
+        for (; c < st->class_num; ++c) {
+            if (st->cls[c].count == 0) {
+                continue;
+            }
+            int next = mqtt_hb_put_hist(lease.buf, off, cap, st->class_name[c], &st->cls[c]);
+            if (next + 2 >= cap) {
+                break;                             ///< 放不下本类别与结尾的 "}}"，留给下一条
+            }
+            off = next;
+            num++;
+        }
+        if (num == 0) {                            ///< 单个类别也放不下（槽位过小），跳过它
+            mqtt_module_publish_abort(&lease);
+            ESP_LOGW(TAG, "puback class %s does not fit in an outbox slot", st->class_name[c]);
+            c++;
+            continue;
+        }
+        off += snprintf(lease.buf + off, (size_t)(cap - off), "}}");
+        mqtt_hb_report_commit(&lease, off);
     }
+
+    free(st);
+}
+
+/**
+ * @brief 心跳模块的消息回调：服务器在线调整心跳间隔
+ *
+ * Topic 为 base_topic/hb/<device_id>/interval，负载为十进制秒数（5~86400）。
+ */
+static esp_err_t mqtt_hb_on_message(const web_mqtt_topic_t *topic,
+                                    const uint8_t          *payload,
+                                    int                     payload_len)
+{
+    if (!topic->for_device ||                      ///< 非发给本设备
+        topic->seg_num != topic->cmd_index + 1 ||  ///< 只接受单级命令
+        !web_mqtt_topic_seg_is(topic, topic->cmd_index, "interval")) {
+        return ESP_OK;
+    }
+
+    char  text[12];
+    char *end = NULL;
+    if (payload_len <= 0 || payload_len >= (int)sizeof(text)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(text, payload, (size_t)payload_len);
+    text[payload_len] = '\0';
+
+    long sec = strtol(text, &end, 10);
+    if (end == text || *end != '\0' ||
+        sec < MQTT_HEARTBEAT_INTERVAL_MIN_S || sec > MQTT_HEARTBEAT_INTERVAL_MAX_S) {
+        ESP_LOGW(TAG, "bad heartbeat interval: %s", text);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_LOGI(TAG, "heartbeat interval set to %ld s", sec);
+    __atomic_store_n(&s_interval_ms, (uint32_t)sec * 1000, __ATOMIC_RELAXED);
+    xn_loop_timer_wake(s_hb_timer);                ///< 按新间隔重新计算等待时间
+    return ESP_OK;
+}
+
+/**
+ * @brief 心跳定时器回调
+ *
+ * 每次执行计算链路空闲时长（距最近一次送达的上行），满一个间隔才发送心跳，
+ * 否则只等待到空闲满间隔的时刻；间隔被远程修改时立即重新计算。
+ *
+ * @return 距下一次执行的毫秒数
+ */
+static uint32_t mqtt_hb_on_timer(void *arg)
+{
+    (void)arg;                                     ///< 未使用参数
+
+    if (s_mgr_cfg->base_topic == NULL) {           ///< 未正确配置，不再定时
+        return XN_LOOP_IDLE;
+    }
+
+    uint32_t interval = __atomic_load_n(&s_interval_ms, __ATOMIC_RELAXED);
+
+    if (!mqtt_reg_module_is_registered()) {        ///< 未注册则跳过本轮
+        return interval;                            ///< 等待下一次
+    }
+
+    uint32_t last = mqtt_module_last_uplink_ms();
+    uint32_t idle = (uint32_t)(esp_timer_get_time() / 1000) - last;
+    if (last != 0 && idle < interval) {            ///< 链路空闲未满间隔：其他上行已证明在线
+        return interval - idle;
+    }
+
+    const char      *device_id = mqtt_hb_get_device_id(); ///< 设备 ID 字符串
+    mqtt_hb_health_t health;                        ///< 心跳负载
+
+    ESP_LOGD(TAG, "send heartbeat, id=%s, topic=%s", ///< 发送已记入轨迹，日志仅调试时输出
+             device_id, s_topic);                  ///< 设备 ID 与 Topic
+
+    mqtt_hb_fill_health(&health);
+
+    /* 负载直接写入出站槽位；不同步调用客户端，以免阻塞共享事件循环，租用失败时本次跳过 */
+    mqtt_module_publish_lease_t lease;
+    if (mqtt_module_publish_begin(s_topic, (int)sizeof(health), &lease) == ESP_OK) {
+        memcpy(lease.buf, &health, sizeof(health)); ///< 负载为健康记录
+        (void)mqtt_module_publish_commit(&lease, (int)sizeof(health), 1, false, NULL);
+    } else {
+        ESP_LOGW(TAG, "outbox unavailable, heartbeat skipped");
+    }
+
+    if (s_mgr_cfg->ack_report_interval_ms > 0 &&
+        (int32_t)(xTaskGetTickCount() - s_report_at) >= 0) { ///< 到达 PUBACK 统计上报时刻
+        s_report_at = xTaskGetTickCount() + pdMS_TO_TICKS(s_mgr_cfg->ack_report_interval_ms);
+        mqtt_hb_report_ack(device_id);
+    }
+
+    return interval;
 }
 
 esp_err_t mqtt_heartbeat_module_init(const web_mqtt_manager_config_t *mgr_cfg)
@@ -87,23 +297,33 @@ esp_err_t mqtt_heartbeat_module_init(const web_mqtt_manager_config_t *mgr_cfg)
     }
 
     s_mgr_cfg = mgr_cfg;                           ///< 保存配置指针
+    s_interval_ms = (mgr_cfg->heartbeat_interval_ms > 0) ? (uint32_t)mgr_cfg->heartbeat_interval_ms
+                                                         : MQTT_HEARTBEAT_INTERVAL_MS;
 
-    if (s_hb_task != NULL) {                       ///< 若任务已创建
+    if (s_hb_timer != NULL) {                      ///< 若定时器已创建
         return ESP_OK;                              ///< 直接视为成功
     }
 
-    BaseType_t ret = xTaskCreate(                  ///< 创建心跳任务
-        mqtt_hb_task,                              ///< 任务函数
-        "mqtt_hb",                               ///< 任务名
-        4096,                                      ///< 栈大小
-        NULL,                                      ///< 参数
-        tskIDLE_PRIORITY + 1,                      ///< 优先级
-        &s_hb_task);                               ///< 任务句柄
+    /* 在管理器中注册本模块的消息回调，使用前缀 "hb"（只接收间隔调整命令） */
+    web_mqtt_app_config_t app_cfg = {
+        .topic_suffix = "hb",                       ///< 模块前缀
+        .route_cb     = mqtt_hb_on_message,         ///< 回调（只解析数字，可经分发线程执行）
+    };
+    esp_err_t err = web_mqtt_manager_register_app_ex(&app_cfg);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "register app failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    /* 预构造心跳 Topic: base_topic + "/hb" */
+    snprintf(s_topic, sizeof(s_topic), "%s/hb", WEB_MQTT_UPLINK_BASE_TOPIC);
+    s_report_at = xTaskGetTickCount() + pdMS_TO_TICKS(mgr_cfg->ack_report_interval_ms);
 
-    if (ret != pdPASS) {                           ///< 创建失败
-        s_hb_task = NULL;                          ///< 清空句柄
-        return ESP_ERR_NO_MEM;                     ///< 返回内存不足
+    err = xn_loop_timer_create("mqtt_hb", mqtt_hb_on_timer, NULL, &s_hb_timer); ///< 创建心跳定时器
+    if (err != ESP_OK) {                           ///< 创建失败
+        return err;
     }
+    (void)xn_loop_timer_start(s_hb_timer, s_interval_ms); ///< 首次在一个间隔后检查
 
     return ESP_OK;                                  ///< 返回成功
 }
@@ -0,0 +1,210 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-10 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-10 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\src\mqtt_lzf_module.c
+ * @Description: MQTT 负载压缩（LZF 格式）实现
+ *
+ * LZF 压缩流由两种指令组成：
+ *  - 000LLLLL                    ：其后 L+1 字节原样拷贝（1~32 字节字面量）；
+ *  - LLLooooo [LLLLLLLL] oooooooo：从已输出数据往回 o+1 字节处拷贝 L+2 字节，
+ *                                  高 3 位为 7 时由下一字节补充长度（最长 264 字节，回看 8KB）。
+ *
+ * 压缩端只用 3 字节哈希查一次候选位置（贪心匹配），对 JSON 这类重复键名多的文本足够，
+ * 且只需一个 2KB 哈希表，不占用额外堆内存。
+ */
+
+#include <string.h>
+
+#include "mqtt_lzf_module.h"
+
+#define LZF_HLOG    10                             ///< 哈希表位数（1 << LZF_HLOG == MQTT_LZF_HTAB_NUM）
+#define LZF_MAX_LIT (1 << 5)                       ///< 单条字面量指令最多字节数
+#define LZF_MAX_OFF (1 << 13)                      ///< 最大回看距离
+#define LZF_MAX_REF ((1 << 8) + (1 << 3))          ///< 单条回引指令最多字节数
+
+_Static_assert((1 << LZF_HLOG) == MQTT_LZF_HTAB_NUM, "hash table size mismatch");
+
+/**
+ * @brief 内部辅助：3 字节哈希
+ */
+static inline uint32_t lzf_hash(const uint8_t *p)
+{
+    uint32_t v = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+    return (v * 2654435761u) >> (32 - LZF_HLOG);
+}
+
+/**
+ * @brief 内部辅助：LZF 压缩
+ *
+ * 每段字面量前预留一个控制字节，段结束时回填长度；段为空时撤回预留字节。
+ *
+ * @return 压缩流长度；0 表示放不下
+ */
+static int lzf_compress(const uint8_t *in, int in_len, uint8_t *out, int out_cap, uint16_t *htab)
+{
+    int ip  = 0;
+    int op  = 1;                                   ///< out[0] 预留给第一段字面量
+    int lit = 0;
+
+    memset(htab, 0, MQTT_LZF_HTAB_NUM * sizeof(uint16_t));
+
+    while (ip < in_len) {
+        if (ip + 2 < in_len) {
+            uint32_t h   = lzf_hash(in + ip);
+            int      ref = htab[h];
+            htab[h] = (uint16_t)ip;
+
+            if (ref < ip && ip - ref - 1 < LZF_MAX_OFF &&
+                in[ref] == in[ip] && in[ref + 1] == in[ip + 1] && in[ref + 2] == in[ip + 2]) {
+                int maxlen = in_len - ip;
+                if (maxlen > LZF_MAX_REF) {
+                    maxlen = LZF_MAX_REF;
+                }
+                int len = 3;
+                while (len < maxlen && in[ref + len] == in[ip + len]) {
+                    len++;
+                }
+
+                if (lit > 0) {
+                    out[op - lit - 1] = (uint8_t)(lit - 1); ///< 回填字面量段长度
+                } else {
+                    op--;                          ///< 撤回未使用的控制字节
+                }
+
+                int off = ip - ref - 1;
+                int l   = len - 2;
+                if (op + (l >= 7 ? 3 : 2) + 1 > out_cap) {
+                    return 0;
+                }
+                if (l < 7) {
+                    out[op++] = (uint8_t)((off >> 8) + (l << 5));
+                } else {
+                    out[op++] = (uint8_t)((off >> 8) + (7 << 5));
+                    out[op++] = (uint8_t)(l - 7);
+                }
+                out[op++] = (uint8_t)off;
+
+                lit = 0;
+                op++;                              ///< 为下一段字面量预留控制字节
+
+                for (int k = ip + 1; k < ip + len && k + 2 < in_len; ++k) {
+                    htab[lzf_hash(in + k)] = (uint16_t)k; ///< 匹配区间内的位置也登记，提高后续命中率
+                }
+                ip += len;
+                continue;
+            }
+        }
+
+        if (op >= out_cap) {
+            return 0;
+        }
+        out[op++] = in[ip++];
+        lit++;
+        if (lit == LZF_MAX_LIT) {                  ///< 字面量段已满，另起一段
+            out[op - lit - 1] = (uint8_t)(LZF_MAX_LIT - 1);
+            lit = 0;
+            op++;
+        }
+    }
+
+    if (lit > 0) {
+        out[op - lit - 1] = (uint8_t)(lit - 1);
+    } else {
+        op--;
+    }
+    return (op <= out_cap) ? op : 0;
+}
+
+/**
+ * @brief 内部辅助：LZF 解压
+ *
+ * @return 解压长度；-1 表示数据损坏或输出放不下
+ */
+static int lzf_decompress(const uint8_t *in, int in_len, uint8_t *out, int out_cap)
+{
+    int ip = 0;
+    int op = 0;
+
+    while (ip < in_len) {
+        int ctrl = in[ip++];
+
+        if (ctrl < LZF_MAX_LIT) {                  ///< 字面量
+            int run = ctrl + 1;
+            if (ip + run > in_len || op + run > out_cap) {
+                return -1;
+            }
+            memcpy(out + op, in + ip, (size_t)run);
+            ip += run;
+            op += run;
+            continue;
+        }
+
+        int len = ctrl >> 5;                       ///< 回引
+        if (len == 7) {
+            if (ip >= in_len) {
+                return -1;
+            }
+            len += in[ip++];
+        }
+        if (ip >= in_len) {
+            return -1;
+        }
+        int ref = op - ((ctrl & 0x1f) << 8) - in[ip++] - 1;
+        len += 2;
+        if (ref < 0 || op + len > out_cap) {
+            return -1;
+        }
+        while (len-- > 0) {                        ///< 可能与输出重叠，逐字节拷贝
+            out[op++] = out[ref++];
+        }
+    }
+
+    return op;
+}
+
+int mqtt_lzf_pack(const uint8_t *in, int in_len, uint8_t *out, int out_cap, uint16_t *htab)
+{
+    if (in == NULL || out == NULL || htab == NULL || in_len <= 0 || in_len > MQTT_LZF_MAX_LEN) {
+        return 0;
+    }
+
+    int cap = out_cap - MQTT_LZF_HEADER_LEN;
+    if (cap > in_len - MQTT_LZF_HEADER_LEN - 1) {
+        cap = in_len - MQTT_LZF_HEADER_LEN - 1;    ///< 整帧必须比原始数据短
+    }
+    if (cap <= 0) {
+        return 0;
+    }
+
+    int n = lzf_compress(in, in_len, out + MQTT_LZF_HEADER_LEN, cap, htab);
+    if (n <= 0) {
+        return 0;
+    }
+
+    out[0] = (uint8_t)(in_len >> 8);
+    out[1] = (uint8_t)in_len;
+    return n + MQTT_LZF_HEADER_LEN;
+}
+
+int mqtt_lzf_unpacked_len(const uint8_t *frame, int frame_len)
+{
+    if (frame == NULL || frame_len <= MQTT_LZF_HEADER_LEN) {
+        return -1;
+    }
+
+    int len = ((int)frame[0] << 8) | frame[1];
+    return (len > 0) ? len : -1;
+}
+
+int mqtt_lzf_unpack(const uint8_t *frame, int frame_len, uint8_t *out, int out_cap)
+{
+    int len = mqtt_lzf_unpacked_len(frame, frame_len);
+    if (len < 0 || out == NULL || len > out_cap) {
+        return -1;
+    }
+
+    int n = lzf_decompress(frame + MQTT_LZF_HEADER_LEN, frame_len - MQTT_LZF_HEADER_LEN, out, len);
+    return (n == len) ? n : -1;
+}
@@ -9,230 +9,2326 @@
  * 仅负责：
  *  - 根据配置创建 MQTT 客户端；
  *  - 启动/停止客户端；
- *  - 将底层事件转换为简单的 mqtt_module_event_t 上报给上层。
+ *  - 将底层事件转换为简单的 mqtt_module_event_t 上报给上层；
+ *  - 维护有界出站队列，调用方发布时只做一次定长拷贝即返回；
+ *  - 离线期间把 QoS>=1 的上行消息转存到 Flash，重连后按限速回放；
+ *  - 把被客户端拆开的 MQTT_EVENT_DATA 分片重组为整条消息再交给上层。
+ *  - MQTT 5.0 下保存/设置 Response Topic 与 Correlation Data，供请求/响应（RPC）使用。
+ *  - 跟踪 QoS>=1 消息的确认延迟，并以在途窗口限制交给客户端的未确认消息数。
+ *  - 收发与确认写入轨迹环形缓冲区（mqtt_trace_module），逐条日志仅在 DEBUG 级别输出。
  * 
  * 不直接处理业务 Topic，由上层管理器决定订阅/发布策略。
  * 
  * Copyright (c) 2025 by ${git_name_email}, All Rights Reserved. 
  */
 
+#include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mqtt_client.h"
 
 #include "mqtt_module.h"
+#include "mqtt_lzf_module.h"
+#include "mqtt_trace_module.h"
 
 /* 日志 TAG */
 static const char *TAG = "mqtt_module";           ///< 本模块日志 TAG
 
-/* MQTT 模块配置与状态 */
-static mqtt_module_config_t   s_mqtt_cfg;          ///< 保存一份配置副本
-static bool                   s_mqtt_inited = false; ///< 是否已初始化
-static esp_mqtt_client_handle_t s_mqtt_client = NULL; ///< MQTT 客户端句柄
+/* -------------------------------------------------------------------------- */
+/*                                  实例状态                                   */
+/* -------------------------------------------------------------------------- */
+
+typedef struct mqtt_module_s mqtt_module_t;
+
+/**
+ * @brief 压缩工作区：输出缓冲区 + 哈希表，同一时刻只能被一个任务使用
+ */
+typedef struct {
+    uint8_t  *buf;  ///< 压缩帧输出缓冲区
+    int       cap;  ///< 输出缓冲区容量
+    uint16_t *htab; ///< MQTT_LZF_HTAB_NUM 项哈希表
+} mqtt_zip_t;
+
+/**
+ * @brief 压缩统计（drain 任务、同步发布者与 esp-mqtt 任务并发更新）
+ */
+typedef struct {
+    portMUX_TYPE            lock;  ///< 保护统计
+    mqtt_module_zip_stats_t stats; ///< 统计信息
+} mqtt_zip_state_t;
+
+#define MQTT_ACK_TABLE_BITS 6                      ///< 跟踪表 64 项（开放定址，线性探测）
+#define MQTT_ACK_TABLE_NUM  (1 << MQTT_ACK_TABLE_BITS)
+#define MQTT_ACK_LOAD_MAX   (MQTT_ACK_TABLE_NUM * 3 / 4) ///< 装载上限，保证探测链足够短
+#define MQTT_ACK_EXPIRE_MS  60000                  ///< 超过该时长未确认视为丢失
+#define MQTT_ACK_EARLY_NUM  4                      ///< 先于登记到达的确认暂存个数
+#define MQTT_ACK_EARLY_MS   1000                   ///< 暂存确认的有效期，防止与复用的 msg_id 误配
+#define MQTT_WINDOW_POLL_MS 1000                   ///< 等待窗口期间检查超时表项 / 离线状态的周期
+
+_Static_assert(MQTT_MODULE_INFLIGHT_MAX <= MQTT_ACK_LOAD_MAX, "inflight window exceeds ack table");
+
+/**
+ * @brief 跟踪表项，msg_id 为 0 表示空
+ */
+typedef struct {
+    uint16_t msg_id;  ///< esp-mqtt 分配的报文 ID（1~65535）
+    uint8_t  qos;     ///< QoS 等级（1/2）
+    uint8_t  cls;     ///< Topic 类别下标
+    uint32_t sent_ms; ///< 交给客户端的时刻（ms）
+} mqtt_ack_entry_t;
+
+/**
+ * @brief 发布确认跟踪状态
+ *
+ * 发布者（drain 任务 / 同步发布者）登记，esp-mqtt 任务在 MQTT_EVENT_PUBLISHED 中移除，
+ * 均为短操作，统一用自旋锁保护。客户端在发布函数返回前就可能收到确认，
+ * 此时确认先暂存在 early 环中，登记时再配对。
+ *
+ * 启用在途窗口时，window_sem 的计数即窗口空位：发送 QoS>=1 消息前取一个，
+ * 表项被移除（确认 / 超时 / 客户端删除）时归还。信号量不能在自旋锁内操作，
+ * 移除时只累计 freed，出锁后由 mqtt_window_settle() 统一归还并触发水位回调。
+ */
+typedef struct {
+    portMUX_TYPE            lock;                      ///< 保护以下全部字段
+    mqtt_ack_entry_t        table[MQTT_ACK_TABLE_NUM]; ///< 跟踪表
+    uint16_t                early_id[MQTT_ACK_EARLY_NUM]; ///< 暂存确认的 msg_id
+    uint32_t                early_ms[MQTT_ACK_EARLY_NUM]; ///< 暂存确认的到达时刻
+    uint8_t                 early_next;                ///< early 环下一个写入位置
+    SemaphoreHandle_t       window_sem;                ///< 在途窗口空位计数，NULL 表示不限制
+    uint16_t                freed;                     ///< 已移除、尚未归还窗口的表项数
+    bool                    full;                      ///< 窗口是否处于高水位
+    int8_t                  edge;                      ///< 待通知的水位变化：1 已满，-1 已回落
+    mqtt_module_ack_stats_t stats;                     ///< 统计信息
+} mqtt_ack_state_t;
+
+/**
+ * @brief 出站队列槽位
+ *
+ * 所有槽位在初始化时一次性分配，运行期间只在空闲栈与就绪环之间移动下标。
+ */
+typedef struct {
+    char                 *topic;   ///< Topic 缓冲区（outbox_topic_max 字节）
+    uint8_t              *payload; ///< 负载缓冲区（outbox_payload_max 字节）
+    int                   len;     ///< 负载长度
+    int                   qos;     ///< QoS 等级
+    bool                  retain;  ///< 是否保留
+    bool                  queued;  ///< 已入队、尚未离开队列（在就绪环中或正由 drain 任务发送）
+    mqtt_module_ticket_t  ticket;  ///< 入队票据，queued 为 true 时有效
+} mqtt_outbox_slot_t;
+
+/**
+ * @brief 已离开队列的票据去向（按票据取模存放，只保留最近的 2 * capacity 条）
+ */
+typedef struct {
+    mqtt_module_ticket_t        ticket; ///< 票据
+    mqtt_module_ticket_state_t  state;  ///< 去向
+} mqtt_outbox_result_t;
+
+/**
+ * @brief 出站队列
+ *
+ * - free_stack：空闲槽位下标栈；ready：按入队顺序排列的就绪槽位环；
+ * - 仍在队列中的票据由槽位的 queued 标记判断，离开队列的票据去向记入 results；
+ * - 下标操作在自旋锁内完成，拷贝在锁外完成，调用方耗时恒定；
+ * - free_sem 计数空闲槽位，供 BLOCK 策略等待；
+ * - users 计数进行中的发布调用与未结束的租约，销毁实例时等其归零后才释放资源。
+ */
+typedef struct {
+    mqtt_outbox_slot_t        *slots;       ///< 槽位数组
+    mqtt_outbox_result_t      *results;     ///< 最近离开队列的票据去向（2 * capacity 条）
+    uint16_t                  *free_stack;  ///< 空闲槽位下标栈
+    uint16_t                   free_top;    ///< 空闲栈元素个数
+    uint16_t                  *ready;       ///< 就绪槽位环
+    uint16_t                   ready_head;  ///< 就绪环头（最旧）
+    uint16_t                   ready_count; ///< 就绪环元素个数
+    uint16_t                   capacity;    ///< 槽位总数
+    portMUX_TYPE               lock;        ///< 保护下标与统计的自旋锁
+    SemaphoreHandle_t          free_sem;    ///< 空闲槽位计数信号量
+    TaskHandle_t               drain_task;  ///< drain 任务句柄，任务退出后清空
+    uint16_t                   users;       ///< 进行中的发布调用与未结束的租约数（受 lock 保护）
+    volatile bool              closing;     ///< 实例销毁中，拒绝新的发布与租约
+    volatile bool              quit;        ///< 已无使用者，drain 任务应尽快退出
+    mqtt_module_ticket_t       next_ticket; ///< 下一个待分配票据
+    mqtt_zip_t                 zip;         ///< drain 任务专用压缩工作区，未启用压缩时为空
+    mqtt_module_outbox_stats_t stats;       ///< 统计信息
+} mqtt_outbox_t;
+
+#define MQTT_RX_CLASS_NUM     2                     ///< 重组缓冲区规格数（小 / 大）
+#define MQTT_RX_CLASS_MAX_BUF 32                    ///< 每种规格最多缓冲区个数（位图宽度）
+#define MQTT_RX_TOPIC_MAX     128                   ///< 重组期间保存 Topic 的最大长度
+#define MQTT_RX_CORR_MAX      32                    ///< 保存 Correlation Data 的最大长度
+
+/**
+ * @brief 一种规格的重组缓冲区（slab）
+ */
+typedef struct {
+    uint8_t  *mem;      ///< 连续内存，num 个 size 字节的缓冲区
+    int       size;     ///< 单个缓冲区大小
+    int       num;      ///< 缓冲区个数
+    uint32_t  free_map; ///< 空闲位图，bit=1 表示空闲
+} mqtt_rx_slab_t;
+
+/**
+ * @brief 接收重组状态
+ *
+ * esp-mqtt 在自身任务中按顺序投递同一条消息的各个分片，
+ * 因此同一时刻只存在一条正在重组的消息。
+ */
+typedef struct {
+    mqtt_rx_slab_t          slabs[MQTT_RX_CLASS_NUM]; ///< 各规格缓冲区
+    portMUX_TYPE            lock;       ///< 保护 slab 位图与统计
+    char                    topic[MQTT_RX_TOPIC_MAX]; ///< 当前消息 Topic 副本
+    int                     topic_len;  ///< Topic 长度
+    uint8_t                *buf;        ///< 当前重组缓冲区，NULL 表示非重组模式
+    int                     total_len;  ///< 当前消息总长度
+    int                     received;   ///< 已收到字节数
+    bool                    streaming;  ///< 当前消息是否按分片流交付
+    bool                    discarding; ///< 当前消息是否整体丢弃
+    char                    resp_topic[MQTT_RX_TOPIC_MAX]; ///< 当前消息 Response Topic 副本
+    uint8_t                 corr[MQTT_RX_CORR_MAX];        ///< 当前消息 Correlation Data 副本
+    mqtt_module_msg_props_t props;      ///< 当前消息的请求/响应属性（指向上面两个副本）
+    mqtt_module_rx_stats_t  stats;      ///< 统计信息
+} mqtt_rx_t;
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+
+#define MQTT_ALIAS_TOPIC_MAX 128 ///< 可分配别名的 Topic 最大长度（含 '\0'）
+#define MQTT_ALIAS_GHOST_NUM 32  ///< 准入过滤器大小：只为近期重复出现过的 Topic 分配别名
+
+/**
+ * @brief 别名表项，别名值为下标 + 1
+ */
+typedef struct {
+    char     topic[MQTT_ALIAS_TOPIC_MAX]; ///< 映射的 Topic，空串表示空闲
+    uint32_t hash;                        ///< Topic 哈希，加速查找
+    uint32_t last_use;                    ///< LRU 时间戳（单调计数），0 表示从未使用
+    uint32_t gen;                         ///< 已在哪一代连接上建立映射，与实例 conn_gen 不等表示尚未建立
+} mqtt_alias_entry_t;
+
+/**
+ * @brief 别名表，所有字段只在持有 prop_mutex 时访问
+ */
+typedef struct {
+    mqtt_alias_entry_t       *entries;   ///< 表项数组（topic_alias_max 个）
+    int                       num;       ///< 表项总数
+    int                       limit;     ///< 本代连接可用的表项数，确认超出服务器 Topic Alias Maximum 时收缩
+    uint32_t                  limit_gen; ///< limit 对应的连接代数
+    uint32_t                  clock;     ///< LRU 时钟
+    uint32_t                  ghost[MQTT_ALIAS_GHOST_NUM]; ///< 最近出现过的 Topic 哈希（直接映射）
+    mqtt_module_alias_stats_t stats;     ///< 统计信息
+} mqtt_alias_t;
+
+#endif /* CONFIG_MQTT_PROTOCOL_5 */
+
+/**
+ * @brief MQTT 模块实例（一条服务器会话）
+ *
+ * 每个实例拥有独立的 esp-mqtt 客户端、出站队列与 drain 任务、接收重组缓冲区、
+ * 别名表与确认跟踪表；客户端事件在各自的 esp-mqtt 任务中分发，互不阻塞。
+ * 旧接口（不带句柄的 mqtt_module_xxx）作用于 mqtt_module_init() 创建的默认实例。
+ */
+struct mqtt_module_s {
+    mqtt_module_config_t     cfg;             ///< 保存一份配置副本
+    esp_mqtt_client_handle_t client;          ///< MQTT 客户端句柄
+    volatile bool            connected;       ///< 当前是否已连接服务器
+    bool                     v5;              ///< 是否使用 MQTT 5.0
+    bool                     spool;           ///< 是否持有离线缓存（Flash 分区只能归一个实例）
+    volatile bool            session_present; ///< 最近一次 CONNACK 的 session present 标志
+    SemaphoreHandle_t        prop_mutex;      ///< 串行化“设置发布属性 + 发布”（MQTT 5.0）与同步压缩工作区的使用
+    volatile uint32_t        conn_gen;        ///< 连接代数，每次 CONNECTED 加一（别名映射只在本代连接内有效）
+    uint32_t                 uplink_ms;       ///< 最近一次确认送达服务器的上行时刻（ms），0 表示尚无
+    mqtt_zip_state_t         zip;             ///< 压缩统计
+    mqtt_zip_t               zip_ws;          ///< 同步发布共用的压缩工作区，持有 prop_mutex 时使用
+    mqtt_ack_state_t         ack;             ///< 确认跟踪与在途窗口
+    mqtt_outbox_t            outbox;          ///< 出站队列
+    mqtt_rx_t                rx;              ///< 接收重组
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    mqtt_alias_t             alias;           ///< 上行 Topic 别名表
+#endif
+};
+
+static mqtt_module_t *s_default     = NULL;  ///< 旧接口使用的默认实例
+static mqtt_module_t *s_spool_owner = NULL;  ///< 持有离线缓存的实例
+
+/* -------------------------------------------------------------------------- */
+/*                                  负载压缩                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 内部辅助：按需分配一块压缩工作区（输出容量 cap 字节）
+ */
+static esp_err_t mqtt_zip_alloc(mqtt_zip_t *zip, int cap)
+{
+    uint8_t *mem = (uint8_t *)malloc(MQTT_LZF_HTAB_NUM * sizeof(uint16_t) + (size_t)cap);
+    if (mem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    zip->htab = (uint16_t *)mem;
+    zip->buf  = mem + MQTT_LZF_HTAB_NUM * sizeof(uint16_t);
+    zip->cap  = cap;
+    return ESP_OK;
+}
+
+static void mqtt_zip_free(mqtt_zip_t *zip)
+{
+    free(zip->htab);                               ///< htab 即整块内存起始地址
+    zip->htab = NULL;
+    zip->buf  = NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                发布确认跟踪                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 内部辅助：当前时刻（ms，回绕后按差值使用）
+ */
+static uint32_t mqtt_ack_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/**
+ * @brief 内部辅助：记录一次已送达服务器的上行（QoS 0 在连接中发出，或收到 PUBACK / PUBCOMP）
+ */
+static void mqtt_uplink_touch(mqtt_module_t *m)
+{
+    uint32_t now = mqtt_ack_now_ms();
+    __atomic_store_n(&m->uplink_ms, now != 0 ? now : 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief 内部辅助：延迟值对应的直方图桶
+ */
+static int mqtt_lat_bucket(uint32_t ms)
+{
+    if (ms < 4) {
+        return (int)ms;
+    }
+    int e   = 31 - __builtin_clz(ms);              ///< 最高位位置（>= 2）
+    int idx = (e - 1) * 4 + (int)((ms >> (e - 2)) & 3);
+    return (idx < MQTT_MODULE_LAT_BUCKET_NUM) ? idx : MQTT_MODULE_LAT_BUCKET_NUM - 1;
+}
+
+void mqtt_module_lat_record(mqtt_module_lat_hist_t *h, uint32_t ms)
+{
+    h->count++;
+    h->sum_ms += ms;
+    if (ms > h->max_ms) {
+        h->max_ms = ms;
+    }
+    h->bucket[mqtt_lat_bucket(ms)]++;
+}
+
+static inline uint32_t mqtt_ack_slot(uint16_t msg_id)
+{
+    return ((uint32_t)msg_id * 2654435761u) >> (32 - MQTT_ACK_TABLE_BITS);
+}
+
+/**
+ * @brief 内部辅助：删除表项并把后续探测链前移（无墓碑）
+ */
+static void mqtt_ack_remove_locked(mqtt_module_t *m, uint32_t i)
+{
+    m->ack.table[i].msg_id = 0;
+    m->ack.stats.unacked--;
+    if (m->ack.window_sem != NULL) {
+        m->ack.freed++;
+        if (m->ack.full && m->ack.stats.unacked <= m->ack.stats.window / 2) {
+            m->ack.full = false;
+            m->ack.edge = -1;
+        }
+    }
+
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & (MQTT_ACK_TABLE_NUM - 1);
+         m->ack.table[j].msg_id != 0;
+         j = (j + 1) & (MQTT_ACK_TABLE_NUM - 1)) {
+        uint32_t home = mqtt_ack_slot(m->ack.table[j].msg_id);
+        /* home 不在 (hole, j] 区间内时，该项可以前移填补空洞 */
+        if (((j - home) & (MQTT_ACK_TABLE_NUM - 1)) >= ((j - hole) & (MQTT_ACK_TABLE_NUM - 1))) {
+            m->ack.table[hole]     = m->ack.table[j];
+            m->ack.table[j].msg_id = 0;
+            hole                  = j;
+        }
+    }
+}
+
+static int mqtt_ack_find_locked(mqtt_module_t *m, uint16_t msg_id)
+{
+    for (uint32_t i = mqtt_ack_slot(msg_id), n = 0; n < MQTT_ACK_TABLE_NUM;
+         i = (i + 1) & (MQTT_ACK_TABLE_NUM - 1), ++n) {
+        if (m->ack.table[i].msg_id == msg_id) {
+            return (int)i;
+        }
+        if (m->ack.table[i].msg_id == 0) {
+            break;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief 内部辅助：记录一次确认并移除表项
+ */
+static void mqtt_ack_complete_locked(mqtt_module_t *m, uint32_t i, uint32_t now_ms)
+{
+    mqtt_ack_entry_t *e  = &m->ack.table[i];
+    uint32_t          ms = now_ms - e->sent_ms;
+
+    mqtt_module_lat_record(&m->ack.stats.qos[e->qos >= 2 ? 1 : 0], ms);
+    mqtt_module_lat_record(&m->ack.stats.cls[e->cls], ms);
+    m->ack.stats.acked++;
+    mqtt_ack_remove_locked(m, i);
+}
+
+/**
+ * @brief 内部辅助：清除超时未确认的表项（表接近装满时调用）
+ */
+static void mqtt_ack_expire_locked(mqtt_module_t *m, uint32_t now_ms)
+{
+    for (uint32_t i = 0; i < MQTT_ACK_TABLE_NUM; ++i) {
+        while (m->ack.table[i].msg_id != 0 &&
+               now_ms - m->ack.table[i].sent_ms >= MQTT_ACK_EXPIRE_MS) {
+            m->ack.stats.expired++;
+            mqtt_ack_remove_locked(m, i);             ///< 后续项可能前移到 i，继续检查
+        }
+    }
+}
+
+/**
+ * @brief 内部辅助：取 Topic 第 ack_class_level 级作为类别，新类别在有空位时登记
+ */
+static uint8_t mqtt_ack_class(mqtt_module_t *m, const char *topic)
+{
+    const char *seg = topic;
+    for (int level = 0; level < m->cfg.ack_class_level && seg != NULL; ++level) {
+        seg = strchr(seg, '/');
+        if (seg != NULL) {
+            seg++;
+        }
+    }
+    if (seg == NULL) {
+        return 0;
+    }
+
+    const char *end = strchr(seg, '/');
+    size_t      len = (end != NULL) ? (size_t)(end - seg) : strlen(seg);
+    if (len == 0 || len >= MQTT_MODULE_ACK_CLASS_NAME_MAX) {
+        return 0;
+    }
+
+    uint8_t cls = 0;
+    portENTER_CRITICAL(&m->ack.lock);
+    for (uint8_t i = 1; i < m->ack.stats.class_num; ++i) {
+        if (strncmp(m->ack.stats.class_name[i], seg, len) == 0 && m->ack.stats.class_name[i][len] == '\0') {
+            cls = i;
+            break;
+        }
+    }
+    if (cls == 0 && m->ack.stats.class_num < MQTT_MODULE_ACK_CLASS_NUM) {
+        cls = m->ack.stats.class_num++;
+        memcpy(m->ack.stats.class_name[cls], seg, len);
+        m->ack.stats.class_name[cls][len] = '\0';
+    }
+    portEXIT_CRITICAL(&m->ack.lock);
+    return cls;
+}
+
+/**
+ * @brief 内部辅助：归还已移除表项占用的窗口空位，并通知水位变化（不可在锁内调用）
+ */
+static void mqtt_window_settle(mqtt_module_t *m)
+{
+    if (m->ack.window_sem == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&m->ack.lock);
+    uint16_t freed    = m->ack.freed;
+    int8_t   edge     = m->ack.edge;
+    int      inflight = m->ack.stats.unacked;
+    m->ack.freed = 0;
+    m->ack.edge  = 0;
+    portEXIT_CRITICAL(&m->ack.lock);
+
+    while (freed-- > 0) {
+        (void)xSemaphoreGive(m->ack.window_sem);
+    }
+    if (edge != 0 && m->cfg.inflight_cb_ex != NULL) {
+        m->cfg.inflight_cb_ex(inflight, edge > 0, m->cfg.user_ctx);
+    } else if (edge != 0 && m->cfg.inflight_cb != NULL) {
+        m->cfg.inflight_cb(inflight, edge > 0);
+    }
+}
+
+/**
+ * @brief 内部辅助：清除超时未确认的表项，腾出其占用的窗口
+ */
+static void mqtt_ack_expire_stale(mqtt_module_t *m)
+{
+    uint32_t now = mqtt_ack_now_ms();
+
+    portENTER_CRITICAL(&m->ack.lock);
+    mqtt_ack_expire_locked(m, now);
+    portEXIT_CRITICAL(&m->ack.lock);
+
+    mqtt_window_settle(m);
+}
+
+/**
+ * @brief 内部辅助：为一条 QoS>=1 消息取一个窗口空位
+ *
+ * 等待期间每 MQTT_WINDOW_POLL_MS 清理一次超时表项，避免丢失的确认永久占住窗口。
+ *
+ * @return true 已取得（或未启用窗口）；false 在 wait 内仍无空位
+ */
+static bool mqtt_window_acquire(mqtt_module_t *m, TickType_t wait)
+{
+    if (m->ack.window_sem == NULL) {
+        return true;
+    }
+    if (xSemaphoreTake(m->ack.window_sem, 0) == pdTRUE) {
+        return true;
+    }
+
+    portENTER_CRITICAL(&m->ack.lock);
+    m->ack.stats.window_wait++;
+    portEXIT_CRITICAL(&m->ack.lock);
+
+    TickType_t start = xTaskGetTickCount();
+    for (;;) {
+        if (m->outbox.closing) {
+            return false;                           ///< 实例销毁中，不再等待
+        }
+        mqtt_ack_expire_stale(m);
+
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= wait) {
+            return xSemaphoreTake(m->ack.window_sem, 0) == pdTRUE;
+        }
+        TickType_t slice = wait - elapsed;
+        if (slice > pdMS_TO_TICKS(MQTT_WINDOW_POLL_MS)) {
+            slice = pdMS_TO_TICKS(MQTT_WINDOW_POLL_MS);
+        }
+        if (xSemaphoreTake(m->ack.window_sem, slice) == pdTRUE) {
+            return true;
+        }
+    }
+}
+
+/**
+ * @brief 内部辅助：归还一个未被使用的窗口空位（发送失败时）
+ */
+static void mqtt_window_release(mqtt_module_t *m)
+{
+    if (m->ack.window_sem != NULL) {
+        (void)xSemaphoreGive(m->ack.window_sem);
+    }
+}
+
+/**
+ * @brief 内部辅助：登记一条已交给客户端、等待确认的消息
+ *
+ * 启用窗口时调用方已为该消息取得一个窗口空位，由表项持有直到被移除。
+ */
+static void mqtt_ack_track(mqtt_module_t *m, int msg_id, int qos, const char *topic, uint32_t sent_ms)
+{
+    if (msg_id <= 0 || msg_id > UINT16_MAX || qos <= 0) {
+        return;
+    }
+
+    uint8_t  cls = mqtt_ack_class(m, topic);
+    uint32_t now = mqtt_ack_now_ms();
+
+    portENTER_CRITICAL(&m->ack.lock);
+    m->ack.stats.tracked++;
+
+    int old = mqtt_ack_find_locked(m, (uint16_t)msg_id);
+    if (old >= 0) {                                ///< msg_id 已回绕复用，旧消息视为丢失
+        m->ack.stats.expired++;
+        mqtt_ack_remove_locked(m, (uint32_t)old);
+    }
+    if (m->ack.stats.unacked >= MQTT_ACK_LOAD_MAX) {
+        mqtt_ack_expire_locked(m, now);
+    }
+
+    if (m->ack.stats.unacked >= MQTT_ACK_LOAD_MAX) {
+        m->ack.stats.untracked++;
+        if (m->ack.window_sem != NULL) {
+            m->ack.freed++;                        ///< 不登记则不占用窗口
+        }
+    } else {
+        uint32_t i = mqtt_ack_slot((uint16_t)msg_id);
+        while (m->ack.table[i].msg_id != 0) {
+            i = (i + 1) & (MQTT_ACK_TABLE_NUM - 1);
+        }
+        m->ack.table[i] = (mqtt_ack_entry_t){
+            .msg_id  = (uint16_t)msg_id,
+            .qos     = (uint8_t)qos,
+            .cls     = cls,
+            .sent_ms = sent_ms,
+        };
+        if (++m->ack.stats.unacked > m->ack.stats.unacked_max) {
+            m->ack.stats.unacked_max = m->ack.stats.unacked;
+        }
+        if (m->ack.window_sem != NULL && !m->ack.full && m->ack.stats.unacked >= m->ack.stats.window) {
+            m->ack.full = true;
+            m->ack.edge = 1;
+            m->ack.stats.window_full++;
+        }
+
+        for (int k = 0; k < MQTT_ACK_EARLY_NUM; ++k) {
+            uint32_t age = now - m->ack.early_ms[k];
+            if (m->ack.early_id[k] == msg_id && age < MQTT_ACK_EARLY_MS &&
+                age <= now - sent_ms) {            ///< 确认必须晚于发送，早于发送的是上一条同 ID 消息的
+                m->ack.early_id[k] = 0;            ///< 确认已先到达，立即配对
+                mqtt_ack_complete_locked(m, i, m->ack.early_ms[k]);
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&m->ack.lock);
+
+    mqtt_window_settle(m);
+}
+
+/**
+ * @brief 内部辅助：处理 MQTT_EVENT_PUBLISHED（esp-mqtt 任务中调用）
+ */
+static void mqtt_ack_on_published(mqtt_module_t *m, int msg_id)
+{
+    if (msg_id <= 0 || msg_id > UINT16_MAX) {
+        return;
+    }
+
+    uint32_t now = mqtt_ack_now_ms();
+
+    portENTER_CRITICAL(&m->ack.lock);
+    int i = mqtt_ack_find_locked(m, (uint16_t)msg_id);
+    if (i >= 0) {
+        mqtt_ack_complete_locked(m, (uint32_t)i, now);
+    } else {
+        m->ack.early_id[m->ack.early_next] = (uint16_t)msg_id;
+        m->ack.early_ms[m->ack.early_next] = now;
+        m->ack.early_next = (uint8_t)((m->ack.early_next + 1) % MQTT_ACK_EARLY_NUM);
+    }
+    portEXIT_CRITICAL(&m->ack.lock);
+
+    mqtt_window_settle(m);
+}
+
+/**
+ * @brief 内部辅助：处理 MQTT_EVENT_DELETED（客户端因超时删除了未确认的消息）
+ */
+static void mqtt_ack_on_deleted(mqtt_module_t *m, int msg_id)
+{
+    if (msg_id <= 0 || msg_id > UINT16_MAX) {
+        return;
+    }
+
+    portENTER_CRITICAL(&m->ack.lock);
+    int i = mqtt_ack_find_locked(m, (uint16_t)msg_id);
+    if (i >= 0) {
+        m->ack.stats.expired++;
+        mqtt_ack_remove_locked(m, (uint32_t)i);
+    }
+    portEXIT_CRITICAL(&m->ack.lock);
+
+    mqtt_window_settle(m);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  接收重组                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 内部辅助：按配置预分配各规格重组缓冲区
+ */
+static esp_err_t mqtt_rx_init(mqtt_module_t *m)
+{
+    const int sizes[MQTT_RX_CLASS_NUM] = { m->cfg.rx_small_buf_size, m->cfg.rx_large_buf_size };
+    const int nums[MQTT_RX_CLASS_NUM]  = { m->cfg.rx_small_buf_num,  m->cfg.rx_large_buf_num  };
+
+    for (int c = 0; c < MQTT_RX_CLASS_NUM; ++c) {
+        mqtt_rx_slab_t *slab = &m->rx.slabs[c];
+        if (sizes[c] <= 0 || nums[c] <= 0) {
+            continue;                               ///< 该规格未启用
+        }
+        if (nums[c] > MQTT_RX_CLASS_MAX_BUF) {
+            return ESP_ERR_INVALID_ARG;
+        }
+
+        slab->mem = (uint8_t *)malloc((size_t)sizes[c] * (size_t)nums[c]);
+        if (slab->mem == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        slab->size     = sizes[c];
+        slab->num      = nums[c];
+        slab->free_map = (nums[c] == 32) ? 0xFFFFFFFFu : ((1u << nums[c]) - 1u);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief 内部辅助：取一个能容纳 len 字节的最小规格空闲缓冲区
+ */
+static uint8_t *mqtt_rx_buf_alloc(mqtt_module_t *m, int len)
+{
+    uint8_t *buf = NULL;
+
+    portENTER_CRITICAL(&m->rx.lock);
+    for (int c = 0; c < MQTT_RX_CLASS_NUM && buf == NULL; ++c) {
+        mqtt_rx_slab_t *slab = &m->rx.slabs[c];
+        if (slab->mem == NULL || slab->size < len || slab->free_map == 0) {
+            continue;
+        }
+        int bit = __builtin_ctz(slab->free_map);
+        slab->free_map &= ~(1u << bit);
+        buf = slab->mem + (size_t)bit * (size_t)slab->size;
+    }
+    portEXIT_CRITICAL(&m->rx.lock);
+
+    return buf;
+}
+
+/**
+ * @brief 内部辅助：归还重组缓冲区
+ */
+static void mqtt_rx_buf_free(mqtt_module_t *m, uint8_t *buf)
+{
+    portENTER_CRITICAL(&m->rx.lock);
+    for (int c = 0; c < MQTT_RX_CLASS_NUM; ++c) {
+        mqtt_rx_slab_t *slab = &m->rx.slabs[c];
+        if (slab->mem == NULL || buf < slab->mem ||
+            buf >= slab->mem + (size_t)slab->size * (size_t)slab->num) {
+            continue;
+        }
+        int bit = (int)((buf - slab->mem) / slab->size);
+        slab->free_map |= (1u << bit);
+        break;
+    }
+    portEXIT_CRITICAL(&m->rx.lock);
+}
+
+/**
+ * @brief 内部辅助：在锁内累加一项接收统计（读取方可能在其他任务中）
+ */
+static void mqtt_rx_count(mqtt_module_t *m, uint32_t *counter)
+{
+    portENTER_CRITICAL(&m->rx.lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&m->rx.lock);
+}
+
+/**
+ * @brief 内部辅助：保存消息携带的 MQTT 5.0 请求/响应属性
+ *
+ * 属性只随第一片到达，拷贝一份以便重组完成后仍可读取；超长属性视为不存在。
+ */
+static void mqtt_rx_capture_props(mqtt_module_t *m, esp_mqtt_event_handle_t event)
+{
+    memset(&m->rx.props, 0, sizeof(m->rx.props));
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    const esp_mqtt5_event_property_t *p = event->property;
+    if (!m->v5 || p == NULL) {
+        return;
+    }
+
+    if (p->response_topic != NULL && p->response_topic_len > 0 &&
+        p->response_topic_len < MQTT_RX_TOPIC_MAX) {
+        memcpy(m->rx.resp_topic, p->response_topic, (size_t)p->response_topic_len);
+        m->rx.resp_topic[p->response_topic_len] = '\0';
+        m->rx.props.response_topic     = m->rx.resp_topic;
+        m->rx.props.response_topic_len = p->response_topic_len;
+    }
+
+    if (p->correlation_data != NULL && p->correlation_data_len > 0 &&
+        p->correlation_data_len <= MQTT_RX_CORR_MAX) {
+        memcpy(m->rx.corr, p->correlation_data, (size_t)p->correlation_data_len);
+        m->rx.props.correlation_data     = m->rx.corr;
+        m->rx.props.correlation_data_len = p->correlation_data_len;
+    }
+#else
+    (void)event;
+#endif
+}
+
+/**
+ * @brief 内部辅助：把一条完整消息交给上层，Topic 以 "/z" 结尾时先解压
+ *
+ * 解压结果放进一个重组缓冲区并登记为 m->rx.buf，上层同样可以接管；
+ * 原压缩负载若在重组缓冲区中则先行归还。调用方在回调返回后回收 m->rx.buf。
+ */
+static void mqtt_rx_deliver(mqtt_module_t *m, const char *topic, int topic_len,
+                            const uint8_t *data, int len)
+{
+    const int sfx = (int)strlen(MQTT_LZF_TOPIC_SUFFIX);
+    if (topic_len > sfx && memcmp(topic + topic_len - sfx, MQTT_LZF_TOPIC_SUFFIX, (size_t)sfx) == 0) {
+        int      plain_len = mqtt_lzf_unpacked_len(data, len);
+        uint8_t *plain     = NULL;
+        if (plain_len > 0 && plain_len <= m->cfg.rx_max_msg_len) {
+            plain = mqtt_rx_buf_alloc(m, plain_len);
+        }
+        if (plain != NULL && mqtt_lzf_unpack(data, len, plain, plain_len) != plain_len) {
+            mqtt_rx_buf_free(m, plain);
+            plain = NULL;
+        }
+        if (m->rx.buf != NULL) {                    ///< 压缩负载已不再需要
+            mqtt_rx_buf_free(m, m->rx.buf);
+            m->rx.buf = NULL;
+        }
+
+        portENTER_CRITICAL(&m->zip.lock);
+        if (plain != NULL) {
+            m->zip.stats.inflated++;
+        } else {
+            m->zip.stats.inflate_failed++;
+        }
+        portEXIT_CRITICAL(&m->zip.lock);
+
+        if (plain == NULL) {
+            ESP_LOGW(TAG, "drop compressed message, topic=%.*s, len=%d", topic_len, topic, len);
+            return;
+        }
+
+        m->rx.buf       = plain;                    ///< 与重组消息一样允许上层接管
+        m->rx.total_len = plain_len;
+        m->rx.received  = plain_len;
+        topic_len     -= sfx;
+        data           = plain;
+        len            = plain_len;
+    }
+
+    if (m->cfg.message_cb_ex) {
+        m->cfg.message_cb_ex(topic, topic_len, data, len, m->cfg.user_ctx);
+    } else if (m->cfg.message_cb) {
+        m->cfg.message_cb(topic, topic_len, data, len);
+    }
+}
+
+/**
+ * @brief 内部辅助：处理一个 MQTT_EVENT_DATA
+ *
+ * - 单事件即完整的消息直接透传，不做拷贝；
+ * - 分片消息拷贝进预分配缓冲区，收齐后一次性交付；
+ * - 超过 rx_max_msg_len 或缓冲区耗尽时改为分片流（fragment_cb）或丢弃。
+ */
+static void mqtt_rx_on_data(mqtt_module_t *m, esp_mqtt_event_handle_t event)
+{
+    int offset = event->current_data_offset;
+    int total  = event->total_data_len;
+    int len    = event->data_len;
+
+    if (offset == 0 && len >= total) {              ///< 未分片
+        mqtt_rx_count(m, &m->rx.stats.whole);
+        mqtt_rx_capture_props(m, event);
+        mqtt_rx_deliver(m, event->topic, (int)event->topic_len, (const uint8_t *)event->data, len);
+        memset(&m->rx.props, 0, sizeof(m->rx.props));
+        if (m->rx.buf != NULL) {                    ///< 解压缓冲区未被接管
+            mqtt_rx_buf_free(m, m->rx.buf);
+            m->rx.buf = NULL;
+        }
+        return;
+    }
+
+    if (offset == 0) {                              ///< 分片消息的第一片，携带 Topic
+        if (m->rx.buf != NULL) {                    ///< 上一条未收齐（理论上不会发生）
+            mqtt_rx_buf_free(m, m->rx.buf);
+            m->rx.buf = NULL;
+        }
+
+        m->rx.total_len  = total;
+        m->rx.received   = 0;
+        m->rx.streaming  = false;
+        m->rx.discarding = false;
+        mqtt_rx_capture_props(m, event);
+        m->rx.topic_len  = (int)event->topic_len;
+        if (m->rx.topic_len >= MQTT_RX_TOPIC_MAX) {
+            ESP_LOGW(TAG, "fragmented topic too long, drop");
+            m->rx.discarding = true;
+            mqtt_rx_count(m, &m->rx.stats.dropped);
+            return;
+        }
+        memcpy(m->rx.topic, event->topic, (size_t)m->rx.topic_len);
+        m->rx.topic[m->rx.topic_len] = '\0';
+
+        if (total <= m->cfg.rx_max_msg_len) {
+            m->rx.buf = mqtt_rx_buf_alloc(m, total);
+            if (m->rx.buf == NULL) {
+                mqtt_rx_count(m, &m->rx.stats.no_buffer);
+            }
+        }
+
+        if (m->rx.buf == NULL) {
+            if (m->cfg.fragment_cb_ex != NULL || m->cfg.fragment_cb != NULL) {
+                m->rx.streaming = true;
+                mqtt_rx_count(m, &m->rx.stats.streamed);
+            } else {
+                ESP_LOGW(TAG, "drop oversize message, topic=%s, len=%d", m->rx.topic, total);
+                m->rx.discarding = true;
+                mqtt_rx_count(m, &m->rx.stats.dropped);
+            }
+        }
+    } else if (m->rx.buf == NULL && !m->rx.streaming) {
+        return;                                     ///< 丢弃中的消息或缺少首片的孤立分片
+    }
+
+    if (m->rx.discarding) {
+        return;
+    }
+
+    if (m->rx.streaming) {
+        if (m->cfg.fragment_cb_ex != NULL) {
+            m->cfg.fragment_cb_ex(m->rx.topic, m->rx.topic_len, offset, m->rx.total_len,
+                                  (const uint8_t *)event->data, len, m->cfg.user_ctx);
+        } else {
+            m->cfg.fragment_cb(m->rx.topic, m->rx.topic_len, offset, m->rx.total_len,
+                               (const uint8_t *)event->data, len);
+        }
+        return;
+    }
+
+    if (offset + len > m->rx.total_len || offset != m->rx.received) {
+        ESP_LOGW(TAG, "fragment out of order, drop message");
+        mqtt_rx_buf_free(m, m->rx.buf);
+        m->rx.buf = NULL;
+        mqtt_rx_count(m, &m->rx.stats.dropped);
+        return;
+    }
+
+    memcpy(m->rx.buf + offset, event->data, (size_t)len);
+    m->rx.received += len;
+
+    if (m->rx.received == m->rx.total_len) {        ///< 收齐，整条交付
+        mqtt_rx_count(m, &m->rx.stats.reassembled);
+        mqtt_rx_deliver(m, m->rx.topic, m->rx.topic_len, m->rx.buf, m->rx.total_len);
+        memset(&m->rx.props, 0, sizeof(m->rx.props));
+        if (m->rx.buf != NULL) {                    ///< 回调中未被接管
+            mqtt_rx_buf_free(m, m->rx.buf);
+            m->rx.buf = NULL;
+        }
+    }
+}
+
+/**
+ * @brief 内部辅助：统一分发事件到上层回调
+ */
+static void mqtt_module_dispatch_event(mqtt_module_t *m, mqtt_module_event_t event)
+{
+    if (m->cfg.event_cb_ex) {                     ///< 携带 user_ctx 的回调优先
+        m->cfg.event_cb_ex(event, m->cfg.user_ctx);
+    } else if (m->cfg.event_cb) {                 ///< 若上层配置了回调
+        m->cfg.event_cb(event);                   ///< 则转发事件
+    }
+}
+
+/**
+ * @brief esp-mqtt 事件回调
+ *
+ * 由 IDF MQTT 客户端在其内部任务中调用，用于通知连接状态变化等；
+ * 每个实例的客户端有各自的任务，handler_args 为所属实例。
+ */
+static void mqtt_module_event_handler(void           *handler_args,
+                                      esp_event_base_t base,
+                                      int32_t         event_id,
+                                      void           *event_data)
+{
+    mqtt_module_t *m = (mqtt_module_t *)handler_args; ///< 注册时传入的实例
+    (void)base;                                    ///< 未使用参数
+
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data; ///< 事件数据
+
+    switch ((esp_mqtt_event_id_t)event_id) {       ///< 根据事件 ID 分类处理
+    case MQTT_EVENT_CONNECTED:                     ///< 已连接事件
+        m->session_present = m->cfg.persistent_session && event->session_present;
+        m->conn_gen++;                             ///< 旧连接上建立的 Topic 别名全部作废
+        ESP_LOGI(TAG, "MQTT connected, session_present=%d", (int)m->session_present); ///< 打印日志
+        m->connected = true;                       ///< 标记已连接
+        if (m->outbox.drain_task != NULL) {        ///< 唤醒 drain 任务回放离线缓存
+            (void)xTaskNotifyGive(m->outbox.drain_task);
+        }
+        mqtt_module_dispatch_event(m, MQTT_MODULE_EVENT_CONNECTED); ///< 上报已连接
+        break;                                     ///< 结束分支
+
+    case MQTT_EVENT_DISCONNECTED:                  ///< 断开连接事件
+        ESP_LOGW(TAG, "MQTT disconnected");       ///< 打印警告日志
+        m->connected = false;                      ///< 标记已断开
+        mqtt_module_dispatch_event(m, MQTT_MODULE_EVENT_DISCONNECTED); ///< 上报断开
+        break;                                     ///< 结束分支
+
+    case MQTT_EVENT_ERROR:                         ///< 错误事件
+        ESP_LOGE(TAG, "MQTT error");             ///< 打印错误日志
+        mqtt_module_dispatch_event(m, MQTT_MODULE_EVENT_ERROR); ///< 上报错误
+        break;                                     ///< 结束分支
+
+    case MQTT_EVENT_PUBLISHED:                     ///< 收到 PUBACK（QoS 1）或 PUBCOMP（QoS 2）
+        mqtt_trace_inst_record(m->cfg.trace, MQTT_TRACE_DIR_ACK, NULL, 0, 0, event->msg_id, 0);
+        mqtt_uplink_touch(m);                      ///< 服务器已确认收到，可替代心跳
+        mqtt_ack_on_published(m, event->msg_id);
+        break;                                     ///< 结束分支
+
+    case MQTT_EVENT_DELETED:                       ///< 客户端 outbox 中的消息超时未确认被删除
+        mqtt_ack_on_deleted(m, event->msg_id);
+        break;                                     ///< 结束分支
+
+    case MQTT_EVENT_SUBSCRIBED:                    ///< 收到 SUBACK
+        if (m->cfg.suback_cb_ex || m->cfg.suback_cb) {
+            bool ok = true;                        ///< 任一返回码 >= 0x80 即视为失败
+            for (int i = 0; event->data != NULL && i < event->data_len; ++i) {
+                if ((uint8_t)event->data[i] >= 0x80) {
+                    ok = false;
+                    break;
+                }
+            }
+            if (m->cfg.suback_cb_ex) {
+                m->cfg.suback_cb_ex(event->msg_id, ok, m->cfg.user_ctx);
+            } else {
+                m->cfg.suback_cb(event->msg_id, ok);
+            }
+        }
+        break;                                     ///< 结束分支
+
+    case MQTT_EVENT_DATA:                          ///< 收到一条 MQTT 消息
+        if (event->current_data_offset == 0) {     ///< 每条消息只记录首片
+            mqtt_trace_inst_record(m->cfg.trace, MQTT_TRACE_DIR_RX, event->topic, event->topic_len,
+                                   event->total_data_len, event->msg_id, event->qos);
+        }
+        ESP_LOGD(TAG, "MQTT data: topic=%.*s, len=%d, offset=%d, total=%d", ///< 逐条日志仅调试时输出
+                 event->topic_len,                  ///< Topic 长度（后续分片为 0）
+                 event->topic,                      ///< Topic 内容
+                 event->data_len,                   ///< 本片长度
+                 event->current_data_offset,        ///< 本片偏移
+                 event->total_data_len);            ///< 整条长度
+
+        mqtt_rx_on_data(m, event);                     ///< 重组后交给上层回调
+        break;                                     ///< 结束分支
+
+    default:                                       ///< 其他事件暂不关心
+        break;                                     ///< 直接忽略
+    }
+}
+
+/**
+ * @brief 内部辅助：发布属性互斥（MQTT 5.0 下发布属性是客户端级状态），同时串行化同步压缩工作区
+ */
+static void mqtt_prop_lock(mqtt_module_t *m)
+{
+    if (m->prop_mutex != NULL) {
+        (void)xSemaphoreTake(m->prop_mutex, portMAX_DELAY);
+    }
+}
+
+static void mqtt_prop_unlock(mqtt_module_t *m)
+{
+    if (m->prop_mutex != NULL) {
+        (void)xSemaphoreGive(m->prop_mutex);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                             上行 Topic 别名                                  */
+/* -------------------------------------------------------------------------- */
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+
+static const esp_mqtt5_publish_property_config_t s_no_prop = { 0 }; ///< 清空发布属性用
+
+/**
+ * @brief 内部辅助：FNV-1a 哈希
+ */
+static uint32_t mqtt_alias_hash(const char *topic)
+{
+    uint32_t h = 2166136261u;
+    while (*topic != '\0') {
+        h = (h ^ (uint8_t)*topic++) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief 内部辅助：为 Topic 查找或分配别名表项
+ *
+ * 命中时刷新 LRU；未命中且 Topic 近期出现过时替换最久未用的表项。
+ *
+ * @return 表项下标；-1 表示本次不使用别名
+ */
+static int mqtt_alias_pick(mqtt_module_t *m, const char *topic)
+{
+    if (strlen(topic) >= MQTT_ALIAS_TOPIC_MAX) {
+        return -1;
+    }
+
+    uint32_t h      = mqtt_alias_hash(topic);
+    int      victim = -1;
+    for (int i = 0; i < m->alias.limit; ++i) {
+        mqtt_alias_entry_t *e = &m->alias.entries[i];
+        if (e->hash == h && strcmp(e->topic, topic) == 0) {
+            e->last_use = ++m->alias.clock;
+            return i;
+        }
+        if (victim < 0 || e->last_use < m->alias.entries[victim].last_use) {
+            victim = i;
+        }
+    }
+    if (victim < 0) {
+        return -1;                                 ///< 服务器不支持别名
+    }
+
+    /* 一次性的 Topic 只记入准入过滤器，不挤占热点 Topic 的别名 */
+    uint32_t *ghost = &m->alias.ghost[h % MQTT_ALIAS_GHOST_NUM];
+    if (*ghost != h) {
+        *ghost = h;
+        return -1;
+    }
+
+    mqtt_alias_entry_t *e = &m->alias.entries[victim];
+    if (e->topic[0] != '\0') {
+        m->alias.stats.evicted++;
+    }
+    strcpy(e->topic, topic);
+    e->hash     = h;
+    e->gen      = m->conn_gen - 1;                 ///< 新映射尚未在本代连接上建立
+    e->last_use = ++m->alias.clock;
+    return victim;
+}
+
+/**
+ * @brief 内部辅助：MQTT 变长整数编码后的字节数
+ */
+static uint32_t mqtt_alias_varint_len(uint32_t n)
+{
+    return (n < 128u) ? 1u : (n < 16384u) ? 2u : (n < 2097152u) ? 3u : 4u;
+}
+
+/**
+ * @brief 内部辅助：QoS 0 PUBLISH 报文在线路上的字节数（MQTT 5.0）
+ *
+ * 固定头 1 字节 + 剩余长度；可变头为 2 字节 Topic 长度 + Topic + 属性长度 + 属性，之后是负载。
+ *
+ * @param topic_len Topic 长度，只发送别名时为 0
+ * @param prop_len  属性字节数，Topic Alias 为 3（标识 1 + 值 2）
+ */
+static uint32_t mqtt_alias_packet_len(int topic_len, int prop_len, int len)
+{
+    uint32_t rem = 2u + (uint32_t)topic_len + mqtt_alias_varint_len((uint32_t)prop_len) +
+                   (uint32_t)prop_len + (uint32_t)len;
+    return 1u + mqtt_alias_varint_len(rem) + rem;
+}
+
+/**
+ * @brief 内部辅助：按别名表发布一条 QoS 0 消息（需持有 prop_mutex）
+ *
+ * 映射已在本代连接上建立时只发送别名，否则发送完整 Topic 并建立映射。
+ * 只用于 QoS 0 同步发布：QoS>=1 的报文会被客户端原样保存并在重连后重发，
+ * 届时旧连接的别名已失效，因此不能携带别名；出站队列交给客户端排队的 QoS 0 报文
+ * 同样可能跨过断线在新连接上发出，也不携带别名。
+ *
+ * 建立映射失败时不直接判定为超出上限（断线、写超时同样会失败），
+ * 由 *rejected 带回别名下标，调用方按普通方式重发后交给 mqtt_alias_on_rejected() 判断。
+ *
+ * @return true 已发布，*msg_id 为结果；false 调用方应按普通方式发布
+ */
+static bool mqtt_alias_publish(mqtt_module_t *m, const char *topic, const char *data, int len,
+                               bool retain, int *msg_id, int *rejected)
+{
+    if (m->alias.entries == NULL || !m->connected) {
+        return false;
+    }
+
+    uint32_t gen = m->conn_gen;
+    if (m->alias.limit_gen != gen) {               ///< 新连接：恢复完整表容量
+        m->alias.limit     = m->alias.num;
+        m->alias.limit_gen = gen;
+    }
+
+    int idx = mqtt_alias_pick(m, topic);
+    if (idx < 0) {
+        return false;
+    }
+
+    mqtt_alias_entry_t *e     = &m->alias.entries[idx];
+    bool                bound = (e->gen == gen);
+
+    esp_mqtt5_publish_property_config_t prop = { 0 };
+    prop.topic_alias = (uint16_t)(idx + 1);
+
+    int ret = -1;
+    if (esp_mqtt5_client_set_publish_property(m->client, &prop) == ESP_OK) {
+        ret = esp_mqtt_client_publish(m->client, bound ? "" : topic, data, len, 0, retain);
+    }
+    (void)esp_mqtt5_client_set_publish_property(m->client, &s_no_prop);
+
+    if (ret < 0) {
+        if (!bound) {
+            *rejected = idx;                       ///< 可能超出服务器上限，也可能只是暂时发送失败
+        }
+        return false;                              ///< 表项保留，暂时失败时下次照常使用
+    }
+
+    int topic_len = (int)strlen(topic);
+    m->alias.stats.bytes_wire  += mqtt_alias_packet_len(bound ? 0 : topic_len, 3, len);
+    m->alias.stats.bytes_plain += mqtt_alias_packet_len(topic_len, 0, len);
+    if (bound) {
+        m->alias.stats.aliased++;
+    } else {
+        e->gen = gen;
+        m->alias.stats.bound++;
+    }
+    *msg_id = ret;
+    return true;
+}
+
+/**
+ * @brief 内部辅助：判断建立映射失败的原因（需持有 prop_mutex）
+ *
+ * esp-mqtt 不对外提供 CONNACK 中的 Topic Alias Maximum，但会在发送前拒绝超出该值的别名。
+ * 同一条消息不带别名同步重发成功，说明失败只与别名有关：别名值超出服务器上限，
+ * 本代连接内只使用更小的别名；重发也失败则是连接或发送问题，别名表保持不变。
+ *
+ * @param idx      建立映射失败的表项下标
+ * @param plain_ok 不带别名的同步重发是否成功
+ */
+static void mqtt_alias_on_rejected(mqtt_module_t *m, int idx, bool plain_ok)
+{
+    if (!plain_ok || !m->connected || idx >= m->alias.limit) {
+        return;
+    }
+
+    ESP_LOGW(TAG, "topic alias %d exceeds server maximum, use %d alias(es)", idx + 1, idx);
+    m->alias.limit = idx;
+    for (int i = idx; i < m->alias.num; ++i) {
+        mqtt_alias_entry_t *e = &m->alias.entries[i];
+        e->topic[0] = '\0';                       ///< 本代连接内不再使用的表项
+        e->hash     = 0;
+        e->last_use = 0;
+    }
+}
+
+#endif /* CONFIG_MQTT_PROTOCOL_5 */
+
+/**
+ * @brief 内部辅助：把一条消息交给客户端
+ *
+ * - zip 非空且负载达到 compress_min_len 时先压缩，Topic 追加 "/z"（压缩无收益则原样发送）；
+ * - store 为 true 时由客户端排队发送（esp_mqtt_client_enqueue），否则同步发布；
+ * - MQTT 5.0 下同步发布的 QoS 0 消息优先按别名表发布，失败时退回原方式（排队发送不使用别名，
+ *   drain 任务不会在持有 prop_mutex 时阻塞于网络写）；
+ * - QoS>=1 消息须由调用方先取得窗口空位（mqtt_window_acquire），发送失败时在此归还。
+ */
+static int mqtt_client_send(mqtt_module_t *m, const char *topic, const void *payload, int len,
+                            int qos, bool retain, bool store, const mqtt_zip_t *zip)
+{
+    const char *data   = (const char *)payload;
+    int         msg_id = -1;
+    char        ztopic[MQTT_RX_TOPIC_MAX + sizeof(MQTT_LZF_TOPIC_SUFFIX)];
+
+    mqtt_prop_lock(m);                              ///< 避免带上其他调用方设置的发布属性，并独占压缩工作区
+    if (zip != NULL && zip->buf != NULL &&
+        m->cfg.compress_min_len > 0 && len >= m->cfg.compress_min_len) {
+        int zlen = mqtt_lzf_pack((const uint8_t *)payload, len, zip->buf, zip->cap, zip->htab);
+        int n    = snprintf(ztopic, sizeof(ztopic), "%s" MQTT_LZF_TOPIC_SUFFIX, topic);
+        if (zlen > 0 && n > 0 && n < (int)sizeof(ztopic)) {
+            portENTER_CRITICAL(&m->zip.lock);
+            m->zip.stats.compressed++;
+            m->zip.stats.bytes_in  += (uint32_t)len;
+            m->zip.stats.bytes_out += (uint32_t)zlen;
+            portEXIT_CRITICAL(&m->zip.lock);
+
+            topic = ztopic;
+            data  = (const char *)zip->buf;
+            len   = zlen;
+        }
+    }
+
+    uint32_t sent_ms = mqtt_ack_now_ms();
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    int rejected = -1;                              ///< 建立映射失败的别名下标
+    if (qos == 0 && !store && mqtt_alias_publish(m, topic, data, len, retain, &msg_id, &rejected)) {
+        mqtt_prop_unlock(m);
+        mqtt_trace_inst_record(m->cfg.trace, MQTT_TRACE_DIR_TX, topic, -1, len, msg_id, qos);
+        mqtt_uplink_touch(m);
+        return msg_id;
+    }
+#endif
+    if (store) {
+        msg_id = esp_mqtt_client_enqueue(m->client, topic, data, len, qos, retain, true);
+    } else {
+        msg_id = esp_mqtt_client_publish(m->client, topic, data, len, qos, retain);
+    }
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    if (rejected >= 0) {                            ///< 入队成功不代表能发出，只有同步重发结果可作判断
+        mqtt_alias_on_rejected(m, rejected, !store && msg_id >= 0);
+    }
+#endif
+    mqtt_prop_unlock(m);
+
+    if (msg_id < 0 && qos > 0) {
+        mqtt_window_release(m);
+    }
+    if (msg_id >= 0) {
+        mqtt_trace_inst_record(m->cfg.trace, MQTT_TRACE_DIR_TX, topic, -1, len, msg_id, qos);
+        if (qos == 0 && !store && m->connected) {  ///< QoS 0 同步发布已写入连接；QoS>=1 等 PUBACK
+            mqtt_uplink_touch(m);
+        }
+    }
+    mqtt_ack_track(m, msg_id, qos, topic, sent_ms);   ///< QoS 0 或失败时内部忽略
+    return msg_id;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  出站队列                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief 内部辅助：登记一个进行中的发布调用或租约
+ *
+ * @return 实例销毁中返回 false，调用方应立即以 ESP_ERR_INVALID_STATE 返回
+ */
+static bool mqtt_user_enter(mqtt_module_t *m)
+{
+    bool ok = false;
+    portENTER_CRITICAL(&m->outbox.lock);
+    if (!m->outbox.closing) {
+        m->outbox.users++;
+        ok = true;
+    }
+    portEXIT_CRITICAL(&m->outbox.lock);
+    return ok;
+}
+
+/**
+ * @brief 内部辅助：注销 mqtt_user_enter 登记的使用者，此后不得再访问实例
+ */
+static void mqtt_user_leave(mqtt_module_t *m)
+{
+    portENTER_CRITICAL(&m->outbox.lock);
+    m->outbox.users--;
+    portEXIT_CRITICAL(&m->outbox.lock);
+}
+
+/**
+ * @brief 内部辅助：记录槽位中的消息已离开队列及其去向
+ */
+static void mqtt_outbox_mark_done_locked(mqtt_module_t *m, mqtt_outbox_slot_t *slot,
+                                         mqtt_module_ticket_state_t state)
+{
+    mqtt_outbox_result_t *r = &m->outbox.results[slot->ticket % (2u * m->outbox.capacity)];
+    r->ticket    = slot->ticket;
+    r->state     = state;
+    slot->queued = false;
+}
+
+/**
+ * @brief 内部辅助：从就绪环头部取出一个槽位，无则返回 -1
+ */
+static int mqtt_outbox_pop_ready_locked(mqtt_module_t *m)
+{
+    if (m->outbox.ready_count == 0) {
+        return -1;
+    }
+
+    int idx = m->outbox.ready[m->outbox.ready_head];
+    m->outbox.ready_head = (uint16_t)((m->outbox.ready_head + 1) % m->outbox.capacity);
+    m->outbox.ready_count--;
+    m->outbox.stats.depth = m->outbox.ready_count;
+    return idx;
+}
+
+/**
+ * @brief 内部辅助：归还槽位到空闲栈并唤醒可能在等待的发布者
+ */
+static void mqtt_outbox_release(mqtt_module_t *m, int idx)
+{
+    portENTER_CRITICAL(&m->outbox.lock);
+    m->outbox.free_stack[m->outbox.free_top++] = (uint16_t)idx;
+    portEXIT_CRITICAL(&m->outbox.lock);
+
+    (void)xSemaphoreGive(m->outbox.free_sem);
+}
+
+/**
+ * @brief 内部辅助：按配置策略获取一个可写槽位
+ *
+ * @return 槽位下标；<0 表示失败，*err 给出原因
+ */
+static int mqtt_outbox_acquire(mqtt_module_t *m, esp_err_t *err)
+{
+    TickType_t wait = 0;
+    if (m->cfg.outbox_policy == MQTT_MODULE_OUTBOX_BLOCK &&
+        m->cfg.outbox_block_ms > 0) {
+        wait = pdMS_TO_TICKS(m->cfg.outbox_block_ms);
+    }
+
+    int idx = -1;
+    if (xSemaphoreTake(m->outbox.free_sem, wait) == pdTRUE) {
+        if (m->outbox.closing) {                   ///< 由 mqtt_module_destroy() 唤醒，不取槽位
+            *err = ESP_ERR_INVALID_STATE;
+            return -1;
+        }
+        portENTER_CRITICAL(&m->outbox.lock);
+        idx = m->outbox.free_stack[--m->outbox.free_top];
+        portEXIT_CRITICAL(&m->outbox.lock);
+        return idx;
+    }
+
+    portENTER_CRITICAL(&m->outbox.lock);
+    if (m->cfg.outbox_policy == MQTT_MODULE_OUTBOX_DROP_OLDEST) {
+        idx = mqtt_outbox_pop_ready_locked(m);      ///< 挤掉最旧的一条，槽位直接复用
+        if (idx >= 0) {
+            mqtt_outbox_mark_done_locked(m, &m->outbox.slots[idx], MQTT_MODULE_TICKET_DROPPED);
+        }
+    }
+    m->outbox.stats.dropped++;                     ///< 无论挤掉旧的还是放弃新的，均丢弃一条
+    portEXIT_CRITICAL(&m->outbox.lock);
+
+    if (idx < 0) {
+        *err = (m->cfg.outbox_policy == MQTT_MODULE_OUTBOX_BLOCK)
+                   ? ESP_ERR_TIMEOUT
+                   : ESP_ERR_NO_MEM;
+    }
+    return idx;
+}
+
+/**
+ * @brief 内部辅助：把一个就绪槽位交给客户端，离线时 QoS>=1 的消息转存 Flash
+ *
+ * QoS>=1 消息需等到在途窗口有空位才交给客户端，等待期间后续消息留在队列中（保持顺序），
+ * 队列占满后由 outbox_policy 反压发布者；等待中连接断开则改为转存 Flash。
+ * 连接恢复后离线缓存尚未回放完时，QoS>=1 消息同样追加到缓存末尾，排在离线期间的消息之后发出。
+ */
+static void mqtt_outbox_send_slot(mqtt_module_t *m, int idx)
+{
+    mqtt_outbox_slot_t *slot    = &m->outbox.slots[idx];
+    bool                spooled = false;
+    bool                ready   = false;
+    int                 msg_id  = -1;
+
+    for (;;) {
+        if (slot->qos > 0 && m->spool && mqtt_spool_is_ready() &&
+            (!m->connected || mqtt_spool_has_pending())) {
+            spooled = (mqtt_spool_append(slot->topic, slot->payload, slot->len,
+                                         slot->qos, slot->retain) == ESP_OK);
+            if (spooled) {
+                break;
+            }
+        }
+        if (slot->qos == 0 || mqtt_window_acquire(m, pdMS_TO_TICKS(MQTT_WINDOW_POLL_MS))) {
+            ready = true;
+            break;
+        }
+        if (m->outbox.quit) {
+            break;                                  ///< 实例销毁中，放弃本条
+        }
+    }
+
+    if (ready) {
+        msg_id = mqtt_client_send(m, slot->topic, slot->payload, slot->len,
+                                  slot->qos, slot->retain, true, &m->outbox.zip);
+    }
+
+    mqtt_module_ticket_state_t state = MQTT_MODULE_TICKET_SENT;
+
+    portENTER_CRITICAL(&m->outbox.lock);
+    if (spooled) {
+        m->outbox.stats.spooled++;
+        state = MQTT_MODULE_TICKET_SPOOLED;
+    } else if (msg_id < 0) {
+        m->outbox.stats.failed++;
+        state = MQTT_MODULE_TICKET_FAILED;
+    } else {
+        m->outbox.stats.sent++;
+    }
+    mqtt_outbox_mark_done_locked(m, slot, state);
+    portEXIT_CRITICAL(&m->outbox.lock);
+
+    if (!spooled && msg_id < 0) {
+        ESP_LOGW(TAG, "outbox enqueue failed, topic=%s, ret=%d", slot->topic, msg_id);
+    }
+
+    mqtt_outbox_release(m, idx);
+}
 
 /**
- * @brief 内部辅助：统一分发事件到上层回调
+ * @brief 内部辅助：在限速范围内回放离线缓存
+ *
+ * @return 距离下一次允许回放还需等待的 Tick 数；无需回放时返回 portMAX_DELAY
+ */
+static TickType_t mqtt_outbox_replay_spool(mqtt_module_t *m, TickType_t *next_replay)
+{
+    if (!m->connected || !m->spool || !mqtt_spool_has_pending()) {
+        return portMAX_DELAY;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if ((int32_t)(*next_replay - now) > 0) {
+        return *next_replay - now;                 ///< 尚未到达回放时间
+    }
+
+    mqtt_spool_record_t rec;
+    if (mqtt_spool_peek(&rec) != ESP_OK) {
+        return portMAX_DELAY;                      ///< 剩余记录均已过期或损坏
+    }
+    if (rec.qos > 0 && !mqtt_window_acquire(m, 0)) {
+        return pdMS_TO_TICKS(MQTT_WINDOW_POLL_MS); ///< 窗口已满，回放让位于实时消息
+    }
+
+    int msg_id = mqtt_client_send(m, rec.topic, rec.payload, rec.payload_len,
+                                  rec.qos, rec.retain, true, &m->outbox.zip);
+    if (msg_id >= 0) {
+        (void)mqtt_spool_pop();                    ///< 成功交给客户端后才标记已回放
+    }
+
+    TickType_t interval = pdMS_TO_TICKS(mqtt_spool_replay_interval_ms());
+    if (msg_id < 0 && interval == 0) {
+        interval = pdMS_TO_TICKS(100);             ///< 客户端拒收时退避，避免空转
+    }
+    *next_replay = now + interval;
+    return interval;
+}
+
+/**
+ * @brief 内部辅助：填写完毕的槽位按顺序挂到就绪环尾部并唤醒 drain 任务
  */
-static void mqtt_module_dispatch_event(mqtt_module_event_t event)
+static void mqtt_outbox_push(mqtt_module_t *m, int idx, int len, int qos, bool retain,
+                             mqtt_module_ticket_t *ticket)
 {
-    if (s_mqtt_cfg.event_cb) {                    ///< 若上层配置了回调
-        s_mqtt_cfg.event_cb(event);               ///< 则转发事件
+    mqtt_outbox_slot_t *slot = &m->outbox.slots[idx];
+    slot->len    = len;
+    slot->qos    = qos;
+    slot->retain = retain;
+
+    portENTER_CRITICAL(&m->outbox.lock);
+    if (++m->outbox.next_ticket == 0) {
+        m->outbox.next_ticket = 1;                  ///< 0 保留为“无效票据”
+    }
+    slot->ticket = m->outbox.next_ticket;           ///< 票据与就绪环顺序一致
+    slot->queued = true;
+    uint16_t tail = (uint16_t)((m->outbox.ready_head + m->outbox.ready_count) % m->outbox.capacity);
+    m->outbox.ready[tail] = (uint16_t)idx;
+    m->outbox.ready_count++;
+    m->outbox.stats.enqueued++;
+    m->outbox.stats.depth = m->outbox.ready_count;
+    if (m->outbox.ready_count > m->outbox.stats.high_water) {
+        m->outbox.stats.high_water = m->outbox.ready_count;
+    }
+    mqtt_module_ticket_t t = slot->ticket;
+    portEXIT_CRITICAL(&m->outbox.lock);
+
+    (void)xTaskNotifyGive(m->outbox.drain_task);    ///< 唤醒 drain 任务
+
+    if (ticket != NULL) {
+        *ticket = t;
     }
 }
 
 /**
- * @brief esp-mqtt 事件回调
+ * @brief 出站队列 drain 任务
  *
- * 由 IDF MQTT 客户端在其内部任务中调用，用于通知连接状态变化等。
+ * 被发布者通过任务通知唤醒，按入队顺序把消息交给 esp-mqtt 的内部 outbox，
+ * 真正的 socket 写入由 esp-mqtt 自身任务完成，因此这里只可能短暂等待客户端锁。
+ * 连接恢复后，在队列空闲时按 replay_rate_per_sec 回放离线缓存；回放完之前到达的 QoS>=1 消息
+ * 先追加到缓存末尾（见 mqtt_outbox_send_slot），不会越过离线期间的消息。
  */
-static void mqtt_module_event_handler(void           *handler_args,
-                                      esp_event_base_t base,
-                                      int32_t         event_id,
-                                      void           *event_data)
+static void mqtt_outbox_drain_task(void *arg)
 {
-    (void)handler_args;                            ///< 未使用参数
-    (void)base;                                    ///< 未使用参数
+    mqtt_module_t *m = (mqtt_module_t *)arg;      ///< 所属实例
 
-    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data; ///< 事件数据
+    TickType_t wait        = portMAX_DELAY;
+    TickType_t next_replay = xTaskGetTickCount();
 
-    switch ((esp_mqtt_event_id_t)event_id) {       ///< 根据事件 ID 分类处理
-    case MQTT_EVENT_CONNECTED:                     ///< 已连接事件
-        ESP_LOGI(TAG, "MQTT connected");          ///< 打印日志
-        mqtt_module_dispatch_event(MQTT_MODULE_EVENT_CONNECTED); ///< 上报已连接
-        break;                                     ///< 结束分支
+    while (!m->outbox.quit) {
+        (void)ulTaskNotifyTake(pdTRUE, wait);
+
+        while (!m->outbox.quit) {
+            portENTER_CRITICAL(&m->outbox.lock);
+            int idx = mqtt_outbox_pop_ready_locked(m);
+            portEXIT_CRITICAL(&m->outbox.lock);
+
+            if (idx < 0) {
+                break;
+            }
+            mqtt_outbox_send_slot(m, idx);
+        }
+
+        wait = mqtt_outbox_replay_spool(m, &next_replay);
+    }
+
+    m->outbox.drain_task = NULL;                    ///< 通知 mqtt_module_destroy()，此后不再访问实例
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 内部辅助：按配置分配出站队列并创建 drain 任务
+ */
+static esp_err_t mqtt_outbox_init(mqtt_module_t *m)
+{
+    if (m->cfg.outbox_slot_num <= 0) {             ///< 未启用出站队列
+        return ESP_OK;
+    }
+
+    if (m->cfg.outbox_slot_num > UINT16_MAX ||
+        m->cfg.outbox_topic_max <= 1 ||
+        m->cfg.outbox_payload_max < 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t num       = (size_t)m->cfg.outbox_slot_num;
+    size_t slot_data = (size_t)m->cfg.outbox_topic_max + (size_t)m->cfg.outbox_payload_max;
+
+    /* 槽位描述、票据去向、两个下标数组与数据区一次性分配，运行期间不再申请内存 */
+    size_t result_off = num * sizeof(mqtt_outbox_slot_t);
+    size_t index_off  = result_off + 2 * num * sizeof(mqtt_outbox_result_t);
+    size_t hdr_size   = index_off + 2 * num * sizeof(uint16_t);
+    hdr_size = (hdr_size + 3) & ~(size_t)3;
+    uint8_t *mem = (uint8_t *)calloc(1, hdr_size + num * slot_data);
+    if (mem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    m->outbox.slots      = (mqtt_outbox_slot_t *)mem;
+    m->outbox.results    = (mqtt_outbox_result_t *)(mem + result_off);
+    m->outbox.free_stack = (uint16_t *)(mem + index_off);
+    m->outbox.ready      = m->outbox.free_stack + num;
+    m->outbox.capacity   = (uint16_t)num;
+
+    uint8_t *data = mem + hdr_size;
+    for (size_t i = 0; i < num; ++i) {
+        m->outbox.slots[i].topic   = (char *)data;
+        m->outbox.slots[i].payload = data + m->cfg.outbox_topic_max;
+        m->outbox.free_stack[i]    = (uint16_t)(num - 1 - i);
+        data += slot_data;
+    }
+    m->outbox.free_top       = (uint16_t)num;
+    m->outbox.stats.capacity = (uint16_t)num;
+
+    /* drain 任务串行发送，共用一块压缩工作区；分配失败只是不压缩 */
+    if (m->cfg.compress_min_len > 0 &&
+        m->cfg.outbox_payload_max >= m->cfg.compress_min_len) {
+        (void)mqtt_zip_alloc(&m->outbox.zip, m->cfg.outbox_payload_max);
+    }
+
+    m->outbox.free_sem = xSemaphoreCreateCounting(num, num);
+    if (m->outbox.free_sem == NULL) {
+        mqtt_zip_free(&m->outbox.zip);
+        free(mem);
+        m->outbox.slots = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    BaseType_t ret = xTaskCreate(mqtt_outbox_drain_task,
+                                 "mqtt_outbox",
+                                 3072,
+                                 m,
+                                 tskIDLE_PRIORITY + 2,  ///< 略高于事件循环任务，尽快清空队列
+                                 &m->outbox.drain_task);
+    if (ret != pdPASS) {
+        vSemaphoreDelete(m->outbox.free_sem);
+        m->outbox.free_sem = NULL;
+        mqtt_zip_free(&m->outbox.zip);
+        free(mem);
+        m->outbox.slots = NULL;
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief 内部辅助：按配置创建实例的客户端与各项资源
+ *
+ * 失败时已分配的资源由调用方通过 mqtt_module_destroy() 统一释放。
+ */
+static esp_err_t mqtt_module_setup(mqtt_module_t *m, const mqtt_module_config_t *config)
+{
+    /* 装载配置：优先使用外部配置，否则使用默认配置 */
+    if (config == NULL) {                          ///< 未传入配置
+        m->cfg = MQTT_MODULE_DEFAULT_CONFIG();     ///< 使用默认配置
+    } else {                                       ///< 传入了配置
+        m->cfg = *config;                          ///< 直接保存一份副本
+    }
+    mqtt_trace_retain(m->cfg.trace);               ///< 实例存在期间轨迹不可销毁，失败时由 mqtt_module_destroy 释放
+
+    /* broker_uri 为必填项 */
+    if (m->cfg.broker_uri == NULL ||               ///< URI 为空
+        m->cfg.broker_uri[0] == '\0') {           ///< 或者空字符串
+        return ESP_ERR_INVALID_ARG;                ///< 返回参数错误
+    }
+
+    /* 构造 esp-mqtt 配置 */
+    esp_mqtt_client_config_t mqtt_cfg = (esp_mqtt_client_config_t){ 0 }; ///< 清零配置结构体
+
+    mqtt_cfg.broker.address.uri = m->cfg.broker_uri; ///< 设置服务器 URI
+
+    if (m->cfg.client_id != NULL) {                ///< 如配置了 client_id
+        mqtt_cfg.credentials.client_id = m->cfg.client_id; ///< 则传递给底层
+    }
+    if (m->cfg.username != NULL) {                 ///< 如配置了用户名
+        mqtt_cfg.credentials.username = m->cfg.username;       ///< 则传递给底层
+    }
+    if (m->cfg.password != NULL) {                 ///< 如配置了密码
+        mqtt_cfg.credentials.authentication.password = m->cfg.password; ///< 则传递给底层
+    }
+
+    if (m->cfg.keepalive_sec > 0) {                ///< 配置了 keepalive
+        mqtt_cfg.session.keepalive = (uint16_t)m->cfg.keepalive_sec; ///< 使用该值
+    }
+
+    mqtt_cfg.network.disable_auto_reconnect = m->cfg.disable_auto_reconnect; ///< 重连时机是否交给上层
+    if (m->cfg.network_timeout_ms > 0) {           ///< 限制单次建连耗时，停止客户端时也不会长时间阻塞
+        mqtt_cfg.network.timeout_ms = m->cfg.network_timeout_ms;
+    }
+    mqtt_cfg.session.disable_clean_session  = m->cfg.persistent_session;         ///< 持久会话
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    if (m->cfg.protocol_v5) {                      ///< 使用 MQTT 5.0
+        mqtt_cfg.session.protocol_ver = MQTT_PROTOCOL_V_5;
+        if (m->prop_mutex == NULL) {
+            m->prop_mutex = xSemaphoreCreateMutex(); ///< 发布属性与发布需原子完成
+        }
+        if (m->prop_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        m->v5 = true;
+
+        if (m->cfg.topic_alias_max > 0) {          ///< 上行 Topic 别名表，分配失败只是不压缩
+            m->alias.entries = calloc((size_t)m->cfg.topic_alias_max, sizeof(mqtt_alias_entry_t));
+            if (m->alias.entries != NULL) {
+                m->alias.num       = m->cfg.topic_alias_max;
+                m->alias.limit_gen = UINT32_MAX;   ///< 首次发布时按新连接装载 limit
+            }
+        }
+    }
+#else
+    if (m->cfg.protocol_v5) {
+        ESP_LOGW(TAG, "CONFIG_MQTT_PROTOCOL_5 disabled, fall back to MQTT 3.1.1");
+    }
+#endif
+
+    /* 同步发布共用一块压缩工作区，由 prop_mutex 串行使用；分配失败只是不压缩 */
+    if (m->cfg.compress_min_len > 0 && m->cfg.compress_buf_size > 0 &&
+        mqtt_zip_alloc(&m->zip_ws, m->cfg.compress_buf_size) == ESP_OK) {
+        if (m->prop_mutex == NULL) {
+            m->prop_mutex = xSemaphoreCreateMutex();
+        }
+        if (m->prop_mutex == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    /* 在途窗口：信号量计数即空位数，上限受确认跟踪表容量限制 */
+    if (m->cfg.inflight_max > 0) {
+        int window = (m->cfg.inflight_max < MQTT_MODULE_INFLIGHT_MAX)
+                         ? m->cfg.inflight_max
+                         : MQTT_MODULE_INFLIGHT_MAX;
+        m->ack.window_sem = xSemaphoreCreateCounting((UBaseType_t)window, (UBaseType_t)window);
+        if (m->ack.window_sem == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        m->ack.stats.window = (uint16_t)window;
+    }
+
+    /* 创建 MQTT 客户端实例 */
+    m->client = esp_mqtt_client_init(&mqtt_cfg); ///< 初始化客户端
+    if (m->client == NULL) {                        ///< 创建失败
+        ESP_LOGE(TAG, "esp_mqtt_client_init failed"); ///< 打印错误日志
+        return ESP_ERR_NO_MEM;                      ///< 返回内存不足
+    }
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    /* MQTT 5.0 下会话默认随连接断开而结束，持久会话需显式设置保留时间 */
+    if (m->v5 && m->cfg.persistent_session) {
+        esp_mqtt5_connection_property_config_t conn_prop = { 0 };
+        conn_prop.session_expiry_interval = m->cfg.session_expiry_sec;
+        if (esp_mqtt5_client_set_connect_property(m->client, &conn_prop) != ESP_OK) {
+            ESP_LOGW(TAG, "set session expiry failed");
+        }
+    }
+#endif
+
+    /* 注册事件回调 */
+    esp_err_t ret = esp_mqtt_client_register_event( ///< 注册事件回调
+        m->client,                                  ///< 客户端句柄
+        ESP_EVENT_ANY_ID,                           ///< 关心所有事件
+        mqtt_module_event_handler,                  ///< 回调函数
+        m);                                         ///< 传入所属实例
+
+    if (ret != ESP_OK) {                            ///< 注册失败
+        ESP_LOGE(TAG, "esp_mqtt_client_register_event failed: %s", ///< 打印错误
+                 esp_err_to_name(ret));             ///< 错误码转字符串
+        esp_mqtt_client_destroy(m->client);         ///< 销毁客户端
+        m->client = NULL;                           ///< 句柄清空
+        return ret;                                 ///< 返回错误码
+    }
+
+    /* 创建出站队列（outbox_slot_num <= 0 时跳过） */
+    ret = mqtt_outbox_init(m);                       ///< 预分配槽位并创建 drain 任务
+    if (ret != ESP_OK) {                            ///< 创建失败
+        ESP_LOGE(TAG, "outbox init failed: %s", esp_err_to_name(ret));
+        esp_mqtt_client_destroy(m->client);         ///< 销毁客户端
+        m->client = NULL;                           ///< 句柄清空
+        return ret;                                 ///< 返回错误码
+    }
+
+    /* 预分配接收重组缓冲区 */
+    ret = mqtt_rx_init(m);                           ///< 按规格分配 slab
+    if (ret != ESP_OK) {                            ///< 分配失败
+        ESP_LOGE(TAG, "rx pool init failed: %s", esp_err_to_name(ret));
+        esp_mqtt_client_destroy(m->client);         ///< 销毁客户端
+        m->client = NULL;                           ///< 句柄清空
+        return ret;                                 ///< 返回错误码
+    }
+
+    /* 离线缓存依赖 drain 任务，未启用出站队列时不初始化；失败不影响在线收发。
+     * 缓存分区全局唯一，只归第一个配置了 spool_cfg 的实例所有 */
+    if (m->cfg.spool_cfg != NULL && m->outbox.slots != NULL) {
+        if (s_spool_owner != NULL) {
+            ESP_LOGW(TAG, "spool already owned by another instance");
+        } else {
+            esp_err_t spool_ret = mqtt_spool_init(m->cfg.spool_cfg);
+            if (spool_ret == ESP_OK) {
+                m->spool      = true;
+                s_spool_owner = m;
+            } else {
+                ESP_LOGW(TAG, "spool disabled: %s", esp_err_to_name(spool_ret));
+            }
+        }
+    }
+
+    return ESP_OK;                                  ///< 返回成功
+}
+
+esp_err_t mqtt_module_create(const mqtt_module_config_t *config, mqtt_module_handle_t *out)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = NULL;
+
+    mqtt_module_t *m = (mqtt_module_t *)calloc(1, sizeof(mqtt_module_t));
+    if (m == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    portMUX_INITIALIZE(&m->zip.lock);
+    portMUX_INITIALIZE(&m->ack.lock);
+    portMUX_INITIALIZE(&m->outbox.lock);
+    portMUX_INITIALIZE(&m->rx.lock);
+    m->ack.stats.class_num = 1;                     ///< 下标 0 固定为 "other"
+    strcpy(m->ack.stats.class_name[0], "other");
+
+    esp_err_t ret = mqtt_module_setup(m, config);
+    if (ret != ESP_OK) {
+        mqtt_module_destroy(m);
+        return ret;
+    }
+
+    *out = m;
+    return ESP_OK;
+}
+
+void mqtt_module_destroy(mqtt_module_handle_t m)
+{
+    if (m == NULL) {
+        return;
+    }
+
+    /*
+     * 先拒绝新的发布与租约，再等进行中的调用离开：BLOCK 策略下发布者可能正阻塞在 free_sem 上，
+     * 反复归还信号量将其唤醒（醒来后见 closing 即返回），未结束的租约须由持有者提交或放弃
+     */
+    portENTER_CRITICAL(&m->outbox.lock);
+    m->outbox.closing = true;
+    uint16_t users = m->outbox.users;
+    portEXIT_CRITICAL(&m->outbox.lock);
+    while (users > 0) {
+        if (m->outbox.free_sem != NULL) {
+            (void)xSemaphoreGive(m->outbox.free_sem);
+        }
+        vTaskDelay(pdMS_TO_TICKS(10));
+        portENTER_CRITICAL(&m->outbox.lock);
+        users = m->outbox.users;
+        portEXIT_CRITICAL(&m->outbox.lock);
+    }
+
+    /* 再让 drain 任务自行退出：它可能正持有客户端锁，不能在外部直接删除 */
+    if (m->outbox.drain_task != NULL) {
+        m->outbox.quit = true;
+        xTaskNotifyGive(m->outbox.drain_task);
+        while (m->outbox.drain_task != NULL) {      ///< 最长等待一个窗口轮询周期
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+
+    if (m->client != NULL) {
+        esp_mqtt_client_destroy(m->client);         ///< 内部先停止客户端任务
+        m->client = NULL;
+    }
+    mqtt_trace_release(m->cfg.trace);               ///< 客户端与 drain 任务均已停止，不再写入轨迹
+
+    if (m->outbox.free_sem != NULL) {
+        vSemaphoreDelete(m->outbox.free_sem);
+    }
+    mqtt_zip_free(&m->outbox.zip);
+    mqtt_zip_free(&m->zip_ws);
+    free(m->outbox.slots);                          ///< 槽位、下标数组与数据区为同一块内存
+
+    for (int c = 0; c < MQTT_RX_CLASS_NUM; ++c) {
+        free(m->rx.slabs[c].mem);
+    }
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    free(m->alias.entries);
+#endif
+    if (m->prop_mutex != NULL) {
+        vSemaphoreDelete(m->prop_mutex);
+    }
+    if (m->ack.window_sem != NULL) {
+        vSemaphoreDelete(m->ack.window_sem);
+    }
+
+    if (s_spool_owner == m) {
+        s_spool_owner = NULL;                       ///< 缓存内容保留，可由下一个实例接管
+    }
+    if (s_default == m) {
+        s_default = NULL;
+    }
+    free(m);
+}
+
+mqtt_module_handle_t mqtt_module_get_default(void)
+{
+    return s_default;
+}
+
+esp_err_t mqtt_module_inst_start(mqtt_module_handle_t m)
+{
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    }
+
+    /* 启动 MQTT 客户端（内部将自动重连等） */
+    esp_err_t ret = esp_mqtt_client_start(m->client); ///< 启动客户端
+    if (ret != ESP_OK) {                            ///< 启动失败
+        ESP_LOGE(TAG, "esp_mqtt_client_start failed: %s", ///< 打印错误
+                 esp_err_to_name(ret));             ///< 错误码转字符串
+        return ret;                                 ///< 返回错误
+    }
+
+    return ESP_OK;                                  ///< 返回成功
+}
+
+esp_err_t mqtt_module_inst_stop(mqtt_module_handle_t m)
+{
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    }
+
+    /* 停止客户端，不销毁句柄，便于后续再次启动 */
+    esp_err_t ret = esp_mqtt_client_stop(m->client); ///< 停止客户端
+    if (ret != ESP_OK) {                            ///< 停止失败
+        ESP_LOGE(TAG, "esp_mqtt_client_stop failed: %s", ///< 打印错误
+                 esp_err_to_name(ret));             ///< 错误码转字符串
+        return ret;                                 ///< 返回错误
+    }
+
+    return ESP_OK;                                  ///< 返回成功
+}
+
+esp_err_t mqtt_module_inst_reconnect(mqtt_module_handle_t m)
+{
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    }
+
+    /* 客户端可能仍在运行（连接中/等待重连），也可能已因断开而停止，先统一停掉 */
+    (void)esp_mqtt_client_stop(m->client);         ///< 未运行时返回失败，忽略
+
+    return mqtt_module_inst_start(m);               ///< 重新启动即发起一次连接
+}
+
+esp_err_t mqtt_module_inst_set_uri(mqtt_module_handle_t m, const char *uri)
+{
+    if (m == NULL || m->client == NULL) {          ///< 未创建或无客户端
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    }
+
+    if (uri == NULL || uri[0] == '\0') {           ///< URI 非法
+        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+    }
+
+    /* 新地址在下次连接时生效，先停掉可能仍在连接旧服务器的客户端 */
+    (void)esp_mqtt_client_stop(m->client);          ///< 未运行时返回失败，忽略
+
+    esp_err_t ret = esp_mqtt_client_set_uri(m->client, uri);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "esp_mqtt_client_set_uri failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    m->cfg.broker_uri = uri;                        ///< 与实际连接的服务器保持一致
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_inst_publish(mqtt_module_handle_t m,
+                                   const char          *topic,
+                                   const void          *payload,
+                                   int                  len,
+                                   int                  qos,
+                                   bool                 retain)
+{
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    }
+
+    if (topic == NULL || topic[0] == '\0') {       ///< Topic 非法
+        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+    }
+
+    if (len < 0) {                                  ///< 长度为负数
+        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+    }
+
+    /* 启用出站队列且负载可放入槽位时，入队后立即返回 */
+    if (m->outbox.slots != NULL &&
+        len <= m->cfg.outbox_payload_max &&
+        (int)strlen(topic) < m->cfg.outbox_topic_max) {
+        return mqtt_module_inst_publish_enqueue(m, topic, payload, len, qos, retain, NULL);
+    }
+
+    if (!mqtt_user_enter(m)) {
+        return ESP_ERR_INVALID_STATE;               ///< 实例销毁中
+    }
+    if (qos > 0 && !mqtt_window_acquire(m, pdMS_TO_TICKS(m->cfg.inflight_wait_ms))) {
+        mqtt_user_leave(m);
+        return ESP_ERR_TIMEOUT;                     ///< 在途窗口已满
+    }
+
+    /* 同步路径只承载超出槽位的大负载，压缩使用实例创建时分配的工作区 */
+    int msg_id = mqtt_client_send(m, topic, payload, len, qos, retain, false, &m->zip_ws); ///< 同步发布
+    mqtt_user_leave(m);
+
+    if (msg_id < 0) {                               ///< 发布失败
+        ESP_LOGE(TAG, "esp_mqtt_client_publish failed, ret=%d", msg_id);
+        return ESP_FAIL;                            ///< 返回失败
+    }
+
+    return ESP_OK;                                  ///< 返回成功
+}
+
+esp_err_t mqtt_module_inst_publish_props(mqtt_module_handle_t           m,
+                                         const char                    *topic,
+                                         const void                    *payload,
+                                         int                            len,
+                                         int                            qos,
+                                         bool                           retain,
+                                         const mqtt_module_msg_props_t *props)
+{
+    if (m == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!m->v5 || props == NULL ||
+        (props->response_topic == NULL && props->correlation_data == NULL)) {
+        return mqtt_module_inst_publish(m, topic, payload, len, qos, retain);
+    }
+
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    if (topic == NULL || topic[0] == '\0' || len < 0 ||
+        props->correlation_data_len < 0 || props->correlation_data_len > UINT16_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_mqtt5_publish_property_config_t prop = { 0 };
+    prop.response_topic       = props->response_topic;
+    prop.correlation_data     = (const char *)props->correlation_data;
+    prop.correlation_data_len = (uint16_t)props->correlation_data_len;
+
+    if (!mqtt_user_enter(m)) {
+        return ESP_ERR_INVALID_STATE;               ///< 实例销毁中
+    }
+    if (qos > 0 && !mqtt_window_acquire(m, pdMS_TO_TICKS(m->cfg.inflight_wait_ms))) {
+        mqtt_user_leave(m);
+        return ESP_ERR_TIMEOUT;                     ///< 在途窗口已满
+    }
 
-    case MQTT_EVENT_DISCONNECTED:                  ///< 断开连接事件
-        ESP_LOGW(TAG, "MQTT disconnected");       ///< 打印警告日志
-        mqtt_module_dispatch_event(MQTT_MODULE_EVENT_DISCONNECTED); ///< 上报断开
-        break;                                     ///< 结束分支
+    uint32_t sent_ms = mqtt_ack_now_ms();
 
-    case MQTT_EVENT_ERROR:                         ///< 错误事件
-        ESP_LOGE(TAG, "MQTT error");             ///< 打印错误日志
-        mqtt_module_dispatch_event(MQTT_MODULE_EVENT_ERROR); ///< 上报错误
-        break;                                     ///< 结束分支
+    mqtt_prop_lock(m);
+    int msg_id = -1;
+    if (esp_mqtt5_client_set_publish_property(m->client, &prop) == ESP_OK) {
+        msg_id = esp_mqtt_client_publish(m->client, topic, (const char *)payload,
+                                         len, qos, retain);
+    }
+    (void)esp_mqtt5_client_set_publish_property(m->client, &s_no_prop); ///< 不影响后续发布
+    mqtt_prop_unlock(m);
 
-    case MQTT_EVENT_DATA:                          ///< 收到一条 MQTT 消息
-        ESP_LOGI(TAG, "MQTT data: topic=%.*s, len=%d", ///< 打印简单日志
-                 event->topic_len,                  ///< Topic 长度
-                 event->topic,                      ///< Topic 内容
-                 event->data_len);                  ///< 数据长度
+    if (msg_id < 0 && qos > 0) {
+        mqtt_window_release(m);
+    }
+    mqtt_ack_track(m, msg_id, qos, topic, sent_ms);
 
-        if (s_mqtt_cfg.message_cb) {                ///< 若配置了消息回调
-            s_mqtt_cfg.message_cb(                  ///< 调用上层回调
-                event->topic,                       ///< Topic 指针
-                (int)event->topic_len,              ///< Topic 长度
-                (const uint8_t *)event->data,       ///< 负载指针
-                (int)event->data_len);              ///< 负载长度
+    if (msg_id >= 0) {
+        mqtt_trace_inst_record(m->cfg.trace, MQTT_TRACE_DIR_TX, topic, -1, len, msg_id, qos);
+        if (qos == 0 && m->connected) {
+            mqtt_uplink_touch(m);
         }
-        break;                                     ///< 结束分支
+    }
+    mqtt_user_leave(m);
+    if (msg_id < 0) {
+        ESP_LOGE(TAG, "publish with properties failed, topic=%s, ret=%d", topic, msg_id);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;                   ///< m->v5 只在开启 MQTT 5.0 时为 true
+#endif
+}
 
-    default:                                       ///< 其他事件暂不关心
-        break;                                     ///< 直接忽略
+esp_err_t mqtt_module_inst_get_alias_stats(mqtt_module_handle_t m, mqtt_module_alias_stats_t *out)
+{
+    if (m == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
+
+    memset(out, 0, sizeof(*out));
+#ifdef CONFIG_MQTT_PROTOCOL_5
+    mqtt_prop_lock(m);
+    *out       = m->alias.stats;
+    out->limit = (uint16_t)((m->alias.limit_gen == m->conn_gen) ? m->alias.limit : m->alias.num);
+    mqtt_prop_unlock(m);
+#endif
+    return ESP_OK;
 }
 
-esp_err_t mqtt_module_init(const mqtt_module_config_t *config)
+esp_err_t mqtt_module_inst_wait_inflight(mqtt_module_handle_t m, uint32_t timeout_ms)
 {
-    /* 若已初始化则直接返回 */
-    if (s_mqtt_inited) {                           ///< 已初始化标志
-        return ESP_OK;                             ///< 直接视为成功
+    if (m == NULL) {
+        return ESP_ERR_INVALID_STATE;
     }
+    if (!mqtt_window_acquire(m, pdMS_TO_TICKS(timeout_ms))) {
+        return ESP_ERR_TIMEOUT;
+    }
+    mqtt_window_release(m);                          ///< 只探测不预留
+    return ESP_OK;
+}
 
-    /* 装载配置：优先使用外部配置，否则使用默认配置 */
-    if (config == NULL) {                          ///< 未传入配置
-        s_mqtt_cfg = MQTT_MODULE_DEFAULT_CONFIG(); ///< 使用默认配置
-    } else {                                       ///< 传入了配置
-        s_mqtt_cfg = *config;                      ///< 直接保存一份副本
+bool mqtt_module_inst_is_v5(mqtt_module_handle_t m)
+{
+    return m != NULL && m->v5;
+}
+
+bool mqtt_module_inst_session_present(mqtt_module_handle_t m)
+{
+    return m != NULL && m->session_present;
+}
+
+uint32_t mqtt_module_inst_last_uplink_ms(mqtt_module_handle_t m)
+{
+    return (m != NULL) ? __atomic_load_n(&m->uplink_ms, __ATOMIC_RELAXED) : 0;
+}
+
+esp_err_t mqtt_module_inst_publish_enqueue(mqtt_module_handle_t  m,
+                                           const char           *topic,
+                                           const void           *payload,
+                                           int                   len,
+                                           int                   qos,
+                                           bool                  retain,
+                                           mqtt_module_ticket_t *ticket)
+{
+    if (m == NULL || m->outbox.slots == NULL) {     ///< 未创建或未启用队列
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
     }
 
-    /* broker_uri 为必填项 */
-    if (s_mqtt_cfg.broker_uri == NULL ||           ///< URI 为空
-        s_mqtt_cfg.broker_uri[0] == '\0') {       ///< 或者空字符串
-        return ESP_ERR_INVALID_ARG;                ///< 返回参数错误
+    if (topic == NULL || topic[0] == '\0' || len < 0 ||
+        (len > 0 && payload == NULL) || qos < 0 || qos > 2) {
+        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
     }
 
-    /* 构造 esp-mqtt 配置 */
-    esp_mqtt_client_config_t mqtt_cfg = (esp_mqtt_client_config_t){ 0 }; ///< 清零配置结构体
+    size_t topic_len = strlen(topic);               ///< Topic 长度
+    if (topic_len >= (size_t)m->cfg.outbox_topic_max ||
+        len > m->cfg.outbox_payload_max) {
+        return ESP_ERR_INVALID_SIZE;                ///< 超出槽位大小
+    }
+
+    if (!mqtt_user_enter(m)) {
+        return ESP_ERR_INVALID_STATE;               ///< 实例销毁中
+    }
 
-    mqtt_cfg.broker.address.uri = s_mqtt_cfg.broker_uri; ///< 设置服务器 URI
+    esp_err_t err = ESP_OK;
+    int idx = mqtt_outbox_acquire(m, &err);            ///< 按策略获取槽位
+    if (idx < 0) {
+        mqtt_user_leave(m);
+        return err;                                 ///< 队列满且丢弃本条
+    }
 
-    if (s_mqtt_cfg.client_id != NULL) {            ///< 如配置了 client_id
-        mqtt_cfg.credentials.client_id = s_mqtt_cfg.client_id; ///< 则传递给底层
+    /* 拷贝在锁外完成，槽位此时只属于当前调用方 */
+    mqtt_outbox_slot_t *slot = &m->outbox.slots[idx];
+    memcpy(slot->topic, topic, topic_len + 1);
+    if (len > 0) {
+        memcpy(slot->payload, payload, (size_t)len);
     }
-    if (s_mqtt_cfg.username != NULL) {             ///< 如配置了用户名
-        mqtt_cfg.credentials.username = s_mqtt_cfg.username;   ///< 则传递给底层
+
+    mqtt_outbox_push(m, idx, len, qos, retain, ticket);
+    mqtt_user_leave(m);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_inst_publish_begin(mqtt_module_handle_t         m,
+                                         const char                  *topic,
+                                         int                          max_len,
+                                         mqtt_module_publish_lease_t *lease)
+{
+    if (lease == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
-    if (s_mqtt_cfg.password != NULL) {             ///< 如配置了密码
-        mqtt_cfg.credentials.authentication.password = s_mqtt_cfg.password; ///< 则传递给底层
+    lease->inst = NULL;
+    lease->buf  = NULL;
+    lease->cap  = 0;
+    lease->slot = -1;
+
+    if (m == NULL || m->outbox.slots == NULL) {    ///< 未创建或未启用队列
+        return ESP_ERR_INVALID_STATE;
     }
 
-    if (s_mqtt_cfg.keepalive_sec > 0) {            ///< 配置了 keepalive
-        mqtt_cfg.session.keepalive = (uint16_t)s_mqtt_cfg.keepalive_sec; ///< 使用该值
+    if (topic == NULL || topic[0] == '\0') {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    /* 创建 MQTT 客户端实例 */
-    s_mqtt_client = esp_mqtt_client_init(&mqtt_cfg); ///< 初始化客户端
-    if (s_mqtt_client == NULL) {                    ///< 创建失败
-        ESP_LOGE(TAG, "esp_mqtt_client_init failed"); ///< 打印错误日志
-        return ESP_ERR_NO_MEM;                      ///< 返回内存不足
+    size_t topic_len = strlen(topic);
+    if (topic_len >= (size_t)m->cfg.outbox_topic_max ||
+        max_len > m->cfg.outbox_payload_max) {
+        return ESP_ERR_INVALID_SIZE;                ///< 超出槽位大小
     }
 
-    /* 注册事件回调 */
-    esp_err_t ret = esp_mqtt_client_register_event( ///< 注册事件回调
-        s_mqtt_client,                              ///< 客户端句柄
-        ESP_EVENT_ANY_ID,                           ///< 关心所有事件
-        mqtt_module_event_handler,                  ///< 回调函数
-        NULL);                                      ///< 传入参数（此处未用）
+    if (!mqtt_user_enter(m)) {                      ///< 租约持有使用者计数，提交 / 放弃时注销
+        return ESP_ERR_INVALID_STATE;               ///< 实例销毁中
+    }
 
-    if (ret != ESP_OK) {                            ///< 注册失败
-        ESP_LOGE(TAG, "esp_mqtt_client_register_event failed: %s", ///< 打印错误
-                 esp_err_to_name(ret));             ///< 错误码转字符串
-        esp_mqtt_client_destroy(s_mqtt_client);     ///< 销毁客户端
-        s_mqtt_client = NULL;                       ///< 句柄清空
-        return ret;                                 ///< 返回错误码
+    esp_err_t err = ESP_OK;
+    int idx = mqtt_outbox_acquire(m, &err);            ///< 按策略获取槽位
+    if (idx < 0) {
+        mqtt_user_leave(m);
+        return err;
     }
 
-    s_mqtt_inited = true;                           ///< 标记已初始化
-    return ESP_OK;                                  ///< 返回成功
+    mqtt_outbox_slot_t *slot = &m->outbox.slots[idx];
+    memcpy(slot->topic, topic, topic_len + 1);
+
+    lease->inst = m;                                ///< 提交 / 放弃时据此找到实例
+    lease->buf  = (char *)slot->payload;            ///< 调用方直接写入槽位负载区
+    lease->cap  = m->cfg.outbox_payload_max;
+    lease->slot = idx;
+    return ESP_OK;
 }
 
-esp_err_t mqtt_module_start(void)
+esp_err_t mqtt_module_publish_commit(mqtt_module_publish_lease_t *lease,
+                                     int                          len,
+                                     int                          qos,
+                                     bool                         retain,
+                                     mqtt_module_ticket_t        *ticket)
 {
-    if (!s_mqtt_inited || s_mqtt_client == NULL) {  ///< 未初始化或无客户端
-        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    if (lease == NULL || lease->inst == NULL || lease->slot < 0) {
+        return ESP_ERR_INVALID_STATE;
     }
 
-    /* 启动 MQTT 客户端（内部将自动重连等） */
-    esp_err_t ret = esp_mqtt_client_start(s_mqtt_client); ///< 启动客户端
-    if (ret != ESP_OK) {                            ///< 启动失败
-        ESP_LOGE(TAG, "esp_mqtt_client_start failed: %s", ///< 打印错误
-                 esp_err_to_name(ret));             ///< 错误码转字符串
-        return ret;                                 ///< 返回错误
+    if (len < 0 || len > lease->cap || qos < 0 || qos > 2) {
+        mqtt_module_publish_abort(lease);           ///< 非法参数同样释放槽位
+        return ESP_ERR_INVALID_ARG;
     }
 
-    return ESP_OK;                                  ///< 返回成功
+    mqtt_module_t *m = lease->inst;
+    mqtt_outbox_push(m, lease->slot, len, qos, retain, ticket);
+    mqtt_user_leave(m);
+
+    lease->inst = NULL;
+    lease->buf  = NULL;
+    lease->cap  = 0;
+    lease->slot = -1;
+    return ESP_OK;
 }
 
-esp_err_t mqtt_module_stop(void)
+void mqtt_module_publish_abort(mqtt_module_publish_lease_t *lease)
 {
-    if (!s_mqtt_inited || s_mqtt_client == NULL) {  ///< 未初始化或无客户端
-        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    if (lease == NULL || lease->inst == NULL || lease->slot < 0) {
+        return;
     }
 
-    /* 停止客户端，不销毁句柄，便于后续再次启动 */
-    esp_err_t ret = esp_mqtt_client_stop(s_mqtt_client); ///< 停止客户端
-    if (ret != ESP_OK) {                            ///< 停止失败
-        ESP_LOGE(TAG, "esp_mqtt_client_stop failed: %s", ///< 打印错误
-                 esp_err_to_name(ret));             ///< 错误码转字符串
-        return ret;                                 ///< 返回错误
-    }
+    mqtt_module_t *m = lease->inst;
+    mqtt_outbox_release(m, lease->slot);
+    mqtt_user_leave(m);
 
-    return ESP_OK;                                  ///< 返回成功
+    lease->inst = NULL;
+    lease->buf  = NULL;
+    lease->cap  = 0;
+    lease->slot = -1;
 }
 
-esp_err_t mqtt_module_publish(const char *topic,
-                              const void *payload,
-                              int         len,
-                              int         qos,
-                              bool        retain)
+mqtt_module_ticket_state_t mqtt_module_inst_outbox_ticket_state(mqtt_module_handle_t m,
+                                                                 mqtt_module_ticket_t ticket)
 {
-    if (!s_mqtt_inited || s_mqtt_client == NULL) {  ///< 未初始化或无客户端
-        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    if (m == NULL || m->outbox.slots == NULL || ticket == 0) {
+        return MQTT_MODULE_TICKET_UNKNOWN;
     }
 
-    if (topic == NULL || topic[0] == '\0') {       ///< Topic 非法
-        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+    mqtt_module_ticket_state_t state = MQTT_MODULE_TICKET_UNKNOWN;
+
+    portENTER_CRITICAL(&m->outbox.lock);
+    if ((int32_t)(m->outbox.next_ticket - ticket) >= 0) { ///< 已分配过的票据
+        for (int i = 0; i < m->outbox.capacity; ++i) {  ///< 槽位数很少，直接扫描
+            if (m->outbox.slots[i].queued && m->outbox.slots[i].ticket == ticket) {
+                state = MQTT_MODULE_TICKET_PENDING;
+                break;
+            }
+        }
+        const mqtt_outbox_result_t *r = &m->outbox.results[ticket % (2u * m->outbox.capacity)];
+        if (state != MQTT_MODULE_TICKET_PENDING && r->ticket == ticket) {
+            state = r->state;
+        }
     }
+    portEXIT_CRITICAL(&m->outbox.lock);
+    return state;
+}
 
-    if (len < 0) {                                  ///< 长度为负数
-        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+bool mqtt_module_inst_outbox_is_done(mqtt_module_handle_t m, mqtt_module_ticket_t ticket)
+{
+    if (m == NULL || m->outbox.slots == NULL || ticket == 0) {
+        return false;
     }
 
-    const char *data = (const char *)payload;       ///< 负载按字节视为字符串
+    portENTER_CRITICAL(&m->outbox.lock);
+    bool issued = (int32_t)(m->outbox.next_ticket - ticket) >= 0;
+    portEXIT_CRITICAL(&m->outbox.lock);
 
-    int msg_id = esp_mqtt_client_publish(           ///< 调用底层发布接口
-        s_mqtt_client,                              ///< 客户端句柄
-        topic,                                      ///< Topic 字符串
-        data,                                       ///< 数据指针（可为 NULL）
-        len,                                        ///< 数据长度
-        qos,                                        ///< QoS 等级
-        retain);                                    ///< 是否保留
+    return issued && mqtt_module_inst_outbox_ticket_state(m, ticket) != MQTT_MODULE_TICKET_PENDING;
+}
 
-    if (msg_id < 0) {                               ///< 发布失败
-        ESP_LOGE(TAG, "esp_mqtt_client_publish failed, ret=%d", msg_id);
-        return ESP_FAIL;                            ///< 返回失败
+esp_err_t mqtt_module_inst_get_outbox_stats(mqtt_module_handle_t        m,
+                                            mqtt_module_outbox_stats_t *out)
+{
+    if (m == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
-    return ESP_OK;                                  ///< 返回成功
+    portENTER_CRITICAL(&m->outbox.lock);
+    *out = m->outbox.stats;
+    portEXIT_CRITICAL(&m->outbox.lock);
+    return ESP_OK;
 }
 
-esp_err_t mqtt_module_subscribe(const char *topic, int qos)
+esp_err_t mqtt_module_inst_subscribe(mqtt_module_handle_t m, const char *topic, int qos)
 {
-    if (!s_mqtt_inited || s_mqtt_client == NULL) {  ///< 未初始化或无客户端
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
         return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
     }
 
@@ -245,7 +2341,7 @@ esp_err_t mqtt_module_subscribe(const char *topic, int qos)
     }
 
     int msg_id = esp_mqtt_client_subscribe(        ///< 调用底层订阅接口
-        s_mqtt_client,                              ///< 客户端句柄
+        m->client,                                  ///< 客户端句柄
         topic,                                      ///< Topic 字符串
         qos);                                       ///< QoS 等级
 
@@ -257,9 +2353,44 @@ esp_err_t mqtt_module_subscribe(const char *topic, int qos)
     return ESP_OK;                                  ///< 返回成功
 }
 
-esp_err_t mqtt_module_unsubscribe(const char *topic)
+esp_err_t mqtt_module_inst_subscribe_multiple(mqtt_module_handle_t       m,
+                                              const mqtt_module_topic_t *topics,
+                                              int                        num,
+                                              int                       *msg_id)
+{
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
+        return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
+    }
+
+    if (topics == NULL || num <= 0 || num > MQTT_MODULE_SUBSCRIBE_BATCH_MAX) { ///< 参数非法
+        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+    }
+
+    esp_mqtt_topic_t list[MQTT_MODULE_SUBSCRIBE_BATCH_MAX];
+    for (int i = 0; i < num; ++i) {
+        if (topics[i].filter == NULL || topics[i].filter[0] == '\0' ||
+            topics[i].qos < 0 || topics[i].qos > 2) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        list[i].filter = topics[i].filter;
+        list[i].qos    = topics[i].qos;
+    }
+
+    int id = esp_mqtt_client_subscribe_multiple(m->client, list, num);
+    if (id < 0) {                                   ///< 订阅失败
+        ESP_LOGE(TAG, "esp_mqtt_client_subscribe_multiple failed, ret=%d", id);
+        return ESP_FAIL;                            ///< 返回失败
+    }
+
+    if (msg_id != NULL) {
+        *msg_id = id;
+    }
+    return ESP_OK;                                  ///< 返回成功
+}
+
+esp_err_t mqtt_module_inst_unsubscribe(mqtt_module_handle_t m, const char *topic)
 {
-    if (!s_mqtt_inited || s_mqtt_client == NULL) {  ///< 未初始化或无客户端
+    if (m == NULL || m->client == NULL) {           ///< 未创建或无客户端
         return ESP_ERR_INVALID_STATE;               ///< 返回状态错误
     }
 
@@ -268,7 +2399,7 @@ esp_err_t mqtt_module_unsubscribe(const char *topic)
     }
 
     int msg_id = esp_mqtt_client_unsubscribe(      ///< 调用底层取消订阅接口
-        s_mqtt_client,                              ///< 客户端句柄
+        m->client,                                  ///< 客户端句柄
         topic);                                     ///< Topic 字符串
 
     if (msg_id < 0) {                               ///< 取消失败
@@ -278,3 +2409,267 @@ esp_err_t mqtt_module_unsubscribe(const char *topic)
 
     return ESP_OK;                                  ///< 返回成功
 }
+
+esp_err_t mqtt_module_inst_get_zip_stats(mqtt_module_handle_t m, mqtt_module_zip_stats_t *out)
+{
+    if (m == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&m->zip.lock);
+    *out = m->zip.stats;
+    portEXIT_CRITICAL(&m->zip.lock);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_module_inst_get_ack_stats(mqtt_module_handle_t     m,
+                                         mqtt_module_ack_stats_t *out,
+                                         bool                     reset)
+{
+    if (m == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&m->ack.lock);
+    *out = m->ack.stats;
+    if (reset) {
+        m->ack.stats.tracked     = 0;
+        m->ack.stats.acked       = 0;
+        m->ack.stats.untracked   = 0;
+        m->ack.stats.expired     = 0;
+        m->ack.stats.window_full = 0;
+        m->ack.stats.window_wait = 0;
+        m->ack.stats.unacked_max = m->ack.stats.unacked;
+        memset(m->ack.stats.qos, 0, sizeof(m->ack.stats.qos));
+        memset(m->ack.stats.cls, 0, sizeof(m->ack.stats.cls));
+    }
+    portEXIT_CRITICAL(&m->ack.lock);
+    return ESP_OK;
+}
+
+uint32_t mqtt_module_lat_percentile(const mqtt_module_lat_hist_t *hist, int pct)
+{
+    if (hist == NULL || hist->count == 0) {
+        return 0;
+    }
+    if (pct < 1) {
+        pct = 1;
+    } else if (pct > 100) {
+        pct = 100;
+    }
+
+    uint64_t rank = ((uint64_t)hist->count * (uint32_t)pct + 99) / 100; ///< 第 rank 个样本（向上取整）
+    uint64_t seen = 0;
+    for (int i = 0; i < MQTT_MODULE_LAT_BUCKET_NUM; ++i) {
+        seen += hist->bucket[i];
+        if (seen < rank) {
+            continue;
+        }
+        if (i < 4 || i == MQTT_MODULE_LAT_BUCKET_NUM - 1) {
+            return (i < 4) ? (uint32_t)i : hist->max_ms;
+        }
+        int      e     = i / 4 + 1;                ///< 桶所在 2 的幂区间
+        uint32_t upper = ((uint32_t)(4 + i % 4 + 1) << (e - 2)) - 1;
+        return (upper < hist->max_ms) ? upper : hist->max_ms;
+    }
+    return hist->max_ms;
+}
+
+esp_err_t mqtt_module_inst_get_rx_stats(mqtt_module_handle_t m, mqtt_module_rx_stats_t *out)
+{
+    if (m == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&m->rx.lock);
+    *out = m->rx.stats;
+    portEXIT_CRITICAL(&m->rx.lock);
+    return ESP_OK;
+}
+
+bool mqtt_module_inst_rx_get_props(mqtt_module_handle_t m, mqtt_module_msg_props_t *out)
+{
+    if (m == NULL || out == NULL ||
+        (m->rx.props.response_topic == NULL && m->rx.props.correlation_data == NULL)) {
+        return false;
+    }
+
+    *out = m->rx.props;
+    return true;
+}
+
+bool mqtt_module_inst_rx_detach(mqtt_module_handle_t m, const uint8_t *payload)
+{
+    if (m == NULL || payload == NULL || payload != m->rx.buf || m->rx.received != m->rx.total_len) {
+        return false;                               ///< 非当前已收齐的重组缓冲区
+    }
+
+    m->rx.buf = NULL;                               ///< 交由调用方归还
+    return true;
+}
+
+void mqtt_module_inst_rx_release(mqtt_module_handle_t m, const uint8_t *payload)
+{
+    if (m != NULL && payload != NULL) {
+        mqtt_rx_buf_free(m, (uint8_t *)payload);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                           默认实例（兼容接口）                               */
+/* -------------------------------------------------------------------------- */
+
+esp_err_t mqtt_module_init(const mqtt_module_config_t *config)
+{
+    if (s_default != NULL) {                       ///< 已初始化
+        return ESP_OK;                             ///< 直接视为成功
+    }
+
+    mqtt_module_config_t cfg = (config != NULL) ? *config : MQTT_MODULE_DEFAULT_CONFIG();
+    if (cfg.trace == NULL) {                       ///< 默认实例沿用默认轨迹（RPC "trace" 读取的即是它）
+        cfg.trace = mqtt_trace_get_default();
+    }
+
+    return mqtt_module_create(&cfg, &s_default);
+}
+
+esp_err_t mqtt_module_start(void)
+{
+    return mqtt_module_inst_start(s_default);
+}
+
+esp_err_t mqtt_module_stop(void)
+{
+    return mqtt_module_inst_stop(s_default);
+}
+
+esp_err_t mqtt_module_reconnect(void)
+{
+    return mqtt_module_inst_reconnect(s_default);
+}
+
+esp_err_t mqtt_module_set_uri(const char *uri)
+{
+    return mqtt_module_inst_set_uri(s_default, uri);
+}
+
+esp_err_t mqtt_module_publish(const char *topic,
+                              const void *payload,
+                              int         len,
+                              int         qos,
+                              bool        retain)
+{
+    return mqtt_module_inst_publish(s_default, topic, payload, len, qos, retain);
+}
+
+esp_err_t mqtt_module_publish_props(const char                    *topic,
+                                    const void                    *payload,
+                                    int                            len,
+                                    int                            qos,
+                                    bool                           retain,
+                                    const mqtt_module_msg_props_t *props)
+{
+    return mqtt_module_inst_publish_props(s_default, topic, payload, len, qos, retain, props);
+}
+
+esp_err_t mqtt_module_get_alias_stats(mqtt_module_alias_stats_t *out)
+{
+    return mqtt_module_inst_get_alias_stats(s_default, out);
+}
+
+esp_err_t mqtt_module_wait_inflight(uint32_t timeout_ms)
+{
+    return mqtt_module_inst_wait_inflight(s_default, timeout_ms);
+}
+
+bool mqtt_module_is_v5(void)
+{
+    return mqtt_module_inst_is_v5(s_default);
+}
+
+bool mqtt_module_session_present(void)
+{
+    return mqtt_module_inst_session_present(s_default);
+}
+
+uint32_t mqtt_module_last_uplink_ms(void)
+{
+    return mqtt_module_inst_last_uplink_ms(s_default);
+}
+
+esp_err_t mqtt_module_publish_enqueue(const char           *topic,
+                                      const void           *payload,
+                                      int                   len,
+                                      int                   qos,
+                                      bool                  retain,
+                                      mqtt_module_ticket_t *ticket)
+{
+    return mqtt_module_inst_publish_enqueue(s_default, topic, payload, len, qos, retain, ticket);
+}
+
+esp_err_t mqtt_module_publish_begin(const char                  *topic,
+                                    int                          max_len,
+                                    mqtt_module_publish_lease_t *lease)
+{
+    return mqtt_module_inst_publish_begin(s_default, topic, max_len, lease);
+}
+
+bool mqtt_module_outbox_is_done(mqtt_module_ticket_t ticket)
+{
+    return mqtt_module_inst_outbox_is_done(s_default, ticket);
+}
+
+mqtt_module_ticket_state_t mqtt_module_outbox_ticket_state(mqtt_module_ticket_t ticket)
+{
+    return mqtt_module_inst_outbox_ticket_state(s_default, ticket);
+}
+
+esp_err_t mqtt_module_get_outbox_stats(mqtt_module_outbox_stats_t *out)
+{
+    return mqtt_module_inst_get_outbox_stats(s_default, out);
+}
+
+esp_err_t mqtt_module_subscribe(const char *topic, int qos)
+{
+    return mqtt_module_inst_subscribe(s_default, topic, qos);
+}
+
+esp_err_t mqtt_module_subscribe_multiple(const mqtt_module_topic_t *topics, int num, int *msg_id)
+{
+    return mqtt_module_inst_subscribe_multiple(s_default, topics, num, msg_id);
+}
+
+esp_err_t mqtt_module_unsubscribe(const char *topic)
+{
+    return mqtt_module_inst_unsubscribe(s_default, topic);
+}
+
+esp_err_t mqtt_module_get_zip_stats(mqtt_module_zip_stats_t *out)
+{
+    return mqtt_module_inst_get_zip_stats(s_default, out);
+}
+
+esp_err_t mqtt_module_get_ack_stats(mqtt_module_ack_stats_t *out, bool reset)
+{
+    return mqtt_module_inst_get_ack_stats(s_default, out, reset);
+}
+
+esp_err_t mqtt_module_get_rx_stats(mqtt_module_rx_stats_t *out)
+{
+    return mqtt_module_inst_get_rx_stats(s_default, out);
+}
+
+bool mqtt_module_rx_get_props(mqtt_module_msg_props_t *out)
+{
+    return mqtt_module_inst_rx_get_props(s_default, out);
+}
+
+bool mqtt_module_rx_detach(const uint8_t *payload)
+{
+    return mqtt_module_inst_rx_detach(s_default, payload);
+}
+
+void mqtt_module_rx_release(const uint8_t *payload)
+{
+    mqtt_module_inst_rx_release(s_default, payload);
+}
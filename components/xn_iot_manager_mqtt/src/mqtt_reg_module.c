@@ -7,8 +7,12 @@
  * @Description: 设备注册模块实现
  *
  * 功能概述：
- *  - 在 MQTT 连接建立后，向服务器查询当前设备是否已注册；
- *  - 收到注册相关回复后标记注册完成；
+ *  - 在 MQTT 连接建立且订阅完成后，向服务器查询当前设备是否已注册；
+ *  - 查询带回复截止时间，超时后按带抖动的指数退避重试，连续 reg_retry_max 次失败进入 FAILED，
+ *    此后仍按最大间隔继续查询，单条报文丢失不会让设备永远停留在未注册状态；
+ *  - 收到注册相关回复后标记注册完成，并把服务器签发的令牌与过期时间缓存到 NVS；
+ *  - 重启或重连时若缓存有效，直接视为已注册，只上行一条 QoS0 的 reg/check 供服务器校验令牌，
+ *    服务器校验失败时才会按完整注册处理并回复新令牌；
  *  - 后续可供心跳模块查询注册状态。
  *
  * 具体报文格式可根据实际后台约定在此模块内调整，这里仅给出简单占位实现。
@@ -16,8 +20,14 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 
+#include "freertos/FreeRTOS.h"
 #include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs.h"
 
 #include "mqtt_module.h"
 #include "mqtt_app_module.h"
@@ -26,8 +36,34 @@
 /* 日志 TAG */
 static const char *TAG = "mqtt_reg";              ///< 本模块日志 TAG
 
+#define MQTT_REG_NVS_NAMESPACE "xn_mqtt_reg"       ///< 注册缓存所在 NVS 命名空间
+#define MQTT_REG_NVS_KEY       "cache"             ///< 注册缓存键
+#define MQTT_REG_TOKEN_MAX     64                  ///< 令牌最大长度（不含 '\0'）
+#define MQTT_REG_TIME_VALID    1700000000          ///< 系统时间大于该值才认为已同步，可据此判断过期
+#define MQTT_REG_TIMEOUT_MS    5000                ///< 未配置 reg_timeout_ms 时的回复截止时间
+
+/**
+ * @brief NVS 中保存的注册缓存
+ */
+typedef struct {
+    uint32_t id_hash;                              ///< 设备 ID 的 FNV-1a 哈希，ID 变化后缓存作废
+    int64_t  expires;                              ///< 令牌过期时间（服务器下发的 unix 秒）
+    char     token[MQTT_REG_TOKEN_MAX + 1];        ///< 服务器签发的令牌
+} mqtt_reg_cache_t;
+
 static const web_mqtt_manager_config_t *s_mgr_cfg = NULL; ///< 保存管理器配置指针
-static bool                             s_registered = false; ///< 是否已注册
+static mqtt_reg_notify_cb_t             s_notify  = NULL; ///< 状态变化通知
+static mqtt_reg_cache_t                 s_cache;   ///< 注册缓存（token 为空表示无缓存），初始化后由 s_lock 保护，使用时先取快照
+
+/* 握手状态（分发线程与管理状态机共同访问，由 s_lock 保护） */
+static portMUX_TYPE      s_lock         = portMUX_INITIALIZER_UNLOCKED;
+static mqtt_reg_state_t  s_state        = MQTT_REG_STATE_IDLE; ///< 当前状态
+static bool              s_connected    = false; ///< 是否处于连接中
+static bool              s_wait_resp    = false; ///< 已发送查询，正在等待回复
+static uint32_t          s_attempt      = 0;     ///< 本次连接内连续超时次数
+static int64_t           s_connected_us = 0;     ///< 本次连接建立时刻
+static int64_t           s_due_us       = 0;     ///< 等待回复时为截止时刻，否则为下次发送时刻
+static mqtt_reg_stats_t  s_stats;                ///< 统计信息
 
 /**
  * @brief 内部辅助：设备唯一标识
@@ -43,72 +79,260 @@ static const char *mqtt_reg_get_device_id(void)
 }
 
 /**
- * @brief 设备注册模块的消息回调
+ * @brief 内部辅助：设备 ID 哈希（FNV-1a）
+ */
+static uint32_t mqtt_reg_id_hash(const char *id)
+{
+    uint32_t h = 2166136261u;
+    while (*id != '\0') {
+        h = (h ^ (uint8_t)*id++) * 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief 内部辅助：缓存快照是否可用（存在、属于本设备，且在系统时间已同步时未过期）
+ */
+static bool mqtt_reg_cache_valid(const mqtt_reg_cache_t *cache)
+{
+    if (cache->token[0] == '\0' || cache->id_hash != mqtt_reg_id_hash(mqtt_reg_get_device_id())) {
+        return false;
+    }
+
+    time_t now = time(NULL);                       ///< 未同步时无法判断过期，交由服务器校验令牌
+    return now < MQTT_REG_TIME_VALID || (int64_t)now < cache->expires;
+}
+
+/**
+ * @brief 内部辅助：从 NVS 读取注册缓存
+ */
+static void mqtt_reg_cache_load(void)
+{
+    nvs_handle_t handle;
+    size_t       len = sizeof(s_cache);
+
+    memset(&s_cache, 0, sizeof(s_cache));
+    if (nvs_open(MQTT_REG_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;                                    ///< 命名空间不存在即无缓存
+    }
+    if (nvs_get_blob(handle, MQTT_REG_NVS_KEY, &s_cache, &len) != ESP_OK || len != sizeof(s_cache)) {
+        memset(&s_cache, 0, sizeof(s_cache));
+    }
+    s_cache.token[MQTT_REG_TOKEN_MAX] = '\0';
+    nvs_close(handle);
+}
+
+/**
+ * @brief 内部辅助：写入或清除 NVS 中的注册缓存
  *
- * 注册到管理器时使用的回调：只要 Topic 前缀匹配 base_topic+"/reg" 即会被调用。
- * 这里简单地认为：只要收到任意来自服务器的 reg 相关回复，即表示注册成功。
+ * @param cache 为 NULL 时清除缓存
  */
-static esp_err_t mqtt_reg_module_on_message(const char    *topic,
-                                            int            topic_len,
-                                            const uint8_t *payload,
-                                            int            payload_len)
+static void mqtt_reg_cache_store(const mqtt_reg_cache_t *cache)
 {
-    (void)payload;
-    (void)payload_len;
+    nvs_handle_t handle;
+    esp_err_t    ret = nvs_open(MQTT_REG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "nvs_open failed: %s", esp_err_to_name(ret));
+        return;
+    }
 
-    if (s_mgr_cfg == NULL || s_mgr_cfg->base_topic == NULL || topic == NULL) {
-        return ESP_OK;
+    if (cache != NULL) {
+        ret = nvs_set_blob(handle, MQTT_REG_NVS_KEY, cache, sizeof(*cache));
+    } else {
+        ret = nvs_erase_key(handle, MQTT_REG_NVS_KEY);
+        ret = (ret == ESP_ERR_NVS_NOT_FOUND) ? ESP_OK : ret;
     }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
 
-    const char *device_id = mqtt_reg_get_device_id();
-    if (device_id == NULL || device_id[0] == '\0') {
-        return ESP_OK;
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "save reg cache failed: %s", esp_err_to_name(ret));
     }
+}
 
-    char prefix[128];
-    int  n = snprintf(prefix, sizeof(prefix), "%s/reg/", s_mgr_cfg->base_topic);
-    if (n <= 0 || n >= (int)sizeof(prefix)) {
-        return ESP_OK;
+/**
+ * @brief 内部辅助：在 JSON 文本中查找 "key": 之后的值起始位置
+ *
+ * 回复由服务器按固定格式生成，只做简单的键查找，不处理嵌套与转义。
+ */
+static const char *mqtt_reg_json_value(const char *json, int len, const char *key)
+{
+    size_t      klen = strlen(key);
+    const char *end  = json + len;
+
+    for (const char *p = json; p + klen + 2 <= end; ++p) {
+        if (p[0] != '"' || memcmp(p + 1, key, klen) != 0 || p[klen + 1] != '"') {
+            continue;
+        }
+        p += klen + 2;
+        while (p < end && (*p == ' ' || *p == ':')) {
+            ++p;
+        }
+        return (p < end) ? p : NULL;
     }
+    return NULL;
+}
 
-    int prefix_len = n;
-    size_t dev_len = strlen(device_id);
-    int suffix_len = 5; /* strlen("/resp") */
+/**
+ * @brief 内部辅助：reg/query 回复截止时间（ms）
+ */
+static uint32_t mqtt_reg_timeout_ms(void)
+{
+    return (s_mgr_cfg->reg_timeout_ms > 0) ? (uint32_t)s_mgr_cfg->reg_timeout_ms : MQTT_REG_TIMEOUT_MS;
+}
 
-    if (topic_len != prefix_len + (int)dev_len + suffix_len) {
-        return ESP_OK;
+/**
+ * @brief 内部辅助：第 attempt 次超时后的重试等待（us）
+ *
+ * 窗口为 reg_timeout_ms * 2^attempt，上限 reconnect_max_ms，在窗口后半段内随机，
+ * 整批设备同时重连时查询被打散，同时保证每次至少等待半个窗口。
+ */
+static int64_t mqtt_reg_backoff_us(uint32_t attempt)
+{
+    uint32_t base   = mqtt_reg_timeout_ms();
+    uint32_t cap    = (s_mgr_cfg->reconnect_max_ms > 0) ? (uint32_t)s_mgr_cfg->reconnect_max_ms : base;
+    uint32_t window = cap;
+
+    if (attempt < 16 && (base << attempt) < cap) {
+        window = base << attempt;
+    }
+    if (window < base) {
+        window = base;
     }
 
-    if (memcmp(topic, prefix, prefix_len) != 0) {
+    uint32_t ms = window / 2 + esp_random() % (window / 2 + 1);
+    return (int64_t)ms * 1000;
+}
+
+/**
+ * @brief 内部辅助：进入 REGISTERED 并记录耗时（需持有 s_lock）
+ */
+static void mqtt_reg_set_registered_locked(int64_t now_us)
+{
+    uint32_t ms = (uint32_t)((now_us - s_connected_us) / 1000);
+
+    s_state     = MQTT_REG_STATE_REGISTERED;
+    s_wait_resp = false;
+    s_attempt   = 0;
+    s_stats.last_ms = ms;
+    mqtt_module_lat_record(&s_stats.latency, ms);
+}
+
+/**
+ * @brief 设备注册模块的消息回调
+ *
+ * 由管理器路由器按 base_topic/reg/<client_id>/# 分发，Topic 已切分好。
+ * 收到 base_topic/reg/<device_id>/resp 即表示注册结果：
+ *  - "registered": false 时清除缓存并回到未注册；
+ *  - 其余情况视为注册成功，回复中带有 "token" / "expires" 时更新 NVS 缓存。
+ *
+ * 在分发线程中执行（写 NVS 可能阻塞数毫秒，不放在 esp-mqtt 任务中）。
+ */
+static esp_err_t mqtt_reg_module_on_message(const web_mqtt_topic_t *topic,
+                                            const uint8_t          *payload,
+                                            int                     payload_len)
+{
+    if (!topic->for_device ||                      ///< 非发给本设备
+        topic->seg_num != topic->cmd_index + 1 ||  ///< 只接受单级命令
+        !web_mqtt_topic_seg_is(topic, topic->cmd_index, "resp")) {
         return ESP_OK;
     }
 
-    if (memcmp(topic + prefix_len, device_id, dev_len) != 0) {
+    const char *json = (const char *)payload;
+    const char *reg  = mqtt_reg_json_value(json, payload_len, "registered");
+    int64_t     now  = esp_timer_get_time();
+
+    if (reg != NULL && strncmp(reg, "false", 5) == 0) {
+        ESP_LOGW(TAG, "server reports unregistered, drop reg cache");
+        portENTER_CRITICAL(&s_lock);
+        bool had_cache = (s_cache.token[0] != '\0');
+        memset(&s_cache, 0, sizeof(s_cache));
+        s_stats.rejected++;
+        if (s_connected) {                         ///< 服务器收到查询即会登记，稍后重新查询确认
+            s_state     = MQTT_REG_STATE_QUERYING;
+            s_wait_resp = false;
+            s_due_us    = now + mqtt_reg_backoff_us(s_attempt++);
+        } else {
+            s_state = MQTT_REG_STATE_IDLE;
+        }
+        portEXIT_CRITICAL(&s_lock);
+        if (had_cache) {
+            mqtt_reg_cache_store(NULL);            ///< 写 NVS 在锁外进行
+        }
+        if (s_notify != NULL) {
+            s_notify();
+        }
         return ESP_OK;
     }
 
-    if (memcmp(topic + prefix_len + (int)dev_len, "/resp", (size_t)suffix_len) != 0) {
-        return ESP_OK;
+    bool changed = false;
+    portENTER_CRITICAL(&s_lock);
+    if (s_connected && s_state != MQTT_REG_STATE_REGISTERED) {
+        mqtt_reg_set_registered_locked(now);
+        changed = true;
+    }
+    uint32_t ms = s_stats.last_ms;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (changed) {
+        ESP_LOGI(TAG, "registered in %u ms", (unsigned)ms);
+        if (s_notify != NULL) {
+            s_notify();
+        }
     }
 
-    ESP_LOGI(TAG, "recv reg message, mark as registered");
-    s_registered = true;
+    const char *tok = mqtt_reg_json_value(json, payload_len, "token");
+    const char *exp = mqtt_reg_json_value(json, payload_len, "expires");
+    if (s_mgr_cfg->reg_cache && tok != NULL && *tok == '"' && exp != NULL) {
+        const char *tok_end = memchr(tok + 1, '"', (size_t)(json + payload_len - tok - 1));
+        size_t      tok_len = (tok_end != NULL) ? (size_t)(tok_end - tok - 1) : 0;
+        if (tok_len > 0 && tok_len <= MQTT_REG_TOKEN_MAX) {
+            mqtt_reg_cache_t cache = { 0 };
+            cache.id_hash = mqtt_reg_id_hash(mqtt_reg_get_device_id());
+            cache.expires = strtoll(exp, NULL, 10);
+            memcpy(cache.token, tok + 1, tok_len);
+
+            portENTER_CRITICAL(&s_lock);
+            bool changed = (memcmp(&cache, &s_cache, sizeof(cache)) != 0); ///< 令牌未变化时不重复写 Flash
+            if (changed) {
+                s_cache = cache;
+            }
+            portEXIT_CRITICAL(&s_lock);
+
+            if (changed) {
+                mqtt_reg_cache_store(&cache);
+            }
+        }
+    }
 
     return ESP_OK;
 }
 
-esp_err_t mqtt_reg_module_init(const web_mqtt_manager_config_t *mgr_cfg)
+esp_err_t mqtt_reg_module_init(const web_mqtt_manager_config_t *mgr_cfg, mqtt_reg_notify_cb_t notify)
 {
     if (mgr_cfg == NULL) {                         ///< 管理器配置不可为空
         return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
     }
 
-    s_mgr_cfg   = mgr_cfg;                         ///< 保存配置指针
-    s_registered = false;                          ///< 初始视为未注册
+    s_mgr_cfg = mgr_cfg;                           ///< 保存配置指针
+    s_notify  = notify;
+    s_state   = MQTT_REG_STATE_IDLE;               ///< 连接建立前视为未注册
+    memset(&s_stats, 0, sizeof(s_stats));
 
-    /* 在管理器中注册本模块的消息回调，使用前缀 "reg" */
-    esp_err_t ret = web_mqtt_manager_register_app("reg", ///< 模块前缀
-                                                   mqtt_reg_module_on_message); ///< 回调
+    /* 读取注册缓存，连接建立时若有效则直接视为已注册，无需等待服务器回复 */
+    memset(&s_cache, 0, sizeof(s_cache));
+    if (mgr_cfg->reg_cache) {
+        mqtt_reg_cache_load();
+    }
+
+    /* 在管理器中注册本模块的消息回调，使用前缀 "reg" 与默认订阅模板 */
+    web_mqtt_app_config_t app_cfg = {
+        .topic_suffix = "reg",                      ///< 模块前缀
+        .route_cb     = mqtt_reg_module_on_message, ///< 回调（可能写 NVS，经分发线程执行）
+    };
+    esp_err_t ret = web_mqtt_manager_register_app_ex(&app_cfg);
     if (ret != ESP_OK) {                           ///< 注册失败
         ESP_LOGE(TAG, "register app failed: %s",  ///< 打印错误日志
                  esp_err_to_name(ret));            ///< 错误码转字符串
@@ -124,23 +348,139 @@ void mqtt_reg_module_on_connected(void)
         return;                                     ///< 直接返回
     }
 
+    mqtt_reg_cache_t cache;                         ///< 快照：分发线程可能同时更新或清除缓存
+    portENTER_CRITICAL(&s_lock);
+    cache = s_cache;
+    portEXIT_CRITICAL(&s_lock);
+
+    int64_t now    = esp_timer_get_time();
+    bool    cached = s_mgr_cfg->reg_cache && mqtt_reg_cache_valid(&cache);
+
+    portENTER_CRITICAL(&s_lock);
+    s_connected    = true;
+    s_connected_us = now;                           ///< 注册耗时的起点
+    s_wait_resp    = false;
+    s_attempt      = 0;
+    s_state        = MQTT_REG_STATE_IDLE;           ///< 等待订阅完成后再查询
+    if (cached) {
+        s_stats.cache_hits++;
+        mqtt_reg_set_registered_locked(now);
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (!cached) {
+        return;
+    }
+
+    /* 缓存有效：直接视为已注册，只上行令牌供服务器校验（丢失也无妨，下次重连再校验） */
     char topic[128];                                ///< Topic 缓冲区
-    const char *device_id = mqtt_reg_get_device_id(); ///< 设备 ID 字符串
+    snprintf(topic, sizeof(topic), "%s/reg/check", WEB_MQTT_UPLINK_BASE_TOPIC);
+    ESP_LOGD(TAG, "send reg check, id=%s", mqtt_reg_get_device_id());
+    (void)mqtt_module_publish_enqueue(topic, cache.token, (int)strlen(cache.token), 0, false, NULL);
+}
 
-    /* 约定查询 Topic: base_topic + "/reg/query" */
-    snprintf(topic, sizeof(topic), "%s/reg/query", WEB_MQTT_UPLINK_BASE_TOPIC);
+void mqtt_reg_module_on_subscribed(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    if (s_connected && s_state == MQTT_REG_STATE_IDLE) {
+        s_state     = MQTT_REG_STATE_QUERYING;
+        s_wait_resp = false;
+        s_due_us    = esp_timer_get_time();        ///< 由管理状态机立即发送
+    }
+    portEXIT_CRITICAL(&s_lock);
+}
+
+void mqtt_reg_module_on_disconnected(void)
+{
+    portENTER_CRITICAL(&s_lock);
+    s_connected = false;
+    s_wait_resp = false;
+    s_state     = MQTT_REG_STATE_IDLE;
+    portEXIT_CRITICAL(&s_lock);
+}
+
+int mqtt_reg_module_step(void)
+{
+    if (s_mgr_cfg == NULL) {
+        return -1;
+    }
+
+    int64_t now       = esp_timer_get_time();
+    bool    send      = false;
+    bool    to_failed = false;
+    int64_t wait_us   = -1;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_connected && (s_state == MQTT_REG_STATE_QUERYING || s_state == MQTT_REG_STATE_FAILED)) {
+        if (s_wait_resp && now >= s_due_us) {      ///< 回复超时，安排重试
+            s_stats.timeouts++;
+            s_wait_resp = false;
+            s_due_us    = now + mqtt_reg_backoff_us(s_attempt++);
+            if (s_state == MQTT_REG_STATE_QUERYING && s_mgr_cfg->reg_retry_max > 0 &&
+                s_attempt >= (uint32_t)s_mgr_cfg->reg_retry_max) {
+                s_state   = MQTT_REG_STATE_FAILED;
+                to_failed = true;
+                s_stats.failed++;
+            }
+        }
+        if (!s_wait_resp && now >= s_due_us) {     ///< 到达发送时刻
+            s_wait_resp = true;
+            s_due_us    = now + (int64_t)mqtt_reg_timeout_ms() * 1000;
+            s_stats.queries++;
+            send = true;
+        }
+        wait_us = s_due_us - now;
+    }
+    uint32_t attempt = s_attempt;
+    portEXIT_CRITICAL(&s_lock);
+
+    if (to_failed) {
+        ESP_LOGW(TAG, "no reg response after %u attempts, keep retrying", (unsigned)attempt);
+    }
+    if (send) {
+        /* 约定查询 Topic: base_topic + "/reg/query" */
+        char        topic[128];                     ///< Topic 缓冲区
+        const char *device_id = mqtt_reg_get_device_id(); ///< 设备 ID 字符串
+        snprintf(topic, sizeof(topic), "%s/reg/query", WEB_MQTT_UPLINK_BASE_TOPIC);
 
-    ESP_LOGI(TAG, "send reg query, id=%s, topic=%s", ///< 打印日志
-             device_id, topic);                      ///< 设备 ID 与 Topic
+        ESP_LOGD(TAG, "send reg query, id=%s, attempt=%u", ///< 发送已记入轨迹，日志仅调试时输出
+                 device_id, (unsigned)attempt);
 
-    (void)mqtt_module_publish(topic,                ///< 发送到查询 Topic
-                               device_id,           ///< 负载使用设备 ID
-                               (int)strlen(device_id), ///< 负载长度
-                               1,                   ///< QoS 1 示例
-                               false);              ///< 不保留
+        /* 在共享事件循环中运行，只放入出站队列，不同步调用客户端 */
+        (void)mqtt_module_publish_enqueue(topic,    ///< 发送到查询 Topic，入队失败按回复超时处理
+                                          device_id, ///< 负载使用设备 ID
+                                          (int)strlen(device_id), ///< 负载长度
+                                          1,        ///< QoS 1
+                                          false,    ///< 不保留
+                                          NULL);    ///< 不关心票据
+    }
+
+    return (wait_us < 0) ? -1 : (int)((wait_us + 999) / 1000);
+}
+
+mqtt_reg_state_t mqtt_reg_module_get_state(void)
+{
+    return (mqtt_reg_state_t)__atomic_load_n(&s_state, __ATOMIC_RELAXED);
 }
 
 bool mqtt_reg_module_is_registered(void)
 {
-    return s_registered;                            ///< 返回注册标志
+    return mqtt_reg_module_get_state() == MQTT_REG_STATE_REGISTERED;
+}
+
+esp_err_t mqtt_reg_module_get_stats(mqtt_reg_stats_t *out, bool reset)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    *out       = s_stats;
+    out->state = s_state;
+    if (reset) {
+        memset(&s_stats, 0, sizeof(s_stats));
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return ESP_OK;
 }
@@ -0,0 +1,587 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-08 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-08 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\src\mqtt_rpc_module.c
+ * @Description: 基于 MQTT 的请求/响应（RPC）模块实现
+ *
+ * 功能概述：
+ *  - 在途调用表：固定大小，关联 ID = (序号 << 8) | 表下标，响应到达时 O(1) 定位；
+ *  - 截止时间：单个 esp_timer 始终对准最早的截止时间，到期后批量超时并重新对准；
+ *  - 服务器请求：按方法名查表执行，回复到 resp / err（或 MQTT 5.0 Response Topic）。
+ */
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "mqtt_module.h"
+#include "mqtt_app_module.h"
+#include "mqtt_rpc_module.h"
+
+/* 日志 TAG */
+static const char *TAG = "mqtt_rpc";              ///< 本模块日志 TAG
+
+#define MQTT_RPC_SLOT_BITS   8                     ///< 关联 ID 中表下标占用的位数
+#define MQTT_RPC_SLOT_MASK   ((1u << MQTT_RPC_SLOT_BITS) - 1u)
+#define MQTT_RPC_CORR_LEN    8                     ///< 关联 ID 的十六进制文本长度
+#define MQTT_RPC_TOPIC_MAX   160                   ///< RPC Topic 最大长度
+
+/**
+ * @brief 在途调用表项
+ */
+typedef struct {
+    uint32_t             id;          ///< 关联 ID，0 表示空闲
+    int64_t              deadline_us; ///< 截止时间（esp_timer 时间）
+    mqtt_rpc_result_cb_t cb;          ///< 结果回调
+    void                *ctx;         ///< 用户参数
+} mqtt_rpc_slot_t;
+
+/**
+ * @brief 已注册的方法
+ */
+typedef struct {
+    char                 name[MQTT_RPC_METHOD_NAME_MAX + 1]; ///< 方法名，空串表示未使用
+    mqtt_rpc_method_cb_t cb;                                 ///< 处理函数
+} mqtt_rpc_method_t;
+
+static const web_mqtt_manager_config_t *s_mgr_cfg = NULL; ///< 管理器配置指针
+
+static portMUX_TYPE        s_lock = portMUX_INITIALIZER_UNLOCKED; ///< 保护在途表、方法表与统计
+static mqtt_rpc_slot_t    *s_slots     = NULL;     ///< 在途调用表
+static int                 s_slot_num  = 0;        ///< 在途表容量
+static int                 s_next_slot = 0;        ///< 下一次分配的起始下标（轮转，减少 ID 复用）
+static uint32_t            s_seq       = 0;        ///< 关联 ID 序号部分
+static uint32_t            s_timeout_ms = 0;       ///< 默认截止时间（ms）
+static mqtt_rpc_stats_t    s_stats;                ///< 统计信息
+static mqtt_rpc_method_t   s_methods[MQTT_RPC_METHOD_MAX_NUM]; ///< 方法表
+
+static esp_timer_handle_t  s_timer       = NULL;   ///< 截止时间定时器
+static SemaphoreHandle_t   s_timer_mutex = NULL;   ///< 串行化定时器重新对准
+static int64_t             s_armed_us    = 0;      ///< 定时器当前对准的截止时间，0 表示未启动
+
+static uint8_t            *s_reply_buf = NULL;     ///< 方法回复缓冲区（同一模块的消息串行执行，可复用）
+static char                s_resp_topic[MQTT_RPC_TOPIC_MAX]; ///< MQTT 5.0 下设备调用携带的 Response Topic
+
+/**
+ * @brief 内部辅助：方法名是否合法（非空、不超长、不含 Topic 分隔符与通配符）
+ */
+static bool mqtt_rpc_name_valid(const char *name, size_t max)
+{
+    if (name == NULL || name[0] == '\0') {
+        return false;
+    }
+
+    size_t n = 0;
+    for (const char *p = name; *p != '\0'; ++p, ++n) {
+        if (*p == '/' || *p == '+' || *p == '#' || n >= max) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 内部辅助：把 8 位十六进制文本解析为关联 ID
+ */
+static bool mqtt_rpc_parse_corr(const char *s, int len, uint32_t *out)
+{
+    if (s == NULL || len != MQTT_RPC_CORR_LEN) {
+        return false;
+    }
+
+    uint32_t v = 0;
+    for (int i = 0; i < len; ++i) {
+        char c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') {
+            v |= (uint32_t)(c - '0');
+        } else if (c >= 'a' && c <= 'f') {
+            v |= (uint32_t)(c - 'a' + 10);
+        } else if (c >= 'A' && c <= 'F') {
+            v |= (uint32_t)(c - 'A' + 10);
+        } else {
+            return false;
+        }
+    }
+
+    *out = v;
+    return v != 0;
+}
+
+/**
+ * @brief 内部辅助：释放在途表项（需持有 s_lock）
+ */
+static void mqtt_rpc_slot_free_locked(mqtt_rpc_slot_t *slot)
+{
+    slot->id  = 0;
+    slot->cb  = NULL;
+    slot->ctx = NULL;
+    s_stats.inflight--;
+}
+
+/**
+ * @brief 内部辅助：让定时器对准更早的截止时间
+ *
+ * 只会提前、不会推后；过期的对准由定时器回调重新计算。
+ */
+static void mqtt_rpc_arm(int64_t deadline_us)
+{
+    (void)xSemaphoreTake(s_timer_mutex, portMAX_DELAY);
+    if (s_armed_us == 0 || deadline_us < s_armed_us) {
+        int64_t delay = deadline_us - esp_timer_get_time();
+        (void)esp_timer_stop(s_timer);             ///< 未启动时返回错误，忽略
+        (void)esp_timer_start_once(s_timer, delay > 0 ? (uint64_t)delay : 1);
+        s_armed_us = deadline_us;
+    }
+    (void)xSemaphoreGive(s_timer_mutex);
+}
+
+/**
+ * @brief 截止时间定时器回调：超时所有到期调用，再对准剩余调用中最早的截止时间
+ */
+static void mqtt_rpc_timer_cb(void *arg)
+{
+    (void)arg;
+
+    (void)xSemaphoreTake(s_timer_mutex, portMAX_DELAY);
+    s_armed_us = 0;                                ///< 之后新发起的调用会自行对准
+    (void)xSemaphoreGive(s_timer_mutex);
+
+    int64_t now  = esp_timer_get_time();
+    int64_t next = 0;
+
+    for (int i = 0; i < s_slot_num; ++i) {
+        mqtt_rpc_slot_t done = { 0 };
+
+        portENTER_CRITICAL(&s_lock);
+        mqtt_rpc_slot_t *slot = &s_slots[i];
+        if (slot->id != 0) {
+            if (slot->deadline_us <= now) {
+                done = *slot;
+                mqtt_rpc_slot_free_locked(slot);
+                s_stats.timeouts++;
+            } else if (next == 0 || slot->deadline_us < next) {
+                next = slot->deadline_us;
+            }
+        }
+        portEXIT_CRITICAL(&s_lock);
+
+        if (done.id != 0) {
+            ESP_LOGW(TAG, "call %08" PRIx32 " timeout", done.id);
+            if (done.cb) {
+                done.cb(done.id, ESP_ERR_TIMEOUT, NULL, 0, done.ctx); ///< 在锁外回调
+            }
+        }
+    }
+
+    if (next != 0) {
+        mqtt_rpc_arm(next);
+    }
+}
+
+/**
+ * @brief 内部辅助：按关联 ID 结束一次在途调用
+ */
+static void mqtt_rpc_complete(uint32_t id, esp_err_t status, const uint8_t *data, int len)
+{
+    uint32_t        idx  = id & MQTT_RPC_SLOT_MASK;
+    mqtt_rpc_slot_t done = { 0 };
+
+    portENTER_CRITICAL(&s_lock);
+    if (id != 0 && idx < (uint32_t)s_slot_num && s_slots[idx].id == id) {
+        done = s_slots[idx];
+        mqtt_rpc_slot_free_locked(&s_slots[idx]);
+        if (status == ESP_OK) {
+            s_stats.completed++;
+        } else {
+            s_stats.failed++;
+        }
+    } else {
+        s_stats.stale++;                            ///< 已超时、已取消或伪造的 ID
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (done.id != 0 && done.cb) {
+        done.cb(id, status, data, len, done.ctx);
+    }
+}
+
+/**
+ * @brief 内部辅助：回复服务器请求
+ *
+ * 请求带 Response Topic 时成功回复到该 Topic、失败回复到 <Response Topic>/err，
+ * 并原样带回 Correlation Data；否则回复到 xn/esp/rpc/<id>/resp|err/<corr>。
+ */
+static void mqtt_rpc_reply(const web_mqtt_topic_t *t,
+                           const char             *corr,
+                           int                     corr_len,
+                           bool                    ok,
+                           const void             *data,
+                           int                     len)
+{
+    char topic[MQTT_RPC_TOPIC_MAX];
+    int  n;
+
+    if (t->response_topic != NULL) {
+        n = snprintf(topic, sizeof(topic), "%s%s", t->response_topic, ok ? "" : "/err");
+    } else {
+        n = snprintf(topic, sizeof(topic), "%s/rpc/%s/%s/%.*s", WEB_MQTT_UPLINK_BASE_TOPIC,
+                     s_mgr_cfg->client_id, ok ? "resp" : "err", corr_len, corr);
+    }
+    if (n <= 0 || n >= (int)sizeof(topic)) {
+        ESP_LOGW(TAG, "reply topic too long, drop");
+        return;
+    }
+
+    mqtt_module_msg_props_t props = {
+        .correlation_data     = t->correlation_data,
+        .correlation_data_len = t->correlation_data_len,
+    };
+
+    esp_err_t ret = mqtt_module_publish_props(topic, data, len, 1, false, &props);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "reply publish failed: %s", esp_err_to_name(ret));
+    }
+}
+
+/**
+ * @brief 内部辅助：执行服务器下发的请求并回复
+ */
+static void mqtt_rpc_handle_request(const web_mqtt_topic_t *t,
+                                    const uint8_t          *payload,
+                                    int                     payload_len)
+{
+    int m = t->cmd_index + 1;                       ///< 方法名所在层级
+    if (m >= t->seg_num) {
+        return;
+    }
+
+    /* 关联 ID：3.1.1 取 Topic 末层，MQTT 5.0 可改由 Correlation Data 携带 */
+    const char *corr     = NULL;
+    int         corr_len = 0;
+    if (m + 1 < t->seg_num) {
+        corr     = t->seg[m + 1];
+        corr_len = t->seg_len[m + 1];
+    }
+    bool can_reply = corr_len > 0 || t->response_topic != NULL;
+
+    mqtt_rpc_method_cb_t cb = NULL;
+    portENTER_CRITICAL(&s_lock);
+    s_stats.requests++;
+    for (int i = 0; i < MQTT_RPC_METHOD_MAX_NUM; ++i) {
+        size_t n = strlen(s_methods[i].name);
+        if (n > 0 && n == t->seg_len[m] && memcmp(s_methods[i].name, t->seg[m], n) == 0) {
+            cb = s_methods[i].cb;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    mqtt_rpc_reply_t reply = {
+        .buf = s_reply_buf,
+        .cap = MQTT_RPC_REPLY_MAX_LEN,
+        .len = 0,
+    };
+    esp_err_t ret = (cb != NULL) ? cb(payload, payload_len, &reply) : ESP_ERR_NOT_FOUND;
+
+    if (reply.len < 0 || reply.len > reply.cap) {   ///< 处理函数写越界的长度按空回复处理
+        reply.len = 0;
+    }
+
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.request_errors++;
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGW(TAG, "request '%.*s' failed: %s", t->seg_len[m], t->seg[m], esp_err_to_name(ret));
+    }
+
+    if (!can_reply) {
+        return;                                     ///< 无关联 ID，视为单向通知
+    }
+
+    if (ret == ESP_OK) {
+        mqtt_rpc_reply(t, corr, corr_len, true, reply.buf, reply.len);
+    } else if (reply.len > 0) {
+        mqtt_rpc_reply(t, corr, corr_len, false, reply.buf, reply.len);
+    } else {
+        const char *name = esp_err_to_name(ret);
+        mqtt_rpc_reply(t, corr, corr_len, false, name, (int)strlen(name));
+    }
+}
+
+/**
+ * @brief RPC 模块的消息回调
+ *
+ * 由管理器路由器按 base_topic/rpc/<client_id>/# 与 broadcast/# 分发：
+ *  - resp/<corr>、err/<corr>：设备发起调用的响应（MQTT 5.0 下为 resp 与 resp/err，关联 ID 取自属性）；
+ *  - req/<method>/<corr>    ：服务器发起的调用（广播请求各设备分别回复）。
+ */
+static esp_err_t mqtt_rpc_on_message(const web_mqtt_topic_t *t,
+                                     const uint8_t          *payload,
+                                     int                     payload_len)
+{
+    int cmd = t->cmd_index;
+    if (cmd >= t->seg_num) {
+        return ESP_OK;
+    }
+
+    if (web_mqtt_topic_seg_is(t, cmd, "req")) {
+        mqtt_rpc_handle_request(t, payload, payload_len);
+        return ESP_OK;
+    }
+
+    if (!t->for_device) {
+        return ESP_OK;                              ///< 响应只可能发给本设备
+    }
+
+    bool is_resp = web_mqtt_topic_seg_is(t, cmd, "resp");
+    if (!is_resp && !web_mqtt_topic_seg_is(t, cmd, "err")) {
+        return ESP_OK;
+    }
+
+    bool     ok = is_resp;
+    uint32_t id = 0;
+    bool     found;
+    if (is_resp && web_mqtt_topic_seg_is(t, cmd + 1, "err")) {
+        ok    = false;                              ///< MQTT 5.0：<Response Topic>/err
+        found = t->correlation_data != NULL &&
+                mqtt_rpc_parse_corr((const char *)t->correlation_data, t->correlation_data_len, &id);
+    } else if (cmd + 1 < t->seg_num) {
+        found = mqtt_rpc_parse_corr(t->seg[cmd + 1], t->seg_len[cmd + 1], &id);
+    } else {
+        found = t->correlation_data != NULL &&
+                mqtt_rpc_parse_corr((const char *)t->correlation_data, t->correlation_data_len, &id);
+    }
+
+    if (!found) {
+        portENTER_CRITICAL(&s_lock);
+        s_stats.stale++;
+        portEXIT_CRITICAL(&s_lock);
+        return ESP_OK;
+    }
+
+    mqtt_rpc_complete(id, ok ? ESP_OK : ESP_FAIL, payload, payload_len);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_rpc_module_init(const web_mqtt_manager_config_t *mgr_cfg)
+{
+    if (mgr_cfg == NULL || mgr_cfg->client_id == NULL) { ///< 管理器配置不可为空
+        return ESP_ERR_INVALID_ARG;                 ///< 返回参数错误
+    }
+
+    if (s_slots != NULL) {                         ///< 已初始化
+        return ESP_OK;                              ///< 直接视为成功
+    }
+
+    int num = mgr_cfg->rpc_inflight_max;
+    if (num <= 0 || num > MQTT_RPC_INFLIGHT_MAX_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_mgr_cfg    = mgr_cfg;                        ///< 保存配置指针
+    s_timeout_ms = mgr_cfg->rpc_timeout_ms > 0 ? (uint32_t)mgr_cfg->rpc_timeout_ms : 5000;
+
+    if (mgr_cfg->base_topic != NULL) {
+        snprintf(s_resp_topic, sizeof(s_resp_topic), "%s/rpc/%s/resp",
+                 mgr_cfg->base_topic, mgr_cfg->client_id);
+    }
+
+    s_timer_mutex = xSemaphoreCreateMutex();
+    s_reply_buf   = (uint8_t *)malloc(MQTT_RPC_REPLY_MAX_LEN);
+    mqtt_rpc_slot_t *slots = (mqtt_rpc_slot_t *)calloc((size_t)num, sizeof(mqtt_rpc_slot_t));
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = mqtt_rpc_timer_cb,
+        .name     = "mqtt_rpc",
+    };
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    if (s_timer_mutex != NULL && s_reply_buf != NULL && slots != NULL) {
+        ret = esp_timer_create(&timer_args, &s_timer);
+    }
+    if (ret != ESP_OK) {
+        free(slots);
+        free(s_reply_buf);
+        s_reply_buf = NULL;
+        if (s_timer_mutex != NULL) {
+            vSemaphoreDelete(s_timer_mutex);
+            s_timer_mutex = NULL;
+        }
+        return ret;
+    }
+
+    s_slot_num = num;
+    s_slots    = slots;
+
+    /* 在管理器中注册本模块，分发队列与在途表同深度，服务器可流水线下发请求 */
+    web_mqtt_app_config_t app_cfg = {
+        .topic_suffix = "rpc",                      ///< 模块前缀
+        .route_cb     = mqtt_rpc_on_message,        ///< 回调
+        .queue_len    = num,                        ///< 分发队列长度
+    };
+    ret = web_mqtt_manager_register_app_ex(&app_cfg);
+    if (ret != ESP_OK) {                           ///< 注册失败
+        ESP_LOGE(TAG, "register app failed: %s",  ///< 打印错误日志
+                 esp_err_to_name(ret));            ///< 错误码转字符串
+        return ret;                                 ///< 返回错误
+    }
+
+    return ESP_OK;                                  ///< 返回成功
+}
+
+esp_err_t mqtt_rpc_call(const char          *method,
+                        const void          *params,
+                        int                  params_len,
+                        uint32_t             timeout_ms,
+                        mqtt_rpc_result_cb_t cb,
+                        void                *ctx,
+                        uint32_t            *call_id)
+{
+    if (s_slots == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    if (!mqtt_rpc_name_valid(method, MQTT_RPC_METHOD_NAME_MAX) ||
+        params_len < 0 || (params == NULL && params_len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (timeout_ms == 0) {
+        timeout_ms = s_timeout_ms;
+    }
+    int64_t deadline = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+
+    /* 先登记再发布，保证响应再快也能找到在途表项 */
+    uint32_t id  = 0;
+    int      idx = -1;
+    portENTER_CRITICAL(&s_lock);
+    for (int n = 0; n < s_slot_num; ++n) {
+        int i = (s_next_slot + n) % s_slot_num;
+        if (s_slots[i].id != 0) {
+            continue;
+        }
+        s_seq = (s_seq + 1) & (UINT32_MAX >> MQTT_RPC_SLOT_BITS);
+        if (s_seq == 0) {
+            s_seq = 1;                              ///< 保证关联 ID 不为 0
+        }
+        idx = i;
+        id  = (s_seq << MQTT_RPC_SLOT_BITS) | (uint32_t)i;
+        s_slots[i].id          = id;
+        s_slots[i].deadline_us = deadline;
+        s_slots[i].cb          = cb;
+        s_slots[i].ctx         = ctx;
+        s_next_slot            = (i + 1) % s_slot_num;
+        s_stats.calls++;
+        s_stats.inflight++;
+        if (s_stats.inflight > s_stats.high_water) {
+            s_stats.high_water = s_stats.inflight;
+        }
+        break;
+    }
+    if (idx < 0) {
+        s_stats.rejected++;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    if (idx < 0) {
+        return ESP_ERR_NO_MEM;                      ///< 在途表已满
+    }
+
+    if (call_id != NULL) {
+        *call_id = id;
+    }
+    mqtt_rpc_arm(deadline);
+
+    char corr[MQTT_RPC_CORR_LEN + 1];
+    char topic[MQTT_RPC_TOPIC_MAX];
+    snprintf(corr, sizeof(corr), "%08" PRIx32, id);
+    int n = snprintf(topic, sizeof(topic), "%s/rpc/%s/req/%s/%s", WEB_MQTT_UPLINK_BASE_TOPIC,
+                     s_mgr_cfg->client_id, method, corr);
+
+    mqtt_module_msg_props_t props = {
+        .response_topic       = s_resp_topic[0] != '\0' ? s_resp_topic : NULL,
+        .response_topic_len   = (int)strlen(s_resp_topic),
+        .correlation_data     = (const uint8_t *)corr,
+        .correlation_data_len = MQTT_RPC_CORR_LEN,
+    };
+
+    esp_err_t ret = (n > 0 && n < (int)sizeof(topic))
+                        ? mqtt_module_publish_props(topic, params, params_len, 1, false, &props)
+                        : ESP_ERR_INVALID_SIZE;
+    if (ret != ESP_OK) {
+        portENTER_CRITICAL(&s_lock);
+        if (s_slots[idx].id == id) {               ///< 尚未被超时回收
+            mqtt_rpc_slot_free_locked(&s_slots[idx]);
+        }
+        portEXIT_CRITICAL(&s_lock);
+        ESP_LOGW(TAG, "call '%s' publish failed: %s", method, esp_err_to_name(ret));
+    }
+
+    return ret;
+}
+
+esp_err_t mqtt_rpc_cancel(uint32_t call_id)
+{
+    uint32_t  idx = call_id & MQTT_RPC_SLOT_MASK;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    portENTER_CRITICAL(&s_lock);
+    if (call_id != 0 && idx < (uint32_t)s_slot_num && s_slots[idx].id == call_id) {
+        mqtt_rpc_slot_free_locked(&s_slots[idx]);
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return ret;
+}
+
+esp_err_t mqtt_rpc_register_method(const char *name, mqtt_rpc_method_cb_t cb)
+{
+    if (cb == NULL || !mqtt_rpc_name_valid(name, MQTT_RPC_METHOD_NAME_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret      = ESP_ERR_NO_MEM;
+    int       free_idx = -1;
+
+    portENTER_CRITICAL(&s_lock);
+    for (int i = 0; i < MQTT_RPC_METHOD_MAX_NUM; ++i) {
+        if (strcmp(s_methods[i].name, name) == 0) {
+            s_methods[i].cb = cb;                   ///< 同名替换
+            ret = ESP_OK;
+            break;
+        }
+        if (free_idx < 0 && s_methods[i].name[0] == '\0') {
+            free_idx = i;
+        }
+    }
+    if (ret != ESP_OK && free_idx >= 0) {
+        strcpy(s_methods[free_idx].name, name);     ///< 长度已校验
+        s_methods[free_idx].cb = cb;
+        ret = ESP_OK;
+    }
+    portEXIT_CRITICAL(&s_lock);
+
+    return ret;
+}
+
+esp_err_t mqtt_rpc_get_stats(mqtt_rpc_stats_t *out)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_lock);
+    return ESP_OK;
+}
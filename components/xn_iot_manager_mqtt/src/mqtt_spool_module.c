@@ -0,0 +1,611 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-02 10:20:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-02 10:20:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\src\mqtt_spool_module.c
+ * @Description: 离线上行消息 Flash 缓存实现
+ *
+ * 分区布局：
+ *  - 分区按扇区（4KB）切分，每个扇区开头是 16 字节扇区头（魔数 + 递增序号）；
+ *  - 扇区头之后是按 4 字节对齐、首尾相接的记录，记录不跨扇区；
+ *  - 写指针所在扇区序号最大，其后的扇区按环形顺序由旧到新。
+ *
+ * 记录状态只通过把 1 写成 0 来推进（擦除 → 有效 → 已消费），
+ * 消费记录无需擦除扇区；扇区只在写指针绕回时被擦除一次。
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+
+#include "mqtt_spool_module.h"
+
+/* 日志 TAG */
+static const char *TAG = "mqtt_spool";             ///< 本模块日志 TAG
+
+#define SPOOL_SECTOR_SIZE      4096                ///< Flash 扇区大小
+#define SPOOL_SECTOR_MAGIC     0x50534E58u         ///< 扇区头魔数 "XNSP"
+#define SPOOL_FORMAT_VERSION   1u                  ///< 记录格式版本
+#define SPOOL_REC_ERASED       0xFFFFFFFFu         ///< 记录状态：未写入
+#define SPOOL_REC_VALID        0xFFFFA5A5u         ///< 记录状态：有效待回放
+#define SPOOL_REC_CONSUMED     0x0000A5A5u         ///< 记录状态：已消费（VALID 的位子集）
+#define SPOOL_EPOCH_VALID_MIN  1700000000u         ///< 小于该值视为系统时间未同步
+
+/**
+ * @brief 扇区头
+ */
+typedef struct {
+    uint32_t magic;    ///< SPOOL_SECTOR_MAGIC
+    uint32_t seq;      ///< 扇区写入序号，越大越新
+    uint32_t version;  ///< 格式版本
+    uint32_t reserved; ///< 保留，保持 0xFFFFFFFF
+} spool_sector_hdr_t;
+
+/**
+ * @brief 记录头（32 字节）
+ */
+typedef struct {
+    uint32_t state;       ///< 记录状态
+    uint16_t rec_len;     ///< 整条记录长度（含头部，4 字节对齐）
+    uint16_t payload_len; ///< 负载长度
+    uint8_t  topic_len;   ///< Topic 长度（不含 '\0'）
+    uint8_t  flags;       ///< bit0-1: QoS，bit7: retain
+    uint16_t reserved;    ///< 保留
+    uint32_t seq;         ///< 记录序号
+    uint32_t boot_id;     ///< 写入时的启动标识
+    uint32_t uptime_s;    ///< 写入时的开机秒数
+    uint32_t epoch;       ///< 写入时的 UNIX 时间，0 表示未同步
+    uint32_t crc;         ///< rec_len..epoch + Topic + 负载的 CRC32
+} spool_rec_hdr_t;
+
+#define SPOOL_CRC_OFFSET  offsetof(spool_rec_hdr_t, rec_len)
+#define SPOOL_CRC_HDR_LEN (offsetof(spool_rec_hdr_t, crc) - SPOOL_CRC_OFFSET)
+
+/**
+ * @brief 分区内位置
+ */
+typedef struct {
+    uint32_t sector; ///< 扇区下标
+    uint32_t off;    ///< 扇区内偏移
+} spool_pos_t;
+
+/**
+ * @brief 模块状态
+ */
+typedef struct {
+    mqtt_spool_config_t    cfg;         ///< 配置副本
+    const esp_partition_t *part;        ///< 数据分区
+    uint32_t               sector_num;  ///< 扇区数量
+    spool_pos_t            wr;          ///< 写指针
+    uint32_t               wr_seq;      ///< 写指针所在扇区序号
+    spool_pos_t            rd;          ///< 读指针（下一条待检查记录）
+    spool_pos_t            peeked;      ///< 最近一次 peek 到的记录位置
+    bool                   has_peeked;  ///< peeked 是否有效
+    uint32_t               rec_seq;     ///< 下一条记录序号
+    uint32_t               boot_id;     ///< 本次启动标识
+    uint8_t               *buf;         ///< 记录读写缓冲区
+    size_t                 buf_size;    ///< 缓冲区大小
+    mqtt_spool_stats_t     stats;       ///< 统计信息
+    bool                   ready;       ///< 是否已初始化
+} mqtt_spool_t;
+
+static mqtt_spool_t s_spool;
+
+/**
+ * @brief 内部辅助：4 字节对齐
+ */
+static inline uint32_t spool_align4(uint32_t v)
+{
+    return (v + 3u) & ~3u;
+}
+
+/**
+ * @brief 内部辅助：扇区内偏移转分区偏移
+ */
+static inline size_t spool_addr(uint32_t sector, uint32_t off)
+{
+    return (size_t)sector * SPOOL_SECTOR_SIZE + off;
+}
+
+/**
+ * @brief 内部辅助：读取扇区头，魔数与版本均匹配时返回 true
+ */
+static bool spool_read_sector_hdr(uint32_t sector, spool_sector_hdr_t *hdr)
+{
+    if (esp_partition_read(s_spool.part, spool_addr(sector, 0), hdr, sizeof(*hdr)) != ESP_OK) {
+        return false;
+    }
+    return hdr->magic == SPOOL_SECTOR_MAGIC && hdr->version == SPOOL_FORMAT_VERSION;
+}
+
+/**
+ * @brief 内部辅助：检查记录头长度字段是否可信
+ */
+static bool spool_rec_len_ok(const spool_rec_hdr_t *hdr, uint32_t off)
+{
+    return hdr->rec_len >= sizeof(spool_rec_hdr_t) &&
+           (hdr->rec_len & 3u) == 0 &&
+           off + hdr->rec_len <= SPOOL_SECTOR_SIZE;
+}
+
+/**
+ * @brief 内部辅助：扫描扇区，返回写入结束偏移并统计有效记录数
+ */
+static uint32_t spool_scan_sector(uint32_t sector, uint32_t *valid_cnt, uint32_t *first_valid_off)
+{
+    uint32_t off   = sizeof(spool_sector_hdr_t);
+    uint32_t valid = 0;
+    uint32_t first = 0;
+
+    while (off + sizeof(spool_rec_hdr_t) <= SPOOL_SECTOR_SIZE) {
+        spool_rec_hdr_t hdr;
+        if (esp_partition_read(s_spool.part, spool_addr(sector, off), &hdr, sizeof(hdr)) != ESP_OK) {
+            return SPOOL_SECTOR_SIZE;
+        }
+        if (hdr.state == SPOOL_REC_ERASED && hdr.rec_len == 0xFFFF) {
+            break;                                  ///< 到达未写入区域
+        }
+        if (!spool_rec_len_ok(&hdr, off)) {
+            return SPOOL_SECTOR_SIZE;               ///< 长度损坏，本扇区后续不可再写
+        }
+        if (hdr.state == SPOOL_REC_VALID) {
+            if (valid == 0) {
+                first = off;
+            }
+            valid++;
+        }
+        if ((int32_t)(hdr.seq - s_spool.rec_seq) >= 0) {
+            s_spool.rec_seq = hdr.seq + 1;
+        }
+        off += hdr.rec_len;
+    }
+
+    if (valid_cnt) {
+        *valid_cnt = valid;
+    }
+    if (first_valid_off) {
+        *first_valid_off = first;
+    }
+    return off;
+}
+
+/**
+ * @brief 内部辅助：擦除扇区并写入新的扇区头
+ */
+static esp_err_t spool_format_sector(uint32_t sector, uint32_t seq)
+{
+    esp_err_t ret = esp_partition_erase_range(s_spool.part, spool_addr(sector, 0), SPOOL_SECTOR_SIZE);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    s_spool.stats.sector_erases++;
+
+    spool_sector_hdr_t hdr = {
+        .magic    = SPOOL_SECTOR_MAGIC,
+        .seq      = seq,
+        .version  = SPOOL_FORMAT_VERSION,
+        .reserved = 0xFFFFFFFFu,
+    };
+    ret = esp_partition_write(s_spool.part, spool_addr(sector, 0), &hdr, sizeof(hdr));
+    if (ret == ESP_OK) {
+        s_spool.stats.bytes_written += sizeof(hdr);
+    }
+    return ret;
+}
+
+/**
+ * @brief 内部辅助：写指针切换到下一个扇区，必要时覆盖最旧数据
+ */
+static esp_err_t spool_advance_write_sector(void)
+{
+    uint32_t next = (s_spool.wr.sector + 1) % s_spool.sector_num;
+
+    spool_sector_hdr_t hdr;
+    if (spool_read_sector_hdr(next, &hdr)) {
+        uint32_t valid = 0;
+        (void)spool_scan_sector(next, &valid, NULL);
+        if (valid > 0) {
+            ESP_LOGW(TAG, "spool full, overwrite %u records", (unsigned)valid);
+            s_spool.stats.overwritten += valid;
+            s_spool.stats.pending     -= (valid > s_spool.stats.pending) ? s_spool.stats.pending : valid;
+        }
+    }
+
+    /* 读指针位于被覆盖扇区时，跳到剩余数据中最旧的扇区 */
+    if (s_spool.rd.sector == next) {
+        s_spool.rd.sector = (next + 1) % s_spool.sector_num;
+        s_spool.rd.off    = sizeof(spool_sector_hdr_t);
+    }
+    if (s_spool.has_peeked && s_spool.peeked.sector == next) {
+        s_spool.has_peeked = false;
+    }
+
+    esp_err_t ret = spool_format_sector(next, s_spool.wr_seq + 1);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    s_spool.wr_seq++;
+    s_spool.wr.sector = next;
+    s_spool.wr.off    = sizeof(spool_sector_hdr_t);
+    return ESP_OK;
+}
+
+/**
+ * @brief 内部辅助：查找记录对应的过期时间
+ */
+static uint32_t spool_ttl_for(const char *topic)
+{
+    for (int i = 0; i < s_spool.cfg.ttl_rule_num; ++i) {
+        const mqtt_spool_ttl_rule_t *rule = &s_spool.cfg.ttl_rules[i];
+        if (rule->topic_prefix != NULL &&
+            strncmp(topic, rule->topic_prefix, strlen(rule->topic_prefix)) == 0) {
+            return rule->ttl_sec;
+        }
+    }
+    return s_spool.cfg.default_ttl_sec;
+}
+
+/**
+ * @brief 内部辅助：判断记录是否已过期
+ *
+ * 优先使用两端都已同步的 UNIX 时间；否则仅在同一次启动内按开机时间比较，
+ * 跨启动且时间未同步时无法得知真实年龄，按未过期处理。
+ */
+static bool spool_is_expired(const spool_rec_hdr_t *hdr, const char *topic)
+{
+    uint32_t ttl = spool_ttl_for(topic);
+    if (ttl == 0) {
+        return false;
+    }
+
+    uint32_t now_epoch = (uint32_t)time(NULL);
+    if (hdr->epoch >= SPOOL_EPOCH_VALID_MIN && now_epoch >= SPOOL_EPOCH_VALID_MIN) {
+        return now_epoch - hdr->epoch > ttl;
+    }
+
+    if (hdr->boot_id == s_spool.boot_id) {
+        uint32_t now_up = (uint32_t)(esp_timer_get_time() / 1000000);
+        return now_up - hdr->uptime_s > ttl;
+    }
+
+    return false;
+}
+
+/**
+ * @brief 内部辅助：把指定位置的记录标记为已消费
+ */
+static esp_err_t spool_mark_consumed(spool_pos_t pos)
+{
+    uint32_t  state = SPOOL_REC_CONSUMED;
+    esp_err_t ret   = esp_partition_write(s_spool.part, spool_addr(pos.sector, pos.off), &state, sizeof(state));
+    if (ret == ESP_OK) {
+        s_spool.stats.bytes_written += sizeof(state);
+    }
+    return ret;
+}
+
+esp_err_t mqtt_spool_init(const mqtt_spool_config_t *config)
+{
+    if (s_spool.ready) {                           ///< 已初始化
+        return ESP_OK;
+    }
+
+    s_spool.cfg = (config != NULL) ? *config : MQTT_SPOOL_DEFAULT_CONFIG();
+    if (s_spool.cfg.partition_label == NULL || s_spool.cfg.max_payload_len <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_spool.part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                            ESP_PARTITION_SUBTYPE_ANY,
+                                            s_spool.cfg.partition_label);
+    if (s_spool.part == NULL) {
+        ESP_LOGW(TAG, "partition '%s' not found", s_spool.cfg.partition_label);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    s_spool.sector_num = s_spool.part->size / SPOOL_SECTOR_SIZE;
+    if (s_spool.sector_num < 2) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    /* 单条记录必须能放进一个扇区 */
+    s_spool.buf_size = spool_align4(sizeof(spool_rec_hdr_t) + 255 + 1 +
+                                    (uint32_t)s_spool.cfg.max_payload_len);
+    if (s_spool.buf_size > SPOOL_SECTOR_SIZE - sizeof(spool_sector_hdr_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_spool.buf = (uint8_t *)malloc(s_spool.buf_size);
+    if (s_spool.buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_spool.boot_id = esp_random();
+
+    /* 找到序号最大的扇区作为写扇区 */
+    bool     found   = false;
+    uint32_t max_seq = 0;
+    for (uint32_t i = 0; i < s_spool.sector_num; ++i) {
+        spool_sector_hdr_t hdr;
+        if (spool_read_sector_hdr(i, &hdr) &&
+            (!found || (int32_t)(hdr.seq - max_seq) > 0)) {
+            found             = true;
+            max_seq           = hdr.seq;
+            s_spool.wr.sector = i;
+        }
+    }
+
+    if (!found) {
+        esp_err_t ret = spool_format_sector(0, 1);  ///< 全新分区
+        if (ret != ESP_OK) {
+            free(s_spool.buf);
+            s_spool.buf = NULL;
+            return ret;
+        }
+        s_spool.wr_seq    = 1;
+        s_spool.wr.sector = 0;
+        s_spool.wr.off    = sizeof(spool_sector_hdr_t);
+        s_spool.rd        = s_spool.wr;
+    } else {
+        s_spool.wr_seq = max_seq;
+        s_spool.wr.off = spool_scan_sector(s_spool.wr.sector, NULL, NULL);
+
+        /* 从最旧扇区开始统计待回放记录，并定位读指针 */
+        bool rd_found = false;
+        for (uint32_t i = 1; i <= s_spool.sector_num; ++i) {
+            uint32_t sector = (s_spool.wr.sector + i) % s_spool.sector_num;
+            spool_sector_hdr_t hdr;
+            if (!spool_read_sector_hdr(sector, &hdr)) {
+                continue;
+            }
+            uint32_t valid = 0;
+            uint32_t first = 0;
+            (void)spool_scan_sector(sector, &valid, &first);
+            if (valid > 0 && !rd_found) {
+                s_spool.rd.sector = sector;
+                s_spool.rd.off    = first;
+                rd_found          = true;
+            }
+            s_spool.stats.pending += valid;
+        }
+        if (!rd_found) {
+            s_spool.rd = s_spool.wr;
+        }
+    }
+
+    s_spool.ready = true;
+    ESP_LOGI(TAG, "spool ready: %u sectors, %u pending",
+             (unsigned)s_spool.sector_num, (unsigned)s_spool.stats.pending);
+    return ESP_OK;
+}
+
+bool mqtt_spool_is_ready(void)
+{
+    return s_spool.ready;
+}
+
+esp_err_t mqtt_spool_append(const char *topic,
+                            const void *payload,
+                            int         len,
+                            int         qos,
+                            bool        retain)
+{
+    if (!s_spool.ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (topic == NULL || len < 0 || (len > 0 && payload == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t topic_len = strlen(topic);
+    if (topic_len == 0 || topic_len > 255 || len > s_spool.cfg.max_payload_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t rec_len = spool_align4(sizeof(spool_rec_hdr_t) + (uint32_t)topic_len + (uint32_t)len);
+    if (s_spool.wr.off + rec_len > SPOOL_SECTOR_SIZE) {
+        esp_err_t ret = spool_advance_write_sector();
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    /* 在缓冲区中组装完整记录，尾部对齐填充保持擦除态 */
+    memset(s_spool.buf, 0xFF, rec_len);
+    spool_rec_hdr_t *hdr = (spool_rec_hdr_t *)s_spool.buf;
+    uint32_t epoch       = (uint32_t)time(NULL);
+
+    hdr->state       = SPOOL_REC_ERASED;
+    hdr->rec_len     = (uint16_t)rec_len;
+    hdr->payload_len = (uint16_t)len;
+    hdr->topic_len   = (uint8_t)topic_len;
+    hdr->flags       = (uint8_t)((qos & 0x03) | (retain ? 0x80 : 0));
+    hdr->seq         = s_spool.rec_seq++;
+    hdr->boot_id     = s_spool.boot_id;
+    hdr->uptime_s    = (uint32_t)(esp_timer_get_time() / 1000000);
+    hdr->epoch       = (epoch >= SPOOL_EPOCH_VALID_MIN) ? epoch : 0;
+    memcpy(s_spool.buf + sizeof(*hdr), topic, topic_len);
+    if (len > 0) {
+        memcpy(s_spool.buf + sizeof(*hdr) + topic_len, payload, (size_t)len);
+    }
+
+    uint32_t crc = esp_rom_crc32_le(0, s_spool.buf + SPOOL_CRC_OFFSET, SPOOL_CRC_HDR_LEN);
+    crc          = esp_rom_crc32_le(crc, s_spool.buf + sizeof(*hdr), (uint32_t)topic_len + (uint32_t)len);
+    hdr->crc     = crc;
+
+    /* 先写记录主体，最后写状态字，掉电时半条记录不会被当作有效数据 */
+    size_t    addr = spool_addr(s_spool.wr.sector, s_spool.wr.off);
+    esp_err_t ret  = esp_partition_write(s_spool.part, addr + sizeof(uint32_t),
+                                         s_spool.buf + sizeof(uint32_t), rec_len - sizeof(uint32_t));
+    if (ret == ESP_OK) {
+        uint32_t state = SPOOL_REC_VALID;
+        ret = esp_partition_write(s_spool.part, addr, &state, sizeof(state));
+    }
+
+    s_spool.wr.off += rec_len;                     ///< 写失败也跳过该位置，避免重复写同一区域
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "append failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_spool.stats.appended++;
+    s_spool.stats.pending++;
+    s_spool.stats.bytes_written += rec_len;
+    return ESP_OK;
+}
+
+bool mqtt_spool_has_pending(void)
+{
+    return s_spool.ready && s_spool.stats.pending > 0;
+}
+
+esp_err_t mqtt_spool_peek(mqtt_spool_record_t *out)
+{
+    if (!s_spool.ready) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_spool.has_peeked = false;
+
+    while (s_spool.stats.pending > 0) {
+        spool_pos_t *rd = &s_spool.rd;
+
+        if (rd->sector == s_spool.wr.sector && rd->off >= s_spool.wr.off) {
+            s_spool.stats.pending = 0;             ///< 已追上写指针，计数以实际数据为准
+            break;
+        }
+
+        spool_rec_hdr_t hdr;
+        bool            end = (rd->off + sizeof(hdr) > SPOOL_SECTOR_SIZE);
+        if (!end) {
+            if (esp_partition_read(s_spool.part, spool_addr(rd->sector, rd->off), &hdr, sizeof(hdr)) != ESP_OK) {
+                return ESP_FAIL;
+            }
+            end = (hdr.state == SPOOL_REC_ERASED && hdr.rec_len == 0xFFFF) ||
+                  !spool_rec_len_ok(&hdr, rd->off);
+        }
+
+        if (end) {
+            if (rd->sector == s_spool.wr.sector) {
+                *rd = s_spool.wr;
+                continue;
+            }
+            rd->sector = (rd->sector + 1) % s_spool.sector_num;
+            rd->off    = sizeof(spool_sector_hdr_t);
+
+            spool_sector_hdr_t shdr;
+            if (rd->sector != s_spool.wr.sector && !spool_read_sector_hdr(rd->sector, &shdr)) {
+                rd->off = SPOOL_SECTOR_SIZE;        ///< 从未使用的扇区，直接跳过
+            }
+            continue;
+        }
+
+        spool_pos_t pos = *rd;
+        rd->off += hdr.rec_len;
+
+        if (hdr.state != SPOOL_REC_VALID) {
+            continue;                               ///< 已消费或写入未完成
+        }
+
+        /* 读取 Topic 与负载并校验 */
+        uint32_t body_len = (uint32_t)hdr.topic_len + hdr.payload_len;
+        if (body_len + 1 > s_spool.buf_size ||
+            esp_partition_read(s_spool.part, spool_addr(pos.sector, pos.off + sizeof(hdr)),
+                               s_spool.buf + 1, body_len) != ESP_OK) {
+            body_len = UINT32_MAX;
+        }
+
+        uint32_t crc = 0;
+        if (body_len != UINT32_MAX) {
+            crc = esp_rom_crc32_le(0, (const uint8_t *)&hdr + SPOOL_CRC_OFFSET, SPOOL_CRC_HDR_LEN);
+            crc = esp_rom_crc32_le(crc, s_spool.buf + 1, body_len);
+        }
+
+        s_spool.stats.pending--;
+
+        if (body_len == UINT32_MAX || crc != hdr.crc) {
+            s_spool.stats.corrupted++;
+            (void)spool_mark_consumed(pos);
+            continue;
+        }
+
+        /* Topic 移到缓冲区开头并补 '\0'，负载紧随其后 */
+        memmove(s_spool.buf, s_spool.buf + 1, hdr.topic_len);
+        s_spool.buf[hdr.topic_len] = '\0';
+
+        if (spool_is_expired(&hdr, (const char *)s_spool.buf)) {
+            s_spool.stats.expired++;
+            (void)spool_mark_consumed(pos);
+            continue;
+        }
+
+        s_spool.stats.pending++;                    ///< 被 pop 之前仍算作待回放
+        s_spool.peeked     = pos;
+        s_spool.has_peeked = true;
+        s_spool.rd         = pos;                   ///< 未 pop 前读指针停留在本条
+
+        out->topic       = (const char *)s_spool.buf;
+        out->payload     = s_spool.buf + 1 + hdr.topic_len;
+        out->payload_len = hdr.payload_len;
+        out->qos         = hdr.flags & 0x03;
+        out->retain      = (hdr.flags & 0x80) != 0;
+        return ESP_OK;
+    }
+
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t mqtt_spool_pop(void)
+{
+    if (!s_spool.ready || !s_spool.has_peeked) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    spool_rec_hdr_t hdr;
+    esp_err_t ret = esp_partition_read(s_spool.part,
+                                       spool_addr(s_spool.peeked.sector, s_spool.peeked.off),
+                                       &hdr, sizeof(hdr));
+    if (ret == ESP_OK) {
+        ret = spool_mark_consumed(s_spool.peeked);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    s_spool.rd.sector  = s_spool.peeked.sector;
+    s_spool.rd.off     = s_spool.peeked.off + hdr.rec_len;
+    s_spool.has_peeked = false;
+    s_spool.stats.replayed++;
+    if (s_spool.stats.pending > 0) {
+        s_spool.stats.pending--;
+    }
+    return ESP_OK;
+}
+
+uint32_t mqtt_spool_replay_interval_ms(void)
+{
+    if (s_spool.cfg.replay_rate_per_sec <= 0) {
+        return 0;
+    }
+    uint32_t ms = 1000u / (uint32_t)s_spool.cfg.replay_rate_per_sec;
+    return (ms == 0) ? 1 : ms;
+}
+
+esp_err_t mqtt_spool_get_stats(mqtt_spool_stats_t *out)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out = s_spool.stats;
+    return ESP_OK;
+}
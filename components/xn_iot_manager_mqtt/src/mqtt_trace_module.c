@@ -0,0 +1,346 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-13 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-13 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_iot_manager_mqtt\src\mqtt_trace_module.c
+ * @Description: MQTT 消息轨迹（二进制环形缓冲区）实现
+ *
+ * 每个槽位是一把小号序号锁（seqlock）：
+ *  - 写入方 fetch_add 取得序号 seq，先把槽位序号清 0，写完记录后再以 release 语义写入 seq+1；
+ *  - 读取方先后两次读取槽位序号，均等于 seq+1 才认为记录完整，否则以空记录占位。
+ * 写入方之间只竞争一次原子自增，esp-mqtt 任务、drain 任务与同步发布者均可直接调用。
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+#include "mqtt_trace_module.h"
+
+_Static_assert(sizeof(mqtt_trace_record_t) == 16, "trace record layout");
+_Static_assert(sizeof(mqtt_trace_dump_hdr_t) == 12, "trace dump header layout");
+
+/**
+ * @brief 槽位：序号 + 记录
+ */
+typedef struct {
+    uint32_t            seq; ///< 记录序号 + 1，0 表示空或正在写入
+    mqtt_trace_record_t rec; ///< 记录内容
+} mqtt_trace_slot_t;
+
+/**
+ * @brief 一个轨迹缓冲区
+ */
+struct mqtt_trace_s {
+    mqtt_trace_slot_t *ring;   ///< 槽位数组，NULL 表示未启用
+    uint32_t           mask;   ///< 容量 - 1
+    uint32_t           head;   ///< 下一条待写记录的序号（原子自增）
+    uint32_t           tick;   ///< 采样计数（原子自增）
+    uint8_t            level;  ///< 当前级别
+    uint16_t           sample; ///< 采样间隔
+    uint32_t           users;  ///< 引用该轨迹的 MQTT 模块实例数（原子读写）
+};
+
+static struct mqtt_trace_s *s_default = NULL; ///< 不带句柄的接口使用的默认轨迹（原子读写）
+
+/**
+ * @brief 内部辅助：FNV-1a 哈希
+ */
+static uint32_t mqtt_trace_hash(const char *topic, int len)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t)topic[i]) * 16777619u;
+    }
+    return h;
+}
+
+esp_err_t mqtt_trace_create(const mqtt_trace_config_t *config, mqtt_trace_handle_t *out)
+{
+    if (config == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    struct mqtt_trace_s *t = (struct mqtt_trace_s *)calloc(1, sizeof(*t));
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (config->capacity > 0) {
+        uint32_t cap = 1;
+        while (cap < (uint32_t)config->capacity && cap < 0x10000u) {
+            cap <<= 1;
+        }
+        t->ring = (mqtt_trace_slot_t *)calloc(cap, sizeof(mqtt_trace_slot_t));
+        if (t->ring == NULL) {
+            free(t);
+            return ESP_ERR_NO_MEM;
+        }
+        t->mask = cap - 1;
+    }
+
+    mqtt_trace_inst_set_level(t, config->level, config->sample > 0 ? config->sample : 1);
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t mqtt_trace_destroy(mqtt_trace_handle_t t)
+{
+    if (t == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (__atomic_load_n(&t->users, __ATOMIC_ACQUIRE) > 0) {
+        return ESP_ERR_INVALID_STATE;              ///< 仍有实例在收发路径上写入
+    }
+    if (t == s_default) {
+        __atomic_store_n(&s_default, NULL, __ATOMIC_RELEASE);
+    }
+    free(t->ring);
+    free(t);
+    return ESP_OK;
+}
+
+void mqtt_trace_retain(mqtt_trace_handle_t t)
+{
+    if (t != NULL) {
+        __atomic_add_fetch(&t->users, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+void mqtt_trace_release(mqtt_trace_handle_t t)
+{
+    if (t != NULL) {
+        __atomic_sub_fetch(&t->users, 1, __ATOMIC_ACQ_REL);
+    }
+}
+
+esp_err_t mqtt_trace_init(const mqtt_trace_config_t *config)
+{
+    if (config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    mqtt_trace_handle_t t = __atomic_load_n(&s_default, __ATOMIC_ACQUIRE);
+    if (t != NULL) {                               ///< 已创建：只更新级别
+        mqtt_trace_inst_set_level(t, config->level, config->sample > 0 ? config->sample : 1);
+        return ESP_OK;
+    }
+
+    esp_err_t ret = mqtt_trace_create(config, &t);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    __atomic_store_n(&s_default, t, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+mqtt_trace_handle_t mqtt_trace_get_default(void)
+{
+    return __atomic_load_n(&s_default, __ATOMIC_ACQUIRE);
+}
+
+void mqtt_trace_inst_set_level(mqtt_trace_handle_t t, mqtt_trace_level_t level, int sample)
+{
+    if (t == NULL) {
+        return;
+    }
+    if (sample > 0) {
+        __atomic_store_n(&t->sample, (uint16_t)(sample > UINT16_MAX ? UINT16_MAX : sample),
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&t->level, (uint8_t)level, __ATOMIC_RELAXED);
+}
+
+mqtt_trace_level_t mqtt_trace_inst_get_level(mqtt_trace_handle_t t, int *sample)
+{
+    if (t == NULL) {
+        if (sample != NULL) {
+            *sample = 0;
+        }
+        return MQTT_TRACE_OFF;
+    }
+    if (sample != NULL) {
+        *sample = __atomic_load_n(&t->sample, __ATOMIC_RELAXED);
+    }
+    return (mqtt_trace_level_t)__atomic_load_n(&t->level, __ATOMIC_RELAXED);
+}
+
+void mqtt_trace_inst_record(mqtt_trace_handle_t t, mqtt_trace_dir_t dir, const char *topic,
+                            int topic_len, int len, int msg_id, int qos)
+{
+    if (t == NULL || t->ring == NULL) {
+        return;
+    }
+
+    uint8_t level = __atomic_load_n(&t->level, __ATOMIC_RELAXED);
+    if (level == MQTT_TRACE_OFF) {
+        return;
+    }
+    if (level == MQTT_TRACE_SAMPLED) {
+        uint16_t sample = __atomic_load_n(&t->sample, __ATOMIC_RELAXED);
+        if (sample > 1 && __atomic_fetch_add(&t->tick, 1, __ATOMIC_RELAXED) % sample != 0) {
+            return;
+        }
+    }
+
+    mqtt_trace_record_t rec = {
+        .ts_ms      = (uint32_t)(esp_timer_get_time() / 1000),
+        .topic_hash = 0,
+        .len        = len > 0 ? (uint32_t)len : 0,
+        .msg_id     = (msg_id > 0 && msg_id <= UINT16_MAX) ? (uint16_t)msg_id : 0,
+        .dir        = (uint8_t)dir,
+        .qos        = (uint8_t)qos,
+    };
+    if (topic != NULL) {
+        rec.topic_hash = mqtt_trace_hash(topic, topic_len >= 0 ? topic_len : (int)strlen(topic));
+    }
+
+    uint32_t           seq  = __atomic_fetch_add(&t->head, 1, __ATOMIC_RELAXED);
+    mqtt_trace_slot_t *slot = &t->ring[seq & t->mask];
+
+    __atomic_store_n(&slot->seq, 0, __ATOMIC_RELAXED); ///< 标记正在写入
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->rec = rec;
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t mqtt_trace_inst_head(mqtt_trace_handle_t t)
+{
+    return (t != NULL) ? __atomic_load_n(&t->head, __ATOMIC_ACQUIRE) : 0;
+}
+
+int mqtt_trace_inst_read(mqtt_trace_handle_t t, uint32_t from_seq, mqtt_trace_record_t *out,
+                         int max, uint32_t *first_seq)
+{
+    uint32_t head = mqtt_trace_inst_head(t);
+
+    if (t == NULL || t->ring == NULL || out == NULL || max <= 0) {
+        if (first_seq != NULL) {
+            *first_seq = head;
+        }
+        return 0;
+    }
+
+    uint32_t cap    = t->mask + 1;
+    uint32_t oldest = head > cap ? head - cap : 0;
+    uint32_t seq    = from_seq;
+    if (seq == 0 || head - seq > head - oldest) {  ///< 早于最旧记录（或晚于 head）时从最旧记录开始
+        seq = oldest;
+    }
+    if (first_seq != NULL) {
+        *first_seq = seq;
+    }
+
+    int n = 0;
+    for (; n < max && seq != head; ++n, ++seq) {
+        const mqtt_trace_slot_t *slot = &t->ring[seq & t->mask];
+
+        uint32_t s1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        out[n] = slot->rec;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t s2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+        if (s1 != seq + 1 || s2 != s1) {            ///< 已被覆盖或尚未写完
+            memset(&out[n], 0, sizeof(out[n]));
+        }
+    }
+    return n;
+}
+
+int mqtt_trace_inst_command(mqtt_trace_handle_t t, const uint8_t *cmd, int cmd_len,
+                            uint8_t *out, int cap)
+{
+    char text[24];
+
+    if (t == NULL || out == NULL || cap < (int)sizeof(mqtt_trace_dump_hdr_t) || cmd_len < 0 ||
+        cmd_len >= (int)sizeof(text)) {
+        return -1;
+    }
+    if (cmd_len > 0) {
+        memcpy(text, cmd, (size_t)cmd_len);
+    }
+    text[cmd_len] = '\0';
+
+    int      count = 0;
+    uint32_t first = 0;
+    char    *end   = NULL;
+
+    if (strcmp(text, "off") == 0) {
+        mqtt_trace_inst_set_level(t, MQTT_TRACE_OFF, 0);
+    } else if (strcmp(text, "full") == 0) {
+        mqtt_trace_inst_set_level(t, MQTT_TRACE_FULL, 0);
+    } else if (strncmp(text, "sampled", 7) == 0) {
+        long sample = 0;
+        if (text[7] != '\0') {
+            sample = strtol(text + 7, &end, 10);
+            if (end == text + 7 || *end != '\0' || sample <= 0) {
+                return -1;
+            }
+        }
+        mqtt_trace_inst_set_level(t, MQTT_TRACE_SAMPLED, (int)sample);
+    } else {
+        unsigned long from = 0;
+        if (text[0] != '\0') {
+            from = strtoul(text, &end, 10);
+            if (*end != '\0') {
+                return -1;
+            }
+        }
+
+        int max = (cap - (int)sizeof(mqtt_trace_dump_hdr_t)) / (int)sizeof(mqtt_trace_record_t);
+        if (max > UINT8_MAX) {
+            max = UINT8_MAX;
+        }
+        mqtt_trace_record_t *recs = (mqtt_trace_record_t *)(out + sizeof(mqtt_trace_dump_hdr_t));
+        count = mqtt_trace_inst_read(t, (uint32_t)from, recs, max, &first);
+    }
+
+    int sample = 0;
+    mqtt_trace_dump_hdr_t hdr = {
+        .first_seq = count > 0 ? first : mqtt_trace_inst_head(t),
+        .head      = mqtt_trace_inst_head(t),
+        .level     = (uint8_t)mqtt_trace_inst_get_level(t, &sample),
+        .count     = (uint8_t)count,
+        .sample    = (uint16_t)sample,
+    };
+    memcpy(out, &hdr, sizeof(hdr));
+
+    return (int)sizeof(hdr) + count * (int)sizeof(mqtt_trace_record_t);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               默认轨迹（旧接口）                              */
+/* -------------------------------------------------------------------------- */
+
+void mqtt_trace_set_level(mqtt_trace_level_t level, int sample)
+{
+    mqtt_trace_inst_set_level(mqtt_trace_get_default(), level, sample);
+}
+
+mqtt_trace_level_t mqtt_trace_get_level(int *sample)
+{
+    return mqtt_trace_inst_get_level(mqtt_trace_get_default(), sample);
+}
+
+void mqtt_trace_record(mqtt_trace_dir_t dir, const char *topic, int topic_len,
+                       int len, int msg_id, int qos)
+{
+    mqtt_trace_inst_record(mqtt_trace_get_default(), dir, topic, topic_len, len, msg_id, qos);
+}
+
+uint32_t mqtt_trace_head(void)
+{
+    return mqtt_trace_inst_head(mqtt_trace_get_default());
+}
+
+int mqtt_trace_read(uint32_t from_seq, mqtt_trace_record_t *out, int max, uint32_t *first_seq)
+{
+    return mqtt_trace_inst_read(mqtt_trace_get_default(), from_seq, out, max, first_seq);
+}
+
+int mqtt_trace_command(const uint8_t *cmd, int cmd_len, uint8_t *out, int cap)
+{
+    return mqtt_trace_inst_command(mqtt_trace_get_default(), cmd, cmd_len, out, cap);
+}
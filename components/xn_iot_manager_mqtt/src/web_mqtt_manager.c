@@ -19,18 +19,27 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 
 #include "esp_log.h"
 #include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_random.h"
 
 #include "mqtt_module.h"
 #include "mqtt_app_module.h"
 #include "mqtt_reg_module.h"
 #include "mqtt_heartbeat_module.h"
+#include "mqtt_rpc_module.h"
+#include "mqtt_broker_module.h"
+#include "mqtt_trace_module.h"
 #include "web_mqtt_manager.h"
+#include "xn_loop.h"
 
 /* 日志 TAG */
 static const char *TAG = "web_mqtt_manager";       ///< 本模块日志 TAG
@@ -38,217 +47,1870 @@ static const char *TAG = "web_mqtt_manager";       ///< 本模块日志 TAG
 /* 管理器内部状态 */
 static web_mqtt_manager_config_t s_mgr_cfg;        ///< 上层传入的管理配置副本
 static web_mqtt_state_t          s_mgr_state = WEB_MQTT_STATE_DISCONNECTED; ///< 当前状态
-static TaskHandle_t              s_mgr_task  = NULL; ///< 管理任务句柄
-static TickType_t                s_last_error_ts = 0; ///< 最近一次错误/断开的时间戳
+static xn_loop_timer_t          *s_mgr_timer = NULL; ///< 管理状态机定时器（运行在共享事件循环中）
+static uint32_t                  s_retry_attempt   = 0; ///< 连续失败次数（决定退避窗口）
+static TickType_t                s_retry_at        = 0; ///< 下次重连时刻，0 表示尚未调度
+static TickType_t                s_connect_start   = 0; ///< 本次连接尝试发起时刻
+static TickType_t                s_connected_since = 0; ///< 本次连接建立时刻
+static int                       s_client_broker   = 0; ///< 客户端当前配置的服务器下标
+static bool                      s_raced           = false; ///< 本次连接尝试是否已并行探测过其他服务器
+static bool                      s_ready_seen      = false; ///< 本次连接是否已进入过 READY（重新注册不计入就绪耗时）
+static mqtt_broker_t             s_single_broker;       ///< 未配置服务器列表时由 broker_uri 构成的单项列表
 
 /* 若上层未指定 client_id，则使用该缓冲区生成一个基于 MAC 的默认 ID */
 static char s_client_id_buf[32];
 
-/* 应用模块注册表配置 */
-#define WEB_MQTT_APP_MAX_NUM         8            ///< 支持的应用模块最大数量
-#define WEB_MQTT_APP_SUFFIX_MAX_LEN  16           ///< 单个模块前缀最大长度
+/* 应用模块注册表 */
+#define WEB_MQTT_APP_FILTER_MAX_LEN  96           ///< 展开后单个订阅过滤器最大长度
+#define WEB_MQTT_ROUTE_BUCKET_NUM    16           ///< 路由哈希桶数量
 
+/**
+ * @brief 限流规则及其令牌桶（令牌以 1/1000 个为单位，补充时不丢失零头）
+ */
+typedef struct {
+    const char *cmd;          ///< 命令段，"*" 匹配任意命令
+    uint8_t     cmd_len;      ///< 命令段长度
+    bool        coalesce;     ///< 是否合并队列中同一 Topic 的未执行消息
+    uint16_t    rate_per_min; ///< 令牌补充速率（条/分钟），0 表示不限速
+    uint32_t    cap_milli;    ///< 桶容量（毫令牌）
+    uint32_t    tokens_milli; ///< 当前令牌（毫令牌）
+    int64_t     last_us;      ///< 已折算为令牌的时间点
+} web_mqtt_app_bucket_t;
+
+/**
+ * @brief 已注册的应用模块（堆上分配，注册表快照中只保存指针）
+ *
+ * 生命周期由引用计数管理：注册表持有一个引用，分发线程执行回调期间再持有一个。
+ * 注销（或同名重复注册）后，等旧快照宽限期结束、正在执行的回调返回才释放，
+ * 此时队列中尚未执行的消息一并丢弃。
+ */
+typedef struct web_mqtt_app {
+    char                   *suffix;             ///< 模块 Topic 前缀（可含 '+' 层级）
+    int                     suffix_segs;        ///< 模块前缀占用的层级数
+    web_mqtt_app_msg_cb_t   cb;                 ///< 模块消息回调（完整 Topic）
+    web_mqtt_app_route_cb_t route_cb;           ///< 模块消息回调（预切分 Topic）
+    const char             *templates[WEB_MQTT_APP_FILTER_MAX_NUM]; ///< 订阅模板
+    web_mqtt_app_dispatch_t dispatch;           ///< 消息执行方式
+    uint8_t                 priority;           ///< 分发优先级
+    portMUX_TYPE            lock;               ///< 保护分发队列与统计
+    struct web_mqtt_dispatch_msg **queue;       ///< 分发队列（环形），INLINE 模块为 NULL
+    uint16_t                queue_cap;          ///< 队列容量
+    uint16_t                queue_head;         ///< 队头下标
+    uint16_t                queue_count;        ///< 队列深度
+    bool                    busy;               ///< 是否有分发线程正在执行该模块回调
+    web_mqtt_app_stats_t    stats;              ///< 分发统计
+    uint64_t                handler_us_sum;     ///< 回调累计耗时，用于计算平均值
+    uint32_t                refs;               ///< 引用计数（原子操作）
+    uint32_t                last_seq;           ///< 最近一次分发的消息序号（仅 esp-mqtt 任务访问）
+    web_mqtt_app_bucket_t   limits[WEB_MQTT_APP_LIMIT_MAX_NUM]; ///< 限流规则，令牌受 lock 保护
+    int                     limit_num;          ///< 有效规则数
+} web_mqtt_app_t;
+
+/**
+ * @brief 入队的下行消息，Topic（及拷贝模式下的负载）紧随结构体存放
+ */
+typedef struct web_mqtt_dispatch_msg {
+    web_mqtt_topic_t topic;       ///< 切分结果，指针已指向 text
+    const uint8_t   *payload;     ///< 负载
+    int              payload_len; ///< 负载长度
+    bool             transferred; ///< 负载是否为接管的 mqtt_module 重组缓冲区
+    int64_t          enqueue_us;  ///< 入队时间
+    char             text[];      ///< Topic + 负载拷贝
+} web_mqtt_dispatch_msg_t;
+
+/**
+ * @brief 一条预编译路由（对应一个展开后的订阅过滤器）
+ */
+typedef struct {
+    char            filter[WEB_MQTT_APP_FILTER_MAX_LEN]; ///< 展开后的过滤器
+    const char     *seg[WEB_MQTT_TOPIC_MAX_SEGS];     ///< 过滤器各层级（指向 filter）
+    uint8_t         seg_len[WEB_MQTT_TOPIC_MAX_SEGS]; ///< 各层级长度
+    int             seg_num;                          ///< 参与比较的层级数（不含末尾 '#'）
+    bool            multi;                            ///< 是否以 '#' 结尾
+    web_mqtt_app_t *app;                              ///< 所属模块
+    int             next;                             ///< 同桶下一条路由，-1 结束
+} web_mqtt_route_t;
+
+/**
+ * @brief 注册表快照
+ *
+ * 发布后只读；注册 / 注销时整体生成新快照并原子替换，
+ * 消息分发全程无锁，注册也不会阻塞分发。
+ */
+typedef struct {
+    int               app_num;                               ///< 模块数量
+    web_mqtt_app_t  **apps;                                  ///< 模块列表
+    const char       *base_seg[WEB_MQTT_TOPIC_MAX_SEGS];     ///< base_topic 各层级
+    uint8_t           base_seg_len[WEB_MQTT_TOPIC_MAX_SEGS]; ///< base_topic 各层级长度
+    int               base_segs;                             ///< base_topic 层级数
+    int               route_num;                             ///< 有效路由数
+    web_mqtt_route_t *routes;                                ///< 路由池
+    int               bucket[WEB_MQTT_ROUTE_BUCKET_NUM];     ///< 按 base 后首段哈希的桶头
+    int               wildcard;                              ///< 无法分桶的路由链表头
+    uint32_t          filter_hash;                           ///< 全部过滤器的摘要（与顺序无关），用于判断订阅集合是否变化
+} web_mqtt_registry_t;
+
+static web_mqtt_registry_t *s_registry       = NULL; ///< 当前快照（原子读写）
+static SemaphoreHandle_t    s_registry_mutex = NULL; ///< 串行化注册 / 注销
+static portMUX_TYPE         s_registry_init_lock = portMUX_INITIALIZER_UNLOCKED; ///< 保护互斥量的延迟创建
+static uint32_t             s_rcu_epoch      = 0;    ///< 读者分组（低位）
+static uint32_t             s_rcu_readers[2];        ///< 两组读者计数
+static uint32_t             s_msg_seq        = 0;    ///< 下行消息序号（仅 esp-mqtt 任务访问）
+
+static web_mqtt_manager_stats_t s_stats;           ///< 收发统计
+static portMUX_TYPE         s_stats_lock = portMUX_INITIALIZER_UNLOCKED; ///< 保护 s_stats 与 s_mgr_state（esp-mqtt、分发与事件循环任务都会更新）
+static size_t               s_client_id_len = 0;   ///< client_id 长度，避免分发时反复 strlen
+
+/* 分发线程：各模块队列由模块自身的自旋锁保护，线程间通过计数信号量唤醒 */
+#define WEB_MQTT_DISPATCH_WORKER_MAX 4            ///< 分发线程数量上限
+#define WEB_MQTT_DISPATCH_SEM_MAX    32           ///< 唤醒信号量计数上限（线程会一直取到无消息为止）
+
+static SemaphoreHandle_t s_dispatch_sem  = NULL;  ///< 有新消息入队
+static TaskHandle_t      s_dispatch_tasks[WEB_MQTT_DISPATCH_WORKER_MAX]; ///< 分发线程句柄
+
+/* 连接后的批量订阅：记录等待中的 SUBACK，全部被接受后进入 READY */
+#define WEB_MQTT_SUBACK_PENDING_MAX 16            ///< 一轮订阅可跟踪的 SUBSCRIBE 报文数
+#define WEB_MQTT_SUBACK_EARLY_NUM   4             ///< 早于 msg_id 登记到达的 SUBACK 暂存数
+
+static portMUX_TYPE s_sub_lock = portMUX_INITIALIZER_UNLOCKED; ///< 保护以下订阅轮次状态
+static int          s_sub_pending[WEB_MQTT_SUBACK_PENDING_MAX]; ///< 等待 SUBACK 的 msg_id
+static int          s_sub_pending_num = 0;        ///< 等待中的 SUBACK 数
+static int          s_sub_early[WEB_MQTT_SUBACK_EARLY_NUM]; ///< 先于登记到达的 SUBACK（负数表示被拒绝）
+static int          s_sub_early_num   = 0;        ///< 累计暂存个数（环形覆盖）
+static bool         s_sub_sending     = false;    ///< 本轮订阅报文是否仍在发送
+static bool         s_sub_queued      = false;    ///< 临时任务忙，待其完成后再开始本轮订阅（仅状态机访问）
+static bool         s_sub_failed      = false;    ///< 本轮是否有报文发送失败或被拒绝
+static bool         s_sub_done        = true;     ///< 本轮是否已结束（防止重复结束）
+static TickType_t   s_sub_start       = 0;        ///< 本轮订阅开始时刻
+static TickType_t   s_sub_retry_at    = 0;        ///< 本轮失败后的重试时刻，0 表示未调度
+static uint32_t     s_sub_attempt     = 0;        ///< 本次连接内连续失败的订阅轮次
+static bool         s_sub_ready       = false;    ///< 本次连接的订阅已全部完成，等待注册握手
+static uint32_t     s_sub_round_hash  = 0;        ///< 本轮订阅的过滤器摘要
+static uint32_t     s_sub_hash        = 0;        ///< 最近一轮成功订阅的过滤器摘要（持久会话中服务器持有的集合）
+static bool         s_sub_hash_valid  = false;    ///< s_sub_hash 是否有效
+
+/* 连接事件：esp-mqtt 任务只登记事件并唤醒管理状态机，状态迁移与订阅都在管理状态机中完成 */
+#define WEB_MQTT_EVENT_QUEUE_LEN    8             ///< 待处理连接事件数，溢出时丢弃最旧的
+
+/**
+ * @brief 待处理的底层连接事件
+ */
 typedef struct {
-    char                  suffix[WEB_MQTT_APP_SUFFIX_MAX_LEN]; ///< 模块 Topic 前缀
-    web_mqtt_app_msg_cb_t cb;                   ///< 模块消息回调
-} web_mqtt_app_entry_t;
+    mqtt_module_event_t event; ///< 事件类型
+    TickType_t          at;    ///< 事件发生时刻
+    uint32_t            gen;   ///< 事件所属的客户端启动代次
+} web_mqtt_conn_event_t;
+
+static portMUX_TYPE          s_evt_lock = portMUX_INITIALIZER_UNLOCKED; ///< 保护事件队列
+static web_mqtt_conn_event_t s_evt_queue[WEB_MQTT_EVENT_QUEUE_LEN]; ///< 事件环形队列
+static uint32_t              s_evt_head = 0;      ///< 下一个待处理事件（累计序号）
+static uint32_t              s_evt_tail = 0;      ///< 下一个写入位置（累计序号）
+static uint32_t              s_conn_gen = 0;      ///< 客户端启动代次：每次停止后、重新启动前加一（原子读写）
+
+/*
+ * 可能阻塞的客户端操作放到临时任务中执行，不占用共享事件循环：
+ * esp_mqtt_client_stop 最长等待一个网络超时，服务器探测需同步解析域名。
+ * 同一时刻最多一个操作，完成后由临时任务唤醒管理状态机并自行退出。
+ */
+#define WEB_MQTT_JOB_STACK_SIZE     4096          ///< 临时任务栈（含域名解析）
+#define WEB_MQTT_JOB_TASK_PRIO      (tskIDLE_PRIORITY + 2) ///< 临时任务优先级
+
+/**
+ * @brief 临时任务执行的客户端操作
+ */
+typedef enum {
+    WEB_MQTT_JOB_NONE = 0,                         ///< 空闲
+    WEB_MQTT_JOB_CONNECT,                          ///< 停止客户端，按需切换服务器地址后重新启动
+    WEB_MQTT_JOB_STOP,                             ///< 停止客户端（放弃超时的连接尝试）
+    WEB_MQTT_JOB_PROBE,                            ///< 并行探测其他服务器
+    WEB_MQTT_JOB_SUBSCRIBE,                        ///< 为全部模块批量订阅（发送 SUBSCRIBE 需要客户端锁）
+} web_mqtt_job_kind_t;
+
+/**
+ * @brief 临时任务的参数与结果（kind 非 NONE 期间只由临时任务写入结果）
+ */
+typedef struct {
+    web_mqtt_job_kind_t kind;     ///< 当前操作，NONE 表示空闲
+    int                 broker;   ///< CONNECT：目标服务器；PROBE：不参与探测的服务器
+    bool                set_uri;  ///< CONNECT：目标与客户端当前地址不同（切换服务器）
+    bool                switched; ///< CONNECT：已切换到目标服务器
+    esp_err_t           ret;      ///< CONNECT：启动结果
+    int                 winner;   ///< PROBE：最先响应的服务器，-1 表示无响应
+    TickType_t          started;  ///< CONNECT：客户端启动时刻
+    uint32_t            hash;     ///< SUBSCRIBE：本轮订阅的过滤器摘要
+    bool                done;     ///< 临时任务已完成（原子读写）
+} web_mqtt_job_t;
+
+static web_mqtt_job_t s_job;                       ///< 当前客户端操作
+
+/* 未显式声明模板的模块只关心发给本设备的指令与广播 */
+static const char *const s_default_templates[] = {
+    WEB_MQTT_APP_FILTER_DEVICE,
+    WEB_MQTT_APP_FILTER_BROADCAST,
+};
+
+/**
+ * @brief 内部辅助：统计计数加一
+ */
+static void web_mqtt_manager_stat_inc(uint32_t *counter)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/**
+ * @brief 内部辅助：更新一项统计值
+ */
+static void web_mqtt_manager_stat_set(uint32_t *field, uint32_t value)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    *field = value;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+/**
+ * @brief 统一更新状态并通知上层回调
+ */
+static void web_mqtt_manager_notify_state(web_mqtt_state_t new_state)
+{
+    portENTER_CRITICAL(&s_stats_lock);
+    s_mgr_state = new_state;                       ///< 更新内部状态
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    if (s_mgr_cfg.event_cb) {                      ///< 如上层配置了回调
+        s_mgr_cfg.event_cb(new_state);             ///< 通知上层当前状态
+    }
+}
+
+/**
+ * @brief 确保管理器配置中存在有效的 client_id
+ *
+ * 若上层未提供（NULL 或空串），则基于芯片 MAC 生成形如
+ * "ESP32_XXXXXXXXXXXX" 的默认 client_id，保证单设备唯一。
+ */
+static void web_mqtt_manager_ensure_client_id(void)
+{
+    if (s_mgr_cfg.client_id != NULL &&            ///< 已显式配置
+        s_mgr_cfg.client_id[0] != '\0') {        ///< 且非空串
+        return;                                    ///< 直接使用上层提供的值
+    }
+
+    uint8_t mac[6] = {0};                         ///< MAC 地址缓冲区
+    esp_err_t err = esp_read_mac(mac, ESP_MAC_WIFI_STA); ///< 读取 STA MAC
+    if (err != ESP_OK) {                          ///< 读取失败
+        snprintf(s_client_id_buf, sizeof(s_client_id_buf),
+                 "ESP32_UNKNOWN");              ///< 退化为占位 ID
+    } else {
+        snprintf(s_client_id_buf, sizeof(s_client_id_buf),
+                 "ESP32_%02X%02X%02X%02X%02X%02X",
+                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+
+    s_mgr_cfg.client_id = s_client_id_buf;        ///< 填入默认 client_id
+}
+
+/**
+ * @brief 将 Topic 按 '/' 切分到 seg / seg_len
+ *
+ * @return 层级数；超出 max_segs 或某层超过 255 字节时返回 -1
+ */
+static int web_mqtt_manager_split(const char  *topic,
+                                  int          topic_len,
+                                  const char **seg,
+                                  uint8_t     *seg_len,
+                                  int          max_segs)
+{
+    int         num   = 0;
+    const char *start = topic;
+    const char *end   = topic + topic_len;
+
+    for (const char *p = topic;; ++p) {
+        if (p == end || *p == '/') {
+            if (num >= max_segs || p - start > UINT8_MAX) {
+                return -1;
+            }
+            seg[num]     = start;
+            seg_len[num] = (uint8_t)(p - start);
+            num++;
+            if (p == end) {
+                break;
+            }
+            start = p + 1;
+        }
+    }
+
+    return num;
+}
+
+/**
+ * @brief 层级哈希（FNV-1a），用于路由分桶
+ */
+static uint32_t web_mqtt_manager_seg_hash(const char *seg, int len)
+{
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; ++i) {
+        h ^= (uint8_t)seg[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool web_mqtt_manager_seg_eq(const char *a, int a_len, const char *b, int b_len)
+{
+    return a_len == b_len && memcmp(a, b, (size_t)a_len) == 0;
+}
+
+/**
+ * @brief 展开订阅模板中的 {base} / {suffix} / {client_id} 占位符
+ */
+static bool web_mqtt_manager_expand_filter(const char *tpl,
+                                           const char *suffix,
+                                           char       *out,
+                                           size_t      out_size)
+{
+    size_t pos = 0;
+
+    while (*tpl != '\0') {
+        const char *val = NULL;
+        size_t      skip = 0;
+
+        if (strncmp(tpl, "{base}", 6) == 0) {
+            val  = s_mgr_cfg.base_topic;
+            skip = 6;
+        } else if (strncmp(tpl, "{suffix}", 8) == 0) {
+            val  = suffix;
+            skip = 8;
+        } else if (strncmp(tpl, "{client_id}", 11) == 0) {
+            val  = s_mgr_cfg.client_id;
+            skip = 11;
+        }
+
+        if (skip > 0) {
+            if (val == NULL || val[0] == '\0') {
+                return false;                      ///< 占位符尚无取值
+            }
+            size_t n = strlen(val);
+            if (pos + n >= out_size) {
+                return false;
+            }
+            memcpy(out + pos, val, n);
+            pos += n;
+            tpl += skip;
+        } else {
+            if (pos + 1 >= out_size) {
+                return false;
+            }
+            out[pos++] = *tpl++;
+        }
+    }
+
+    out[pos] = '\0';
+    return pos > 0;
+}
+
+/* -------------------- 注册表快照：RCU 式读写 -------------------- */
+
+/**
+ * @brief 进入读侧临界区（无锁，只做原子计数）
+ *
+ * 读者先登记到当前分组再读取快照指针；写者替换指针后翻转分组并等待旧分组清零，
+ * 之后旧快照不再被任何读者引用。读侧临界区内不可注册 / 注销模块。
+ *
+ * @return 读者分组，需原样传给 web_mqtt_registry_read_unlock
+ */
+static int web_mqtt_registry_read_lock(void)
+{
+    for (;;) {
+        int idx = (int)(__atomic_load_n(&s_rcu_epoch, __ATOMIC_SEQ_CST) & 1u);
+        __atomic_add_fetch(&s_rcu_readers[idx], 1, __ATOMIC_SEQ_CST);
+        if ((int)(__atomic_load_n(&s_rcu_epoch, __ATOMIC_SEQ_CST) & 1u) == idx) {
+            return idx;
+        }
+        __atomic_sub_fetch(&s_rcu_readers[idx], 1, __ATOMIC_SEQ_CST); ///< 登记期间分组已翻转，重试
+    }
+}
+
+static void web_mqtt_registry_read_unlock(int idx)
+{
+    __atomic_sub_fetch(&s_rcu_readers[idx], 1, __ATOMIC_SEQ_CST);
+}
+
+static web_mqtt_registry_t *web_mqtt_registry_deref(void)
+{
+    return __atomic_load_n(&s_registry, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @brief 等待宽限期：替换快照前进入读侧的读者全部退出
+ */
+static void web_mqtt_registry_synchronize(void)
+{
+    uint32_t old = __atomic_fetch_add(&s_rcu_epoch, 1, __ATOMIC_SEQ_CST) & 1u;
+    while (__atomic_load_n(&s_rcu_readers[old], __ATOMIC_SEQ_CST) != 0) {
+        vTaskDelay(1);
+    }
+}
+
+/**
+ * @brief 获取写者互斥量（首次调用时创建）
+ */
+static bool web_mqtt_registry_lock(void)
+{
+    if (s_registry_mutex == NULL) {
+        SemaphoreHandle_t m = xSemaphoreCreateMutex();
+        if (m == NULL) {
+            return false;
+        }
+        portENTER_CRITICAL(&s_registry_init_lock);
+        if (s_registry_mutex == NULL) {
+            s_registry_mutex = m;
+            m = NULL;
+        }
+        portEXIT_CRITICAL(&s_registry_init_lock);
+        if (m != NULL) {
+            vSemaphoreDelete(m);                   ///< 并发创建，保留先到的一个
+        }
+    }
+
+    return xSemaphoreTake(s_registry_mutex, portMAX_DELAY) == pdTRUE;
+}
+
+static void web_mqtt_registry_unlock(void)
+{
+    xSemaphoreGive(s_registry_mutex);
+}
+
+/**
+ * @brief 由模块列表生成新快照（模块指针、路由表与展开后的过滤器放在同一块内存中）
+ *
+ * 展开后的过滤器若以 base_topic 开头且紧随其后的模块前缀首段为普通字符串，
+ * 则按该段哈希分桶；其余过滤器（含 '+' 或不以 base_topic 开头）放入通配链表逐条匹配。
+ *
+ * @return 新快照，内存不足时返回 NULL
+ */
+static web_mqtt_registry_t *web_mqtt_registry_build(web_mqtt_app_t *const *apps, int app_num)
+{
+    size_t route_cap = (size_t)app_num * WEB_MQTT_APP_FILTER_MAX_NUM;
+    web_mqtt_registry_t *reg = (web_mqtt_registry_t *)calloc(1, sizeof(web_mqtt_registry_t) +
+                                                                 (size_t)app_num * sizeof(web_mqtt_app_t *) +
+                                                                 route_cap * sizeof(web_mqtt_route_t));
+    if (reg == NULL) {
+        return NULL;
+    }
+
+    reg->apps    = (web_mqtt_app_t **)(reg + 1);
+    reg->routes  = (web_mqtt_route_t *)(reg->apps + app_num);
+    reg->app_num = app_num;
+    if (app_num > 0) {
+        memcpy(reg->apps, apps, (size_t)app_num * sizeof(web_mqtt_app_t *));
+    }
+    for (int b = 0; b < WEB_MQTT_ROUTE_BUCKET_NUM; ++b) {
+        reg->bucket[b] = -1;
+    }
+    reg->wildcard = -1;
+
+    if (s_mgr_cfg.base_topic != NULL && s_mgr_cfg.base_topic[0] != '\0') {
+        int n = web_mqtt_manager_split(s_mgr_cfg.base_topic, (int)strlen(s_mgr_cfg.base_topic),
+                                       reg->base_seg, reg->base_seg_len, WEB_MQTT_TOPIC_MAX_SEGS);
+        reg->base_segs = (n > 0) ? n : 0;
+    }
+
+    for (int a = 0; a < app_num; ++a) {
+        web_mqtt_app_t *app = apps[a];
+
+        for (int f = 0; f < WEB_MQTT_APP_FILTER_MAX_NUM; ++f) {
+            if (app->templates[f] == NULL) {
+                continue;
+            }
+
+            web_mqtt_route_t *r = &reg->routes[reg->route_num];
+            if (!web_mqtt_manager_expand_filter(app->templates[f], app->suffix,
+                                                r->filter, sizeof(r->filter))) {
+                continue;                          ///< base_topic / client_id 尚未确定或过长
+            }
+
+            r->app     = app;
+            r->seg_num = web_mqtt_manager_split(r->filter, (int)strlen(r->filter),
+                                                r->seg, r->seg_len, WEB_MQTT_TOPIC_MAX_SEGS);
+            if (r->seg_num <= 0) {
+                ESP_LOGW(TAG, "app '%s': filter too deep %s", app->suffix, r->filter);
+                continue;
+            }
+            if (r->seg_len[r->seg_num - 1] == 1 && r->seg[r->seg_num - 1][0] == '#') {
+                r->multi = true;
+                r->seg_num--;                          ///< '#' 不参与逐层比较
+            }
+
+            /* 判断能否按 base 之后的首段分桶 */
+            int  key      = reg->base_segs;
+            bool hashable = reg->base_segs > 0 && r->seg_num > key;
+            for (int i = 0; hashable && i < reg->base_segs; ++i) {
+                hashable = web_mqtt_manager_seg_eq(r->seg[i], r->seg_len[i],
+                                                   reg->base_seg[i], reg->base_seg_len[i]);
+            }
+            if (hashable && r->seg_len[key] == 1 &&
+                (r->seg[key][0] == '+' || r->seg[key][0] == '#')) {
+                hashable = false;
+            }
+
+            int *head = &reg->wildcard;
+            if (hashable) {
+                uint32_t h = web_mqtt_manager_seg_hash(r->seg[key], r->seg_len[key]);
+                head = &reg->bucket[h % WEB_MQTT_ROUTE_BUCKET_NUM];
+            }
+            r->next = *head;
+            *head   = reg->route_num;
+            reg->route_num++;
+            reg->filter_hash += web_mqtt_manager_seg_hash(r->filter, (int)strlen(r->filter));
+        }
+    }
+
+    return reg;
+}
+
+/**
+ * @brief 快照中是否已有相同的过滤器（用于去重订阅 / 判断能否退订）
+ */
+static bool web_mqtt_registry_has_filter(const web_mqtt_registry_t *reg, int before, const char *filter)
+{
+    int end = (before >= 0) ? before : ((reg != NULL) ? reg->route_num : 0);
+    for (int i = 0; i < end; ++i) {
+        if (strcmp(reg->routes[i].filter, filter) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief 校验模块前缀并计算层级数
+ *
+ * 前缀中可含 '+'（需独占一层），不可含 '#'、空层级或首尾 '/'。
+ */
+static bool web_mqtt_manager_suffix_valid(const char *suffix, int *segs)
+{
+    if (suffix[0] == '\0') {
+        return false;
+    }
+
+    int         n     = 1;
+    const char *level = suffix;
+    for (const char *p = suffix;; ++p) {
+        if (*p == '#') {
+            return false;
+        }
+        if (*p != '/' && *p != '\0') {
+            continue;
+        }
+        size_t len = (size_t)(p - level);
+        if (len == 0 || (len != 1 && memchr(level, '+', len) != NULL)) {
+            return false;                          ///< 空层级，或 '+' 未独占一层
+        }
+        if (*p == '\0') {
+            break;
+        }
+        n++;
+        level = p + 1;
+    }
+
+    *segs = n;
+    return true;
+}
+
+/**
+ * @brief 生成并发布新快照：移除前缀为 key 的模块，再追加 add（可为 NULL）
+ *
+ * 调用方须持有写者互斥量。返回时旧快照已过宽限期并被释放；
+ * 被移除的模块通过 removed 返回，其注册表引用由调用方释放。
+ *
+ * @return
+ *  - ESP_OK           : 成功
+ *  - ESP_ERR_NOT_FOUND: 只移除不追加，且 key 未注册
+ *  - ESP_ERR_NO_MEM   : 内存不足，注册表保持不变
+ */
+static esp_err_t web_mqtt_registry_commit(const char      *key,
+                                          web_mqtt_app_t  *add,
+                                          web_mqtt_app_t **removed)
+{
+    web_mqtt_registry_t *cur     = s_registry;     ///< 写者互斥，直接读取即可
+    int                  cur_num = (cur != NULL) ? cur->app_num : 0;
+    web_mqtt_app_t      *old     = NULL;
+
+    web_mqtt_app_t **apps = (web_mqtt_app_t **)malloc((size_t)(cur_num + 1) * sizeof(*apps));
+    if (apps == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int n = 0;
+    for (int i = 0; i < cur_num; ++i) {
+        if (key != NULL && strcmp(cur->apps[i]->suffix, key) == 0) {
+            old = cur->apps[i];
+        } else {
+            apps[n++] = cur->apps[i];
+        }
+    }
+    if (add != NULL) {
+        apps[n++] = add;
+    } else if (key != NULL && old == NULL) {
+        free(apps);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    web_mqtt_registry_t *next = web_mqtt_registry_build(apps, n);
+    free(apps);
+    if (next == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    __atomic_store_n(&s_registry, next, __ATOMIC_RELEASE); ///< 发布新快照
+    web_mqtt_registry_synchronize();               ///< 等待仍在使用旧快照的读者退出
+    free(cur);
+
+    if (removed != NULL) {
+        *removed = old;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 已切分 Topic 与单条路由逐层比较（'+' 匹配任意一层，'#' 匹配剩余全部含父层级）
+ */
+static bool web_mqtt_manager_route_match(const web_mqtt_route_t *r, const web_mqtt_topic_t *t)
+{
+    if (t->seg_num < r->seg_num || (!r->multi && t->seg_num != r->seg_num)) {
+        return false;
+    }
+
+    for (int i = 0; i < r->seg_num; ++i) {
+        if (r->seg_len[i] == 1 && r->seg[i][0] == '+') {
+            continue;
+        }
+        if (!web_mqtt_manager_seg_eq(r->seg[i], r->seg_len[i], t->seg[i], t->seg_len[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* -------------------- 分发：模块队列与分发线程 -------------------- */
+
+/**
+ * @brief 执行模块回调并记录耗时
+ */
+static void web_mqtt_manager_run_app(web_mqtt_app_t         *app,
+                                     const web_mqtt_topic_t *t,
+                                     const uint8_t          *payload,
+                                     int                     payload_len)
+{
+    int64_t start = esp_timer_get_time();
+
+    if (app->route_cb) {
+        (void)app->route_cb(t, payload, payload_len);
+    } else if (app->cb) {
+        (void)app->cb(t->topic, t->topic_len, payload, payload_len);
+    }
+
+    uint32_t us = (uint32_t)(esp_timer_get_time() - start);
+
+    portENTER_CRITICAL(&app->lock);
+    app->handler_us_sum += us;
+    app->stats.handled++;
+    app->stats.handler_us_avg = (uint32_t)(app->handler_us_sum / app->stats.handled);
+    if (us > app->stats.handler_us_max) {
+        app->stats.handler_us_max = us;
+    }
+    portEXIT_CRITICAL(&app->lock);
+}
+
+/**
+ * @brief 为模块复制一份消息，TRANSFER 模式下尽量直接接管重组缓冲区
+ */
+static web_mqtt_dispatch_msg_t *web_mqtt_manager_msg_create(const web_mqtt_app_t   *app,
+                                                            const web_mqtt_topic_t *t,
+                                                            const uint8_t          *payload,
+                                                            int                     payload_len)
+{
+    bool   transfer = app->dispatch == WEB_MQTT_APP_DISPATCH_TRANSFER &&
+                      mqtt_module_rx_detach(payload);
+    size_t props    = (t->response_topic ? (size_t)t->response_topic_len + 1 : 0) +
+                      (size_t)t->correlation_data_len;
+    size_t size     = sizeof(web_mqtt_dispatch_msg_t) + (size_t)t->topic_len + 1 +
+                      (transfer ? 0 : (size_t)payload_len + 1) + props;
+
+    web_mqtt_dispatch_msg_t *msg = (web_mqtt_dispatch_msg_t *)malloc(size);
+    if (msg == NULL) {
+        if (transfer) {
+            mqtt_module_rx_release(payload);
+        }
+        return NULL;
+    }
+
+    memcpy(msg->text, t->topic, (size_t)t->topic_len);
+    msg->text[t->topic_len] = '\0';
+
+    msg->topic       = *t;
+    msg->topic.topic = msg->text;
+    for (int i = 0; i < t->seg_num; ++i) {
+        msg->topic.seg[i] = msg->text + (t->seg[i] - t->topic); ///< 重定位到副本
+    }
+
+    char *tail = msg->text + t->topic_len + 1;
+    if (transfer) {
+        msg->payload = payload;
+    } else {
+        uint8_t *copy = (uint8_t *)tail;
+        if (payload_len > 0) {
+            memcpy(copy, payload, (size_t)payload_len);
+        }
+        copy[payload_len > 0 ? payload_len : 0] = '\0'; ///< 方便文本协议直接当字符串处理
+        msg->payload = copy;
+        tail += (payload_len > 0 ? payload_len : 0) + 1;
+    }
+
+    if (t->response_topic != NULL) {               ///< MQTT 5.0 属性同样拷贝到消息尾部
+        memcpy(tail, t->response_topic, (size_t)t->response_topic_len + 1);
+        msg->topic.response_topic = tail;
+        tail += t->response_topic_len + 1;
+    }
+    if (t->correlation_data != NULL) {
+        memcpy(tail, t->correlation_data, (size_t)t->correlation_data_len);
+        msg->topic.correlation_data = (const uint8_t *)tail;
+    }
+    msg->payload_len = payload_len;
+    msg->transferred = transfer;
+    msg->enqueue_us  = esp_timer_get_time();
+
+    return msg;
+}
+
+static void web_mqtt_manager_msg_destroy(web_mqtt_dispatch_msg_t *msg)
+{
+    if (msg->transferred) {
+        mqtt_module_rx_release(msg->payload);
+    }
+    free(msg);
+}
+
+/**
+ * @brief 释放模块的一个引用，最后一个引用释放时回收模块及其队列中的消息
+ */
+static void web_mqtt_app_release(web_mqtt_app_t *app)
+{
+    if (__atomic_sub_fetch(&app->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    for (uint16_t i = 0; i < app->queue_count; ++i) {
+        web_mqtt_manager_msg_destroy(app->queue[(app->queue_head + i) % app->queue_cap]);
+    }
+    free(app->queue);
+    free(app->suffix);
+    free(app);
+}
+
+/**
+ * @brief 查找消息命令段对应的限流规则（按声明顺序取第一条匹配）
+ */
+static web_mqtt_app_bucket_t *web_mqtt_app_limit_find(web_mqtt_app_t *app, const web_mqtt_topic_t *t)
+{
+    bool has_cmd = t->cmd_index < t->seg_num;
+
+    for (int i = 0; i < app->limit_num; ++i) {
+        web_mqtt_app_bucket_t *b = &app->limits[i];
+        if (b->cmd_len == 1 && b->cmd[0] == '*') {
+            return b;
+        }
+        if (has_cmd && web_mqtt_manager_seg_eq(b->cmd, b->cmd_len,
+                                               t->seg[t->cmd_index], t->seg_len[t->cmd_index])) {
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 补充令牌并尝试取走一个（调用方持有 app->lock）
+ */
+static bool web_mqtt_app_take_token_locked(web_mqtt_app_bucket_t *b, int64_t now_us)
+{
+    if (b->rate_per_min == 0) {
+        return true;
+    }
+
+    if (b->tokens_milli >= b->cap_milli) {
+        b->last_us = now_us;                       ///< 桶满期间不积累
+    } else if (now_us > b->last_us) {
+        int64_t add = (now_us - b->last_us) * b->rate_per_min / 60000; ///< 1 条/分钟 = 1000 毫令牌 / 60e6 us
+        if (add > 0) {
+            b->last_us += add * 60000 / b->rate_per_min; ///< 只前进已折算的部分，保留零头
+            add += b->tokens_milli;
+            b->tokens_milli = (add >= b->cap_milli) ? b->cap_milli : (uint32_t)add;
+        }
+    }
+
+    if (b->tokens_milli < 1000) {
+        return false;
+    }
+    b->tokens_milli -= 1000;
+    return true;
+}
+
+/**
+ * @brief 用新消息替换队列中同一 Topic 的未执行消息（调用方持有 app->lock）
+ *
+ * @return 被替换的旧消息，未找到时返回 NULL
+ */
+static web_mqtt_dispatch_msg_t *web_mqtt_app_queue_replace_locked(web_mqtt_app_t          *app,
+                                                                  web_mqtt_dispatch_msg_t *msg)
+{
+    for (uint16_t i = 0; i < app->queue_count; ++i) {
+        uint16_t                 idx = (uint16_t)((app->queue_head + i) % app->queue_cap);
+        web_mqtt_dispatch_msg_t *old = app->queue[idx];
+        if (web_mqtt_manager_seg_eq(old->topic.topic, old->topic.topic_len,
+                                    msg->topic.topic, msg->topic.topic_len)) {
+            app->queue[idx] = msg;                 ///< 沿用旧消息的位置，顺序不变
+            return old;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief 把消息交给单个模块，按模块前缀层级补全 cmd_index / for_device
+ *
+ * INLINE 模块（或分发线程尚未启动时）直接在当前任务执行，其余模块入队后由分发线程执行。
+ * 命中限流规则时先按令牌桶判断；合并规则下队列中已有同一 Topic 的消息时直接替换，不消耗令牌。
+ */
+static void web_mqtt_manager_deliver(web_mqtt_app_t   *app,
+                                     web_mqtt_topic_t *t,
+                                     const uint8_t    *payload,
+                                     int               payload_len)
+{
+    int target = t->base_segs + app->suffix_segs;      ///< 目标段下标
+    t->cmd_index  = target + 1;
+    t->for_device = target < t->seg_num &&
+                    web_mqtt_manager_seg_eq(t->seg[target], t->seg_len[target],
+                                            s_mgr_cfg.client_id, (int)s_client_id_len);
+
+    bool                   queue_mode = app->queue != NULL && s_dispatch_sem != NULL;
+    web_mqtt_app_bucket_t *rule       = web_mqtt_app_limit_find(app, t);
+    bool                   coalesce   = rule != NULL && rule->coalesce && queue_mode;
+
+    if (rule != NULL && !coalesce) {               ///< 不合并时先判令牌，被限流的消息不分配内存
+        int64_t now = esp_timer_get_time();
+        portENTER_CRITICAL(&app->lock);
+        bool ok = web_mqtt_app_take_token_locked(rule, now);
+        if (!ok) {
+            app->stats.rate_limited++;
+        }
+        portEXIT_CRITICAL(&app->lock);
+        if (!ok) {
+            web_mqtt_manager_stat_inc(&s_stats.rx_limited);
+            return;
+        }
+    }
+
+    if (!queue_mode) {
+        web_mqtt_manager_run_app(app, t, payload, payload_len);
+        return;
+    }
+
+    web_mqtt_dispatch_msg_t *msg     = web_mqtt_manager_msg_create(app, t, payload, payload_len);
+    web_mqtt_dispatch_msg_t *stale   = NULL;
+    bool                     queued  = false;
+    bool                     limited = false;
+    int64_t                  now     = esp_timer_get_time();
+
+    portENTER_CRITICAL(&app->lock);
+    if (msg != NULL && coalesce && (stale = web_mqtt_app_queue_replace_locked(app, msg)) != NULL) {
+        app->stats.coalesced++;
+    } else if (msg != NULL && coalesce && !web_mqtt_app_take_token_locked(rule, now)) {
+        app->stats.rate_limited++;
+        limited = true;
+    } else if (msg != NULL && app->queue_count < app->queue_cap) {
+        uint16_t tail = (uint16_t)((app->queue_head + app->queue_count) % app->queue_cap);
+        app->queue[tail] = msg;
+        app->queue_count++;
+        app->stats.queued++;
+        if (app->queue_count > app->stats.high_water) {
+            app->stats.high_water = app->queue_count;
+        }
+        queued = true;
+    } else {
+        app->stats.dropped++;
+    }
+    portEXIT_CRITICAL(&app->lock);
+
+    if (stale != NULL) {                           ///< 已替换，旧消息的唤醒仍然有效
+        web_mqtt_manager_msg_destroy(stale);
+        web_mqtt_manager_stat_inc(&s_stats.rx_coalesced);
+        return;
+    }
+    if (limited) {
+        web_mqtt_manager_msg_destroy(msg);
+        web_mqtt_manager_stat_inc(&s_stats.rx_limited);
+        return;
+    }
+    if (!queued) {
+        if (msg != NULL) {
+            web_mqtt_manager_msg_destroy(msg);
+        }
+        web_mqtt_manager_stat_inc(&s_stats.rx_dropped);
+        ESP_LOGW(TAG, "app '%s': dispatch queue full, drop", app->suffix);
+        return;
+    }
+
+    (void)xSemaphoreGive(s_dispatch_sem);          ///< 计数已满时忽略，线程会取到队列为空为止
+}
+
+/**
+ * @brief 取出优先级最高、且当前没有线程在执行的模块的队头消息
+ *
+ * 返回的模块已额外持有一个引用，执行完毕后由调用方释放。
+ */
+static web_mqtt_app_t *web_mqtt_manager_dispatch_pick(web_mqtt_dispatch_msg_t **out)
+{
+    web_mqtt_app_t *picked = NULL;
+    int             rcu    = web_mqtt_registry_read_lock();
+    web_mqtt_registry_t *reg = web_mqtt_registry_deref();
+
+    while (reg != NULL && picked == NULL) {
+        web_mqtt_app_t *best = NULL;
+        for (int i = 0; i < reg->app_num; ++i) {
+            web_mqtt_app_t *app = reg->apps[i];
+            if (app->queue_count == 0 || app->busy) {
+                continue;                          ///< 粗筛，入选后在锁内复核
+            }
+            if (best == NULL || app->priority > best->priority) {
+                best = app;
+            }
+        }
+        if (best == NULL) {
+            break;
+        }
+
+        portENTER_CRITICAL(&best->lock);
+        if (best->queue_count > 0 && !best->busy) {
+            *out = best->queue[best->queue_head];
+            best->queue_head = (uint16_t)((best->queue_head + 1) % best->queue_cap);
+            best->queue_count--;
+            best->busy = true;                     ///< 同一模块串行执行，保证顺序
+            picked = best;
+        }
+        portEXIT_CRITICAL(&best->lock);
+    }
+
+    if (picked != NULL) {
+        __atomic_add_fetch(&picked->refs, 1, __ATOMIC_ACQ_REL); ///< 执行期间防止被注销回收
+    }
+    web_mqtt_registry_read_unlock(rcu);
+
+    return picked;
+}
+
+/**
+ * @brief 分发线程：循环执行各模块队列中的消息，无消息时阻塞等待
+ */
+static void web_mqtt_manager_dispatch_task(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        web_mqtt_dispatch_msg_t *msg = NULL;
+        web_mqtt_app_t          *app = web_mqtt_manager_dispatch_pick(&msg);
+        if (app == NULL) {
+            (void)xSemaphoreTake(s_dispatch_sem, portMAX_DELAY);
+            continue;
+        }
+
+        uint32_t wait_us = (uint32_t)(esp_timer_get_time() - msg->enqueue_us);
+
+        web_mqtt_manager_run_app(app, &msg->topic, msg->payload, msg->payload_len);
+        web_mqtt_manager_msg_destroy(msg);
+
+        portENTER_CRITICAL(&app->lock);
+        if (wait_us > app->stats.wait_us_max) {
+            app->stats.wait_us_max = wait_us;
+        }
+        app->busy = false;
+        portEXIT_CRITICAL(&app->lock);
+
+        web_mqtt_app_release(app);
+    }
+}
+
+/**
+ * @brief 创建分发信号量与分发线程（仅创建一次）
+ */
+static esp_err_t web_mqtt_manager_dispatch_start(void)
+{
+    if (s_dispatch_sem != NULL) {
+        return ESP_OK;
+    }
+
+    s_dispatch_sem = xSemaphoreCreateCounting(WEB_MQTT_DISPATCH_SEM_MAX, 0);
+    if (s_dispatch_sem == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    int num = s_mgr_cfg.dispatch_worker_num;
+    if (num <= 0) {
+        num = 1;
+    } else if (num > WEB_MQTT_DISPATCH_WORKER_MAX) {
+        num = WEB_MQTT_DISPATCH_WORKER_MAX;
+    }
+
+    for (int i = 0; i < num; ++i) {
+        BaseType_t ret = xTaskCreate(web_mqtt_manager_dispatch_task,
+                                     "web_mqtt_disp",
+                                     (s_mgr_cfg.dispatch_stack_size > 0) ? s_mgr_cfg.dispatch_stack_size : 4096,
+                                     NULL,
+                                     (s_mgr_cfg.dispatch_task_prio > 0) ? s_mgr_cfg.dispatch_task_prio : tskIDLE_PRIORITY + 2,
+                                     &s_dispatch_tasks[i]);
+        if (ret != pdPASS) {
+            s_dispatch_tasks[i] = NULL;
+            return (i == 0) ? ESP_ERR_NO_MEM : ESP_OK; ///< 至少一个线程即可工作
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief 唤醒管理状态机处理状态变化
+ */
+static void web_mqtt_manager_wake(void)
+{
+    xn_loop_timer_wake(s_mgr_timer);               ///< 未创建时为空操作
+}
+
+/**
+ * @brief 计算下一次重连等待时间：带上限的指数退避 + 全抖动
+ *
+ * 等待时间在 [0, min(max, base * 2^attempt)] 内均匀随机，
+ * 服务器重启后整批设备的重连被打散到整个窗口内，而不是同时涌入。
+ */
+static uint32_t web_mqtt_manager_backoff_ms(uint32_t attempt)
+{
+    uint32_t base = (uint32_t)s_mgr_cfg.reconnect_interval_ms;
+    if (s_mgr_cfg.reconnect_max_ms <= 0) {
+        return base;                               ///< 未启用退避：固定间隔
+    }
+
+    uint32_t cap    = (uint32_t)s_mgr_cfg.reconnect_max_ms;
+    uint32_t window = cap;
+    if (attempt < 16 && (base << attempt) < cap) {
+        window = base << attempt;
+    }
+    if (window < base) {
+        window = base;
+    }
+
+    return esp_random() % (window + 1);
+}
+
+/**
+ * @brief 结束一轮订阅：全部 SUBACK 已到达且发送完毕时，成功则开始注册握手，失败则调度重试
+ *
+ * 只在管理状态机中调用；SUBACK 回调只记录结果并唤醒管理状态机。
+ */
+static void web_mqtt_manager_sub_check_done(void)
+{
+    bool done   = false;
+    bool failed = false;
+
+    portENTER_CRITICAL(&s_sub_lock);
+    if (!s_sub_done && !s_sub_sending && s_sub_pending_num == 0) {
+        s_sub_done = true;
+        done       = true;
+        failed     = s_sub_failed;
+    }
+    portEXIT_CRITICAL(&s_sub_lock);
+
+    if (!done || s_mgr_state != WEB_MQTT_STATE_CONNECTED) {
+        return;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    if (failed) {
+        web_mqtt_manager_stat_inc(&s_stats.subscribe_failed);
+        uint32_t delay_ms = web_mqtt_manager_backoff_ms(s_sub_attempt++);
+        s_sub_retry_at = now + pdMS_TO_TICKS(delay_ms);
+        if (s_sub_retry_at == 0) {
+            s_sub_retry_at = 1;                    ///< 0 保留为“未调度”
+        }
+        ESP_LOGW(TAG, "subscribe rejected, retry in %u ms", (unsigned)delay_ms);
+        return;
+    }
+
+    s_sub_attempt        = 0;
+    s_sub_hash           = s_sub_round_hash;
+    s_sub_hash_valid     = true;
+    web_mqtt_manager_stat_set(&s_stats.subscribe_ms, (uint32_t)pdTICKS_TO_MS(now - s_connected_since));
+    s_sub_ready          = true;
+    mqtt_reg_module_on_subscribed();               ///< 订阅完成后才能收到 reg/<id>/resp，查询在下一步注册步进中发出
+}
+
+/**
+ * @brief 登记一个需要等待 SUBACK 的 msg_id（SUBACK 可能已先行到达）
+ */
+static void web_mqtt_manager_sub_track(int msg_id)
+{
+    portENTER_CRITICAL(&s_sub_lock);
+    int  n       = s_sub_early_num < WEB_MQTT_SUBACK_EARLY_NUM ? s_sub_early_num
+                                                              : WEB_MQTT_SUBACK_EARLY_NUM;
+    bool arrived = false;
+    for (int i = 0; i < n; ++i) {
+        if (s_sub_early[i] == msg_id || s_sub_early[i] == -msg_id) {
+            arrived = true;
+            if (s_sub_early[i] < 0) {
+                s_sub_failed = true;
+            }
+            s_sub_early[i] = 0;
+            break;
+        }
+    }
+    if (!arrived) {
+        if (s_sub_pending_num < WEB_MQTT_SUBACK_PENDING_MAX) {
+            s_sub_pending[s_sub_pending_num++] = msg_id;
+        } else {
+            ESP_LOGW(TAG, "too many SUBSCRIBE packets, SUBACK %d not tracked", msg_id);
+        }
+    }
+    portEXIT_CRITICAL(&s_sub_lock);
+}
+
+/**
+ * @brief SUBACK 回调（esp-mqtt 任务上下文）：只记录结果，本轮是否结束由管理状态机判断
+ */
+static void web_mqtt_manager_on_suback(int msg_id, bool ok)
+{
+    bool tracked = false;
+
+    portENTER_CRITICAL(&s_sub_lock);
+    for (int i = 0; i < s_sub_pending_num; ++i) {
+        if (s_sub_pending[i] == msg_id) {
+            s_sub_pending[i] = s_sub_pending[--s_sub_pending_num];
+            tracked = true;
+            break;
+        }
+    }
+    if (tracked) {
+        if (!ok) {
+            s_sub_failed = true;
+        }
+    } else if (!s_sub_done && msg_id > 0) {
+        s_sub_early[s_sub_early_num++ % WEB_MQTT_SUBACK_EARLY_NUM] = ok ? msg_id : -msg_id;
+    }
+    portEXIT_CRITICAL(&s_sub_lock);
+
+    if (!ok) {
+        ESP_LOGE(TAG, "SUBACK %d rejected", msg_id);
+    }
+    if (tracked) {
+        web_mqtt_manager_wake();
+    }
+}
+
+/**
+ * @brief 发送一批过滤器，需要跟踪时登记其 msg_id
+ */
+static void web_mqtt_manager_sub_flush(const mqtt_module_topic_t *batch, int num, bool track)
+{
+    if (num == 0) {
+        return;
+    }
+
+    int       msg_id = -1;
+    esp_err_t ret    = mqtt_module_subscribe_multiple(batch, num, &msg_id);
+    if (!track) {
+        return;
+    }
+
+    if (ret == ESP_OK) {
+        web_mqtt_manager_sub_track(msg_id);
+    } else {
+        portENTER_CRITICAL(&s_sub_lock);
+        s_sub_failed = true;                       ///< 本轮视为失败，稍后整轮重试
+        portEXIT_CRITICAL(&s_sub_lock);
+    }
+}
+
+/**
+ * @brief 订阅快照中属于指定模块（app 为 NULL 表示全部模块）的过滤器，相同过滤器只订阅一次
+ *
+ * 过滤器按 MQTT_MODULE_SUBSCRIBE_BATCH_MAX 个一批合并成一个 SUBSCRIBE 报文；
+ * track 为 true 时登记各报文的 msg_id，由 SUBACK 决定何时进入 READY。
+ */
+static void web_mqtt_manager_subscribe_routes(const web_mqtt_registry_t *reg,
+                                              const web_mqtt_app_t      *app,
+                                              bool                       track)
+{
+    if (reg == NULL) {
+        return;
+    }
 
-static web_mqtt_app_entry_t s_app_entries[WEB_MQTT_APP_MAX_NUM]; ///< 模块表
-static int                  s_app_entry_count = 0; ///< 已注册模块数量
+    mqtt_module_topic_t batch[MQTT_MODULE_SUBSCRIBE_BATCH_MAX];
+    int                 num = 0;
+
+    for (int i = 0; i < reg->route_num; ++i) {
+        const web_mqtt_route_t *r = &reg->routes[i];
+        if (app != NULL && r->app != app) {
+            continue;
+        }
+        if (app == NULL && web_mqtt_registry_has_filter(reg, i, r->filter)) {
+            continue;                              ///< 与前面的模块过滤器相同
+        }
+        batch[num].filter = r->filter;             ///< 快照在读侧期间不会释放
+        batch[num].qos    = 1;
+        if (++num == MQTT_MODULE_SUBSCRIBE_BATCH_MAX) {
+            web_mqtt_manager_sub_flush(batch, num, track);
+            num = 0;
+        }
+    }
+    web_mqtt_manager_sub_flush(batch, num, track);
+}
 
 /**
- * @brief 统一更新状态并通知上层回调
+ * @brief 退订被移除模块独占的过滤器（仍被其他模块使用的保留）
  */
-static void web_mqtt_manager_notify_state(web_mqtt_state_t new_state)
+static void web_mqtt_manager_unsubscribe_app(const web_mqtt_registry_t *reg, const web_mqtt_app_t *app)
 {
-    s_mgr_state = new_state;                       ///< 更新内部状态
+    char filter[WEB_MQTT_APP_FILTER_MAX_LEN];
 
-    if (s_mgr_cfg.event_cb) {                      ///< 如上层配置了回调
-        s_mgr_cfg.event_cb(new_state);             ///< 通知上层当前状态
+    for (int f = 0; f < WEB_MQTT_APP_FILTER_MAX_NUM; ++f) {
+        if (app->templates[f] == NULL ||
+            !web_mqtt_manager_expand_filter(app->templates[f], app->suffix, filter, sizeof(filter))) {
+            continue;
+        }
+        if (!web_mqtt_registry_has_filter(reg, -1, filter)) {
+            (void)mqtt_module_unsubscribe(filter);
+        }
     }
 }
 
 /**
- * @brief 确保管理器配置中存在有效的 client_id
- *
- * 若上层未提供（NULL 或空串），则基于芯片 MAC 生成形如
- * "ESP32_XXXXXXXXXXXX" 的默认 client_id，保证单设备唯一。
+ * @brief 是否处于已连接状态（注册 / 注销时需要同步订阅）
  */
-static void web_mqtt_manager_ensure_client_id(void)
+static bool web_mqtt_manager_is_online(void)
 {
-    if (s_mgr_cfg.client_id != NULL &&            ///< 已显式配置
-        s_mgr_cfg.client_id[0] != '\0') {        ///< 且非空串
-        return;                                    ///< 直接使用上层提供的值
+    portENTER_CRITICAL(&s_stats_lock);             ///< 由注册 / 注销模块的任务调用
+    web_mqtt_state_t state = s_mgr_state;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    return state == WEB_MQTT_STATE_CONNECTED ||
+           state == WEB_MQTT_STATE_READY;
+}
+
+/**
+ * @brief 临时任务：执行一次可能阻塞的客户端操作，完成后唤醒管理状态机并退出
+ */
+static void web_mqtt_manager_job_task(void *arg)
+{
+    web_mqtt_job_t *job = (web_mqtt_job_t *)arg;
+
+    switch (job->kind) {
+    case WEB_MQTT_JOB_CONNECT:
+        /* 先停止客户端（最长一个网络超时）并写入目标地址（未切换时原样写回） */
+        job->ret      = mqtt_module_set_uri(mqtt_broker_uri(job->broker));
+        job->switched = job->set_uri && job->ret == ESP_OK;
+        if (job->ret == ESP_OK) {
+            /* 旧客户端已完全停止，此前登记的事件都属于上一代次，由管理状态机丢弃 */
+            __atomic_add_fetch(&s_conn_gen, 1, __ATOMIC_RELEASE);
+            job->started = xTaskGetTickCount();
+            job->ret     = mqtt_module_start();
+        }
+        break;
+
+    case WEB_MQTT_JOB_STOP:
+        (void)mqtt_module_stop();                  ///< 失败时由下一次连接尝试再停止
+        break;
+
+    case WEB_MQTT_JOB_PROBE:
+        job->winner = mqtt_broker_probe(job->broker); ///< 域名解析 + 最长 broker_probe_timeout_ms
+        break;
+
+    case WEB_MQTT_JOB_SUBSCRIBE: {
+        int rcu = web_mqtt_registry_read_lock();
+        const web_mqtt_registry_t *reg = web_mqtt_registry_deref();
+        job->hash = (reg != NULL) ? reg->filter_hash : 0;
+        web_mqtt_manager_subscribe_routes(reg, NULL, true); ///< 断开时客户端立即拒绝，不会久等
+        web_mqtt_registry_read_unlock(rcu);
+        break;
     }
 
-    uint8_t mac[6] = {0};                         ///< MAC 地址缓冲区
-    esp_err_t err = esp_read_mac(mac, ESP_MAC_WIFI_STA); ///< 读取 STA MAC
-    if (err != ESP_OK) {                          ///< 读取失败
-        snprintf(s_client_id_buf, sizeof(s_client_id_buf),
-                 "ESP32_UNKNOWN");              ///< 退化为占位 ID
-    } else {
-        snprintf(s_client_id_buf, sizeof(s_client_id_buf),
-                 "ESP32_%02X%02X%02X%02X%02X%02X",
-                 mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    default:
+        break;
     }
 
-    s_mgr_cfg.client_id = s_client_id_buf;        ///< 填入默认 client_id
+    __atomic_store_n(&job->done, true, __ATOMIC_RELEASE);
+    web_mqtt_manager_wake();
+    vTaskDelete(NULL);
+}
+
+/**
+ * @brief 在临时任务中开始一次客户端操作（调用前需确认没有进行中的操作）
+ */
+static esp_err_t web_mqtt_manager_job_start(web_mqtt_job_kind_t kind, int broker)
+{
+    memset(&s_job, 0, sizeof(s_job));
+    s_job.kind   = kind;
+    s_job.broker = broker;
+    s_job.winner = -1;
+    if (kind == WEB_MQTT_JOB_CONNECT) {
+        s_job.set_uri = (broker != s_client_broker);
+    }
+
+    if (xTaskCreate(web_mqtt_manager_job_task, "web_mqtt_job", WEB_MQTT_JOB_STACK_SIZE,
+                    &s_job, WEB_MQTT_JOB_TASK_PRIO, NULL) != pdPASS) {
+        s_job.kind = WEB_MQTT_JOB_NONE;
+        ESP_LOGE(TAG, "create job task failed");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief 是否有正在执行的客户端操作
+ */
+static bool web_mqtt_manager_job_busy(void)
+{
+    return s_job.kind != WEB_MQTT_JOB_NONE;
 }
 
 /**
- * @brief 在 MQTT 已连接时，为所有已注册应用模块订阅 Topic
+ * @brief 在 MQTT 已连接时，为所有已注册应用模块批量订阅 Topic，开始新一轮 SUBACK 跟踪
+ *
+ * SUBSCRIBE 报文在临时任务中发送（esp_mqtt_client_subscribe 需要等待客户端锁），
+ * 本函数不阻塞共享事件循环；发送完毕后由 web_mqtt_manager_job_finish() 检查本轮是否结束。
  */
 static void web_mqtt_manager_subscribe_all_apps(void)
 {
-    if (s_mgr_cfg.base_topic == NULL) {            ///< 未配置基础 Topic
-        return;                                    ///< 直接返回
+    if (web_mqtt_manager_job_busy()) {
+        s_sub_queued = true;                       ///< 探测或上一轮订阅仍在进行，完成后再开始
+        return;
     }
+    s_sub_queued = false;
 
-    for (int i = 0; i < s_app_entry_count; ++i) {  ///< 遍历所有模块
-        char filter[256];                          ///< 订阅过滤字符串
-        snprintf(filter, sizeof(filter), "%s/%s/#", ///< base_topic/prefix/#
-                 s_mgr_cfg.base_topic,             ///< 基础 Topic
-                 s_app_entries[i].suffix);         ///< 模块前缀
+    portENTER_CRITICAL(&s_sub_lock);
+    s_sub_pending_num = 0;
+    s_sub_early_num   = 0;
+    s_sub_sending     = true;
+    s_sub_failed      = false;
+    s_sub_done        = false;
+    portEXIT_CRITICAL(&s_sub_lock);
 
-        (void)mqtt_module_subscribe(filter, 1);    ///< 订阅，忽略返回值
+    s_sub_start    = xTaskGetTickCount();
+    s_sub_retry_at = 0;
+
+    if (web_mqtt_manager_job_start(WEB_MQTT_JOB_SUBSCRIBE, s_client_broker) != ESP_OK) {
+        portENTER_CRITICAL(&s_sub_lock);
+        s_sub_sending = false;
+        s_sub_failed  = true;                      ///< 按失败处理，稍后整轮重试
+        portEXIT_CRITICAL(&s_sub_lock);
+        web_mqtt_manager_sub_check_done();
     }
 }
 
 /**
  * @brief MQTT 底层消息回调：统一分发到各应用模块
+ *
+ * Topic 只切分一次：先与 base_topic 逐层比较，命中后按下一层哈希取桶，
+ * 再补查通配链表；同一模块只分发一次，未匹配任何模块的消息计入 rx_unmatched。
+ * 整个过程只在 RCU 读侧读取注册表快照，不加锁。
  */
 static void web_mqtt_manager_on_mqtt_message(const char    *topic,
                                              int            topic_len,
                                              const uint8_t *payload,
                                              int            payload_len)
 {
-    if (s_mgr_cfg.base_topic == NULL) {            ///< 未配置基础 Topic
-        return;                                    ///< 不做分发
+    web_mqtt_manager_stat_inc(&s_stats.rx_total); ///< 统计收到的消息
+
+    web_mqtt_topic_t t;
+    t.topic     = topic;
+    t.topic_len = topic_len;
+    t.seg_num   = web_mqtt_manager_split(topic, topic_len, t.seg, t.seg_len, WEB_MQTT_TOPIC_MAX_SEGS);
+    t.base_segs = 0;
+    t.cmd_index = 0;
+    t.for_device = false;
+
+    mqtt_module_msg_props_t props;
+    if (mqtt_module_rx_get_props(&props)) {        ///< 仅 MQTT 5.0 消息可能携带
+        t.response_topic       = props.response_topic;
+        t.response_topic_len   = props.response_topic_len;
+        t.correlation_data     = props.correlation_data;
+        t.correlation_data_len = props.correlation_data_len;
+    } else {
+        t.response_topic       = NULL;
+        t.response_topic_len   = 0;
+        t.correlation_data     = NULL;
+        t.correlation_data_len = 0;
     }
 
-    for (int i = 0; i < s_app_entry_count; ++i) {  ///< 遍历模块表
-        char prefix[128];                          ///< 完整前缀缓冲区
-        int  n = snprintf(prefix, sizeof(prefix),  ///< 生成前缀字符串
-                          "%s/%s",               ///< base_topic/prefix
-                          s_mgr_cfg.base_topic,    ///< 基础 Topic
-                          s_app_entries[i].suffix);///< 模块前缀
-        if (n <= 0 || n >= (int)sizeof(prefix)) {  ///< 生成失败或溢出
-            continue;                              ///< 跳过本模块
-        }
+    int rcu = web_mqtt_registry_read_lock();
+    const web_mqtt_registry_t *reg = web_mqtt_registry_deref();
 
-        int prefix_len = n;                        ///< 前缀长度
-        if (topic_len < prefix_len) {              ///< Topic 过短
-            continue;                              ///< 跳过
-        }
+    if (t.seg_num <= 0 || reg == NULL || reg->route_num == 0) {
+        web_mqtt_registry_read_unlock(rcu);
+        web_mqtt_manager_stat_inc(&s_stats.rx_unmatched);
+        return;                                    ///< 层级过深或没有路由
+    }
 
-        if (memcmp(topic, prefix, prefix_len) != 0) { ///< 前缀不匹配
-            continue;                              ///< 跳过
-        }
+    bool in_base = reg->base_segs > 0 && t.seg_num > reg->base_segs;
+    for (int i = 0; in_base && i < reg->base_segs; ++i) {
+        in_base = web_mqtt_manager_seg_eq(t.seg[i], t.seg_len[i],
+                                          reg->base_seg[i], reg->base_seg_len[i]);
+    }
+    if (in_base) {
+        t.base_segs = reg->base_segs;
+    }
 
-        if (topic_len > prefix_len &&              ///< 有后续字符时
-            topic[prefix_len] != '/') {            ///< 要求分隔符为 '/'
-            continue;                              ///< 否则视为不匹配
-        }
+    uint32_t seq       = ++s_msg_seq;              ///< 本条消息序号，用于每个模块只分发一次
+    bool     delivered = false;
+    int      heads[2];
+    heads[0] = -1;
+    heads[1] = reg->wildcard;
+    if (in_base) {
+        int      key = reg->base_segs;
+        uint32_t h   = web_mqtt_manager_seg_hash(t.seg[key], t.seg_len[key]);
+        heads[0] = reg->bucket[h % WEB_MQTT_ROUTE_BUCKET_NUM];
+    }
 
-        if (s_app_entries[i].cb) {                 ///< 存在回调
-            (void)s_app_entries[i].cb(topic,       ///< 将消息转交模块
-                                       topic_len,
-                                       payload,
-                                       payload_len);
+    for (int l = 0; l < 2; ++l) {
+        for (int ri = heads[l]; ri >= 0; ri = reg->routes[ri].next) {
+            const web_mqtt_route_t *r = &reg->routes[ri];
+            if (r->app->last_seq == seq || !web_mqtt_manager_route_match(r, &t)) {
+                continue;
+            }
+            r->app->last_seq = seq;
+            delivered        = true;
+            web_mqtt_manager_deliver(r->app, &t, payload, payload_len);
         }
     }
+
+    web_mqtt_registry_read_unlock(rcu);
+
+    if (delivered) {
+        web_mqtt_manager_stat_inc(&s_stats.rx_dispatched);
+    } else {
+        web_mqtt_manager_stat_inc(&s_stats.rx_unmatched);
+    }
+}
+
+/**
+ * @brief 持久会话是否被服务器保留，且其中的订阅与当前注册表一致
+ *
+ * 离线期间注册 / 注销过模块时摘要不同，仍需重新订阅；重启后摘要未知，同样重新订阅。
+ */
+static bool web_mqtt_manager_session_resumed(void)
+{
+    if (!s_mgr_cfg.persistent_session || !s_sub_hash_valid || !mqtt_module_session_present()) {
+        return false;
+    }
+
+    int rcu = web_mqtt_registry_read_lock();
+    const web_mqtt_registry_t *reg = web_mqtt_registry_deref();
+    bool same = reg != NULL && reg->filter_hash == s_sub_hash;
+    web_mqtt_registry_read_unlock(rcu);
+
+    return same;
 }
 
 /**
  * @brief MQTT 模块事件回调
  *
- * 由 mqtt_module 在底层连接状态变化时调用，用于驱动管理器状态机。
+ * 由 mqtt_module 在底层连接状态变化时调用（esp-mqtt 任务上下文），
+ * 只把事件与发生时刻放入队列并唤醒管理状态机；状态迁移、订阅与注册握手
+ * 都在管理状态机中按事件顺序处理，两侧不共享其他状态。
  */
 static void web_mqtt_manager_on_mqtt_event(mqtt_module_event_t event)
 {
+    web_mqtt_conn_event_t e = {
+        .event = event,
+        .at    = xTaskGetTickCount(),
+        .gen   = __atomic_load_n(&s_conn_gen, __ATOMIC_ACQUIRE),
+    };
+
+    portENTER_CRITICAL(&s_evt_lock);
+    if (s_evt_tail - s_evt_head >= WEB_MQTT_EVENT_QUEUE_LEN) {
+        s_evt_head++;                              ///< 队列已满：丢弃最旧的事件，最新状态更重要
+    }
+    s_evt_queue[s_evt_tail++ % WEB_MQTT_EVENT_QUEUE_LEN] = e;
+    portEXIT_CRITICAL(&s_evt_lock);
+
+    web_mqtt_manager_wake();                       ///< 由管理状态机处理
+}
+
+/**
+ * @brief 取出一个待处理的连接事件
+ */
+static bool web_mqtt_manager_event_pop(web_mqtt_conn_event_t *out)
+{
+    bool got = false;
+
+    portENTER_CRITICAL(&s_evt_lock);
+    if (s_evt_head != s_evt_tail) {
+        *out = s_evt_queue[s_evt_head++ % WEB_MQTT_EVENT_QUEUE_LEN];
+        got  = true;
+    }
+    portEXIT_CRITICAL(&s_evt_lock);
+
+    return got;
+}
+
+/**
+ * @brief 处理一个底层连接事件（管理状态机上下文）
+ */
+static void web_mqtt_manager_handle_event(const web_mqtt_conn_event_t *e)
+{
+    mqtt_module_event_t event = e->event;
+    TickType_t          now   = e->at;             ///< 以事件发生时刻计算耗时
+
+    if (e->gen != __atomic_load_n(&s_conn_gen, __ATOMIC_ACQUIRE)) {
+        ESP_LOGD(TAG, "drop stale event %d", (int)event); ///< 已停止的上一次尝试，不计入当前服务器
+        return;
+    }
+
     switch (event) {                               ///< 根据事件类型分类处理
     case MQTT_MODULE_EVENT_CONNECTED:              ///< 底层已连接
         ESP_LOGI(TAG, "MQTT connected");          ///< 打印日志
+        s_connected_since = now;                   ///< 记录连接建立时刻
+        s_retry_at        = 0;                     ///< 取消可能已调度的重连，下次断开时重新按退避计算
+        s_ready_seen      = false;
+        mqtt_broker_on_connected(s_client_broker, (uint32_t)pdTICKS_TO_MS(now - s_connect_start));
+        s_sub_attempt     = 0;
+        s_sub_ready       = false;
         web_mqtt_manager_notify_state(WEB_MQTT_STATE_CONNECTED); ///< 更新为已连接
-        s_last_error_ts = 0;                       ///< 清空错误时间戳
-        web_mqtt_manager_subscribe_all_apps();     ///< 为各模块订阅 Topic
-        mqtt_reg_module_on_connected();            ///< 触发一次注册查询
+        mqtt_reg_module_on_connected();            ///< 注册耗时起点；缓存有效时直接完成注册
+        if (web_mqtt_manager_session_resumed()) {  ///< 服务器保留了会话与相同的订阅集合
+            web_mqtt_manager_stat_inc(&s_stats.session_resumed);
+            web_mqtt_manager_stat_set(&s_stats.subscribe_ms, 0);
+            s_sub_ready          = true;
+            ESP_LOGI(TAG, "session resumed, skip subscribe");
+            mqtt_reg_module_on_subscribed();
+        } else {
+            web_mqtt_manager_subscribe_all_apps(); ///< 批量订阅，SUBACK 全部到达后开始注册握手
+        }
         break;                                     ///< 结束分支
 
     case MQTT_MODULE_EVENT_DISCONNECTED:           ///< 底层断开
-        ESP_LOGW(TAG, "MQTT disconnected");       ///< 打印日志
-        web_mqtt_manager_notify_state(WEB_MQTT_STATE_DISCONNECTED); ///< 更新为断开
-        s_last_error_ts = xTaskGetTickCount();     ///< 记录断开时间
-        break;                                     ///< 结束分支
-
     case MQTT_MODULE_EVENT_ERROR:                  ///< 底层错误
     default:                                       ///< 其他视为错误
-        ESP_LOGE(TAG, "MQTT error");             ///< 打印日志
-        web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR); ///< 更新为错误状态
-        s_last_error_ts = xTaskGetTickCount();     ///< 记录错误时间
+        if (s_mgr_state != WEB_MQTT_STATE_CONNECTED &&
+            s_mgr_state != WEB_MQTT_STATE_READY &&
+            s_mgr_state != WEB_MQTT_STATE_CONNECTING) {
+            break;                                 ///< 同一次失败的重复事件（ERROR 后紧跟 DISCONNECTED）
+        }
+        if (s_mgr_state == WEB_MQTT_STATE_CONNECTING) {
+            mqtt_broker_on_failed(s_client_broker, false); ///< 连接尝试失败，计入该服务器
+        }
+        if (s_connected_since != 0 &&
+            (now - s_connected_since) >= pdMS_TO_TICKS(s_mgr_cfg.reconnect_stable_ms)) {
+            s_retry_attempt = 0;                   ///< 连接已稳定过一段时间，退避从头计算
+        }
+        s_connected_since = 0;
+        portENTER_CRITICAL(&s_sub_lock);
+        s_sub_done = true;                         ///< 放弃本轮订阅，重连后重新开始
+        portEXIT_CRITICAL(&s_sub_lock);
+        s_sub_ready  = false;
+        s_sub_queued = false;
+        mqtt_reg_module_on_disconnected();         ///< 放弃未完成的注册握手
+        if (event == MQTT_MODULE_EVENT_DISCONNECTED) {
+            ESP_LOGW(TAG, "MQTT disconnected");   ///< 打印日志
+            web_mqtt_manager_notify_state(WEB_MQTT_STATE_DISCONNECTED); ///< 更新为断开
+        } else {
+            ESP_LOGE(TAG, "MQTT error");         ///< 打印日志
+            web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR); ///< 更新为错误状态
+        }
         break;                                     ///< 结束分支
     }
 }
 
+/**
+ * @brief 向当前选中的服务器发起一次连接尝试，服务器变化时先切换客户端地址
+ *
+ * 停止与重新启动客户端在临时任务中完成，本函数不阻塞；
+ * 旧客户端停止后才进入 CONNECTING（见 web_mqtt_manager_job_finish()）。
+ */
+static esp_err_t web_mqtt_manager_connect(void)
+{
+    int idx = mqtt_broker_current();
+
+    ESP_LOGI(TAG, "try connect MQTT server %s", mqtt_broker_uri(idx)); ///< 打印日志
+    s_raced = false;
+    web_mqtt_manager_stat_inc(&s_stats.connect_attempts);
+    mqtt_broker_on_attempt(idx);
+    return web_mqtt_manager_job_start(WEB_MQTT_JOB_CONNECT, idx);
+}
+
+/**
+ * @brief 连接尝试超出延迟预算：在临时任务中并行探测其他服务器
+ *
+ * 探测期间 esp-mqtt 任务仍在继续当前连接尝试，管理状态机照常处理事件；
+ * 结果由 web_mqtt_manager_job_finish() 处理。
+ */
+static void web_mqtt_manager_race(void)
+{
+    s_raced = true;
+    ESP_LOGW(TAG, "no CONNACK from %s in %d ms, probing other brokers",
+             mqtt_broker_uri(s_client_broker), s_mgr_cfg.broker_latency_budget_ms);
+    (void)web_mqtt_manager_job_start(WEB_MQTT_JOB_PROBE, s_client_broker); ///< 失败时等待连接超时
+}
+
+/**
+ * @brief 处理临时任务完成的客户端操作
+ */
+static void web_mqtt_manager_job_finish(void)
+{
+    web_mqtt_job_t job = s_job;
+    s_job.kind = WEB_MQTT_JOB_NONE;
+
+    switch (job.kind) {
+    case WEB_MQTT_JOB_CONNECT:
+        if (job.switched) {
+            s_client_broker = job.broker;
+            web_mqtt_manager_stat_inc(&s_stats.broker_switches);
+        }
+        if (job.ret != ESP_OK) {
+            mqtt_broker_on_failed(job.broker, false);
+            web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR);
+            break;
+        }
+        s_connect_start = job.started;             ///< 连接耗时与超时从客户端启动时算起
+        web_mqtt_manager_notify_state(WEB_MQTT_STATE_CONNECTING); ///< 旧客户端已停止，进入连接中
+        break;
+
+    case WEB_MQTT_JOB_PROBE: {
+        int cur = job.broker;
+        if (job.winner < 0 || s_mgr_state != WEB_MQTT_STATE_CONNECTING) {
+            break;                                 ///< 无服务器响应，或探测期间已连上 / 已失败
+        }
+
+        /* 停止客户端时旧尝试可能再上报一次错误，其代次已过期，不会计入新服务器 */
+        mqtt_broker_on_failed(cur, true);
+        mqtt_broker_set_current(job.winner);
+        if (web_mqtt_manager_connect() != ESP_OK) {
+            mqtt_broker_on_failed(job.winner, false);
+            web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR);
+        }
+        break;
+    }
+
+    case WEB_MQTT_JOB_SUBSCRIBE:
+        s_sub_round_hash = job.hash;
+        portENTER_CRITICAL(&s_sub_lock);
+        s_sub_sending = false;                     ///< 在状态机中清除，本轮结束时摘要已就绪
+        portEXIT_CRITICAL(&s_sub_lock);
+        web_mqtt_manager_sub_check_done();         ///< 没有模块或 SUBACK 已全部先行到达
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief 推进注册握手；订阅与注册均已完成时进入 READY，注册失效（服务器报告未注册）时退回 CONNECTED
+ *
+ * @return 距注册状态机下一个截止时刻的 Tick 数，portMAX_DELAY 表示没有
+ */
+static TickType_t web_mqtt_manager_reg_step(TickType_t now)
+{
+    int wait_ms = mqtt_reg_module_step();
+
+    if (s_mgr_state == WEB_MQTT_STATE_CONNECTED && s_sub_ready && mqtt_reg_module_is_registered()) {
+        if (!s_ready_seen) {
+            s_ready_seen        = true;
+            web_mqtt_manager_stat_set(&s_stats.register_ms, (uint32_t)pdTICKS_TO_MS(now - s_connected_since));
+            web_mqtt_manager_stat_set(&s_stats.ready_ms,    (uint32_t)pdTICKS_TO_MS(now - s_connect_start));
+            ESP_LOGI(TAG, "MQTT ready in %u ms (subscribe %u ms, register %u ms)",
+                     (unsigned)s_stats.ready_ms, (unsigned)s_stats.subscribe_ms,
+                     (unsigned)s_stats.register_ms);
+        } else {
+            ESP_LOGI(TAG, "MQTT ready again after re-register");
+        }
+        web_mqtt_manager_notify_state(WEB_MQTT_STATE_READY);
+    } else if (s_mgr_state == WEB_MQTT_STATE_READY && !mqtt_reg_module_is_registered()) {
+        ESP_LOGW(TAG, "registration lost, wait for re-register");
+        web_mqtt_manager_notify_state(WEB_MQTT_STATE_CONNECTED); ///< 重新注册完成后再次进入 READY
+    }
+
+    if (wait_ms < 0) {
+        return portMAX_DELAY;
+    }
+    TickType_t wait = pdMS_TO_TICKS(wait_ms);
+    return (wait > 0) ? wait : 1;
+}
+
 /**
  * @brief 单步执行 Web MQTT 管理状态机
  *
- * 根据当前状态与配置决定是否发起连接或等待重试。
+ * @return 距下一个需要处理的时刻的 Tick 数，portMAX_DELAY 表示只等事件
  */
-static void web_mqtt_manager_step(void)
+static TickType_t web_mqtt_manager_step(void)
 {
+    if (web_mqtt_manager_job_busy()) {
+        if (__atomic_load_n(&s_job.done, __ATOMIC_ACQUIRE)) {
+            web_mqtt_manager_job_finish();
+        } else if (s_job.kind == WEB_MQTT_JOB_CONNECT || s_job.kind == WEB_MQTT_JOB_STOP) {
+            return portMAX_DELAY;                  ///< 客户端正在停止 / 重启，完成后由临时任务唤醒
+        }
+    }
+
+    web_mqtt_conn_event_t e;
+    while (web_mqtt_manager_event_pop(&e)) {       ///< 先按顺序处理底层连接事件
+        web_mqtt_manager_handle_event(&e);
+    }
+
+    TickType_t now = xTaskGetTickCount();          ///< 当前 Tick
+
     switch (s_mgr_state) {                         ///< 根据当前状态分类
     case WEB_MQTT_STATE_DISCONNECTED:              ///< 断开状态
     case WEB_MQTT_STATE_ERROR: {                   ///< 错误状态
         if (s_mgr_cfg.reconnect_interval_ms < 0) { ///< 小于 0 表示不自动重连
-            break;                                 ///< 保持当前状态
+            return portMAX_DELAY;                  ///< 保持当前状态
+        }
+
+        if (s_retry_at == 0) {                     ///< 本次断开尚未调度重连
+            bool     failover = false;
+            uint32_t delay_ms = 0;
+            (void)mqtt_broker_select(&failover);   ///< 当前服务器进入冷却期时换一台
+            if (!failover) {                       ///< 仍是同一台，或全部服务器都在冷却期：退避
+                delay_ms = web_mqtt_manager_backoff_ms(s_retry_attempt);
+                s_retry_attempt++;
+            }
+            web_mqtt_manager_stat_set(&s_stats.last_backoff_ms, delay_ms);
+            s_retry_at = now + pdMS_TO_TICKS(delay_ms);
+            if (s_retry_at == 0) {
+                s_retry_at = 1;                    ///< 0 保留为“未调度”
+            }
+            ESP_LOGI(TAG, "reconnect in %u ms (attempt %u)",
+                     (unsigned)delay_ms, (unsigned)s_retry_attempt);
+        }
+
+        if ((TickType_t)(now - s_retry_at) >= (portMAX_DELAY >> 1)) { ///< 尚未到达重连时刻
+            return s_retry_at - now;
         }
 
-        TickType_t now   = xTaskGetTickCount();    ///< 当前 Tick
-        TickType_t delta = (s_last_error_ts == 0)  ///< 若尚未记录
-                               ? 0                 ///< 则视为已到时间
-                               : (now - s_last_error_ts); ///< 与上次错误的间隔
+        if (web_mqtt_manager_job_busy()) {         ///< 探测仍在进行，完成后再发起连接
+            return portMAX_DELAY;
+        }
+        s_retry_at = 0;
+        if (web_mqtt_manager_connect() != ESP_OK) {
+            mqtt_broker_on_failed(s_client_broker, false);
+            web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR);
+        }
+        return 0;                                  ///< 立即计算超时或按退避重新调度
+    }
 
-        TickType_t need = pdMS_TO_TICKS(           ///< 计算需要等待的 Tick
-            (s_mgr_cfg.reconnect_interval_ms <= 0) ///< 间隔 <=0 表示立即重连
-                ? 0
-                : s_mgr_cfg.reconnect_interval_ms);
+    case WEB_MQTT_STATE_CONNECTING: {              ///< 连接中：检查延迟预算与超时
+        TickType_t elapsed = now - s_connect_start;
+        TickType_t wait    = portMAX_DELAY;
 
-        if (delta >= need) {                       ///< 已到达重试时间
-            ESP_LOGI(TAG, "try connect MQTT server"); ///< 打印日志
-            web_mqtt_manager_notify_state(WEB_MQTT_STATE_CONNECTING); ///< 进入连接中
-            (void)mqtt_module_start();             ///< 发起一次连接尝试
-            if (s_last_error_ts == 0) {           ///< 首次尝试时记录时间
-                s_last_error_ts = now;            ///< 避免频繁重试
+        if (!s_raced && s_mgr_cfg.broker_latency_budget_ms > 0 && mqtt_broker_num() > 1) {
+            TickType_t budget = pdMS_TO_TICKS(s_mgr_cfg.broker_latency_budget_ms);
+            if (elapsed >= budget) {
+                web_mqtt_manager_race();
+                return 0;
             }
+            wait = budget - elapsed;
         }
-        break;                                     ///< 结束分支
+
+        if (s_mgr_cfg.connect_timeout_ms <= 0) {
+            return wait;
+        }
+        TickType_t timeout = pdMS_TO_TICKS(s_mgr_cfg.connect_timeout_ms);
+        if (elapsed < timeout) {
+            return (timeout - elapsed < wait) ? timeout - elapsed : wait;
+        }
+        ESP_LOGW(TAG, "connect timeout");
+        mqtt_broker_on_failed(s_client_broker, false);
+        web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR);
+        /* 放弃本次尝试：此后它上报的事件（包括迟到的 CONNACK）都已过期，并停止客户端；
+         * 探测仍在进行时由下一次连接尝试负责停止 */
+        __atomic_add_fetch(&s_conn_gen, 1, __ATOMIC_RELEASE);
+        if (!web_mqtt_manager_job_busy()) {
+            (void)web_mqtt_manager_job_start(WEB_MQTT_JOB_STOP, s_client_broker);
+        }
+        return 0;
+    }
+
+    case WEB_MQTT_STATE_CONNECTED: {               ///< 已连接：等待 SUBACK 与注册握手，超时或被拒绝时重试
+        if (s_sub_queued) {
+            if (web_mqtt_manager_job_busy()) {
+                return portMAX_DELAY;              ///< 临时任务完成后唤醒
+            }
+            web_mqtt_manager_subscribe_all_apps();
+            return 0;
+        }
+        if (!s_sub_ready) {
+            web_mqtt_manager_sub_check_done();     ///< SUBACK 回调已记录结果，在此结束本轮
+        }
+        if (s_sub_ready) {                         ///< 订阅已完成，由注册状态机决定何时进入 READY
+            return web_mqtt_manager_reg_step(now);
+        }
+        if (s_sub_retry_at == 0) {                 ///< 本轮尚未失败，检查 SUBACK 超时
+            if (s_mgr_cfg.connect_timeout_ms <= 0) {
+                return portMAX_DELAY;
+            }
+            TickType_t timeout = pdMS_TO_TICKS(s_mgr_cfg.connect_timeout_ms);
+            TickType_t elapsed = now - s_sub_start;
+            if (elapsed < timeout) {
+                return timeout - elapsed;
+            }
+            ESP_LOGW(TAG, "SUBACK timeout");
+            web_mqtt_manager_stat_inc(&s_stats.subscribe_failed);
+            s_sub_attempt++;
+        } else if ((TickType_t)(now - s_sub_retry_at) >= (portMAX_DELAY >> 1)) {
+            return s_sub_retry_at - now;           ///< 尚未到达重试时刻
+        }
+        web_mqtt_manager_subscribe_all_apps();
+        return 0;
     }
 
-    case WEB_MQTT_STATE_CONNECTED:                 ///< 已连接状态
-    case WEB_MQTT_STATE_READY:                     ///< 业务准备就绪
-    default:                                       ///< 其他状态暂不做周期操作
-        break;                                     ///< 保持静默
+    case WEB_MQTT_STATE_READY:                     ///< 业务准备就绪：服务器报告未注册时退回 CONNECTED 并重新查询
+        return web_mqtt_manager_reg_step(now);
+
+    default:                                       ///< 其他状态无定时动作
+        return portMAX_DELAY;                      ///< 等待断开事件
     }
 }
 
 /**
- * @brief Web MQTT 管理任务：周期性驱动状态机
+ * @brief 管理状态机定时器回调：由事件唤醒与重连定时驱动状态机
+ *
+ * @return 距下一次执行的毫秒数（不超过兜底唤醒周期）
  */
-static void web_mqtt_manager_task(void *arg)
+static uint32_t web_mqtt_manager_on_timer(void *arg)
 {
     (void)arg;                                     ///< 未使用参数
 
-    for (;;) {                                     ///< 永久循环
-        web_mqtt_manager_step();                   ///< 单步执行状态机
+    int        interval_ms = s_mgr_cfg.step_interval_ms; ///< 兜底唤醒周期
+    TickType_t max_wait    = pdMS_TO_TICKS((interval_ms > 0) ? interval_ms
+                                                             : WEB_MQTT_MANAGER_STEP_INTERVAL_MS);
 
-        int interval_ms = s_mgr_cfg.step_interval_ms; ///< 从配置读取间隔
-        if (interval_ms <= 0) {                    ///< 若未配置或非法
-            interval_ms = WEB_MQTT_MANAGER_STEP_INTERVAL_MS; ///< 使用默认值
-        }
+    TickType_t wait = web_mqtt_manager_step();     ///< 单步执行状态机
+    if (wait > max_wait) {
+        wait = max_wait;
+    }
+    return (uint32_t)pdTICKS_TO_MS(wait);          ///< 0 表示状态刚变化，让出一轮后立即再走一步
+}
 
-        vTaskDelay(pdMS_TO_TICKS(interval_ms));    ///< 休眠一段时间
+/**
+ * @brief RPC 方法 "trace"：切换轨迹级别或读出轨迹记录
+ */
+static esp_err_t web_mqtt_manager_trace_method(const uint8_t    *params,
+                                               int               params_len,
+                                               mqtt_rpc_reply_t *reply)
+{
+    int len = mqtt_trace_command(params, params_len, reply->buf, reply->cap);
+    if (len < 0) {
+        return ESP_ERR_INVALID_ARG;
     }
+    reply->len = len;
+    return ESP_OK;
 }
 
 esp_err_t web_mqtt_manager_init(const web_mqtt_manager_config_t *config)
@@ -260,19 +1922,59 @@ esp_err_t web_mqtt_manager_init(const web_mqtt_manager_config_t *config)
         s_mgr_cfg = *config;                       ///< 直接保存一份副本
     }
 
-    /* broker_uri 必须提供 */
-    if (s_mgr_cfg.broker_uri == NULL ||            ///< URI 为空
-        s_mgr_cfg.broker_uri[0] == '\0') {        ///< 或者空字符串
-        return ESP_ERR_INVALID_ARG;                ///< 返回参数错误
+    /* 服务器列表：未配置 brokers 时由 broker_uri 构成单项列表，二者至少提供其一 */
+    mqtt_broker_config_t broker_cfg = MQTT_BROKER_DEFAULT_CONFIG();
+    if (s_mgr_cfg.brokers != NULL && s_mgr_cfg.broker_num > 0) {
+        broker_cfg.list = s_mgr_cfg.brokers;
+        broker_cfg.num  = s_mgr_cfg.broker_num;
+    } else {
+        if (s_mgr_cfg.broker_uri == NULL ||        ///< URI 为空
+            s_mgr_cfg.broker_uri[0] == '\0') {    ///< 或者空字符串
+            return ESP_ERR_INVALID_ARG;            ///< 返回参数错误
+        }
+        s_single_broker.uri    = s_mgr_cfg.broker_uri;
+        s_single_broker.weight = 1;
+        broker_cfg.list = &s_single_broker;
+        broker_cfg.num  = 1;
+    }
+    broker_cfg.latency_budget_ms = s_mgr_cfg.broker_latency_budget_ms;
+    broker_cfg.probe_timeout_ms  = s_mgr_cfg.broker_probe_timeout_ms;
+    broker_cfg.hold_down_ms      = s_mgr_cfg.broker_hold_down_ms;
+
+    esp_err_t ret = mqtt_broker_init(&broker_cfg);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    s_client_broker = mqtt_broker_current();
+
+    /* 消息轨迹：收发路径只写环形缓冲区，先于客户端创建 */
+    mqtt_trace_config_t trace_cfg = MQTT_TRACE_DEFAULT_CONFIG();
+    trace_cfg.capacity = s_mgr_cfg.trace_capacity;
+    trace_cfg.level    = s_mgr_cfg.trace_level;
+    trace_cfg.sample   = s_mgr_cfg.trace_sample;
+    ret = mqtt_trace_init(&trace_cfg);
+    if (ret != ESP_OK) {
+        return ret;
     }
 
     /* 若未指定 client_id，则基于 MAC 生成一个默认 client_id */
     web_mqtt_manager_ensure_client_id();
 
+    /* 初始化前注册的模块在此按最新 base_topic / client_id 重新生成注册表快照 */
+    s_client_id_len = strlen(s_mgr_cfg.client_id);
+    if (!web_mqtt_registry_lock()) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t reg_ret = web_mqtt_registry_commit(NULL, NULL, NULL);
+    web_mqtt_registry_unlock();
+    if (reg_ret != ESP_OK) {
+        return reg_ret;
+    }
+
     /* 组装 MQTT 模块配置 */
     mqtt_module_config_t mqtt_cfg = MQTT_MODULE_DEFAULT_CONFIG(); ///< 基础配置
 
-    mqtt_cfg.broker_uri    = s_mgr_cfg.broker_uri; ///< 服务器 URI
+    mqtt_cfg.broker_uri    = mqtt_broker_uri(s_client_broker); ///< 列表中的第一台服务器
     mqtt_cfg.client_id     = s_mgr_cfg.client_id;  ///< 客户端 ID
     mqtt_cfg.username      = s_mgr_cfg.username;   ///< 用户名
     mqtt_cfg.password      = s_mgr_cfg.password;   ///< 密码
@@ -281,17 +1983,43 @@ esp_err_t web_mqtt_manager_init(const web_mqtt_manager_config_t *config)
         mqtt_cfg.keepalive_sec = s_mgr_cfg.keepalive_sec; ///< 覆盖默认值
     }
 
+    mqtt_cfg.disable_auto_reconnect = true;        ///< 重连时机由管理器的退避调度决定
+    if (broker_cfg.num > 1 && broker_cfg.latency_budget_ms > 0) {
+        /* 放弃慢服务器时需停止客户端，建连超时决定停止最长阻塞多久，从而限定切换耗时 */
+        mqtt_cfg.network_timeout_ms = broker_cfg.latency_budget_ms + broker_cfg.probe_timeout_ms;
+    }
+    mqtt_cfg.protocol_v5   = s_mgr_cfg.protocol_v5; ///< 协议版本
+    mqtt_cfg.persistent_session = s_mgr_cfg.persistent_session; ///< 持久会话
+    mqtt_cfg.session_expiry_sec = s_mgr_cfg.session_expiry_sec;
+    mqtt_cfg.topic_alias_max    = s_mgr_cfg.topic_alias_max;    ///< 上行 Topic 别名
+    mqtt_cfg.compress_min_len   = s_mgr_cfg.compress_min_len;   ///< 上行负载压缩阈值
+    mqtt_cfg.inflight_max       = s_mgr_cfg.inflight_max;       ///< QoS>=1 在途窗口
+    mqtt_cfg.inflight_wait_ms   = s_mgr_cfg.inflight_wait_ms;
+    mqtt_cfg.inflight_cb        = s_mgr_cfg.inflight_cb;
+    mqtt_cfg.trace              = mqtt_trace_get_default(); ///< 与 RPC "trace" 读取的是同一缓冲区
     mqtt_cfg.event_cb      = web_mqtt_manager_on_mqtt_event; ///< 绑定事件回调
     mqtt_cfg.message_cb    = web_mqtt_manager_on_mqtt_message; ///< 绑定消息回调
+    mqtt_cfg.suback_cb     = web_mqtt_manager_on_suback; ///< 跟踪 SUBACK 决定何时进入 READY
+
+    static const mqtt_spool_config_t spool_cfg = MQTT_SPOOL_DEFAULT_CONFIG(); ///< 离线缓存使用默认配置
+    if (s_mgr_cfg.offline_spool) {                 ///< 启用离线缓存
+        mqtt_cfg.spool_cfg = &spool_cfg;
+    }
+
+    /* 先启动分发线程，保证第一条下行消息就不在 esp-mqtt 任务中执行模块回调 */
+    ret = web_mqtt_manager_dispatch_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     /* 初始化底层 MQTT 模块 */
-    esp_err_t ret = mqtt_module_init(&mqtt_cfg);   ///< 调用底层初始化
+    ret = mqtt_module_init(&mqtt_cfg);             ///< 调用底层初始化
     if (ret != ESP_OK) {                           ///< 初始化失败
         return ret;                                 ///< 直接返回错误码
     }
 
     /* 初始化内部应用模块（设备注册 + 心跳） */
-    ret = mqtt_reg_module_init(&s_mgr_cfg);        ///< 初始化注册模块
+    ret = mqtt_reg_module_init(&s_mgr_cfg, web_mqtt_manager_wake); ///< 初始化注册模块，状态变化时唤醒管理状态机
     if (ret != ESP_OK) {                           ///< 初始化失败
         return ret;                                 ///< 直接返回错误码
     }
@@ -301,29 +2029,45 @@ esp_err_t web_mqtt_manager_init(const web_mqtt_manager_config_t *config)
         return ret;                                 ///< 直接返回错误码
     }
 
-    /* 初始化状态 */
-    s_mgr_state     = WEB_MQTT_STATE_DISCONNECTED; ///< 初始设为断开
-    s_last_error_ts = 0;                           ///< 清空错误时间戳
+    if (s_mgr_cfg.rpc_inflight_max > 0) {          ///< 启用 RPC 模块
+        ret = mqtt_rpc_module_init(&s_mgr_cfg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (s_mgr_cfg.trace_capacity > 0) {
+            ret = mqtt_rpc_register_method(MQTT_TRACE_RPC_METHOD, web_mqtt_manager_trace_method);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
 
-    /* 创建管理任务（仅创建一次） */
-    if (s_mgr_task == NULL) {                      ///< 尚未创建任务
-        BaseType_t ret_task = xTaskCreate(         ///< 创建 FreeRTOS 任务
-            web_mqtt_manager_task,                 ///< 任务函数
-            "web_mqtt_mgr",                      ///< 任务名
-            4096,                                  ///< 栈大小
-            NULL,                                  ///< 任务参数
-            tskIDLE_PRIORITY + 1,                  ///< 优先级
-            &s_mgr_task);                          ///< 输出任务句柄
+    /* 初始化状态：首次连接由本函数直接发起，视为连接中 */
+    portENTER_CRITICAL(&s_stats_lock);
+    s_mgr_state       = WEB_MQTT_STATE_CONNECTING;
+    portEXIT_CRITICAL(&s_stats_lock);
+    s_retry_attempt   = 0;
+    s_retry_at        = 0;
+    s_connected_since = 0;
+    s_connect_start   = xTaskGetTickCount();
 
-        if (ret_task != pdPASS) {                  ///< 创建失败
-            s_mgr_task = NULL;                     ///< 清空句柄
-            return ESP_ERR_NO_MEM;                 ///< 返回内存不足
+    /* 创建管理定时器（仅创建一次），与心跳、WiFi 管理共用 xn_loop 任务 */
+    if (s_mgr_timer == NULL) {                     ///< 尚未创建定时器
+        ret = xn_loop_timer_create("web_mqtt_mgr", web_mqtt_manager_on_timer, NULL, &s_mgr_timer);
+        if (ret != ESP_OK) {                       ///< 创建失败
+            return ret;
         }
     }
+    (void)xn_loop_timer_start(s_mgr_timer, 0);     ///< 立即执行一次
 
-    /* 初始化完成后，可立即触发一次连接尝试 */
-    web_mqtt_manager_notify_state(WEB_MQTT_STATE_DISCONNECTED); ///< 确认状态
-    (void)mqtt_module_start();                     ///< 直接尝试连接一次
+    /* 初始化完成后，立即触发一次连接尝试；失败事件会唤醒管理定时器进入退避 */
+    web_mqtt_manager_notify_state(WEB_MQTT_STATE_CONNECTING); ///< 确认状态
+    web_mqtt_manager_stat_inc(&s_stats.connect_attempts);
+    mqtt_broker_on_attempt(s_client_broker);
+    if (mqtt_module_start() != ESP_OK) {           ///< 直接尝试连接一次
+        web_mqtt_manager_notify_state(WEB_MQTT_STATE_ERROR);
+        web_mqtt_manager_wake();
+    }
 
     return ESP_OK;                                 ///< 返回成功
 }
@@ -331,48 +2075,199 @@ esp_err_t web_mqtt_manager_init(const web_mqtt_manager_config_t *config)
 esp_err_t web_mqtt_manager_register_app(const char *topic_suffix,
                                         web_mqtt_app_msg_cb_t cb)
 {
-    if (topic_suffix == NULL || cb == NULL) {      ///< 参数不可为空
+    web_mqtt_app_config_t cfg = {
+        .topic_suffix = topic_suffix,
+        .cb           = cb,
+    };
+    return web_mqtt_manager_register_app_ex(&cfg);
+}
+
+esp_err_t web_mqtt_manager_register_app_ex(const web_mqtt_app_config_t *config)
+{
+    if (config == NULL ||                          ///< 参数不可为空
+        config->topic_suffix == NULL ||
+        (config->cb == NULL && config->route_cb == NULL)) {
         return ESP_ERR_INVALID_ARG;                ///< 返回参数错误
     }
 
-    if (topic_suffix[0] == '\0') {                ///< 前缀不能为空串
-        return ESP_ERR_INVALID_ARG;                ///< 返回参数错误
+    int suffix_segs = 0;
+    if (!web_mqtt_manager_suffix_valid(config->topic_suffix, &suffix_segs)) {
+        return ESP_ERR_INVALID_ARG;                ///< 前缀非法
     }
 
-    if (s_app_entry_count >= WEB_MQTT_APP_MAX_NUM) { ///< 模块数量已达上限
-        return ESP_ERR_NO_MEM;                     ///< 返回内存不足
+    web_mqtt_app_t *app = (web_mqtt_app_t *)calloc(1, sizeof(web_mqtt_app_t));
+    if (app == NULL) {
+        return ESP_ERR_NO_MEM;
     }
+    app->suffix = strdup(config->topic_suffix);    ///< 保存前缀
+    if (app->suffix == NULL) {
+        free(app);
+        return ESP_ERR_NO_MEM;
+    }
+    app->suffix_segs = suffix_segs;
+    app->cb          = config->cb;                 ///< 保存回调
+    app->route_cb    = config->route_cb;
+    app->dispatch    = config->dispatch;
+    app->priority    = config->priority;
+    app->refs        = 1;                          ///< 注册表持有的引用
+    portMUX_INITIALIZE(&app->lock);
 
-    size_t len = strlen(topic_suffix);             ///< 计算前缀长度
-    if (len >= WEB_MQTT_APP_SUFFIX_MAX_LEN) {      ///< 超出可用空间
-        return ESP_ERR_INVALID_ARG;                ///< 返回参数错误
+    /* 保存订阅模板，未声明时使用默认模板 */
+    bool has_tpl = false;
+    for (int i = 0; i < WEB_MQTT_APP_FILTER_MAX_NUM; ++i) {
+        app->templates[i] = config->filters[i];
+        has_tpl |= (config->filters[i] != NULL);
+    }
+    if (!has_tpl) {
+        for (size_t i = 0; i < sizeof(s_default_templates) / sizeof(s_default_templates[0]); ++i) {
+            app->templates[i] = s_default_templates[i];
+        }
+    }
+
+    /* 限流规则：令牌桶初始为满，允许启动后立即处理一次突发 */
+    int64_t now_us = esp_timer_get_time();
+    for (int i = 0; i < WEB_MQTT_APP_LIMIT_MAX_NUM && config->limits[i].cmd != NULL; ++i) {
+        const web_mqtt_app_limit_t *l = &config->limits[i];
+        size_t                      n = strlen(l->cmd);
+        if (n == 0 || n > UINT8_MAX || strchr(l->cmd, '/') != NULL) {
+            web_mqtt_app_release(app);
+            return ESP_ERR_INVALID_ARG;
+        }
+        web_mqtt_app_bucket_t *b = &app->limits[app->limit_num++];
+        b->cmd          = l->cmd;
+        b->cmd_len      = (uint8_t)n;
+        b->coalesce     = l->coalesce;
+        b->rate_per_min = l->rate_per_min;
+        b->cap_milli    = (uint32_t)((l->burst > 0) ? l->burst : 1) * 1000u;
+        b->tokens_milli = b->cap_milli;
+        b->last_us      = now_us;
     }
 
-    for (int i = 0; i < s_app_entry_count; ++i) {  ///< 查找是否已存在
-        if (strcmp(s_app_entries[i].suffix, topic_suffix) == 0) {
-            s_app_entries[i].cb = cb;              ///< 更新回调
-            return ESP_OK;                         ///< 返回成功
+    /* 非 INLINE 模块分配分发队列 */
+    if (config->dispatch != WEB_MQTT_APP_DISPATCH_INLINE) {
+        int cap = (config->queue_len > 0) ? config->queue_len : WEB_MQTT_APP_QUEUE_DEFAULT_LEN;
+        if (cap > UINT16_MAX) {
+            cap = UINT16_MAX;
+        }
+        app->queue = (web_mqtt_dispatch_msg_t **)calloc((size_t)cap, sizeof(*app->queue));
+        if (app->queue == NULL) {
+            web_mqtt_app_release(app);
+            return ESP_ERR_NO_MEM;
         }
+        app->queue_cap = (uint16_t)cap;
+    }
+
+    if (!web_mqtt_registry_lock()) {
+        web_mqtt_app_release(app);
+        return ESP_ERR_NO_MEM;
     }
 
-    strcpy(s_app_entries[s_app_entry_count].suffix, topic_suffix); ///< 保存前缀
-    s_app_entries[s_app_entry_count].cb = cb;       ///< 保存回调
-    s_app_entry_count++;                            ///< 模块数量加一
+    /* 同名模块视为替换：旧模块队列中尚未执行的消息随旧模块一起丢弃 */
+    web_mqtt_app_t *old = NULL;
+    esp_err_t ret = web_mqtt_registry_commit(app->suffix, app, &old);
+    if (ret == ESP_OK && web_mqtt_manager_is_online()) {
+        web_mqtt_manager_subscribe_routes(s_registry, app, false); ///< 已连接则立即订阅
+        if (old != NULL) {
+            web_mqtt_manager_unsubscribe_app(s_registry, old);
+        }
+    }
+    web_mqtt_registry_unlock();
 
-    /* 若 MQTT 已连接，则立即为该模块订阅一次 */
-    if (s_mgr_cfg.base_topic != NULL &&
-        (s_mgr_state == WEB_MQTT_STATE_CONNECTED ||
-         s_mgr_state == WEB_MQTT_STATE_READY)) {
-        char filter[256];                          ///< 订阅过滤字符串
-        snprintf(filter, sizeof(filter), "%s/%s/#", ///< base_topic/prefix/#
-                 s_mgr_cfg.base_topic,             ///< 基础 Topic
-                 topic_suffix);                    ///< 模块前缀
-        (void)mqtt_module_subscribe(filter, 1);    ///< 订阅，忽略返回值
+    if (ret != ESP_OK) {
+        web_mqtt_app_release(app);
+        return ret;
+    }
+    if (old != NULL) {
+        web_mqtt_app_release(old);
     }
 
     return ESP_OK;                                  ///< 返回成功
 }
 
+esp_err_t web_mqtt_manager_unregister_app(const char *topic_suffix)
+{
+    if (topic_suffix == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!web_mqtt_registry_lock()) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    web_mqtt_app_t *old = NULL;
+    esp_err_t ret = web_mqtt_registry_commit(topic_suffix, NULL, &old);
+    if (ret == ESP_OK && web_mqtt_manager_is_online()) {
+        web_mqtt_manager_unsubscribe_app(s_registry, old);
+    }
+    web_mqtt_registry_unlock();
+
+    if (old != NULL) {
+        web_mqtt_app_release(old);                 ///< 正在执行的回调返回后才真正回收
+    }
+
+    return ret;
+}
+
+esp_err_t web_mqtt_manager_get_stats(web_mqtt_manager_stats_t *out)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_lock);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_stats_lock);
+    out->rx_queue_depth      = 0;
+    out->rx_queue_high_water = 0;
+
+    int rcu = web_mqtt_registry_read_lock();
+    const web_mqtt_registry_t *reg = web_mqtt_registry_deref();
+    for (int i = 0; reg != NULL && i < reg->app_num; ++i) {
+        web_mqtt_app_t *app = reg->apps[i];
+        portENTER_CRITICAL(&app->lock);
+        out->rx_queue_depth += app->queue_count;
+        if (app->stats.high_water > out->rx_queue_high_water) {
+            out->rx_queue_high_water = app->stats.high_water;
+        }
+        portEXIT_CRITICAL(&app->lock);
+    }
+    web_mqtt_registry_read_unlock(rcu);
+
+    return ESP_OK;
+}
+
+esp_err_t web_mqtt_manager_get_broker_stats(mqtt_broker_stats_t *out, int max, int *num)
+{
+    return mqtt_broker_get_stats(out, max, num);
+}
+
+esp_err_t web_mqtt_manager_get_app_stats(const char *topic_suffix, web_mqtt_app_stats_t *out)
+{
+    if (topic_suffix == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+    int       rcu = web_mqtt_registry_read_lock();
+    const web_mqtt_registry_t *reg = web_mqtt_registry_deref();
+
+    for (int i = 0; reg != NULL && i < reg->app_num; ++i) {
+        web_mqtt_app_t *app = reg->apps[i];
+        if (strcmp(app->suffix, topic_suffix) != 0) {
+            continue;
+        }
+        portENTER_CRITICAL(&app->lock);
+        *out       = app->stats;
+        out->depth = app->queue_count;
+        portEXIT_CRITICAL(&app->lock);
+        ret = ESP_OK;
+        break;
+    }
+
+    web_mqtt_registry_read_unlock(rcu);
+    return ret;
+}
+
 const char *web_mqtt_manager_get_client_id(void)
 {
     return s_mgr_cfg.client_id;
@@ -382,3 +2277,4 @@ const char *web_mqtt_manager_get_base_topic(void)
 {
     return s_mgr_cfg.base_topic;
 }
+
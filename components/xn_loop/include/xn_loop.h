@@ -0,0 +1,125 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-16 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-16 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_loop\include\xn_loop.h
+ * @Description: 共享事件循环接口（单任务 + 定时器）
+ *
+ * 设计要点：
+ *  - 只有一个任务、一块栈，各模块把原本“循环 + vTaskDelay”的管理任务改为定时器回调；
+ *  - 回调返回距下一次执行的毫秒数，也可由其他任务随时唤醒（替代 xTaskNotifyGive）；
+ *  - 定时器按到期时刻排序，同一时刻按创建顺序执行，顺序确定；
+ *  - 到期时刻相差不超过 slack_ms 的定时器在同一次唤醒中执行，减少上下文切换；
+ *  - 回调在同一任务中串行执行，不得长时间阻塞，否则会推迟其他模块。
+ */
+
+#ifndef XN_LOOP_H
+#define XN_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/**
+ * @brief 回调返回值：不再定时，只在 xn_loop_timer_wake / xn_loop_timer_start 时执行
+ */
+#define XN_LOOP_IDLE UINT32_MAX
+
+/**
+ * @brief 定时器回调（在事件循环任务中执行）
+ *
+ * @return 距下一次执行的毫秒数；0 表示在本轮其他到期定时器之后立即再执行；XN_LOOP_IDLE 表示只等唤醒
+ */
+typedef uint32_t (*xn_loop_cb_t)(void *arg);
+
+/**
+ * @brief 定时器句柄
+ */
+typedef struct xn_loop_timer_s xn_loop_timer_t;
+
+/**
+ * @brief 事件循环配置
+ */
+typedef struct {
+    int stack_size; ///< 任务栈大小（字节），需容纳最深的一个回调
+    int priority;   ///< 任务优先级
+    int slack_ms;   ///< 合并窗口（ms）：唤醒时一并执行在该时长内到期的定时器，0 表示严格按时
+} xn_loop_config_t;
+
+/**
+ * @brief 事件循环默认配置
+ */
+#define XN_LOOP_DEFAULT_CONFIG()   \
+    (xn_loop_config_t){           \
+        .stack_size = 4096,       \
+        .priority   = 1,          \
+        .slack_ms   = 50,         \
+    }
+
+/**
+ * @brief 事件循环统计信息
+ *
+ * 每分钟上下文切换次数约为 wakeups * 60000 / uptime_ms（每次唤醒切入、切出各一次）。
+ */
+typedef struct {
+    uint32_t wakeups;        ///< 任务从阻塞中被唤醒的次数
+    uint32_t runs;           ///< 回调执行次数
+    uint32_t uptime_ms;      ///< 统计区间时长（ms）
+    uint32_t run_us_max;     ///< 单次回调最长耗时（us）
+    uint32_t late_ms_max;    ///< 回调相对到期时刻的最大延迟（ms），反映被其他回调阻塞的程度
+    uint32_t stack_free_min; ///< 任务栈历史最小剩余（字节）
+    uint16_t timer_num;      ///< 已创建的定时器数量
+} xn_loop_stats_t;
+
+/**
+ * @brief 启动事件循环（只创建一次任务，重复调用直接返回 ESP_OK）
+ *
+ * 可在各模块初始化前调用以指定栈大小等参数；未调用时首次创建定时器会按默认配置启动。
+ *
+ * @param config 配置，NULL 表示使用默认配置
+ *
+ * @return
+ *      - ESP_OK         : 启动成功
+ *      - ESP_ERR_NO_MEM : 创建任务失败
+ */
+esp_err_t xn_loop_init(const xn_loop_config_t *config);
+
+/**
+ * @brief 创建定时器（创建后未启动）
+ *
+ * @param name 名称（需为静态字符串），仅用于日志
+ * @param cb   回调
+ * @param arg  回调参数
+ * @param out  输出定时器句柄
+ *
+ * @return
+ *      - ESP_OK              : 创建成功
+ *      - ESP_ERR_INVALID_ARG : 参数为 NULL
+ *      - ESP_ERR_NO_MEM      : 内存不足或事件循环启动失败
+ */
+esp_err_t xn_loop_timer_create(const char *name, xn_loop_cb_t cb, void *arg, xn_loop_timer_t **out);
+
+/**
+ * @brief 在 delay_ms 后执行定时器（已启动时重新安排到期时刻）
+ *
+ * 可在任意任务中调用（不可在中断中调用）。
+ */
+esp_err_t xn_loop_timer_start(xn_loop_timer_t *timer, uint32_t delay_ms);
+
+/**
+ * @brief 尽快执行定时器（已安排的更早时刻保持不变）
+ *
+ * 用于状态变化时通知模块，可在任意任务中调用；在回调执行期间调用时，回调返回后会再执行一次。
+ */
+void xn_loop_timer_wake(xn_loop_timer_t *timer);
+
+/**
+ * @brief 获取事件循环统计信息
+ *
+ * @param reset 读取后清零计数并重新开始计时
+ */
+esp_err_t xn_loop_get_stats(xn_loop_stats_t *out, bool reset);
+
+#endif /* XN_LOOP_H */
@@ -0,0 +1,296 @@
+/*
+ * @Author: 星年 && jixingnian@gmail.com
+ * @Date: 2025-12-16 10:00:00
+ * @LastEditors: xingnian && jixingnian@gmail.com
+ * @LastEditTime: 2025-12-16 10:00:00
+ * @FilePath: \xn_esp32_web_mqtt_manager\components\xn_loop\src\xn_loop.c
+ * @Description: 共享事件循环实现
+ *
+ * 已启动的定时器按 (到期时刻, 创建序号) 排成单向链表，任务只阻塞到链表头的到期时刻。
+ * 模块数量只有个位数，插入是短链表遍历；相比按固定节拍转动的时间轮，
+ * 空闲时不需要为空槽位唤醒，这正是合并任务想省下的上下文切换。
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "xn_loop.h"
+
+static const char *TAG = "xn_loop";               ///< 本模块日志 TAG
+
+#define XN_LOOP_DELAY_MAX (portMAX_DELAY >> 1)     ///< 单次延迟上限（Tick），保证回绕比较有效
+
+/**
+ * @brief 定时器
+ */
+struct xn_loop_timer_s {
+    xn_loop_timer_t *next;  ///< 链表后继（仅在 armed 时有效）
+    TickType_t       due;   ///< 到期时刻
+    uint16_t         id;    ///< 创建序号，同一时刻按序号执行
+    bool             armed; ///< 是否在链表中
+    const char      *name;  ///< 名称
+    xn_loop_cb_t     cb;    ///< 回调
+    void            *arg;   ///< 回调参数
+};
+
+/**
+ * @brief 模块状态
+ */
+static struct {
+    portMUX_TYPE     lock;      ///< 保护链表、统计与下列字段
+    TaskHandle_t     task;      ///< 事件循环任务
+    xn_loop_timer_t *head;      ///< 最早到期的定时器
+    uint16_t         timer_num; ///< 已创建的定时器数量
+    TickType_t       slack;     ///< 合并窗口（Tick）
+    int64_t          since_us;  ///< 统计起点
+    xn_loop_stats_t  stats;     ///< 统计信息（uptime_ms / stack_free_min / timer_num 读取时计算）
+} s_loop = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/**
+ * @brief 内部辅助：a 是否早于 b 执行
+ */
+static bool xn_loop_before(const xn_loop_timer_t *a, const xn_loop_timer_t *b)
+{
+    int32_t d = (int32_t)(a->due - b->due);
+    return d < 0 || (d == 0 && a->id < b->id);
+}
+
+/**
+ * @brief 内部辅助：从链表摘下定时器（需持有锁）
+ */
+static void xn_loop_unlink_locked(xn_loop_timer_t *t)
+{
+    for (xn_loop_timer_t **pp = &s_loop.head; *pp != NULL; pp = &(*pp)->next) {
+        if (*pp == t) {
+            *pp = t->next;
+            break;
+        }
+    }
+    t->next  = NULL;
+    t->armed = false;
+}
+
+/**
+ * @brief 内部辅助：按到期时刻插入定时器（需持有锁）
+ *
+ * @return 插入后是否成为链表头（此时需要唤醒任务重新计算等待时间）
+ */
+static bool xn_loop_insert_locked(xn_loop_timer_t *t, TickType_t due)
+{
+    if (t->armed) {
+        xn_loop_unlink_locked(t);
+    }
+    t->due   = due;
+    t->armed = true;
+
+    xn_loop_timer_t **pp = &s_loop.head;
+    while (*pp != NULL && !xn_loop_before(t, *pp)) {
+        pp = &(*pp)->next;
+    }
+    t->next = *pp;
+    *pp     = t;
+    return s_loop.head == t;
+}
+
+/**
+ * @brief 内部辅助：毫秒换算为延迟 Tick（带上限）
+ */
+static TickType_t xn_loop_ticks(uint32_t ms)
+{
+    uint64_t ticks = (uint64_t)ms * configTICK_RATE_HZ / 1000;
+    return (ticks > XN_LOOP_DELAY_MAX) ? XN_LOOP_DELAY_MAX : (TickType_t)ticks;
+}
+
+/**
+ * @brief 内部辅助：取出一个已到期（含合并窗口内）的定时器，没有时返回等待 Tick 数
+ */
+static xn_loop_timer_t *xn_loop_pop_due(TickType_t now, TickType_t *wait)
+{
+    xn_loop_timer_t *t = NULL;
+
+    portENTER_CRITICAL(&s_loop.lock);
+    xn_loop_timer_t *head = s_loop.head;
+    if (head == NULL) {
+        *wait = portMAX_DELAY;
+    } else if ((int32_t)(head->due - now) <= (int32_t)s_loop.slack) {
+        t             = head;
+        s_loop.head   = head->next;
+        t->next       = NULL;
+        t->armed      = false;
+        uint32_t late = ((int32_t)(now - t->due) > 0) ? (uint32_t)pdTICKS_TO_MS(now - t->due) : 0;
+        if (late > s_loop.stats.late_ms_max) {
+            s_loop.stats.late_ms_max = late;
+        }
+    } else {
+        *wait = head->due - now;
+    }
+    portEXIT_CRITICAL(&s_loop.lock);
+
+    return t;
+}
+
+/**
+ * @brief 事件循环任务：依次执行到期的定时器，其余时间阻塞到最早的到期时刻或被唤醒
+ */
+static void xn_loop_task(void *arg)
+{
+    (void)arg;
+
+    for (;;) {
+        TickType_t       now  = xTaskGetTickCount();
+        TickType_t       wait = 0;
+        xn_loop_timer_t *t    = xn_loop_pop_due(now, &wait);
+
+        if (t == NULL) {
+            (void)ulTaskNotifyTake(pdTRUE, wait);
+            portENTER_CRITICAL(&s_loop.lock);
+            s_loop.stats.wakeups++;
+            portEXIT_CRITICAL(&s_loop.lock);
+            continue;
+        }
+
+        int64_t  start = esp_timer_get_time();
+        uint32_t next  = t->cb(t->arg);
+        uint32_t cost  = (uint32_t)(esp_timer_get_time() - start);
+
+        TickType_t end = xTaskGetTickCount();
+        portENTER_CRITICAL(&s_loop.lock);
+        s_loop.stats.runs++;
+        if (cost > s_loop.stats.run_us_max) {
+            s_loop.stats.run_us_max = cost;
+        }
+        if (next != XN_LOOP_IDLE) {
+            TickType_t due = end + xn_loop_ticks(next);
+            if (!t->armed || (int32_t)(due - t->due) < 0) { ///< 回调期间被唤醒时保留更早的时刻
+                (void)xn_loop_insert_locked(t, due);
+            }
+        }
+        portEXIT_CRITICAL(&s_loop.lock);
+    }
+}
+
+esp_err_t xn_loop_init(const xn_loop_config_t *config)
+{
+    xn_loop_config_t cfg = (config != NULL) ? *config : XN_LOOP_DEFAULT_CONFIG();
+
+    portENTER_CRITICAL(&s_loop.lock);
+    bool started = (s_loop.task != NULL);
+    portEXIT_CRITICAL(&s_loop.lock);
+    if (started) {
+        return ESP_OK;
+    }
+
+    s_loop.slack    = xn_loop_ticks(cfg.slack_ms > 0 ? (uint32_t)cfg.slack_ms : 0);
+    s_loop.since_us = esp_timer_get_time();
+
+    TaskHandle_t task = NULL;
+    BaseType_t   ret  = xTaskCreate(xn_loop_task, "xn_loop",
+                                    (cfg.stack_size > 0) ? (uint32_t)cfg.stack_size : 4096,
+                                    NULL, (UBaseType_t)cfg.priority, &task);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "create task failed");
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_loop.lock);
+    s_loop.task = task;
+    portEXIT_CRITICAL(&s_loop.lock);
+    xTaskNotifyGive(task);                         ///< 启动前已安排的定时器立即生效
+    return ESP_OK;
+}
+
+esp_err_t xn_loop_timer_create(const char *name, xn_loop_cb_t cb, void *arg, xn_loop_timer_t **out)
+{
+    if (cb == NULL || out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (xn_loop_init(NULL) != ESP_OK) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    xn_loop_timer_t *t = (xn_loop_timer_t *)calloc(1, sizeof(xn_loop_timer_t));
+    if (t == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    t->name = (name != NULL) ? name : "-";
+    t->cb   = cb;
+    t->arg  = arg;
+
+    portENTER_CRITICAL(&s_loop.lock);
+    t->id = s_loop.timer_num++;
+    portEXIT_CRITICAL(&s_loop.lock);
+
+    ESP_LOGD(TAG, "timer %s created, id=%u", t->name, (unsigned)t->id);
+    *out = t;
+    return ESP_OK;
+}
+
+esp_err_t xn_loop_timer_start(xn_loop_timer_t *timer, uint32_t delay_ms)
+{
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_loop.lock);
+    bool first = xn_loop_insert_locked(timer, xTaskGetTickCount() + xn_loop_ticks(delay_ms));
+    TaskHandle_t task = s_loop.task;
+    portEXIT_CRITICAL(&s_loop.lock);
+
+    if (first && task != NULL && task != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(task);
+    }
+    return ESP_OK;
+}
+
+void xn_loop_timer_wake(xn_loop_timer_t *timer)
+{
+    if (timer == NULL) {
+        return;
+    }
+
+    TickType_t now   = xTaskGetTickCount();
+    bool       first = false;
+
+    portENTER_CRITICAL(&s_loop.lock);
+    if (!timer->armed || (int32_t)(timer->due - now) > 0) { ///< 已安排的更早时刻保持不变
+        first = xn_loop_insert_locked(timer, now);
+    }
+    TaskHandle_t task = s_loop.task;
+    portEXIT_CRITICAL(&s_loop.lock);
+
+    if (first && task != NULL && task != xTaskGetCurrentTaskHandle()) {
+        xTaskNotifyGive(task);
+    }
+}
+
+esp_err_t xn_loop_get_stats(xn_loop_stats_t *out, bool reset)
+{
+    if (out == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_loop.lock);
+    *out           = s_loop.stats;
+    out->uptime_ms = (uint32_t)((now - s_loop.since_us) / 1000);
+    out->timer_num = s_loop.timer_num;
+    TaskHandle_t task = s_loop.task;
+    if (reset) {
+        memset(&s_loop.stats, 0, sizeof(s_loop.stats));
+        s_loop.since_us = now;
+    }
+    portEXIT_CRITICAL(&s_loop.lock);
+
+    /* ESP-IDF 中栈深度以字节为单位 */
+    out->stack_free_min = (task != NULL) ? (uint32_t)uxTaskGetStackHighWaterMark(task) : 0;
+    return ESP_OK;
+}
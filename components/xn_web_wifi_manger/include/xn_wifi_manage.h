@@ -21,9 +21,10 @@
 /**
  * @brief WiFi 管理状态机单步运行周期（单位：ms）
  *
- * 管理任务会按该间隔周期性调用内部状态机：
- * - 间隔过小：状态更新更及时，但占用更多 CPU；
- * - 间隔过大：重连/轮询响应变慢。
+ * 状态机作为 xn_loop 定时器运行，由 WiFi 事件唤醒；已连接、连接进行中时不再轮询，
+ * 整轮失败后只在重连时刻运行。该间隔仅用于断开且尚无可用配置时轮询存储：
+ * - 间隔过小：发现新配置更及时，但唤醒更频繁；
+ * - 间隔过大：配网后开始连接变慢。
  */
 #define WIFI_MANAGE_STEP_INTERVAL_MS 1000
 
@@ -91,7 +92,7 @@ typedef struct {
  *
  * 功能概览：
  * - 初始化内部 WiFi / 存储 / Web 配网子模块；
- * - 创建管理任务并启动状态机；
+ * - 在共享事件循环（xn_loop）中创建管理定时器并启动状态机；
  * - 根据配置启动 STA + AP 模式。
  *
  * @param config 若为 NULL，则使用 @ref WIFI_MANAGE_DEFAULT_CONFIG
@@ -23,6 +23,7 @@
 #include "storage_module.h"
 #include "web_module.h"
 #include "xn_wifi_manage.h"
+#include "xn_loop.h"
 
 /* 日志 TAG（如需日志输出，使用 ESP_LOGx(TAG, ...)） */
 static const char *TAG = "wifi_manage";
@@ -31,8 +32,8 @@ static const char *TAG = "wifi_manage";
 static wifi_manage_state_t  s_wifi_manage_state = WIFI_MANAGE_STATE_DISCONNECTED;
 /* 上层传入的管理配置（保存 WiFi 数量、重连间隔、AP 信息等） */
 static wifi_manage_config_t s_wifi_cfg;
-/* WiFi 管理任务句柄 */
-static TaskHandle_t         s_wifi_manage_task  = NULL;
+/* WiFi 管理定时器（运行在共享事件循环 xn_loop 中） */
+static xn_loop_timer_t     *s_wifi_manage_timer = NULL;
 
 /* 统一更新状态并通知上层回调（若配置了 wifi_event_cb） */
 static void wifi_manage_notify_state(wifi_manage_state_t new_state)
@@ -386,7 +387,7 @@ static void wifi_manage_on_wifi_event(wifi_module_event_t event)
     }
 
     case WIFI_MODULE_EVENT_STA_DISCONNECTED:
-        /* 连接断开，等待管理任务按策略进行重连 */
+        /* 连接断开，由管理定时器按策略进行重连 */
         wifi_manage_notify_state(WIFI_MANAGE_STATE_DISCONNECTED);
         s_wifi_connecting   = false;
         s_wifi_try_index    = 0;
@@ -402,6 +403,9 @@ static void wifi_manage_on_wifi_event(wifi_module_event_t event)
         /* 其他事件暂不关心 */
         break;
     }
+
+    /* 由状态机立即处理本次事件（重连、切换下一条配置等） */
+    xn_loop_timer_wake(s_wifi_manage_timer);
 }
 
 /* -------------------- 状态机核心逻辑 -------------------- */
@@ -409,8 +413,10 @@ static void wifi_manage_on_wifi_event(wifi_module_event_t event)
  * @brief 单步执行 WiFi 管理状态机
  *
  * 按当前状态决定是否发起连接、切换状态或等待重试。
+ *
+ * @return 距下一次执行的毫秒数；XN_LOOP_IDLE 表示只等 WiFi 事件唤醒
  */
-static void wifi_manage_step(void)
+static uint32_t wifi_manage_step(void)
 {
     switch (s_wifi_manage_state) {
     case WIFI_MANAGE_STATE_DISCONNECTED: {
@@ -418,7 +424,7 @@ static void wifi_manage_step(void)
 
         if (s_wifi_connecting) {
             /* 已经有一个连接操作在进行，等待事件回调给结果 */
-            break;
+            return XN_LOOP_IDLE;
         }
 
         /* 从存储模块加载全部配置，数量受 save_wifi_count 限制 */
@@ -430,7 +436,7 @@ static void wifi_manage_step(void)
         wifi_config_t *list = (wifi_config_t *)malloc(max_num * sizeof(wifi_config_t));
         if (list == NULL) {
             /* 内存不足时保留在断开状态，等待下次循环再尝试 */
-            break;
+            return WIFI_MANAGE_STEP_INTERVAL_MS;
         }
 
         uint8_t count = 0;
@@ -438,7 +444,7 @@ static void wifi_manage_step(void)
         if (wifi_storage_load_all(list, &count) != ESP_OK || count == 0) {
             /* 没有可用配置，交由上层决定是否启用纯 AP 配网等逻辑 */
             free(list);
-            break;
+            return WIFI_MANAGE_STEP_INTERVAL_MS;
         }
 
         if (s_wifi_try_index >= count) {
@@ -448,7 +454,7 @@ static void wifi_manage_step(void)
             s_wifi_try_index    = 0;
             s_wifi_connecting   = false;
             free(list);
-            break;
+            return 0;
         }
 
         wifi_config_t *cfg = &list[s_wifi_try_index];
@@ -456,7 +462,7 @@ static void wifi_manage_step(void)
             /* 跳过无效 SSID */
             s_wifi_try_index++;
             free(list);
-            break;
+            return 0;
         }
 
         const char *ssid     = (const char *)cfg->sta.ssid;
@@ -465,26 +471,27 @@ static void wifi_manage_step(void)
                                    : (const char *)cfg->sta.password;
 
         /* 尝试发起连接，成功则等待事件回调，失败则立即切换到下一条 */
-        if (wifi_module_connect(ssid, password) == ESP_OK) {
+        bool started = (wifi_module_connect(ssid, password) == ESP_OK);
+        if (started) {
             s_wifi_connecting = true;
         } else {
             s_wifi_try_index++;
         }
 
         free(list);
-        break;
+        return started ? XN_LOOP_IDLE : 0;
     }
 
     case WIFI_MANAGE_STATE_CONNECTED:
-        /* 已连接状态下，当前不做周期性操作，保持静默 */
-        break;
+        /* 已连接状态下，当前不做周期性操作，保持静默直到断开事件 */
+        return XN_LOOP_IDLE;
 
     case WIFI_MANAGE_STATE_CONNECT_FAILED: {
         /* 一轮全部失败，根据配置的重连间隔决定何时重新遍历 */
 
         if (s_wifi_cfg.reconnect_interval_ms < 0) {
             /* 小于 0 表示关闭自动重连，保持在失败状态 */
-            break;
+            return XN_LOOP_IDLE;
         }
 
         TickType_t now   = xTaskGetTickCount();
@@ -498,28 +505,27 @@ static void wifi_manage_step(void)
             s_wifi_try_index    = 0;
             s_wifi_connecting   = false;
             wifi_manage_notify_state(WIFI_MANAGE_STATE_DISCONNECTED);
+            return 0;
         }
-        break;
+        /* 只等待到重试时刻 */
+        return (uint32_t)pdTICKS_TO_MS(need - delta);
     }
 
     default:
         /* 理论上不应到达，保留作防护 */
-        break;
+        return WIFI_MANAGE_STEP_INTERVAL_MS;
     }
 }
 
-/* -------------------- WiFi 管理任务 -------------------- */
+/* -------------------- WiFi 管理定时器 -------------------- */
 /**
- * @brief 管理任务：周期性驱动状态机运行
+ * @brief 管理定时器回调：由 WiFi 事件唤醒或按状态机给出的时刻驱动状态机运行
  */
-static void wifi_manage_task(void *arg)
+static uint32_t wifi_manage_on_timer(void *arg)
 {
     (void)arg;
 
-    for (;;) {
-        wifi_manage_step();
-        vTaskDelay(pdMS_TO_TICKS(WIFI_MANAGE_STEP_INTERVAL_MS));
-    }
+    return wifi_manage_step();
 }
 
 /* -------------------- 管理模块初始化 -------------------- */
@@ -531,7 +537,7 @@ static void wifi_manage_task(void *arg)
  * 2. 初始化 WiFi 模块（STA+AP）
  * 3. 初始化存储模块（保存常用 WiFi）
  * 4. 初始化 Web 配网模块（HTTP 服务与回调）
- * 5. 创建管理任务，启动状态机
+ * 5. 在共享事件循环中创建管理定时器，启动状态机
  */
 esp_err_t wifi_manage_init(const wifi_manage_config_t *config)
 {
@@ -611,20 +617,14 @@ esp_err_t wifi_manage_init(const wifi_manage_config_t *config)
         }
     }
 
-    // 创建WiFi管理任务
-    if (s_wifi_manage_task == NULL) {
-        BaseType_t ret_task = xTaskCreate(
-            wifi_manage_task,
-            "wifi_manage",
-            4096,               // 任务栈大小，可根据实际需要调整
-            NULL,
-            tskIDLE_PRIORITY + 1,   // 任务优先级，可根据实际需要调整
-            &s_wifi_manage_task);
-
-        if (ret_task != pdPASS) {
-            return ESP_ERR_NO_MEM;
+    // 创建WiFi管理定时器，与 MQTT 管理器、心跳共用 xn_loop 任务
+    if (s_wifi_manage_timer == NULL) {
+        ret = xn_loop_timer_create("wifi_manage", wifi_manage_on_timer, NULL, &s_wifi_manage_timer);
+        if (ret != ESP_OK) {
+            return ret;
         }
     }
+    (void)xn_loop_timer_start(s_wifi_manage_timer, 0);
 
     return ESP_OK;
 }
@@ -36,23 +36,31 @@ static const char *TAG = "wifi_cfg_app";              ///< 本模块日志 TAG
 
 /* -------------------- 内部工具：发布 JSON 到指定 WiFi 子 Topic -------------------- */
 /**
- * @brief 辅助函数：以 JSON 形式向 xn/esp/wifi/<device_id>/<sub> 发布上行消息
+ * @brief 辅助函数：生成上行 Topic xn/esp/wifi/<device_id>/<sub>
  */
-static void wifi_cfg_publish_json(const char *sub, const char *json)
+static bool wifi_cfg_build_topic(const char *sub, char *topic, size_t topic_size)
 {
     const char *client_id = web_mqtt_manager_get_client_id();
-    if (client_id == NULL || client_id[0] == '\0' || sub == NULL || json == NULL) {
-        return;
+    if (client_id == NULL || client_id[0] == '\0' || sub == NULL) {
+        return false;
     }
 
+    int n = snprintf(topic,
+                     topic_size,
+                     "%s/wifi/%s/%s",
+                     WEB_MQTT_UPLINK_BASE_TOPIC,
+                     client_id,
+                     sub);
+    return n > 0 && n < (int)topic_size;
+}
+
+/**
+ * @brief 辅助函数：以 JSON 形式向 xn/esp/wifi/<device_id>/<sub> 发布上行消息
+ */
+static void wifi_cfg_publish_json(const char *sub, const char *json)
+{
     char topic[128];
-    int  n = snprintf(topic,
-                      sizeof(topic),
-                      "%s/wifi/%s/%s",
-                      WEB_MQTT_UPLINK_BASE_TOPIC,
-                      client_id,
-                      sub);
-    if (n <= 0 || n >= (int)sizeof(topic)) {
+    if (json == NULL || !wifi_cfg_build_topic(sub, topic, sizeof(topic))) {
         return;
     }
 
@@ -171,18 +179,33 @@ static void wifi_cfg_handle_get_status(void)
         mode[sizeof(mode) - 1] = '\0';
     }
 
-    /* 组装简单 JSON（不依赖额外 JSON 库） */
-    char json[256];
-    snprintf(json,
-             sizeof(json),
-             "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\",\"rssi\":%d,\"mode\":\"%s\"}",
-             connected ? "true" : "false",
-             ssid,
-             ip,
-             (int)rssi,
-             mode);
-
-    wifi_cfg_publish_json("status", json);
+    /* 直接在出站槽位中组装简单 JSON（不依赖额外 JSON 库，也不经过栈缓冲区） */
+    char topic[128];
+    if (!wifi_cfg_build_topic("status", topic, sizeof(topic))) {
+        return;
+    }
+
+    mqtt_module_publish_lease_t lease;
+    esp_err_t ret = mqtt_module_publish_begin(topic, 256, &lease);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "wifi cfg: status publish begin failed, err=%d", (int)ret);
+        return;
+    }
+
+    int n = snprintf(lease.buf,
+                     (size_t)lease.cap,
+                     "{\"connected\":%s,\"ssid\":\"%s\",\"ip\":\"%s\",\"rssi\":%d,\"mode\":\"%s\"}",
+                     connected ? "true" : "false",
+                     ssid,
+                     ip,
+                     (int)rssi,
+                     mode);
+    if (n <= 0 || n >= lease.cap) {
+        mqtt_module_publish_abort(&lease);
+        return;
+    }
+
+    (void)mqtt_module_publish_commit(&lease, n, 1, false, NULL);
 }
 
 /* -------------------- 处理命令：上报已保存 WiFi 列表 -------------------- */
@@ -314,61 +337,28 @@ static void wifi_cfg_handle_connect_saved(const char *payload, int payload_len)
 /**
  * @brief MQTT 应用模块回调：解析 WiFi 指令并分发到对应处理函数
  */
-static esp_err_t wifi_config_app_on_message(const char    *topic,
-                                            int            topic_len,
-                                            const uint8_t *payload,
-                                            int            payload_len)
+static esp_err_t wifi_config_app_on_message(const web_mqtt_topic_t *topic,
+                                            const uint8_t          *payload,
+                                            int                     payload_len)
 {
-    const char *base_topic = web_mqtt_manager_get_base_topic();
-    const char *client_id  = web_mqtt_manager_get_client_id();
-
-    if (base_topic == NULL || base_topic[0] == '\0' ||
-        client_id == NULL || client_id[0] == '\0' ||
-        topic == NULL || topic_len <= 0) {
-        return ESP_OK;
-    }
-
-    char prefix[128];
-    int  n = snprintf(prefix, sizeof(prefix), "%s/wifi/", base_topic);
-    if (n <= 0 || n >= (int)sizeof(prefix)) {
-        return ESP_OK;
-    }
-
-    if (topic_len <= n) {
-        return ESP_OK;
-    }
-
-    if (memcmp(topic, prefix, (size_t)n) != 0) {
-        return ESP_OK;   ///< 非 "<base>/wifi/..." 前缀，忽略
-    }
-
-    const char *rest     = topic + n;
-    int         rest_len = topic_len - n;
-
-    /* rest 形如："<client_id>/set" / "<client_id>/get_status" 等 */
-    size_t id_len = strlen(client_id);
-    if (rest_len <= (int)id_len || strncmp(rest, client_id, id_len) != 0) {
-        return ESP_OK;   ///< Topic 中携带的 device_id 不匹配本设备，忽略
-    }
-
-    if (rest_len <= (int)id_len + 1 || rest[id_len] != '/') {
-        return ESP_OK;
+    /* Topic 形如 "<base>/wifi/<client_id>/<cmd>"，已由管理器切分 */
+    if (!topic->for_device || topic->seg_num != topic->cmd_index + 1) {
+        return ESP_OK;   ///< 非本设备或命令层级不符，忽略
     }
 
-    const char *cmd     = rest + id_len + 1;           ///< 指向 "set" / "get_status" 等
-    int         cmd_len = rest_len - (int)id_len - 1;
+    int cmd = topic->cmd_index;
 
     /* 根据命令后缀分发处理逻辑 */
-    if (cmd_len == 3 && strncmp(cmd, "set", 3) == 0) {
+    if (web_mqtt_topic_seg_is(topic, cmd, "set")) {
         /* 下发新 WiFi 配置 */
         wifi_cfg_handle_set((const char *)payload, payload_len);
-    } else if (cmd_len == 10 && strncmp(cmd, "get_status", 10) == 0) {
+    } else if (web_mqtt_topic_seg_is(topic, cmd, "get_status")) {
         /* 请求当前 WiFi 状态 */
         wifi_cfg_handle_get_status();
-    } else if (cmd_len == 9 && strncmp(cmd, "get_saved", 9) == 0) {
+    } else if (web_mqtt_topic_seg_is(topic, cmd, "get_saved")) {
         /* 请求已保存 WiFi 列表 */
         wifi_cfg_handle_get_saved();
-    } else if (cmd_len == 13 && strncmp(cmd, "connect_saved", 13) == 0) {
+    } else if (web_mqtt_topic_seg_is(topic, cmd, "connect_saved")) {
         /* 请求切换到已保存的某个 WiFi，payload 中携带 ssid=... */
         wifi_cfg_handle_connect_saved((const char *)payload, payload_len);
     }
@@ -378,6 +368,17 @@ static esp_err_t wifi_config_app_on_message(const char    *topic,
 
 esp_err_t wifi_config_app_init(void)
 {
-    /* 注册到 Web MQTT 管理器，使用模块前缀 "wifi" */
-    return web_mqtt_manager_register_app("wifi", wifi_config_app_on_message);
+    /* 注册到 Web MQTT 管理器，使用模块前缀 "wifi" 与默认订阅模板 */
+    /* 切换 WiFi 代价高，严格限速；查询类命令只需回复最新状态，排队中的重复请求合并为一条 */
+    web_mqtt_app_config_t app_cfg = {
+        .topic_suffix = "wifi",
+        .route_cb     = wifi_config_app_on_message,
+        .limits       = {
+            { .cmd = "set",           .rate_per_min = 6,  .burst = 2 },
+            { .cmd = "connect_saved", .rate_per_min = 6,  .burst = 2 },
+            { .cmd = "get_status",    .rate_per_min = 30, .burst = 4, .coalesce = true },
+            { .cmd = "get_saved",     .rate_per_min = 30, .burst = 4, .coalesce = true },
+        },
+    };
+    return web_mqtt_manager_register_app_ex(&app_cfg);
 }
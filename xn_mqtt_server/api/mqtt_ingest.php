@@ -6,6 +6,9 @@ require_once __DIR__ . '/../config.php';
 require_once __DIR__ . '/../db.php';
 require_once __DIR__ . '/../mqtt_config.php';
 require_once __DIR__ . '/../lib/MqttClient.php';
+require_once __DIR__ . '/../lib/XnLzf.php';
+require_once __DIR__ . '/../lib/XnRegToken.php';
+require_once __DIR__ . '/../lib/XnHealth.php';
 
 header('Content-Type: application/json; charset=utf-8');
 
@@ -29,9 +32,10 @@ $logLine = sprintf(
 @file_put_contents(__DIR__ . '/../mqtt_ingest.log', $logLine, FILE_APPEND);
 $data = json_decode($raw, true);
 
-$clientId = '';
-$topic    = '';
-$payload  = '';
+$clientId   = '';
+$topic      = '';
+$payload    = '';
+$payloadB64 = null;
 
 if (is_array($data) && isset($data['client_id'])) {
     $clientId = (string)$data['client_id'];
@@ -39,6 +43,9 @@ if (is_array($data) && isset($data['client_id'])) {
     if (array_key_exists('payload', $data)) {
         $payload = is_string($data['payload']) ? $data['payload'] : json_encode($data['payload']);
     }
+    if (isset($data['payload_b64'])) {
+        $payloadB64 = (string)$data['payload_b64'];
+    }
 }
 
 if ($clientId === '') {
@@ -49,6 +56,29 @@ if ($clientId === '') {
     if (isset($_POST['payload'])) {
         $payload = (string)$_POST['payload'];
     }
+    if (isset($_POST['payload_b64'])) {
+        $payloadB64 = (string)$_POST['payload_b64'];
+    }
+}
+
+// 二进制负载（如压缩消息）需由规则以 base64 转发，原样的 payload 字段在 JSON 中可能已被破坏
+if ($payloadB64 !== null && $payloadB64 !== '') {
+    $bin = base64_decode($payloadB64, true);
+    if ($bin !== false) {
+        $payload = $bin;
+    }
+}
+
+// 设备压缩上行：Topic 以 "/z" 结尾，负载为 LZF 帧；解压后按原 Topic 继续处理
+if (xn_lzf_is_packed_topic($topic)) {
+    $plain = xn_lzf_unpack($payload);
+    if ($plain === null) {
+        http_response_code(400);
+        echo json_encode(['status' => 'error', 'message' => 'bad compressed payload']);
+        exit;
+    }
+    $topic   = xn_lzf_strip_topic($topic);
+    $payload = $plain;
 }
 
 if ($clientId === '') {
@@ -57,20 +87,56 @@ if ($clientId === '') {
     exit;
 }
 
-$db     = xn_get_db();
-$device = xn_upsert_device($db, $clientId);
-
 $now = date('Y-m-d H:i:s');
 $ip  = $_SERVER['REMOTE_ADDR'] ?? null;
 
-// 简单更新在线信息
- $upd = $db->prepare('UPDATE devices SET last_seen_at = :ls, last_ip = :ip, updated_at = :u WHERE id = :id');
- $upd->execute([
-    ':ls' => $now,
-    ':ip' => $ip,
-    ':u'  => $now,
-    ':id' => $device['id'],
-]);
+// 只表示“设备在线”的上行：心跳，以及设备重连时令牌有效的注册校验（负载为缓存的注册令牌）。
+// 只刷新在线时间，不写消息表、不连接 MQTT；设备只在链路空闲时才补发心跳，其余上行同样计入在线（见下方）。
+// 令牌无效（过期 / 密钥已更换）的 reg/check 按完整注册查询处理，重新签发令牌
+$regCheck = $topic === XN_MQTT_UPLINK_BASE_TOPIC . '/reg/check';
+$hbOnly   = $topic === XN_MQTT_UPLINK_BASE_TOPIC . '/hb';
+$known    = false;
+if ($hbOnly || ($regCheck && xn_reg_token_verify($clientId, $payload))) {
+    $db    = xn_get_db();
+    $touch = $db->prepare('UPDATE devices SET last_seen_at = :ls, last_ip = :ip WHERE device_id = :d');
+    $touch->execute([':ls' => $now, ':ip' => $ip, ':d' => $clientId]);
+
+    $known = $touch->rowCount() > 0;               // 同一秒内重复刷新时影响行数为 0，再确认一次
+    if (!$known) {
+        $sel = $db->prepare('SELECT 1 FROM devices WHERE device_id = :d');
+        $sel->execute([':d' => $clientId]);
+        $known = (bool)$sel->fetchColumn();
+    }
+    if ($known && $regCheck) {
+        echo json_encode(['status' => 'ok', 'registered' => true]);
+        exit;
+    }
+    // 设备记录不存在（如数据库被清空）时按普通消息处理，重新创建设备记录
+}
+
+$db = $db ?? xn_get_db();
+if (!$known) {
+    $device = xn_upsert_device($db, $clientId);
+
+    // 任何上行都视为在线：更新在线信息
+    $upd = $db->prepare('UPDATE devices SET last_seen_at = :ls, last_ip = :ip, updated_at = :u WHERE id = :id');
+    $upd->execute([
+        ':ls' => $now,
+        ':ip' => $ip,
+        ':u'  => $now,
+        ':id' => $device['id'],
+    ]);
+}
+
+// 心跳负载为二进制健康记录（需规则转发 payload_b64），解析后按设备保存最新值，不写消息表
+if ($hbOnly) {
+    $health = xn_health_decode($payload);
+    if ($health !== null) {
+        xn_health_store($db, $clientId, $health, $now);
+    }
+    echo json_encode(['status' => 'ok']);
+    exit;
+}
 
 $insMsg = $db->prepare('INSERT INTO mqtt_messages (client_id, topic, payload, created_at)
                          VALUES (:c, :t, :p, :ts)');
@@ -84,7 +150,7 @@ $insMsg->execute([
 // 处理设备注册查询：当 Topic 为上行前缀 + "/reg/query" 时，标记已注册并回复一条 MQTT 消息
 if ($topic !== '') {
     $regPrefix = XN_MQTT_UPLINK_BASE_TOPIC . '/reg/query';
-    if (strpos($topic, $regPrefix) === 0) {
+    if ($regCheck || strpos($topic, $regPrefix) === 0) {
         // 在 meta_json 中记录注册标志
         $meta = [];
         if (!empty($device['meta_json'])) {
@@ -116,12 +182,21 @@ if ($topic !== '') {
                 XN_MQTT_KEEPALIVE
             );
 
+            // 签发注册令牌，设备保存后重连只需上行 reg/check；密钥未配置时不带令牌，设备每次走完整注册
+            [$regToken, $regExpires] = xn_reg_token_issue($clientId, XN_REG_TOKEN_TTL);
+
             $replyTopic = rtrim(XN_MQTT_BASE_TOPIC, '/') . '/reg/' . $clientId . '/resp';
-            $replyBody  = json_encode([
+            $reply      = [
                 'status'     => 'ok',
                 'device_id'  => $clientId,
                 'registered' => true,
-            ], JSON_UNESCAPED_UNICODE);
+            ];
+            if ($regToken !== null) {
+                $reply['token']   = $regToken;
+                $reply['expires'] = $regExpires;
+                $reply['ttl']     = XN_REG_TOKEN_TTL;
+            }
+            $replyBody = json_encode($reply, JSON_UNESCAPED_UNICODE);
 
             $mqtt->publish($replyTopic, $replyBody, false);
         } catch (Throwable $e) {
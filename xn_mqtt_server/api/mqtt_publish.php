@@ -5,6 +5,7 @@
 require_once __DIR__ . '/../auth.php';
 require_once __DIR__ . '/../mqtt_config.php';
 require_once __DIR__ . '/../lib/MqttClient.php';
+require_once __DIR__ . '/../lib/XnLzf.php';
 
 header('Content-Type: application/json; charset=utf-8');
 
@@ -28,6 +29,15 @@ if ($topic === '') {
     exit;
 }
 
+// 较大的指令按设备端约定压缩：Topic 追加 "/z"，压缩无收益时原样发送
+if (XN_MQTT_COMPRESS_MIN_LEN > 0 && strlen($payload) >= XN_MQTT_COMPRESS_MIN_LEN) {
+    $packed = xn_lzf_pack($payload);
+    if ($packed !== null) {
+        $topic  .= XN_LZF_TOPIC_SUFFIX;
+        $payload = $packed;
+    }
+}
+
 try {
     $client = new XnMqttClient(
         XN_MQTT_HOST,
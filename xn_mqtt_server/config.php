@@ -29,5 +29,19 @@ define('XN_DEFAULT_ADMIN_PASS', 'admin123');
 // 强烈建议上线前改成复杂随机字符串，并在规则中以 ?token=XXX 方式传入
 define('XN_INGEST_SHARED_SECRET', 'Li2k0e3mVRW4akNjvmwK');
 
-// 多久未收到心跳视为离线（秒）
+// 多久未收到任何上行视为离线（秒），需大于设备心跳间隔 heartbeat_interval_ms（默认 30 秒）
 define('XN_DEVICE_OFFLINE_SECONDS', 90);
+
+// 设备注册令牌签名密钥：设备缓存令牌后重连只上行 reg/check，服务器校验签名即可，无需写库和回复
+// 修改该值会使全部已签发令牌失效，设备下次重连时重新走完整注册
+// 密钥不写入仓库：优先读取未纳入版本管理的 config.local.php（见 config.local.php.example），
+// 其次读取环境变量 XN_REG_TOKEN_SECRET；都未设置（或短于 16 字节）时不签发也不接受令牌，设备每次重连走完整注册
+if (is_file(__DIR__ . '/config.local.php')) {
+    require_once __DIR__ . '/config.local.php';
+}
+if (!defined('XN_REG_TOKEN_SECRET')) {
+    define('XN_REG_TOKEN_SECRET', (string)getenv('XN_REG_TOKEN_SECRET'));
+}
+
+// 注册令牌有效期（秒），过期后设备重新走完整注册
+define('XN_REG_TOKEN_TTL', 7 * 86400);
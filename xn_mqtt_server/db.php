@@ -64,6 +64,22 @@ function xn_init_schema(PDO $db): void
         created_at DATETIME NOT NULL
     ) ENGINE=InnoDB DEFAULT CHARSET=' . XN_DB_CHARSET);
 
+    // 设备健康记录表（心跳负载解析结果，每台设备保留最新一条）
+    $db->exec('CREATE TABLE IF NOT EXISTS device_health (
+        device_id VARCHAR(128) NOT NULL PRIMARY KEY,
+        ver TINYINT UNSIGNED NOT NULL,
+        rssi TINYINT NULL,
+        connects SMALLINT UNSIGNED NOT NULL,
+        uptime_s INT UNSIGNED NOT NULL,
+        heap_free INT UNSIGNED NOT NULL,
+        heap_min INT UNSIGNED NOT NULL,
+        outbox_depth SMALLINT UNSIGNED NOT NULL,
+        outbox_high_water SMALLINT UNSIGNED NOT NULL,
+        rx_queue_depth SMALLINT UNSIGNED NOT NULL,
+        rx_queue_high_water SMALLINT UNSIGNED NOT NULL,
+        updated_at DATETIME NOT NULL
+    ) ENGINE=InnoDB DEFAULT CHARSET=' . XN_DB_CHARSET);
+
     // 默认管理员
     $stmt = $db->query('SELECT COUNT(*) AS c FROM users');
     $row  = $stmt->fetch();
@@ -0,0 +1,63 @@
+<?php
+/**
+ * 设备心跳健康记录（二进制，小端）的解析与保存。
+ *
+ * 格式与 ESP32 端 mqtt_hb_health_t 一致（版本 1，24 字节）：
+ *   ver(u8) rssi(i8) connects(u16) uptime_s(u32) heap_free(u32) heap_min(u32)
+ *   outbox_depth(u16) outbox_high_water(u16) rx_queue_depth(u16) rx_queue_high_water(u16)
+ *
+ * 同一版本只会在末尾追加字段，多出的字节忽略即可；旧固件的心跳负载为设备 ID 文本，解析返回 null。
+ */
+
+const XN_HEALTH_VERSION = 1;
+const XN_HEALTH_V1_LEN  = 24;
+
+/**
+ * 解析心跳负载
+ *
+ * @return array<string, int>|null 字段名与设备端一致；不是健康记录时返回 null
+ */
+function xn_health_decode(string $payload): ?array
+{
+    if (strlen($payload) < XN_HEALTH_V1_LEN || ord($payload[0]) !== XN_HEALTH_VERSION) {
+        return null;
+    }
+
+    $h = unpack(
+        'Cver/crssi/vconnects/Vuptime_s/Vheap_free/Vheap_min/' .
+        'voutbox_depth/voutbox_high_water/vrx_queue_depth/vrx_queue_high_water',
+        $payload
+    );
+    return $h === false ? null : $h;
+}
+
+/**
+ * 保存设备最新的健康记录（每台设备一行，覆盖旧值）
+ */
+function xn_health_store(PDO $db, string $deviceId, array $h, string $now): void
+{
+    $stmt = $db->prepare('INSERT INTO device_health
+            (device_id, ver, rssi, connects, uptime_s, heap_free, heap_min,
+             outbox_depth, outbox_high_water, rx_queue_depth, rx_queue_high_water, updated_at)
+        VALUES (:d, :ver, :rssi, :cn, :up, :hf, :hm, :od, :ohw, :rd, :rhw, :u)
+        ON DUPLICATE KEY UPDATE
+            ver = VALUES(ver), rssi = VALUES(rssi), connects = VALUES(connects),
+            uptime_s = VALUES(uptime_s), heap_free = VALUES(heap_free), heap_min = VALUES(heap_min),
+            outbox_depth = VALUES(outbox_depth), outbox_high_water = VALUES(outbox_high_water),
+            rx_queue_depth = VALUES(rx_queue_depth), rx_queue_high_water = VALUES(rx_queue_high_water),
+            updated_at = VALUES(updated_at)');
+    $stmt->execute([
+        ':d'    => $deviceId,
+        ':ver'  => $h['ver'],
+        ':rssi' => $h['rssi'] !== 0 ? $h['rssi'] : null,
+        ':cn'   => $h['connects'],
+        ':up'   => $h['uptime_s'],
+        ':hf'   => $h['heap_free'],
+        ':hm'   => $h['heap_min'],
+        ':od'   => $h['outbox_depth'],
+        ':ohw'  => $h['outbox_high_water'],
+        ':rd'   => $h['rx_queue_depth'],
+        ':rhw'  => $h['rx_queue_high_water'],
+        ':u'    => $now,
+    ]);
+}
@@ -0,0 +1,145 @@
+<?php
+/**
+ * 设备负载压缩（LZF 格式）的纯 PHP 编解码。
+ *
+ * 帧格式与 ESP32 端 mqtt_lzf_module 一致：
+ *  - 2 字节大端原始长度 + LZF 压缩流；
+ *  - 压缩消息的 Topic 以 "/z" 结尾，上下行相同。
+ *
+ * 不依赖 pecl lzf 扩展；如已安装，可用 lzf_decompress() 解压去掉帧头后的数据。
+ */
+
+const XN_LZF_TOPIC_SUFFIX = '/z';
+
+/**
+ * Topic 是否为压缩消息（以 "/z" 结尾）
+ */
+function xn_lzf_is_packed_topic(string $topic): bool
+{
+    $n = strlen(XN_LZF_TOPIC_SUFFIX);
+    return strlen($topic) > $n && substr($topic, -$n) === XN_LZF_TOPIC_SUFFIX;
+}
+
+/**
+ * 去掉压缩 Topic 的 "/z" 后缀
+ */
+function xn_lzf_strip_topic(string $topic): string
+{
+    return xn_lzf_is_packed_topic($topic) ? substr($topic, 0, -strlen(XN_LZF_TOPIC_SUFFIX)) : $topic;
+}
+
+/**
+ * 解压一帧，帧损坏时返回 null
+ */
+function xn_lzf_unpack(string $frame): ?string
+{
+    $inLen = strlen($frame);
+    if ($inLen <= 2) {
+        return null;
+    }
+
+    $outLen = (ord($frame[0]) << 8) | ord($frame[1]);
+    if ($outLen <= 0) {
+        return null;
+    }
+
+    $out = '';
+    $ip  = 2;
+    while ($ip < $inLen) {
+        $ctrl = ord($frame[$ip++]);
+
+        if ($ctrl < 32) {                          // 字面量：其后 ctrl+1 字节原样拷贝
+            $run = $ctrl + 1;
+            if ($ip + $run > $inLen || strlen($out) + $run > $outLen) {
+                return null;
+            }
+            $out .= substr($frame, $ip, $run);
+            $ip  += $run;
+            continue;
+        }
+
+        $len = $ctrl >> 5;                         // 回引：从已输出数据往回拷贝
+        if ($len === 7) {
+            if ($ip >= $inLen) {
+                return null;
+            }
+            $len += ord($frame[$ip++]);
+        }
+        if ($ip >= $inLen) {
+            return null;
+        }
+        $ref  = strlen($out) - (($ctrl & 0x1f) << 8) - ord($frame[$ip++]) - 1;
+        $len += 2;
+        if ($ref < 0 || strlen($out) + $len > $outLen) {
+            return null;
+        }
+        for ($i = 0; $i < $len; $i++) {            // 可能与输出重叠，逐字节拷贝
+            $out .= $out[$ref + $i];
+        }
+    }
+
+    return strlen($out) === $outLen ? $out : null;
+}
+
+/**
+ * 压缩为一帧，压缩无收益或数据过长时返回 null（调用方应原样发送）
+ */
+function xn_lzf_pack(string $data): ?string
+{
+    $inLen = strlen($data);
+    if ($inLen === 0 || $inLen > 0xFFFF) {
+        return null;
+    }
+
+    $out   = '';
+    $lit   = '';
+    $htab  = [];
+    $ip    = 0;
+    $flush = static function () use (&$out, &$lit): void {
+        if ($lit !== '') {
+            $out .= chr(strlen($lit) - 1) . $lit;
+            $lit  = '';
+        }
+    };
+
+    while ($ip < $inLen) {
+        if ($ip + 2 < $inLen) {
+            $key = substr($data, $ip, 3);
+            $ref = $htab[$key] ?? -1;
+            $htab[$key] = $ip;
+
+            if ($ref >= 0 && $ip - $ref - 1 < 8192) {
+                $maxLen = min($inLen - $ip, 264);
+                $len    = 3;
+                while ($len < $maxLen && $data[$ref + $len] === $data[$ip + $len]) {
+                    $len++;
+                }
+
+                $flush();
+                $off = $ip - $ref - 1;
+                $l   = $len - 2;
+                if ($l < 7) {
+                    $out .= chr(($off >> 8) + ($l << 5));
+                } else {
+                    $out .= chr(($off >> 8) + (7 << 5)) . chr($l - 7);
+                }
+                $out .= chr($off & 0xff);
+
+                for ($k = $ip + 1; $k < $ip + $len && $k + 2 < $inLen; $k++) {
+                    $htab[substr($data, $k, 3)] = $k;
+                }
+                $ip += $len;
+                continue;
+            }
+        }
+
+        $lit .= $data[$ip++];
+        if (strlen($lit) === 32) {
+            $flush();
+        }
+    }
+    $flush();
+
+    $frame = chr($inLen >> 8) . chr($inLen & 0xff) . $out;
+    return strlen($frame) < $inLen ? $frame : null;
+}
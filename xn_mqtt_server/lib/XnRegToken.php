@@ -0,0 +1,60 @@
+<?php
+/**
+ * 设备注册令牌（无状态，HMAC-SHA256 签名）。
+ *
+ * 令牌格式：<过期时间 unix 秒>.<HMAC 前 32 位十六进制>，签名内容为 "<client_id>|<过期时间>"。
+ *  - 完整注册（reg/query）时签发，随 reg/<id>/resp 下发，设备保存到 NVS；
+ *  - 设备重连时只上行 reg/check（负载为令牌），服务器只做一次 HMAC 校验并刷新在线时间，不回复；
+ *  - 修改 XN_REG_TOKEN_SECRET 即可让全部令牌失效，设备下次重连回到完整注册；
+ *  - 密钥未配置或过短时不签发也不接受任何令牌（不会退回到可猜测的默认密钥）。
+ */
+
+const XN_REG_TOKEN_SECRET_MIN_LEN = 16;
+
+/**
+ * 是否已配置可用的签名密钥
+ */
+function xn_reg_token_enabled(): bool
+{
+    return strlen(XN_REG_TOKEN_SECRET) >= XN_REG_TOKEN_SECRET_MIN_LEN;
+}
+
+/**
+ * 为设备签发令牌
+ *
+ * @return array{0: ?string, 1: int} [令牌, 过期时间]，密钥未配置时令牌为 null
+ */
+function xn_reg_token_issue(string $clientId, int $ttl): array
+{
+    if (!xn_reg_token_enabled()) {
+        return [null, 0];
+    }
+
+    $expires = time() + max(60, $ttl);
+    $mac     = substr(hash_hmac('sha256', $clientId . '|' . $expires, XN_REG_TOKEN_SECRET), 0, 32);
+    return [$expires . '.' . $mac, $expires];
+}
+
+/**
+ * 校验设备上报的令牌：签名匹配且未过期
+ */
+function xn_reg_token_verify(string $clientId, string $token): bool
+{
+    if (!xn_reg_token_enabled()) {
+        return false;
+    }
+
+    $token = trim($token);
+    $dot   = strpos($token, '.');
+    if ($dot === false || $dot === 0 || !ctype_digit(substr($token, 0, $dot))) {
+        return false;
+    }
+
+    $expires = (int)substr($token, 0, $dot);
+    if ($expires <= time()) {
+        return false;
+    }
+
+    $expect = substr(hash_hmac('sha256', $clientId . '|' . $expires, XN_REG_TOKEN_SECRET), 0, 32);
+    return hash_equals($expect, substr($token, $dot + 1));
+}
@@ -32,3 +32,6 @@ define('XN_MQTT_KEEPALIVE', 60);
 // 可选：网站常用的 Topic 前缀（应与设备端 base_topic 对应）
 define('XN_MQTT_BASE_TOPIC', 'xn/web');
 define('XN_MQTT_UPLINK_BASE_TOPIC', 'xn/esp');
+
+// 下发指令负载达到该长度（字节）时按设备约定 LZF 压缩（Topic 追加 "/z"），0 表示不压缩
+define('XN_MQTT_COMPRESS_MIN_LEN', 0);